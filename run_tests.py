@@ -48,6 +48,7 @@ for idx in range(0, 1):
 
         expecting_str = False
         expected_output = str()
+        extra_args = list()
         with open(file) as f:
             first_line = f.readline()
             expression = first_line[3:]
@@ -56,9 +57,14 @@ for idx in range(0, 1):
                 expected_output = remove_newlines(first_line[5:])
             else:
                 expected_output = str(eval(expression))
+            # Optional second line with extra compiler arguments
+            second_line = f.readline()
+            if second_line.startswith('// args:'):
+                extra_args = second_line[8:].split()
 
         command_line = ['apoc', file]
         command_line += ['--backend', backend]
+        command_line += extra_args
         command_line += ['--out']
         command_line += ['a.exe']
         start_time = time()
@@ -5,6 +5,7 @@
 #include <Type.h>
 #include <Errors.h>
 #include <Interpret.h>
+#include <RunCache.h>
 
 void
 initialize_analyzer(File_Contents *f)
@@ -475,7 +476,7 @@ analyze_file_level_statement_list(File_Contents *f, Ast_Node *node)
 			if(functions[i]->assignment.rhs)
 			{
 				b32 failed = false;
-				auto val = interpret_expression(functions[i]->assignment.rhs, &failed);
+				auto val = interpret_run(functions[i]->assignment.rhs, &functions[i]->assignment.token, &failed);
 				if(failed)
 					raise_semantic_error(f, "Global expression couldn't be interpreted at compile time", functions[i]->assignment.token);
 				interp_fix_and_add_val(functions[i]->assignment.token.identifier, &val, val.type);
@@ -523,9 +524,9 @@ run_global_runs(File_Contents *f, Ast_Node **top_level)
 	{
 		if(top_level[i]->type == type_run)
 		{
-			get_expression_type(f, top_level[i]->run.to_run, top_level[i]->run.token, top_level[i], NULL);
+			Type_Info type = get_expression_type(f, top_level[i]->run.to_run, top_level[i]->run.token, top_level[i], NULL);
 			b32 failed = false;
-			top_level[i]->run.ran_val = interpret_expression(top_level[i]->run.to_run, &failed);
+			top_level[i]->run.ran_val = interpret_cached_expression(top_level[i]->run.to_run, &type, top_level[i]->run.token, &failed);
 			if(failed)
 				raise_semantic_error(f, "Expression couldn't be run at compile time", *top_level[i]->run.token);
 		}
@@ -567,7 +568,7 @@ analyze_file_level_statement(File_Contents *f, Ast_Node *node)
 			// multiple times, it will save some performance
 			if(node->assignment.rhs)
 			{
-				auto expr = interpret_expression(node->assignment.rhs, &failed);
+				auto expr = interpret_cached_expression(node->assignment.rhs, node->assignment.decl_type, &node->assignment.token, &failed);
 				if(failed)
 					raise_semantic_error(f, "Expression for global declaration is not constant",
 							node->assignment.token);
@@ -991,6 +992,122 @@ is_else_valid(Ast_Node **list, size_t idx)
 	return false;
 }
 
+inline b32
+switch_value_less(i64 a, i64 b, b32 is_unsigned)
+{
+	return is_unsigned ? (u64)a < (u64)b : a < b;
+}
+
+inline Type_Info
+switch_integer_type(Type_Info type)
+{
+	if(type.type == T_ENUM)
+		return *type.enumerator.type;
+	return type;
+}
+
+// Case values have to be constants, enum members are read straight from the enum
+i64
+get_case_constant(File_Contents *f, Ast_Node *expr, Ast_Case *owner, Type_Info *switch_type)
+{
+	Type_Info value_type = get_expression_type(f, expr, owner->token, NULL, NULL);
+	if(!is_integer(switch_integer_type(value_type)) || !check_type_compatibility(*switch_type, value_type))
+	{
+		raise_formated_semantic_error(f, *owner->token, "case value of type %s doesn't match the switch on %s",
+				var_type_to_name(&value_type), var_type_to_name(switch_type));
+	}
+	i64 result = 0;
+	if(expr->type == type_selector && expr->selector.operand_type->type == T_ENUM)
+	{
+		Ast_Enum enumerator = expr->selector.operand_type->enumerator.node->enumerator;
+		result = interp_val_to_i64(enumerator.members[expr->selector.selected_index]->interp_val.val);
+	}
+	else
+	{
+		b32 failed = false;
+		Interp_Val val = interpret_expression(expr, &failed);
+		if(failed || !is_integer(*val.type))
+			raise_semantic_error(f, "case value is not a constant integer expression", *owner->token);
+		result = interp_val_to_i64(val);
+	}
+
+	Type_Info integer_type = switch_integer_type(*switch_type);
+	if(!is_untyped(integer_type))
+	{
+		i32 bits = get_type_size(integer_type) * 8;
+		b32 fits = true;
+		if(bits < 64 && is_signed(integer_type))
+			fits = result >= -(1ll << (bits - 1)) && result < (1ll << (bits - 1));
+		else if(bits < 64)
+			fits = result >= 0 && result < (1ll << bits);
+		if(!fits)
+			raise_formated_semantic_error(f, *owner->token, "case value doesn't fit in the switch type %s",
+					var_type_to_name(switch_type));
+	}
+	return result;
+}
+
+void
+verify_switch(File_Contents *f, Ast_Node *node, Ast_Node *func_node)
+{
+	Ast_Switch *sw = &node->switch_statement;
+	Type_Info switch_type = get_expression_type(f, sw->expr, sw->token, NULL, NULL);
+	if(!is_integer(switch_integer_type(switch_type)))
+	{
+		raise_formated_semantic_error(f, *sw->token, "Cannot switch on a value of type %s, only on integers and enums",
+				var_type_to_name(&switch_type));
+	}
+	// the backends only see the integer an enum is stored as
+	sw->expr_type = switch_integer_type(switch_type);
+	b32 is_unsigned = !is_signed(sw->expr_type);
+
+	sw->ranges = SDCreate(Switch_Range);
+	size_t case_count = SDCount(sw->cases);
+	for(size_t i = 0; i < case_count; ++i)
+	{
+		Ast_Case *c = &sw->cases[i];
+		size_t value_count = SDCount(c->values);
+		for(size_t j = 0; j < value_count; ++j)
+		{
+			Switch_Range range = {};
+			range.case_index = i;
+			range.low = get_case_constant(f, c->values[j].low, c, &switch_type);
+			range.high = range.low;
+			if(c->values[j].high)
+				range.high = get_case_constant(f, c->values[j].high, c, &switch_type);
+			if(switch_value_less(range.high, range.low, is_unsigned))
+				raise_semantic_error(f, "case range is empty, its start is bigger than its end", *c->token);
+			SDPush(sw->ranges, range);
+		}
+		verify_func_level_statement_list(f, c->body, func_node);
+	}
+	if(sw->default_body)
+		verify_func_level_statement_list(f, sw->default_body, func_node);
+
+	// the backends search the ranges in order, so sort them and catch duplicates here
+	size_t range_count = SDCount(sw->ranges);
+	for(size_t i = 1; i < range_count; ++i)
+	{
+		Switch_Range range = sw->ranges[i];
+		size_t j = i;
+		for(; j > 0 && switch_value_less(range.low, sw->ranges[j - 1].low, is_unsigned); --j)
+			sw->ranges[j] = sw->ranges[j - 1];
+		sw->ranges[j] = range;
+	}
+	for(size_t i = 1; i < range_count; ++i)
+	{
+		Switch_Range prev = sw->ranges[i - 1];
+		Switch_Range range = sw->ranges[i];
+		if(!switch_value_less(prev.high, range.low, is_unsigned))
+		{
+			Ast_Case *later = &sw->cases[range.case_index > prev.case_index ? range.case_index : prev.case_index];
+			Ast_Case *earlier = &sw->cases[range.case_index > prev.case_index ? prev.case_index : range.case_index];
+			raise_formated_semantic_error(f, *later->token, "case value is already handled by the case on line %d",
+					(i32)earlier->token->line);
+		}
+	}
+}
+
 void
 verify_func_level_statement(File_Contents *f, Ast_Node *node, Ast_Node *func_node, 
 		Ast_Node *current_list, size_t *idx)
@@ -1109,6 +1226,10 @@ verify_func_level_statement(File_Contents *f, Ast_Node *node, Ast_Node *func_nod
 			Assert(next_node->type == type_scope_start)
 			verify_func_level_statement_list(f, next_node->scope_desc.body, func_node);
 		} break;
+		case type_switch:
+		{
+			verify_switch(f, node, func_node);
+		} break;
 		case type_else:
 		{
 			if(!is_else_valid(current_list->statements.list, *idx - 2))
@@ -1780,7 +1901,7 @@ get_atom_expression_type(File_Contents *f, Ast_Node *expression, Ast_Node *previ
 
 			// @NOTE: verify expression
 			Type_Info result = get_expression_type(f, expression->run.to_run, expression->run.token, expression, info);
-			expression->run.ran_val = interpret_expression(expression->run.to_run, &failed);
+			expression->run.ran_val = interpret_cached_expression(expression->run.to_run, &result, expression->run.token, &failed);
 			if(failed)
 			{
 				raise_semantic_error(f, "Expression cannot be run at compile time",
@@ -76,6 +76,7 @@ typedef enum
 	LINK_EXE,
 	LINK_LD,
 	LINK_WASM_LD,
+	LINK_BUILTIN, // x64_Linker, fast backend on linux only
 } Linker;
 
 typedef enum
@@ -88,12 +89,23 @@ typedef struct
 {
 	u8 *output_file;
 	u8 *linker_command;
+	u8 *run_cache_path;
+	u8 *profile_path;
 	Define_Table *defines;
 	u8  **included_dirs;
 	Platform_Dynamic_Lib  *dynamic_libs;
 	b32 debug_info;
 	b32 call_linker;
 	b32 dump_symbols;
+	b32 interpret_only;
+	b32 ir_memory_report;
+	b32 peephole_report;
+	b32 keep_frames;
+	b32 perf_map;
+	b32 time_passes;
+	u32 jit_threshold;
+	u64 run_step_limit;
+	u64 run_time_limit;
 	Optimization_Level optimization;
 	Target_Arch target;
 	Linker linker;
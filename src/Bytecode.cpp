@@ -1,12 +1,18 @@
 #include <Bytecode.h>
+#include <RegisterAllocator.h>
+#include <Optimizer.h>
 #include <Type.h>
 #include <platform/platform.h>
 #include <Parser.h>
+#include <RunCache.h>
+#include <Threading.h>
 
 static Type_Info *type_64;
 static Type_Info *type_32;
 static Type_Info *type_16;
 static Type_Info *type_u8;
+static Type_Info *type_u64;
+static Type_Info *type_f32;
 static Type_Info *str_type;
 static BC_Function_Table *func_table;
 //static Data_Segment_Table *global_lookup;
@@ -14,8 +20,68 @@ static i32 *overload_table;
 static Type_Info *ptr_type;
 static i32 CALL_MEMCPY_INTRIN;
 
+typedef struct
+{
+	Generate_Bytecode_Args *args;
+	i32 file_index;
+	i32 ir_index;
+} Pending_Function;
+
+// functions of every file, posted once all the file level code is lowered, the jobs read
+// other files' global tables and their IR arrays can't grow after that
+static Pending_Function *pending_functions;
+static i32 pending_file_index;
+
+// @NOTE: shget keeps the index it found in the table's header, the
+// tables shared by the bytecode jobs are looked up with a local one
+#define shared_shget(t, k, temp) \
+	((t) = stbds_hmget_key_ts_wrapper((t), sizeof *(t), (void *)(k), sizeof (t)->key, &(temp), STBDS_HM_STRING), \
+	 (t)[temp].value)
+
 #define COPY_TYPE(DST, SRC) DST = NewType(Type_Info); memcpy(DST, SRC, sizeof(Type_Info))
-#define MAX_BC_PER_BLOCK (1024 * 8)
+// @NOTE: blocks start small and double when they fill up, most blocks
+// made by ifs and loops only hold a handful of instructions
+#define BC_BLOCK_INITIAL_SIZE 16
+#define MAX_BC_PER_BLOCK (1024 * 1024)
+// copies up to this size are done with moves through a register instead of calling memcpy
+#define MAX_INLINE_COPY_SIZE 64
+
+static IR_Memory_Stats ir_memory;
+
+void
+reserve_bytecode(IR_Block *block, i32 capacity)
+{
+	if(capacity <= block->bc_capacity)
+		return;
+	if(capacity > MAX_BC_PER_BLOCK)
+		LG_FATAL("Block %s has more than %d instructions", block->id, MAX_BC_PER_BLOCK);
+
+	Bytecode *new_bc = (Bytecode *)AllocateCompileMemory(sizeof(Bytecode) * capacity);
+	if(block->bc_count)
+		memcpy(new_bc, block->bc, sizeof(Bytecode) * block->bc_count);
+	platform_interlocked_add64(&ir_memory.abandoned_bytes, sizeof(Bytecode) * block->bc_capacity);
+	platform_interlocked_add64(&ir_memory.reserved_bytes, sizeof(Bytecode) * capacity);
+	block->bc = new_bc;
+	block->bc_capacity = capacity;
+}
+
+Bytecode *
+push_bytecode(IR_Block *block, Bytecode bc)
+{
+	if(block->bc_count == block->bc_capacity)
+	{
+		i32 capacity = block->bc_capacity ? block->bc_capacity * 2 : BC_BLOCK_INITIAL_SIZE;
+		if(capacity > MAX_BC_PER_BLOCK)
+			capacity = block->bc_count + 1;
+		reserve_bytecode(block, capacity);
+	}
+	// the register allocator rebuilds blocks from copies, what it
+	// adds between them is put at the instruction before
+	block->line = bc.line;
+	block->column = bc.column;
+	block->bc[block->bc_count++] = bc;
+	return &block->bc[block->bc_count - 1];
+}
 
 IR_Block *
 alloc_block(u8 *id, IR *ir)
@@ -23,11 +89,10 @@ alloc_block(u8 *id, IR *ir)
 	IR_Block *result = (IR_Block *)AllocateCompileMemory(sizeof(IR_Block));
 	result->id = id;
 	result->start_address = 0;
-	// @NOTE: this (8192) should be more than enough instructions for a
-	// block of code that doesn't branch
-	// I feel like it's important for this to be a fast linear allocation
-	// so I am not using a dynamic array
-	result->bc = (Bytecode *)AllocateCompileMemory(sizeof(Bytecode) * MAX_BC_PER_BLOCK);
+	result->line = ir->line;
+	result->column = ir->column;
+	reserve_bytecode(result, BC_BLOCK_INITIAL_SIZE);
+	platform_interlocked_add64(&ir_memory.blocks, 1);
 	SDPush(ir->blocks, result);
 	return result;
 }
@@ -49,35 +114,11 @@ set_terminator(IR_Block *block)
 	block->has_terminator = true;
 }
 
-IR **
-ast_to_bytecode(File_Contents **files)
+void
+bc_initialize_types()
 {
-	shdefault(func_table, -1);
-	i32 func_count = 0;
-	i32 overload_count = 0;
-	auto file_count = SDCount(files);
-	LOOP_FILES {
-		File_Contents *f = files[file_idx];
-		int file_func_count = SDCount(f->functions);
-		for(int i = 0; i < file_func_count; ++i)
-		{
-			shput(func_table, f->functions[i]->identifier, i + func_count);
-		}
-		func_count += file_func_count;
-	}
-
-	LOOP_FILES {
-		File_Contents *f = files[file_idx];
-		int file_overload_count = SDCount(f->overloads);
-		for(int i = 0; i < file_overload_count; ++i)
-		{
-			int position = i + func_count + overload_count;
-			SDPush(overload_table, position);
-		}
-		overload_count += file_overload_count;
-	}
-
-	CALL_MEMCPY_INTRIN = func_count + overload_count;
+	if(type_64)
+		return;
 
 	type_64 = (Type_Info *)AllocateCompileMemory(sizeof(Type_Info));
 	type_64->type = T_INTEGER;
@@ -99,6 +140,16 @@ ast_to_bytecode(File_Contents **files)
 	type_u8->primitive.size = byte1;
 	type_u8->identifier = (u8 *)"u8";
 
+	type_u64 = (Type_Info *)AllocateCompileMemory(sizeof(Type_Info));
+	type_u64->type = T_INTEGER;
+	type_u64->primitive.size = ubyte8;
+	type_u64->identifier = (u8 *)"u64";
+
+	type_f32 = (Type_Info *)AllocateCompileMemory(sizeof(Type_Info));
+	type_f32->type = T_FLOAT;
+	type_f32->primitive.size = real32;
+	type_f32->identifier = (u8 *)"f32";
+
 	str_type = (Type_Info *)AllocateCompileMemory(sizeof(Type_Info));
 	str_type->type = T_POINTER;
 	str_type->pointer.type = type_u8;
@@ -107,11 +158,48 @@ ast_to_bytecode(File_Contents **files)
 	ptr_type = (Type_Info *)AllocateCompileMemory(sizeof(Type_Info));
 	ptr_type->type = T_POINTER;
 	ptr_type->pointer.type = type_64;
+}
+
+IR **
+ast_to_bytecode(File_Contents **files)
+{
+	shdefault(func_table, -1);
+	i32 func_count = 0;
+	i32 overload_count = 0;
+	auto file_count = SDCount(files);
+	LOOP_FILES {
+		File_Contents *f = files[file_idx];
+		int file_func_count = SDCount(f->functions);
+		for(int i = 0; i < file_func_count; ++i)
+		{
+			shput(func_table, f->functions[i]->identifier, i + func_count);
+		}
+		func_count += file_func_count;
+	}
+
+	LOOP_FILES {
+		File_Contents *f = files[file_idx];
+		int file_overload_count = SDCount(f->overloads);
+		for(int i = 0; i < file_overload_count; ++i)
+		{
+			int position = i + func_count + overload_count;
+			SDPush(overload_table, position);
+		}
+		overload_count += file_overload_count;
+	}
+
+	CALL_MEMCPY_INTRIN = func_count + overload_count;
+
+	bc_initialize_types();
 
 	IR **result = SDCreate(IR *);
+	pending_functions = SDCreate(Pending_Function);
 	LOOP_FILES {
 		File_Contents *f = files[file_idx];
 		auto ir = SDCreate(IR);
+		pending_file_index = file_idx;
+		// the table has to exist before the bytecode jobs share it
+		shdefault(f->global_table, -1);
 
 		{
 			IR global_block = {};
@@ -127,10 +215,37 @@ ast_to_bytecode(File_Contents **files)
 		ir = ast_to_bc_file_level_list(f, f->ast_root->statements.list, ir);
 		SDPush(result, ir);
 	}
+
+	size_t pending_count = SDCount(pending_functions);
+	for(size_t i = 0; i < pending_count; ++i)
+	{
+		Generate_Bytecode_Args *args = pending_functions[i].args;
+		args->out = &result[pending_functions[i].file_index][pending_functions[i].ir_index];
+		post_job_listing(JOB_GENERATE_BYTECODE, (void *)generate_bc_function, args);
+	}
+	wait_for_threads();
+
+	LOOP_FILES {
+		IR *ir = result[file_idx];
+		size_t ir_count = SDCount(ir);
+		for(size_t i = 1; i < ir_count; ++i)
+			write_ir_dump(&ir[i], "out.ir");
+	}
 	
 	return result;
 }
 
+void
+queue_bc_function(File_Contents *f, Ast_Node **list, Ast_Node *function, i32 ir_index)
+{
+	Generate_Bytecode_Args *args = (Generate_Bytecode_Args *)AllocateCompileMemory(sizeof(Generate_Bytecode_Args));
+	args->f = f;
+	args->list = list;
+	args->function = function;
+	Pending_Function pending = { args, pending_file_index, ir_index };
+	SDPush(pending_functions, pending);
+}
+
 IR *
 ast_to_bc_file_level_list(File_Contents *f, Ast_Node **list, IR *ir)
 {
@@ -139,8 +254,17 @@ ast_to_bc_file_level_list(File_Contents *f, Ast_Node **list, IR *ir)
 		ir = ast_to_bc_file_level(f, list[i], &ir[0], false);
 	}
 
-	for(size_t i = 0; i < count; ++i) {
-		ir = ast_to_bc_file_level(f, list[i], ir, true);
+	// @NOTE: calls and symbols index functions by their spot in f->functions,
+	// overloaded functions are in it more than once so it has to drive the order
+	// instead of the ast, then the operator overloads go after them
+	size_t func_count = SDCount(f->functions);
+	for(size_t i = 0; i < func_count; ++i) {
+		ir = ast_to_bc_file_level(f, f->functions[i]->node, ir, true);
+	}
+
+	size_t overload_count = SDCount(f->overloads);
+	for(size_t i = 0; i < overload_count; ++i) {
+		ir = ast_to_bc_file_level(f, f->overloads[i], ir, true);
 	}
 	return ir;
 }
@@ -157,7 +281,7 @@ ast_to_bc_file_level(File_Contents *f, Ast_Node *node, IR *ir, b32 gen_func)
 
 			Assert(node->assignment.is_declaration);
 			b32 failed = false;
-			auto value = interpret_expression(node->assignment.rhs, &failed);
+			auto value = interpret_cached_expression(node->assignment.rhs, node->assignment.decl_type, &node->assignment.token, &failed);
 			Data_Segment global_var;
 			global_var.virtual_register = -1;
 			if(ir[0].allocated == NULL || SDCount(ir[0].allocated) == 0)
@@ -168,39 +292,49 @@ ast_to_bc_file_level(File_Contents *f, Ast_Node *node, IR *ir, b32 gen_func)
 				global_var.position = last_segment.position + last_segment.size;
 			}
 			auto size = get_type_size(*value.type);
-			global_var.init_val = (u64)value.pointed;
+			if((value.type->type == T_POINTER || value.type->type == T_FUNC || value.type->type == T_STRING) && value.pointed)
+			{
+				LG_FATAL("Global %s holds a compile time address, it can't be written to the object file",
+						node->assignment.token.identifier);
+			}
+
+			// flatten the interpreted value so the code generator can copy it as is
+			u8 *init_bytes = (u8 *)AllocateCompileMemory(size);
+			memset(init_bytes, 0, size);
+			copy_interp_val_to_memory(init_bytes, &value, value.type);
+			b32 all_zero = true;
+			for(size_t b = 0; b < size && all_zero; ++b)
+				all_zero = init_bytes[b] == 0;
+
+			global_var.init_val = all_zero ? 0 : (u64)init_bytes;
 			global_var.size = size;
+			global_var.alignment = get_type_alignment(*value.type);
+			global_var.symbol_index = -1;
 			SDPush(ir[0].allocated, global_var);
 			shput(f->global_table, node->assignment.token.identifier, SDCount(ir[0].allocated) - 1);
 		} break;
 		case type_func:
 		{
 			if(gen_func) {
-				IR next;
+				IR next = {};
+				SDPush(ir, next);
 				if(node->function.body)
 				{
-					next = ast_to_bc_function(
-							f, node->function.body->scope_desc.body->statements.list,
-							node
-						);
+					queue_bc_function(f, node->function.body->scope_desc.body->statements.list,
+							node, SDCount(ir) - 1);
 				}
-				else
-				{
-					next = {};
-				}
-				SDPush(ir, next);
 			}
 
 		} break;
 		case type_overload:
 		{
 			if(gen_func) {
-				IR next;
+				IR next = {};
+				SDPush(ir, next);
 				Assert(node->overload.function->function.body);
-				next = ast_to_bc_function(f,
+				queue_bc_function(f,
 						node->overload.function->function.body->scope_desc.body->statements.list,
-						node->overload.function);
-				SDPush(ir, next);
+						node->overload.function, SDCount(ir) - 1);
 			}
 
 		} break;
@@ -222,9 +356,9 @@ instruction(i64 big_num, i32 result, BC_OP op, IR_Block *block, Type_Info *type)
 	bc.big_idx = big_num;
 	bc.result = result;
 	bc.type = type;
-	block->bc[block->bc_count++] = bc;
-	Assert(block->bc_count < MAX_BC_PER_BLOCK);
-	return &block->bc[block->bc_count - 1];
+	bc.line = block->line;
+	bc.column = block->column;
+	return push_bytecode(block, bc);
 }
 
 Bytecode *
@@ -236,26 +370,26 @@ instruction(i32 left, i32 right, i32 result, BC_OP op, IR_Block *block, Type_Inf
 	bc.right_idx = right;
 	bc.result = result;
 	bc.type = type;
-	block->bc[block->bc_count++] = bc;
-	Assert(block->bc_count < MAX_BC_PER_BLOCK);
-	return &block->bc[block->bc_count - 1];
+	bc.line = block->line;
+	bc.column = block->column;
+	return push_bytecode(block, bc);
 }
 
 Bytecode *
-out_instruction(i64 big_num, i32 result, BC_OP op, Bytecode *out_bc, size_t *bc_count, Type_Info *type)
+out_instruction(i64 big_num, i32 result, BC_OP op, IR_Block *out, Type_Info *type)
 {
 	Bytecode bc;
 	bc.op = op;
 	bc.big_idx = big_num;
 	bc.result = result;
 	bc.type = type;
-	out_bc[*bc_count] = bc;
-	*bc_count += 1;
-	return &out_bc[*bc_count - 1];
+	bc.line = out->line;
+	bc.column = out->column;
+	return push_bytecode(out, bc);
 }
 
 Bytecode *
-out_instruction(i32 left, i32 right, i32 result, BC_OP op, Bytecode *out_bc, size_t *bc_count, Type_Info *type)
+out_instruction(i32 left, i32 right, i32 result, BC_OP op, IR_Block *out, Type_Info *type)
 {
 	Bytecode bc;
 	bc.op = op;
@@ -263,9 +397,9 @@ out_instruction(i32 left, i32 right, i32 result, BC_OP op, Bytecode *out_bc, siz
 	bc.right_idx = right;
 	bc.result = result;
 	bc.type = type;
-	out_bc[*bc_count] = bc;
-	*bc_count += 1;
-	return &out_bc[*bc_count - 1];
+	bc.line = out->line;
+	bc.column = out->column;
+	return push_bytecode(out, bc);
 }
 
 i32
@@ -304,6 +438,17 @@ call_memcpy(IR *ir, IR_Block *block, i32 src_addr, i32 dst_addr, i32 size)
 	instruction((u64)call, -1, BC_CALL, block, type_64);
 }
 
+void
+inline_memcpy(IR *ir, IR_Block *block, i32 src_addr, i32 dst_addr, i32 size)
+{
+	Type_Info *copy_type = (Type_Info *)AllocateCompileMemory(sizeof(Type_Info));
+	copy_type->type = T_ARRAY;
+	copy_type->array.type = type_u8;
+	copy_type->array.elem_count = size;
+	i32 scratch = allocate_register(ir);
+	instruction(dst_addr, src_addr, scratch, BC_COPY_MEMORY, block, copy_type);
+}
+
 i32
 copy_memory(IR *ir, IR_Block *block, i32 src_register, i32 size)
 {
@@ -311,7 +456,11 @@ copy_memory(IR *ir, IR_Block *block, i32 src_register, i32 size)
 	i32 idx = allocate_stack_space(ir, size);
 	ir->allocated[idx].virtual_register = dst_register;
 	instruction(-1, idx, dst_register, BC_LOAD_ADDRESS, block, ptr_type);
-	call_memcpy(ir, block, src_register, dst_register, size);
+	// the call makes the allocator spill everything that lives in a caller saved register
+	if(size <= MAX_INLINE_COPY_SIZE)
+		inline_memcpy(ir, block, src_register, dst_register, size);
+	else
+		call_memcpy(ir, block, src_register, dst_register, size);
 	return dst_register;
 }
 
@@ -356,22 +505,332 @@ size_to_type(int size)
 	Assert(false);
 }
 
+// functions with a body this small get inlined without being marked $inline
+#define MAX_INLINE_STATEMENTS 4
+#define MAX_INLINE_DEPTH 3
+
+b32
+is_inline_value_type(Type_Info *type)
+{
+	switch(type->type)
+	{
+		case T_UNTYPED_INTEGER:
+		case T_UNTYPED_FLOAT:
+		case T_INTEGER:
+		case T_FLOAT:
+		case T_POINTER:
+		case T_BOOLEAN:
+		case T_ENUM:
+		return true;
+		default:
+		return false;
+	}
+}
+
+b32
+can_inline_expression(Ast_Node *expr)
+{
+	switch((int)expr->type)
+	{
+		case type_identifier:
+		case type_literal:
+		case type_const_str:
+		case type_size:
+		case type_run:
+		case type_overload:
+		return true;
+		case type_binary_expr:
+		return can_inline_expression(expr->left) && can_inline_expression(expr->right);
+		case type_unary_expr:
+		return can_inline_expression(expr->unary_expr.expression);
+		case type_cast:
+		return can_inline_expression(expr->cast.expression);
+		case type_selector:
+		return can_inline_expression(expr->selector.operand);
+		case type_index:
+		return can_inline_expression(expr->index.operand) && can_inline_expression(expr->index.expression);
+		case type_func_call:
+		{
+			size_t count = SDCount(expr->func_call.arguments);
+			for(size_t i = 0; i < count; ++i)
+			{
+				if(!can_inline_expression(expr->func_call.arguments[i]))
+					return false;
+			}
+			return can_inline_expression(expr->func_call.operand);
+		}
+		default:
+		return false;
+	}
+}
+
+// Only straight line bodies are inlined, declarations, assignments and calls,
+// with the only return being the last statement
+b32
+can_inline_function(Ast_Node *function)
+{
+	Ast_Func *func = &function->function;
+	if(!func->body || func->flags & (FF_HAS_VAR_ARGS | FF_IS_INTERP_ONLY | FF_IS_INTRINSIC))
+		return false;
+
+	Type_Info *ret_type = func->type->func.return_type;
+	if(ret_type->type != T_VOID && !is_inline_value_type(ret_type))
+		return false;
+
+	size_t arg_count = SDCount(func->arguments);
+	for(size_t i = 0; i < arg_count; ++i)
+	{
+		if(!is_inline_value_type(func->arguments[i]->variable.type))
+			return false;
+	}
+
+	Ast_Node **list = func->body->scope_desc.body->statements.list;
+	size_t count = SDCount(list);
+	size_t statement_count = 0;
+	b32 returned = false;
+	for(size_t i = 0; i < count; ++i)
+	{
+		Ast_Node *node = list[i];
+		if(node->type == type_scope_end)
+			continue;
+		if(returned)
+			return false;
+
+		statement_count++;
+		switch((int)node->type)
+		{
+			case type_func_call:
+			{
+				if(!can_inline_expression(node))
+					return false;
+			} break;
+			case type_assignment:
+			{
+				if(node->assignment.rhs && !can_inline_expression(node->assignment.rhs))
+					return false;
+				if(node->assignment.is_declaration)
+				{
+					if(!node->assignment.rhs || !is_inline_value_type(node->assignment.decl_type))
+						return false;
+				}
+				else if(!can_inline_expression(node->assignment.lhs))
+					return false;
+			} break;
+			case type_return:
+			{
+				if(node->ret.expression && !can_inline_expression(node->ret.expression))
+					return false;
+				returned = true;
+			} break;
+			default:
+			return false;
+		}
+	}
+	if(ret_type->type != T_VOID && !returned)
+		return false;
+
+	if(func->flags & FF_INLINE)
+		return true;
+	return statement_count <= MAX_INLINE_STATEMENTS && get_bc_optimization() >= OPT_SOME;
+}
+
+// Returns the function node to inline for this call, or NULL if it should be called.
+// Only functions from this file, or operator overloads, are looked up
+Ast_Node *
+find_inline_callee(File_Contents *f, IR *ir, Ast_Node *call, File_Contents **callee_file)
+{
+	if(!f || ir->inline_depth >= MAX_INLINE_DEPTH)
+		return NULL;
+
+	Ast_Node *operand = call->func_call.operand;
+	Ast_Node *function = NULL;
+	*callee_file = f;
+	if(operand->type == type_overload)
+	{
+		function = operand->overload.function;
+		*callee_file = operand->overload.f;
+	}
+	else
+	{
+		u8 *name = call->func_call.overload_name;
+		if(!name)
+		{
+			if(operand->type != type_identifier)
+				return NULL;
+			name = operand->identifier.name;
+		}
+		// a local variable holding a function pointer
+		if(shget(ir->lookup, name) != -1)
+			return NULL;
+
+		i32 index = find_function_index(f, name);
+		if(index == -1)
+			return NULL;
+		function = f->functions[index]->node;
+	}
+
+	if(!function || function->type != type_func || !can_inline_function(function))
+		return NULL;
+	return function;
+}
+
+i32
+inline_function_call(File_Contents *f, IR *ir, IR_Block *block, Ast_Node *node, Ast_Node *function, File_Contents *callee_file)
+{
+	Ast_Func *func = &function->function;
+	size_t arg_count = SDCount(func->arguments);
+
+	// evaluate the arguments with the caller's variables before switching scopes,
+	// each gets its own register so the callee can't write to a caller's variable
+	i32 *args = (i32 *)AllocateCompileMemory(sizeof(i32) * (arg_count + 1));
+	for(size_t i = 0; i < arg_count; ++i)
+	{
+		Type_Info *param_type = func->arguments[i]->variable.type;
+		i32 expr_reg = expression_to_bc(f, node->func_call.arguments[i], block, ir, false);
+		i32 casted = do_cast(expr_reg, &node->func_call.expr_types[i], param_type, ir, block);
+		if(casted == -1)
+			casted = expr_reg;
+
+		args[i] = allocate_register(ir);
+		instruction(args[i], casted, args[i], BC_MOVE_REG_TO_REG, block, param_type);
+	}
+
+	Data_Segment_Table *caller_lookup = ir->lookup;
+	ir->lookup = NULL;
+	shdefault(ir->lookup, -1);
+	ir->inline_depth++;
+
+	for(size_t i = 0; i < arg_count; ++i)
+	{
+		auto arg = &func->arguments[i]->variable;
+		i32 idx = allocate_stack_space(ir, get_type_size(*arg->type));
+		ir->allocated[idx].virtual_register = args[i];
+		do_store_instruction(idx, args[i], args[i], block, arg->type, true);
+		shput(ir->lookup, arg->identifier.name, idx);
+	}
+
+	i32 result = -1;
+	Ast_Node **list = func->body->scope_desc.body->statements.list;
+	size_t count = SDCount(list);
+	for(i32 i = 0; i < count; ++i)
+	{
+		if(list[i]->type != type_return)
+		{
+			ast_to_bc_func_level(callee_file, list[i], block, list, &i, ir, NULL);
+			continue;
+		}
+		if(!list[i]->ret.expression)
+			continue;
+
+		Type_Info *ret_type = func->type->func.return_type;
+		i32 ret_reg = expression_to_bc(callee_file, list[i]->ret.expression, block, ir, false);
+		i32 casted = do_cast(ret_reg, &list[i]->ret.expression_type, ret_type, ir, block);
+		if(casted == -1)
+			casted = ret_reg;
+
+		result = allocate_register(ir);
+		instruction(result, casted, result, BC_MOVE_REG_TO_REG, block, ret_type);
+	}
+
+	ir->inline_depth--;
+	shfree(ir->lookup);
+	ir->lookup = caller_lookup;
+	return result;
+}
+
+// The lanes are stored to an aligned stack slot and loaded back as one vector,
+// a single lane is copied to all four
+i32
+vector_from_lanes(IR *ir, IR_Block *block, i32 *lanes, i32 lane_count, Type_Info *lane_type, Type_Info *vector_type)
+{
+	if(SDCount(ir->allocated) != 0)
+		padd_to_alignment(16, ir);
+	i32 slot = allocate_stack_space(ir, 16);
+	i32 lane_size = get_type_size(*vector_type) / 4;
+	for(i32 i = 0; i < 4; ++i)
+	{
+		i32 address = allocate_register(ir);
+		instruction(-1, slot, address, BC_LOAD_ADDRESS, block, ptr_type);
+		if(i != 0)
+		{
+			i32 offset_register = allocate_register(ir);
+			instruction(i * lane_size, offset_register, BC_MOVE_VALUE_TO_REG, block, type_64);
+			instruction(address, offset_register, address, BC_OFFSET_POINTER, block, ptr_type);
+		}
+		instruction(address, lanes[lane_count == 1 ? 0 : i], -1, BC_STORE_REG, block, lane_type);
+	}
+	i32 result = allocate_register(ir);
+	instruction(-1, slot, result, BC_LOAD_STACK, block, vector_type);
+	return result;
+}
+
+// get_f128 and get_i128 from Basic.apoc, the other intrinsics are called
+b32
+is_vector_intrinsic(Ast_Node *call)
+{
+	Ast_Node *operand = call->func_call.operand;
+	if(operand->type != type_identifier)
+		return false;
+	Symbol *sym = operand->identifier.symbol_spot;
+	if(sym && sym->node && sym->node->type == type_func && !(sym->node->function.flags & FF_IS_INTRINSIC))
+		return false;
+	Type_Info *return_type = call->func_call.operand_type.func.return_type;
+	if(!return_type || !is_vector(*return_type))
+		return false;
+	return vstd_strcmp((char *)operand->identifier.name, (char *)"get_f128") ||
+		vstd_strcmp((char *)operand->identifier.name, (char *)"get_i128");
+}
+
+i32
+vector_intrinsic_to_bc(File_Contents *f, IR *ir, IR_Block *block, Ast_Node *node)
+{
+	i32 arg_count = SDCount(node->func_call.arguments);
+	if(arg_count != 1 && arg_count != 4)
+		LG_FATAL("%s takes 1 or 4 arguments", node->func_call.operand->identifier.name);
+
+	Type_Info *param_types = node->func_call.operand_type.func.param_types;
+	i32 lanes[4];
+	for(i32 i = 0; i < arg_count; ++i)
+	{
+		i32 expr_reg = expression_to_bc(f, node->func_call.arguments[i], block, ir, false);
+		i32 casted = do_cast(expr_reg, &node->func_call.expr_types[i], &param_types[i], ir, block);
+		lanes[i] = casted == -1 ? expr_reg : casted;
+	}
+	return vector_from_lanes(ir, block, lanes, arg_count, &param_types[0], node->func_call.operand_type.func.return_type);
+}
+
+// A call that's returned as is can reuse the caller's frame, the register
+// allocator turns it into a jump when nothing points into that frame
 i32
-call_function(File_Contents *f, IR *ir, IR_Block *block, Ast_Node *node, Call_Conv conv)
+call_function(File_Contents *f, IR *ir, IR_Block *block, Ast_Node *node, Call_Conv conv, b32 tail_position)
 {
+	if(is_vector_intrinsic(node))
+		return vector_intrinsic_to_bc(f, ir, block, node);
+
+	File_Contents *callee_file = NULL;
+	Ast_Node *inlined = find_inline_callee(f, ir, node, &callee_file);
+	if(inlined)
+		return inline_function_call(f, ir, block, node, inlined, callee_file);
+
 	i32 expr_count = SDCount(node->func_call.arguments);
 	// + 1 incase we need to pass the context
 	i32 *expressions = (i32 *)AllocateCompileMemory(sizeof(i32) * (expr_count + 1));
 
-	Type_Info ret_type = {};
 	b32 is_apoc = conv == CALL_APOC;
-	b32 ret_ptr = false;
-	if(get_type_size(*node->func_call.operand_type.func.return_type) > 8)
+	// vectors come back in xmm0
+	Type_Info *ret_type = node->func_call.operand_type.func.return_type;
+	b32 ret_ptr = get_type_size(*ret_type) > 8 && !is_vector(*ret_type);
+	// @NOTE: the return type belongs to the callee and other jobs lower calls to it
+	// at the same time, so the call through a pointer gets its own void returning type
+	Type_Info *call_type = &node->func_call.operand_type;
+	if(ret_ptr)
 	{
-		ret_type = *node->func_call.operand_type.func.return_type;
-		node->func_call.operand_type.func.return_type->type = T_VOID;
-		node->func_call.operand_type.func.return_type->identifier = (u8 *)"void";
-		ret_ptr = true;
+		Type_Info *void_type = (Type_Info *)AllocateCompileMemory(sizeof(Type_Info));
+		void_type->type = T_VOID;
+		void_type->identifier = (u8 *)"void";
+		call_type = (Type_Info *)AllocateCompileMemory(sizeof(Type_Info));
+		*call_type = node->func_call.operand_type;
+		call_type->func.return_type = void_type;
 	}
 
 	auto expr_types = (Type_Info **)AllocateCompileMemory(sizeof(void *) * (expr_count + (is_apoc ? 1 : 0)));
@@ -379,14 +838,25 @@ call_function(File_Contents *f, IR *ir, IR_Block *block, Ast_Node *node, Call_Co
 	
 	if(is_apoc)
 	{
-		i32 context_idx = bc_create_context(ir);
-
-		i32 context_ptr = allocate_register(ir);
-		instruction(-1, context_idx, context_ptr, BC_LOAD_ADDRESS, block, ptr_type);
+		i32 context_ptr;
+		i32 context_idx = -1;
+		if(tail_position && !ret_ptr && shget(ir->lookup, "__apoc_internal_context") != -1 && can_omit_frames())
+		{
+			// nothing is returned through the context so the callee can get the
+			// one we were called with, the address of a new one would keep our
+			// frame alive
+			context_ptr = load_variable(f, (u8 *)"__apoc_internal_context", ir, block, ptr_type);
+		}
+		else
+		{
+			context_idx = bc_create_context(ir);
+			context_ptr = allocate_register(ir);
+			instruction(-1, context_idx, context_ptr, BC_LOAD_ADDRESS, block, ptr_type);
+		}
 		if(ret_ptr)
 		{
 
-			i32 ret_idx = allocate_stack_space(ir, get_type_size(ret_type));
+			i32 ret_idx = allocate_stack_space(ir, get_type_size(*ret_type));
 			ret_address = allocate_register(ir);
 			ir->allocated[ret_idx].virtual_register = ret_address;
 			instruction(-1, ret_idx, ret_address, BC_LOAD_ADDRESS, block, ptr_type);
@@ -464,22 +934,21 @@ call_function(File_Contents *f, IR *ir, IR_Block *block, Ast_Node *node, Call_Co
 	call->expressions = expressions;
 	call->expr_count = expr_count;
 	call->expr_types = expr_types;
-	instruction((u64)call, -1, BC_CALL, block, &node->func_call.operand_type);
+	instruction((u64)call, -1, BC_CALL, block, call_type);
 
 	if(ret_address != -1)
 	{
-		*node->func_call.operand_type.func.return_type = ret_type;
-		instruction(ret_address, -1, result, BC_DEREFRENCE, block, node->func_call.operand_type.func.return_type);
+		instruction(ret_address, -1, result, BC_DEREFRENCE, block, ret_type);
 	}
 	else
 	{
-		if(node->func_call.operand_type.func.return_type->type == T_VOID)
+		if(ret_type->type == T_VOID)
 			return -1;
 
-		if(is_float(*node->func_call.operand_type.func.return_type))
-			instruction(result, reg_xmm0, result, BC_MOVE_REG_TO_REG, block, node->func_call.operand_type.func.return_type);
+		if(is_float(*ret_type) || is_vector(*ret_type))
+			instruction(result, reg_xmm0, result, BC_MOVE_REG_TO_REG, block, ret_type);
 		else
-			instruction(result, reg_a, result, BC_MOVE_REG_TO_REG, block, node->func_call.operand_type.func.return_type);
+			instruction(result, reg_a, result, BC_MOVE_REG_TO_REG, block, ret_type);
 	}
 	return result;
 }
@@ -515,7 +984,9 @@ val_to_register(Interp_Val *val, IR *ir, IR_Block *block)
 		Assert(false);
 	}
 	bc.type = typed;
-	block->bc[block->bc_count++] = bc;
+	bc.line = block->line;
+	bc.column = block->column;
+	push_bytecode(block, bc);
 	return bc.result;
 }
 
@@ -529,10 +1000,11 @@ load_variable(File_Contents *f, u8 *id, IR *ir, IR_Block *block, Type_Info *type
 	{
 		result = allocate_register(ir);
 		op = BC_LOAD_DATA_SEG;
-		got = shget(f->global_table, id);
+		ptrdiff_t temp;
+		got = shared_shget(f->global_table, id, temp);
 		if(got == -1)
 		{
-			got = shget(func_table, id);
+			got = shared_shget(func_table, id, temp);
 			Assert(got != -1);
 			instruction(-1, got, result, BC_MOVE_FUNCTION_TO_REG, block, type);
 			return result;
@@ -575,11 +1047,12 @@ load_pointer(File_Contents *f, u8 *id, IR *ir, IR_Block *block, Type_Info *type)
 	if(got == -1)
 	{
 		op = BC_GLOBAL_ADDRESS;
-		got = shget(f->global_table, id);
+		ptrdiff_t temp;
+		got = shared_shget(f->global_table, id, temp);
 		if(got == -1)
 		{
 			op = BC_MOVE_FUNCTION_TO_REG;
-			got = shget(func_table, id);
+			got = shared_shget(func_table, id, temp);
 			Assert(got != -1);
 
 			i32 result = allocate_register(ir);
@@ -655,7 +1128,7 @@ atom_expr_to_bc(File_Contents *f, Ast_Node *expr, IR_Block *block, IR *ir, b32 g
 		case type_func_call:
 		{
 			Assert(expr->func_call.operand_type.type == T_FUNC);
-			result = call_function(f, ir, block, expr, (Call_Conv)expr->func_call.operand_type.func.calling_convention);
+			result = call_function(f, ir, block, expr, (Call_Conv)expr->func_call.operand_type.func.calling_convention, false);
 		} break;
 		case type_index:
 		{
@@ -663,7 +1136,7 @@ atom_expr_to_bc(File_Contents *f, Ast_Node *expr, IR_Block *block, IR *ir, b32 g
 			// we want to derefrence them so we pass false get_pointer
 			// but arrays are just the first element so we
 			// pass true to get_pointer if it's an array
-			result = expression_to_bc(f, expr->index.operand, block, ir, expr->index.operand_type.type != T_POINTER);
+			i32 base = expression_to_bc(f, expr->index.operand, block, ir, expr->index.operand_type.type != T_POINTER);
 			i64 type_size;
 			Type_Info *out_type = NULL;
 			if(expr->index.operand_type.type == T_POINTER)
@@ -701,12 +1174,16 @@ atom_expr_to_bc(File_Contents *f, Ast_Node *expr, IR_Block *block, IR *ir, b32 g
 			instruction(reg_d, reg_d, reg_d, BC_BIT_XOR, block, type_64);
 			// Multiply the index by the size off the pointer type
 			instruction(reg_a_virtual, reg_c_virtual, reg_a_virtual, BC_I_MUL, block, type_64);
-			// Offset the pointer to get to the destination
-			instruction(result, reg_a_virtual, result, BC_OFFSET_POINTER, block, ptr_type);
+			// Offset the pointer to get to the destination, into a new register since
+			// the base can be a variable that's still live after this
+			result = allocate_register(ir);
+			instruction(base, reg_a_virtual, result, BC_OFFSET_POINTER, block, ptr_type);
 			if(!get_pointer)
 			{
-				// Derefrence if needed
-				instruction(result, -1, result, BC_DEREFRENCE, block, out_type);
+				// Derefrence if needed, floats and vectors can't share the pointer's register
+				i32 address = result;
+				result = allocate_register(ir);
+				instruction(address, -1, result, BC_DEREFRENCE, block, out_type);
 			}
 		} break;
 		case type_selector:
@@ -784,18 +1261,65 @@ unary_expression_to_bc(File_Contents *f, Ast_Node *expr, IR_Block *block, IR *ir
 			case '-':
 			{
 				i32 expr_reg = expression_to_bc(f, expr->unary_expr.expression, block, ir, false);
-				if(is_float(expr->unary_expr.expr_type))
+				Type_Info *type = &expr->unary_expr.expr_type;
+				if(is_untyped(*type))
+				{
+					// negated literals, the value was loaded as its default type
+					Type_Info *typed = (Type_Info *)AllocateCompileMemory(sizeof(Type_Info));
+					*typed = untyped_to_type(*type);
+					type = typed;
+				}
+				if(is_vector(*type))
+				{
+					// f128 flips the sign bits, i128 is subtracted from zero
+					Interp_Val lane = {};
+					lane.type = type->type == T_FLOAT ? type_f32 : type_32;
+					if(type->type == T_FLOAT)
+						lane._f32 = -0.0f;
+					i32 lane_register = val_to_register(&lane, ir, block);
+					i32 other = vector_from_lanes(ir, block, &lane_register, 1, lane.type, type);
+					result = allocate_register(ir);
+					if(type->type == T_FLOAT)
+					{
+						instruction(result, expr_reg, result, BC_MOVE_REG_TO_REG, block, type);
+						instruction(result, other, result, BC_BIT_XOR, block, type);
+					}
+					else
+					{
+						instruction(result, other, result, BC_MOVE_REG_TO_REG, block, type);
+						instruction(result, expr_reg, result, BC_SUB, block, type);
+					}
+				}
+				else if(is_float(*type))
 				{
 					result = allocate_register(ir);
-					instruction(expr_reg, -1, result, BC_FNEG, block, &expr->unary_expr.expr_type);
+					instruction(expr_reg, -1, result, BC_FNEG, block, type);
 				}
 				else
 				{
 					result = expr_reg;
-					instruction(expr_reg, -1, expr_reg, BC_NEG, block, &expr->unary_expr.expr_type);
+					instruction(expr_reg, -1, expr_reg, BC_NEG, block, type);
 				}
 			} break;
-			case '!':
+			case tok_plusplus:
+			case tok_minusminus:
+			{
+				// prefix, the stored value is the result
+				Type_Info *type = &expr->unary_expr.expr_type;
+				if(!is_integer(*type))
+					LG_FATAL("++ and -- are only implemented for integers in bytecode");
+				i32 address = expression_to_bc(f, expr->unary_expr.expression, block, ir, true);
+				i32 value = allocate_register(ir);
+				instruction(address, -1, value, BC_DEREFRENCE, block, type);
+				i32 one = allocate_register(ir);
+				instruction(1, one, BC_MOVE_VALUE_TO_REG, block, type);
+				result = allocate_register(ir);
+				instruction(result, value, result, BC_MOVE_REG_TO_REG, block, type);
+				BC_OP op = expr->unary_expr.op->type == tok_plusplus ? BC_ADD : BC_SUB;
+				instruction(result, one, result, op, block, type);
+				instruction(address, result, -1, BC_STORE_REG, block, type);
+			} break;
+			case '!':
 			{
 				i32 expr_reg = expression_to_bc(f, expr->unary_expr.expression, block, ir, false);
 				Assert(expr->unary_expr.expr_type.type == T_BOOLEAN);
@@ -839,10 +1363,21 @@ expression_to_bc(File_Contents *f, Ast_Node *expr, IR_Block *block, IR *ir, b32
 		return unary_expression_to_bc(f, expr, block, ir, get_pointer);
 	}
 
+	int op = (int)expr->binary_expr.op;
+	if(is_vector(expr->binary_expr.left))
+	{
+		// lane wise, the integer ones don't have a packed multiply or divide
+		b32 is_supported = op == '+' || op == '-' || op == tok_bits_and || op == tok_bits_xor || op == tok_bits_or ||
+			(is_float(expr->binary_expr.left) && (op == '*' || op == '/'));
+		if(!is_supported)
+			LG_FATAL("The fast backend doesn't support this operator on %s vectors",
+					var_type_to_name(&expr->binary_expr.left));
+	}
+
 	i32 left  = expression_to_bc(f, expr->left, block, ir, get_pointer);
 	i32 right = expression_to_bc(f, expr->right, block, ir, get_pointer);
 	i32 result = allocate_register(ir);
-	switch((int)expr->binary_expr.op)
+	switch(op)
 	{
 		case '+':
 		{
@@ -906,14 +1441,15 @@ expression_to_bc(File_Contents *f, Ast_Node *expr, IR_Block *block, IR *ir, b32
 				instruction(left, right, result, BC_F_DIV, block, &expr->binary_expr.left);
 			}
 			else {
+				i32 right_rc = allocate_register(ir);
 				instruction(reg_a, left, result, BC_MOVE_REG_TO_REG, block, &expr->binary_expr.left);
-				instruction(reg_c, right, right, BC_MOVE_REG_TO_REG, block, &expr->binary_expr.left);
+				instruction(reg_c, right, right_rc, BC_MOVE_REG_TO_REG, block, &expr->binary_expr.left);
 				instruction(reg_d, reg_d, reg_d, BC_BIT_XOR, block, &expr->binary_expr.left);
 				if(is_signed(expr->binary_expr.left)) {
-					instruction(result, right, result, BC_I_DIV, block, &expr->binary_expr.left);
+					instruction(result, right_rc, result, BC_I_DIV, block, &expr->binary_expr.left);
 				}
 				else {
-					instruction(result, right, result, BC_U_DIV, block, &expr->binary_expr.left);
+					instruction(result, right_rc, result, BC_U_DIV, block, &expr->binary_expr.left);
 				}
 			}
 		} break;
@@ -927,14 +1463,15 @@ expression_to_bc(File_Contents *f, Ast_Node *expr, IR_Block *block, IR *ir, b32
 			else
 			{
 				Assert(false);
+				i32 right_rc = allocate_register(ir);
 				instruction(reg_a, left, result, BC_MOVE_REG_TO_REG, block, &expr->binary_expr.left);
-				instruction(reg_c, right, right, BC_MOVE_REG_TO_REG, block, &expr->binary_expr.left);
+				instruction(reg_c, right, right_rc, BC_MOVE_REG_TO_REG, block, &expr->binary_expr.left);
 				instruction(reg_d, reg_d, reg_d, BC_BIT_XOR, block, &expr->binary_expr.left);
 				if(is_signed(expr->binary_expr.left)) {
-					instruction(result, right, result, BC_I_REM, block, &expr->binary_expr.left);
+					instruction(result, right_rc, result, BC_I_REM, block, &expr->binary_expr.left);
 				}
 				else {
-					instruction(result, right, result, BC_U_REM, block, &expr->binary_expr.left);
+					instruction(result, right_rc, result, BC_U_REM, block, &expr->binary_expr.left);
 				}
 			}
 		} break;
@@ -1091,18 +1628,6 @@ do_store_instruction(i32 idx, i32 right, i32 result, IR_Block *block, Type_Info
 		instruction(idx, right, result, BC_STORE, block, type);
 }
 
-void
-do_out_store_instruction(i32 idx, i32 right, i32 result, Bytecode *out_bc, size_t *out_count, Type_Info *type, IR *ir)
-{
-	if(type->type == T_STRING)
-		*type = *str_type;
-	out_instruction(idx, right, result, BC_STORE, out_bc, out_count, type);
-
-	i32 position = idx == 0 ? idx : ir->allocated[idx - 1].position + ir->allocated[idx - 1].size;
-	Data_Segment item = {0, (u64)get_type_size(*type), position};
-	SDPush(ir->allocated, item);
-}
-
 i32
 allocate_stack_space(IR *ir, size_t size)
 {
@@ -1209,13 +1734,17 @@ ast_to_bc_func_level_list(File_Contents *f, Ast_Node **list, i32 *optional_index
 	{
 		block = alloc_block(id, ir);
 	}
+	// @NOTE: an if statement takes the rest of the list into its after block
+	// and branches to to_go by itself, otherwise we have to do it here
+	b32 branched = false;
 	auto statement_count = SDCount(list);
 	if(optional_index)
 	{
 		i32 i = *optional_index;
 		for(; i < statement_count; ++i)
 		{
-			ast_to_bc_func_level(f, list[i], block, list, &i, ir, to_go);
+			if(ast_to_bc_func_level(f, list[i], block, list, &i, ir, to_go))
+				branched = true;
 			*optional_index = i;
 		}
 	}
@@ -1223,16 +1752,19 @@ ast_to_bc_func_level_list(File_Contents *f, Ast_Node **list, i32 *optional_index
 	{
 		for(i32 i = 0; i < statement_count; ++i)
 		{
-			ast_to_bc_func_level(f, list[i], block, list, &i, ir, to_go);
+			if(ast_to_bc_func_level(f, list[i], block, list, &i, ir, to_go))
+				branched = true;
 		}
 	}
+	if(!branched)
+		bc_branch(block, to_go);
 	return block;
 }
 
 IR_Block *
-ast_to_bc_func_level_list(Ast_Node **list, i32 *optional_index, IR_Block *optional_block, const char *id, IR *ir, IR_Block *to_go)
+ast_to_bc_func_level_list(File_Contents *f, Ast_Node **list, i32 *optional_index, IR_Block *optional_block, const char *id, IR *ir, IR_Block *to_go)
 {
-	return ast_to_bc_func_level_list(list, optional_index, optional_block, id, ir, to_go);
+	return ast_to_bc_func_level_list(f, list, optional_index, optional_block, (u8 *)id, ir, to_go);
 }
 
 void
@@ -1275,7 +1807,7 @@ get_function_arguments(Ast_Node *function, IR *ir, IR_Block *block)
 		{
 			type = size_to_type(get_type_size(*type));
 		}
-		if(is_float(*type))
+		if(is_float(*type) || is_vector(*type))
 		{
 			if(float_register_count < sizeof(float_register_order) / sizeof(Register))
 			{
@@ -1310,6 +1842,42 @@ get_function_arguments(Ast_Node *function, IR *ir, IR_Block *block)
 
 IR
 ast_to_bc_function(File_Contents *f, Ast_Node **list, Ast_Node *function)
+{
+	IR result = generate_bc_function(f, list, function);
+	write_ir_dump(&result, "out.ir");
+	return result;
+}
+
+void
+ir_to_dump(IR *ir, Ast_Node *function)
+{
+	size_t block_count = SDCount(ir->blocks);
+	size_t to_allocate = 1024;
+	for(size_t i = 0; i < block_count; ++i)
+		to_allocate += vstd_strlen((char *)ir->blocks[i]->id) + 2 + 128 * ir->blocks[i]->bc_count;
+
+	// Write function signature to be able to read ir
+	char *dump = (char *)AllocateCompileMemory(to_allocate);
+	size_t dump_size = vstd_sprintf(dump, "\nfn %s -> %s:\n", function->function.identifier.name,
+			var_type_to_name(function->function.type));
+	for(size_t i = 0; i < block_count; ++i)
+	{
+		dump_size += vstd_sprintf(dump + dump_size, "%s:\n", ir->blocks[i]->id);
+		dump_size += bytecode_to_text(ir, ir->blocks[i], dump + dump_size);
+	}
+	ir->dump = dump;
+	ir->dump_size = dump_size;
+}
+
+void
+write_ir_dump(IR *ir, const char *path)
+{
+	if(ir->dump)
+		platform_write_file(ir->dump, ir->dump_size, path, false);
+}
+
+IR
+generate_bc_function(File_Contents *f, Ast_Node **list, Ast_Node *function)
 {
 	IR result = {};
 	result.blocks = SDCreate(IR_Block*);
@@ -1319,6 +1887,13 @@ ast_to_bc_function(File_Contents *f, Ast_Node **list, Ast_Node *function)
 	result.bc_count = 0;
 	result.stack_top = 16;
 	shdefault(result.lookup, -1);
+	// the prologue and the arguments are at the declaration
+	Token_Iden *token = function->function.identifier.token;
+	if(token)
+	{
+		result.line = (u32)token->line;
+		result.column = (u32)token->column;
+	}
 
 	IR_Block *entry = alloc_block("entry", &result);
 	instruction(reg_bp, -1, -1, BC_PUSH_REG, entry, type_64);
@@ -1326,30 +1901,14 @@ ast_to_bc_function(File_Contents *f, Ast_Node **list, Ast_Node *function)
 	get_function_arguments(function, &result, entry);
 	ast_to_bc_func_level_list(f, list, NULL, entry, (u8 *)"entry", &result, NULL);
 
-	// Write function signature to file to be able to read ir
-	u8 func_signature[1024] = {};
-	i32 signature_size = vstd_sprintf((char *)func_signature, "\nfn %s -> %s:\n", function->function.identifier.name,
-			var_type_to_name(function->function.type));
-	platform_write_file(func_signature, signature_size, "out.ir", false);
+	optimize_ir(&result);
 	size_t block_count = SDCount(result.blocks);
 
 #if 1
-	write_blocks_to_file(&result, "out.ir");
+	ir_to_dump(&result, function);
 #endif
 
-
-	Virtual_Register_Tracker allocated[result.reg_count];
-	for(size_t i = 0; i < result.reg_count; ++i)
-	{
-		allocated[i].in_memory = -1;
-		allocated[i].in_register = reg_invalid;
-	}
-	for(size_t i = 0; i < block_count; ++i)
-	{
-		do_register_allocation(&result, result.blocks[i], allocated);
-		for(size_t i = 0; i < result.reg_count; ++i)
-			allocated[i].in_register = reg_invalid;
-	}
+	allocate_registers(&result);
 
 	for(size_t i = 0; i < block_count; ++i)
 	{
@@ -1358,11 +1917,8 @@ ast_to_bc_function(File_Contents *f, Ast_Node **list, Ast_Node *function)
 
 	}
 
-	// @NOTE: is this necessary?
-	// it should be pretty cheap since it's 2 tight loops
-	// but it's better to profile it when there are actually programs
-	// to profile it on
-	remove_useless_stores(&result);
+	allocate_stack_slots(&result);
+	lower_frame(&result);
 #if 0
 	write_blocks_to_file(&result, "out.ir");
 #endif
@@ -1370,6 +1926,18 @@ ast_to_bc_function(File_Contents *f, Ast_Node **list, Ast_Node *function)
 	return result;
 }
 
+void
+bc_print_memory_report()
+{
+	u64 used_bytes = ir_memory.instructions * sizeof(Bytecode);
+	LG_INFO("IR blocks:         %llu", ir_memory.blocks);
+	LG_INFO("IR instructions:   %llu", ir_memory.instructions);
+	LG_INFO("Largest block:     %llu", ir_memory.largest_block);
+	LG_INFO("IR bytes reserved: %llu", ir_memory.reserved_bytes);
+	LG_INFO("IR bytes in use:   %llu", used_bytes);
+	LG_INFO("IR bytes outgrown: %llu", ir_memory.abandoned_bytes);
+}
+
 void
 write_blocks_to_file(IR *ir, char *path)
 {
@@ -1399,6 +1967,87 @@ bc_cond_branch(i32 expression_register, IR_Block *from, IR_Block *_true, IR_Bloc
 	bc_branch(from, _false);
 }
 
+b32
+is_compare_op(BC_OP op)
+{
+	return op >= BC_CMP_I_EQ && op <= BC_FCMP_GREATER_EQ;
+}
+
+i32
+bc_jump_target_count(IR *ir, Bytecode *bc)
+{
+	switch(bc->op)
+	{
+		case BC_JUMP:
+		case BC_COND_JUMP:
+			return 1;
+		case BC_JUMP_TABLE:
+			return ir->jump_tables[bc->right_idx].count;
+		default:
+			return 0;
+	}
+}
+
+IR_Block *
+bc_jump_target(IR *ir, Bytecode *bc, i32 i)
+{
+	if(bc->op == BC_JUMP_TABLE)
+		return ir->jump_tables[bc->right_idx].targets[i];
+	return (IR_Block *)bc->big_idx;
+}
+
+// The compare a conditional jump without a register takes its flags from
+Bytecode *
+get_flags_compare(IR_Block *block, i32 jump_idx)
+{
+	for(i32 i = jump_idx - 1; i >= 0; --i)
+	{
+		Bytecode *bc = &block->bc[i];
+		if(bc->op == BC_NO_OP)
+			continue;
+		Assert(is_compare_op(bc->op) && bc->result == -1);
+		return bc;
+	}
+	Assert(false);
+	return NULL;
+}
+
+// Lowers a condition straight to jumps, a compare sets the flags for the
+// jump instead of making a bool and && and || short circuit through blocks
+void
+bc_branch_on_condition(File_Contents *f, IR *ir, IR_Block *block, Ast_Node *expr, IR_Block *_true, IR_Block *_false)
+{
+	if(expr->type == type_binary_expr && expr->binary_expr.op == tok_logical_and)
+	{
+		IR_Block *rhs = alloc_block("and.rhs", ir);
+		bc_branch_on_condition(f, ir, block, expr->left, rhs, _false);
+		bc_branch_on_condition(f, ir, rhs, expr->right, _true, _false);
+		return;
+	}
+	if(expr->type == type_binary_expr && expr->binary_expr.op == tok_logical_or)
+	{
+		IR_Block *rhs = alloc_block("or.rhs", ir);
+		bc_branch_on_condition(f, ir, block, expr->left, _true, rhs);
+		bc_branch_on_condition(f, ir, rhs, expr->right, _true, _false);
+		return;
+	}
+	if(expr->type == type_unary_expr && expr->unary_expr.op->type == '!')
+	{
+		bc_branch_on_condition(f, ir, block, expr->unary_expr.expression, _false, _true);
+		return;
+	}
+
+	i32 evaluation = expression_to_bc(f, expr, block, ir, false);
+	Bytecode *last = block->bc_count > 0 ? &block->bc[block->bc_count - 1] : NULL;
+	if(expr->type == type_binary_expr && last && is_compare_op(last->op) && last->result == evaluation)
+	{
+		// nothing else has the fresh bool, so it doesn't need to be made
+		last->result = -1;
+		evaluation = -1;
+	}
+	bc_cond_branch(evaluation, block, _true, _false);
+}
+
 IR_Block *
 if_to_bc(File_Contents *f, IR *ir, IR_Block *block, Ast_Node *node, i32 *idx, Ast_Node **list, IR_Block *to_go)
 {
@@ -1409,26 +2058,222 @@ if_to_bc(File_Contents *f, IR *ir, IR_Block *block, Ast_Node *node, i32 *idx, As
 	*idx += 1;
 	auto body = list[*idx];
 	Assert(body->type == type_scope_start); 
-	ast_to_bc_func_level_list(body->scope_desc.body->statements.list, NULL, block_true, "if.true", ir, block_aftr);
+	ast_to_bc_func_level_list(f, body->scope_desc.body->statements.list, NULL, block_true, "if.true", ir, block_aftr);
 
 	*idx += 1;
-	auto else_node = list[*idx];
-	if(else_node->type == type_else)
+	if(*idx < SDCount(list) && list[*idx]->type == type_else)
 	{
 		*idx += 1;
 		auto else_body = list[*idx];
 		*idx += 1;
 		Assert(else_body->type == type_scope_start);
-		block_else = ast_to_bc_func_level_list(else_body->scope_desc.body->statements.list, NULL, NULL, "if.else", ir, block_aftr);
+		block_else = ast_to_bc_func_level_list(f, else_body->scope_desc.body->statements.list, NULL, NULL, "if.else", ir, block_aftr);
 	}
 
 	{
-		ast_to_bc_func_level_list(list, idx, block_aftr, "if.aftr", ir, to_go);
-		bc_branch(block_aftr, to_go);
+		ast_to_bc_func_level_list(f, list, idx, block_aftr, "if.aftr", ir, to_go);
 	}
 
-	i32 evaluation = expression_to_bc(f, node->condition.expr, block, ir, false);
-	bc_cond_branch(evaluation, block, block_true, block_else ? block_else : block_aftr);
+	bc_branch_on_condition(f, ir, block, node->condition.expr, block_true, block_else ? block_else : block_aftr);
+	return block_aftr;
+}
+
+// The condition is checked before the first iteration, continue goes to the
+// increment or straight back to the condition if there isn't one
+IR_Block *
+for_to_bc(File_Contents *f, IR *ir, IR_Block *block, Ast_Node *node, i32 *idx, Ast_Node **list, IR_Block *to_go)
+{
+	if(node->for_loop.expr1)
+		assign_to_bc(f, node->for_loop.expr1, block, ir);
+
+	IR_Block *block_cond = alloc_block("for.cond", ir);
+	IR_Block *block_body = alloc_block("for.body", ir);
+	IR_Block *block_incr = node->for_loop.expr3 ? alloc_block("for.incr", ir) : block_cond;
+	IR_Block *block_aftr = alloc_block("for.aftr", ir);
+
+	bc_branch(block, block_cond);
+	bc_branch_on_condition(f, ir, block_cond, node->for_loop.expr2, block_body, block_aftr);
+
+	IR_Block *outer_break = ir->break_block;
+	IR_Block *outer_continue = ir->continue_block;
+	ir->break_block = block_aftr;
+	ir->continue_block = block_incr;
+
+	*idx += 1;
+	auto body = list[*idx];
+	Assert(body->type == type_scope_start);
+	ast_to_bc_func_level_list(f, body->scope_desc.body->statements.list, NULL, block_body, "for.body", ir, block_incr);
+
+	ir->break_block = outer_break;
+	ir->continue_block = outer_continue;
+
+	if(node->for_loop.expr3)
+	{
+		expression_to_bc(f, node->for_loop.expr3, block_incr, ir, false);
+		bc_branch(block_incr, block_cond);
+	}
+
+	*idx += 1;
+	ast_to_bc_func_level_list(f, list, idx, block_aftr, "for.aftr", ir, to_go);
+	return block_aftr;
+}
+
+// Dense runs of cases become a jump table, the rest is a binary
+// search on the sorted case ranges that ends in a few compares
+#define MIN_JUMP_TABLE_RANGES 4
+#define MAX_JUMP_TABLE_ENTRIES 4096
+#define MAX_LINEAR_SWITCH_RANGES 3
+
+typedef struct {
+	IR *ir;
+	Switch_Range *ranges;
+	IR_Block **case_blocks;
+	IR_Block *default_block;
+	// the switch value widened to 64 bits
+	i32 value;
+	b32 is_unsigned;
+} Switch_Lowering;
+
+i32
+bc_constant(IR *ir, IR_Block *block, i64 value)
+{
+	i32 result = allocate_register(ir);
+	instruction(value, result, BC_MOVE_VALUE_TO_REG, block, type_64);
+	return result;
+}
+
+void
+bc_compare_branch(IR_Block *block, BC_OP op, i32 left, i32 right, IR_Block *_true, IR_Block *_false)
+{
+	instruction(left, right, -1, op, block, type_64);
+	bc_cond_branch(-1, block, _true, _false);
+}
+
+i32
+bc_switch_offset(Switch_Lowering *sw, IR_Block *block, i64 low)
+{
+	if(low == 0)
+		return sw->value;
+	i32 result = allocate_register(sw->ir);
+	instruction(result, sw->value, result, BC_MOVE_REG_TO_REG, block, type_64);
+	instruction(result, bc_constant(sw->ir, block, low), result, BC_SUB, block, type_64);
+	return result;
+}
+
+void
+lower_switch_ranges(Switch_Lowering *sw, IR_Block *block, i32 first, i32 count)
+{
+	IR *ir = sw->ir;
+	Switch_Range *ranges = sw->ranges + first;
+	i64 low = ranges[0].low;
+	u64 span = (u64)ranges[count - 1].high - (u64)low;
+	u64 covered = 0;
+	for(i32 i = 0; i < count; ++i)
+		covered += (u64)ranges[i].high - (u64)ranges[i].low + 1;
+
+	if(count >= MIN_JUMP_TABLE_RANGES && span < MAX_JUMP_TABLE_ENTRIES && covered * 10 >= (span + 1) * 4)
+	{
+		BC_Jump_Table table = {};
+		table.count = span + 1;
+		table.targets = (IR_Block **)AllocateCompileMemory(sizeof(IR_Block *) * table.count);
+		for(i32 i = 0; i < table.count; ++i)
+			table.targets[i] = sw->default_block;
+		for(i32 i = 0; i < count; ++i)
+		{
+			for(u64 v = ranges[i].low - low; v <= (u64)ranges[i].high - low; ++v)
+				table.targets[v] = sw->case_blocks[ranges[i].case_index];
+		}
+		if(!ir->jump_tables)
+			ir->jump_tables = SDCreate(BC_Jump_Table);
+		i32 table_idx = SDCount(ir->jump_tables);
+		SDPush(ir->jump_tables, table);
+
+		// one unsigned compare catches values on both sides of the table
+		i32 index = bc_switch_offset(sw, block, low);
+		instruction(index, bc_constant(ir, block, span), -1, BC_CMP_U_GREATER_THAN, block, type_64);
+		instruction((u64)sw->default_block, -1, BC_COND_JUMP, block, NULL);
+		instruction(index, table_idx, allocate_register(ir), BC_JUMP_TABLE, block, type_64);
+		set_terminator(block);
+		return;
+	}
+
+	if(count <= MAX_LINEAR_SWITCH_RANGES)
+	{
+		for(i32 i = 0; i < count; ++i)
+		{
+			IR_Block *next = i + 1 < count ? alloc_block("switch.test", ir) : sw->default_block;
+			IR_Block *target = sw->case_blocks[ranges[i].case_index];
+			if(ranges[i].low == ranges[i].high)
+			{
+				bc_compare_branch(block, BC_CMP_I_EQ, sw->value, bc_constant(ir, block, ranges[i].low), target, next);
+			}
+			else
+			{
+				i32 offset = bc_switch_offset(sw, block, ranges[i].low);
+				i64 width = (u64)ranges[i].high - (u64)ranges[i].low;
+				bc_compare_branch(block, BC_CMP_U_LESS_EQ, offset, bc_constant(ir, block, width), target, next);
+			}
+			block = next;
+		}
+		return;
+	}
+
+	i32 half = count / 2;
+	IR_Block *lower = alloc_block("switch.low", ir);
+	IR_Block *upper = alloc_block("switch.high", ir);
+	BC_OP less = sw->is_unsigned ? BC_CMP_U_LESS_THAN : BC_CMP_I_LESS_THAN;
+	bc_compare_branch(block, less, sw->value, bc_constant(ir, block, ranges[half].low), lower, upper);
+	lower_switch_ranges(sw, lower, first, half);
+	lower_switch_ranges(sw, upper, first + half, count - half);
+}
+
+IR_Block *
+switch_to_bc(File_Contents *f, IR *ir, IR_Block *block, Ast_Node *node, i32 *idx, Ast_Node **list, IR_Block *to_go)
+{
+	Ast_Switch *node_switch = &node->switch_statement;
+	IR_Block *block_aftr = alloc_block("switch.aftr", ir);
+
+	IR_Block *outer_break = ir->break_block;
+	ir->break_block = block_aftr;
+	size_t case_count = SDCount(node_switch->cases);
+	IR_Block **case_blocks = (IR_Block **)AllocateCompileMemory(sizeof(IR_Block *) * (case_count + 1));
+	for(size_t i = 0; i < case_count; ++i)
+	{
+		auto body = node_switch->cases[i].body;
+		Assert(body->type == type_scope_start);
+		case_blocks[i] = ast_to_bc_func_level_list(f, body->scope_desc.body->statements.list, NULL, NULL, "switch.case", ir, block_aftr);
+	}
+	IR_Block *block_default = block_aftr;
+	if(node_switch->default_body)
+	{
+		auto body = node_switch->default_body;
+		Assert(body->type == type_scope_start);
+		block_default = ast_to_bc_func_level_list(f, body->scope_desc.body->statements.list, NULL, NULL, "switch.else", ir, block_aftr);
+	}
+	ir->break_block = outer_break;
+
+	*idx += 1;
+	ast_to_bc_func_level_list(f, list, idx, block_aftr, "switch.aftr", ir, to_go);
+
+	i32 value = expression_to_bc(f, node_switch->expr, block, ir, false);
+	// the cast finds its source type from the instruction, so it has to outlive it
+	b32 is_unsigned = !is_signed(node_switch->expr_type);
+	i32 wide = do_cast(value, &node_switch->expr_type, is_unsigned ? type_u64 : type_64, ir, block);
+	if(wide == -1)
+		wide = value;
+
+	Switch_Lowering lowering = {};
+	lowering.ir = ir;
+	lowering.ranges = node_switch->ranges;
+	lowering.case_blocks = case_blocks;
+	lowering.default_block = block_default;
+	lowering.value = wide;
+	lowering.is_unsigned = is_unsigned;
+	i32 range_count = SDCount(node_switch->ranges);
+	if(range_count == 0)
+		bc_branch(block, block_default);
+	else
+		lower_switch_ranges(&lowering, block, 0, range_count);
 	return block_aftr;
 }
 
@@ -1436,11 +2281,17 @@ IR_Block *
 ast_to_bc_func_level(File_Contents *f, Ast_Node *node, IR_Block *current_block, Ast_Node **list, i32 *optional_index, IR *ir, IR_Block *to_go)
 {
 	IR_Block *result = NULL;
+	Token_Iden *token = profiler_statement_token(node);
+	if(token && ir->inline_depth == 0)
+	{
+		ir->line = current_block->line = (u32)token->line;
+		ir->column = current_block->column = (u32)token->column;
+	}
 	switch((int)node->type)
 	{
 		case type_func_call:
 		{
-			call_function(f, ir, current_block, node, (Call_Conv)node->func_call.operand_type.func.calling_convention);
+			call_function(f, ir, current_block, node, (Call_Conv)node->func_call.operand_type.func.calling_convention, false);
 		} break;
 		case type_assignment:
 		{
@@ -1450,6 +2301,24 @@ ast_to_bc_func_level(File_Contents *f, Ast_Node *node, IR_Block *current_block,
 		{
 			result = if_to_bc(f, ir, current_block, node, optional_index, list, to_go);
 		} break;
+		case type_switch:
+		{
+			result = switch_to_bc(f, ir, current_block, node, optional_index, list, to_go);
+		} break;
+		case type_for:
+		{
+			result = for_to_bc(f, ir, current_block, node, optional_index, list, to_go);
+		} break;
+		case type_break:
+		{
+			Assert(ir->break_block);
+			bc_branch(current_block, ir->break_block);
+		} break;
+		case type_continue:
+		{
+			Assert(ir->continue_block);
+			bc_branch(current_block, ir->continue_block);
+		} break;
 		case type_return:
 		{
 			if(!node->ret.expression)
@@ -1459,7 +2328,12 @@ ast_to_bc_func_level(File_Contents *f, Ast_Node *node, IR_Block *current_block,
 			}
 			else
 			{
-				i32 ret_reg = expression_to_bc(f, node->ret.expression, current_block, ir, false);
+				Ast_Node *expr = node->ret.expression;
+				i32 ret_reg;
+				if(expr->type == type_func_call)
+					ret_reg = call_function(f, ir, current_block, expr, (Call_Conv)expr->func_call.operand_type.func.calling_convention, true);
+				else
+					ret_reg = expression_to_bc(f, expr, current_block, ir, false);
 				i32 casted = do_cast(ret_reg, &node->ret.expression_type, &node->ret.func_type, ir, current_block);
 				if(casted == -1)
 					casted = ret_reg;
@@ -1471,33 +2345,38 @@ ast_to_bc_func_level(File_Contents *f, Ast_Node *node, IR_Block *current_block,
 	return result;
 }
 
+// casts keep the source type as its distance from the destination type in right,
+// types from different arenas can be too far apart for that so both get copied next to each other
+i32
+cast_type_offset(Type_Info *from, Type_Info **to)
+{
+	i64 offset = (u8 *)from - (u8 *)*to;
+	if(offset == (i32)offset)
+		return (i32)offset;
+	Type_Info *pair = (Type_Info *)AllocateCompileMemory(sizeof(Type_Info) * 2);
+	pair[0] = **to;
+	pair[1] = *from;
+	*to = &pair[0];
+	return sizeof(Type_Info);
+}
+
+// the types passed to do_cast are usually in the ast, which other bytecode jobs
+// read at the same time, so an untyped one is resolved into a copy
+static Type_Info *
+cast_resolve_untyped(Type_Info *type)
+{
+	if(!is_untyped(*type))
+		return type;
+	Type_Info *typed = (Type_Info *)AllocateCompileMemory(sizeof(Type_Info));
+	*typed = untyped_to_type(*type);
+	return typed;
+}
+
 i32
 do_cast(i32 source, Type_Info *from, Type_Info *to, IR *ir, IR_Block *block)
 {
-	if(from->type == T_UNTYPED_INTEGER)
-	{
-		from->type = T_INTEGER;
-		from->primitive.size = byte8;
-		from->identifier = (u8 *)"i64";
-	}
-	else if(from->type == T_UNTYPED_FLOAT)
-	{
-		from->type = T_FLOAT;
-		from->primitive.size = real64;
-		from->identifier = (u8 *)"f64";
-	}
-	if(to->type == T_UNTYPED_INTEGER)
-	{
-		to->type = T_INTEGER;
-		to->primitive.size = byte8;
-		to->identifier = (u8 *)"i64";
-	}
-	else if(to->type == T_UNTYPED_FLOAT)
-	{
-		to->type = T_FLOAT;
-		to->primitive.size = real64;
-		to->identifier = (u8 *)"f64";
-	}
+	from = cast_resolve_untyped(from);
+	to = cast_resolve_untyped(to);
 	Type_Type from_type = from->type;
 	Type_Type to_type = to->type;
 	BC_OP op;
@@ -1552,7 +2431,8 @@ do_cast(i32 source, Type_Info *from, Type_Info *to, IR *ir, IR_Block *block)
 							memcpy(to_intermidiate, from, sizeof(Type_Info));
 							to_intermidiate->primitive.size = byte4;
 							i32 extend_register = allocate_register(ir);
-							instruction(source, (u32)((u8 *)from - (u8 *)to_intermidiate), extend_register, BC_CAST_SEXT, block, to); 
+							i32 offset = cast_type_offset(from, &to_intermidiate);
+							instruction(source, offset, extend_register, BC_CAST_SEXT, block, to_intermidiate);
 							source = extend_register;
 							from = to_intermidiate;
 						}
@@ -1625,7 +2505,8 @@ do_cast(i32 source, Type_Info *from, Type_Info *to, IR *ir, IR_Block *block)
 							memcpy(to_intermidiate, from, sizeof(Type_Info));
 							to_intermidiate->primitive.size = ubyte4;
 							i32 extend_register = allocate_register(ir);
-							instruction(source, (u32)((u8 *)from - (u8 *)to_intermidiate), extend_register, BC_CAST_ZEXT, block, to); 
+							i32 offset = cast_type_offset(from, &to_intermidiate);
+							instruction(source, offset, extend_register, BC_CAST_ZEXT, block, to_intermidiate);
 							source = extend_register;
 							from = to_intermidiate;
 						}
@@ -1734,409 +2615,11 @@ do_cast(i32 source, Type_Info *from, Type_Info *to, IR *ir, IR_Block *block)
 	if(op == BC_NO_OP)
 		return source;
 	i32 result = allocate_register(ir);
-	instruction(source, (u32)((u8 *)from - (u8 *)to), result, op, block, to); 
+	i32 offset = cast_type_offset(from, &to);
+	instruction(source, offset, result, op, block, to);
 	return result;
 }
 
-inline b32
-op_has_left_idx(BC_OP op)
-{
-	if(op == BC_STORE || op == BC_STORE_NON_REMOVABLE)
-		return false;
-	return true;
-}
-
-inline b32
-op_has_right_idx(BC_OP op)
-{
-	if(op == BC_LOAD_STACK || op == BC_LOAD_DATA_SEG || op == BC_MOVE_FUNCTION_TO_REG || (op >= BC_CAST_SEXT && op <= BC_CAST_F_EXT))
-		return false;
-	return true;
-}
-
-void
-free_virtual_register(i32 virtual_register, Virtual_Register_Tracker *v_regs, Register_Allocation_Tracker *phy_regs,
-		IR *ir, Bytecode *out_bc, size_t *out_count)
-{
-	Register physical_register = v_regs[virtual_register].in_register;
-	if(v_regs[virtual_register].in_memory == -1)
-	{
-		i32 idx = SDCount(ir->allocated);
-		do_out_store_instruction(idx, physical_register, physical_register, out_bc, out_count,
-				v_regs[virtual_register].current_type, ir);
-		v_regs[virtual_register].in_memory = idx;
-	}
-	v_regs[virtual_register].in_register = reg_invalid;
-	phy_regs[physical_register].current_virtual_register = -1;
-}
-
-Register
-free_up_register_for(i32 virtual_register, Virtual_Register_Tracker *v_regs, Register_Allocation_Tracker *phy_regs,
-		IR *ir, Bytecode *out_bc, size_t *out_count, Type_Info *type)
-{
-	if(v_regs[virtual_register].in_register != reg_invalid)
-		return v_regs[virtual_register].in_register;
-
-	Register out;
-	Register first;
-	Register last;
-	if(is_float(*type))
-	{
-		first = reg_xmm0;
-		last = reg_xmm6;
-	}
-	else
-	{
-		first = reg_a;
-		last = reg_b;
-	}
-	out = first;
-	for(size_t i = first; i < last; ++i)
-	{
-		Register item = (Register)i;
-		if(phy_regs[item].current_virtual_register == -1)
-		{
-			out = item;
-			break;
-		}
-		if(phy_regs[item].last_updated < phy_regs[out].last_updated)
-		{
-			out = item;
-		}
-	}
-
-	phy_regs[out].last_updated++;
-
-	// Free both the virtual register about to be put into the physical one
-	// and the one that was previously connected
-	if(v_regs[virtual_register].in_register != reg_invalid)
-		free_virtual_register(virtual_register, v_regs, phy_regs, ir, out_bc, out_count);
-	if(phy_regs[out].current_virtual_register != -1)
-		free_virtual_register(phy_regs[out].current_virtual_register, v_regs, phy_regs, ir, out_bc, out_count);
-
-	if(v_regs[virtual_register].in_memory != -1)
-	{
-		out_instruction(-1, v_regs[virtual_register].in_memory, out, BC_LOAD_STACK, out_bc, out_count, type);
-	}
-
-	phy_regs[out].current_virtual_register = virtual_register;
-	v_regs[virtual_register].in_register = out;
-	v_regs[virtual_register].current_type = type;
-	return out;
-}
-
-void
-free_phyisical_register(Register reg, Register_Allocation_Tracker *phy_regs, Virtual_Register_Tracker *v_regs, IR *ir, Bytecode *out_bc, size_t *out_count)
-{
-	i32 virtual_register = phy_regs[reg].current_virtual_register;
-	if(virtual_register != -1)
-		free_virtual_register(virtual_register, v_regs, phy_regs, ir, out_bc, out_count);
-	phy_regs[reg].current_virtual_register = -1;
-}
-
-void
-put_virtual_register_into_phyisicla_without_touching_other(i32 virtual_register, Register physical_register,
-		Register_Allocation_Tracker *phy_regs, Virtual_Register_Tracker *v_regs, IR *ir, Bytecode *out_bc, size_t *out_count, Type_Info *type)
-{
-	Assert(v_regs[virtual_register].in_memory != -1 || v_regs[virtual_register].in_register != reg_invalid);
-	if(v_regs[virtual_register].in_register != reg_invalid)
-	{
-		out_instruction(physical_register, v_regs[virtual_register].in_register, physical_register, BC_MOVE_REG_TO_REG, out_bc, out_count, type);
-
-		Register old_physical_register = v_regs[virtual_register].in_register;
-		phy_regs[old_physical_register].current_virtual_register = -1;
-	}
-	else if(v_regs[virtual_register].in_memory != -1)
-	{
-		out_instruction(-1, v_regs[virtual_register].in_memory, physical_register, BC_LOAD_STACK, out_bc, out_count, type);
-	}
-	else
-	{
-		LG_FATAL(" ----- COMPILER BUG ----- \nWhen allocating registers for function call, one value was lost");
-	}
-	phy_regs[physical_register].current_virtual_register = virtual_register;
-	v_regs[virtual_register].current_type = type;
-	v_regs[virtual_register].in_register = physical_register;
-}
-
-void
-allocate_for_function_calls(Bytecode bc, Register_Allocation_Tracker *phy_regs, Virtual_Register_Tracker *v_regs, IR *ir, Bytecode *out_bc, size_t *out_count)
-{
-	BC_Func_Call *call = (BC_Func_Call *)bc.big_idx;
-
-#if defined(_WIN32)
-	const Register int_register_order[] = {
-		reg_c, reg_d, reg_r8, reg_r9
-	};
-#else
-	const Register int_register_order[] = {
-		reg_di, reg_si, reg_d, reg_c, reg_r8, reg_r9
-	};
-#endif
-	i32 int_register_count = 0;
-	const Register float_register_order[] = {
-		reg_xmm0, reg_xmm1, reg_xmm2, reg_xmm3
-	};
-	i32 float_register_count = 0;
-
-	i32 stack_offset = 16;
-	for(i64 i = 0; i < call->expr_count; ++i)
-	{
-		Register physical_register = reg_invalid;
-		Type_Info *type = call->expr_types[i];
-		if(is_float(*type)) {
-			if(float_register_count != sizeof(float_register_order) / sizeof(Register)) {
-				physical_register = float_register_order[float_register_count++];
-			}
-		}
-		else {
-			if(int_register_count != sizeof(int_register_order) / sizeof(Register)) {
-				physical_register = int_register_order[int_register_count++];
-			}
-		}
-		if(physical_register != reg_invalid) {
-			free_phyisical_register(physical_register, phy_regs, v_regs, ir, out_bc, out_count);
-			put_virtual_register_into_phyisicla_without_touching_other(call->expressions[i], physical_register, phy_regs, v_regs, ir, out_bc, out_count, type);
-		}
-		else {
-			// @TODO: implement this
-			// @TODO: implement this
-			// @TODO: implement this
-			// @TODO: implement this
-			// @TODO: implement this
-			// @TODO: implement this
-			// @TODO: implement this
-			// @TODO: implement this
-			Assert(false);
-			out_instruction(stack_offset, call->expressions[i], -1, BC_PUSH_OFFSET, out_bc, out_count, type);
-			stack_offset += 8;
-		}
-	}
-
-	// Put the function in the a register
-	free_phyisical_register(reg_a, phy_regs, v_regs, ir, out_bc, out_count);
-	put_virtual_register_into_phyisicla_without_touching_other(call->func_register, reg_a, phy_regs, v_regs, ir, out_bc, out_count, ptr_type);
-}
-
-void
-do_register_allocation(IR *ir, IR_Block *block, Virtual_Register_Tracker *v_regs)
-{
-	Register_Allocation_Tracker phy_regs[reg_invalid];
-	for(size_t i = 0; i < reg_invalid; ++i)
-	{
-		phy_regs[i].current_virtual_register = -1;
-		phy_regs[i].last_updated = 0;
-	}
-
-	size_t bc_count = block->bc_count;
-	Bytecode *new_bc = (Bytecode *)AllocateCompileMemory(bc_count * sizeof(Bytecode) * 3);
-	size_t new_count = 0;
-	size_t i = 0;
-
-	if(vstd_strcmp((char *)block->id, (char *)"entry")) {
-		// Copy the stack manipulation instructions
-		new_bc[new_count++] = block->bc[i++];
-		new_bc[new_count++] = block->bc[i++];
-	}
-
-	for(; i < bc_count; ++i)
-	{
-		Bytecode bc = block->bc[i];
-		if(bc.op == BC_STORE || bc.op == BC_STORE_NON_REMOVABLE)
-		{
-			v_regs[bc.right_idx].in_memory = bc.left_idx;
-			v_regs[bc.right_idx].current_type = bc.type;
-		}
-		if(bc.op < BC_MOVE_VALUE_TO_REG || bc.op > BC_LOAD_STRING) // doesn't use big_idx register
-		{
-			if(bc.left_idx != -1 && op_has_left_idx(bc.op) && bc.left_idx > reg_invalid)
-			{
-				if(bc.op >= BC_CAST_I_TO_F && bc.op <= BC_CAST_D_TO_I)
-				{
-					Type_Info *src_type = (Type_Info *)((u8 *)bc.type + bc.right_idx);
-					bc.left_idx = free_up_register_for(bc.left_idx, v_regs, phy_regs, ir, new_bc, &new_count, src_type);
-				}
-				else
-					bc.left_idx = free_up_register_for(bc.left_idx, v_regs, phy_regs, ir, new_bc, &new_count, bc.type);
-				if(bc.op == BC_CAST_ZEXT)
-				{
-					free_virtual_register(phy_regs[bc.left_idx].current_virtual_register, v_regs,
-							phy_regs, ir, new_bc, &new_count);
-				}
-			}
-			if(bc.right_idx != -1 && op_has_right_idx(bc.op) && bc.right_idx > reg_invalid)
-			{
-				bc.right_idx = free_up_register_for(bc.right_idx, v_regs, phy_regs, ir, new_bc, &new_count, bc.type);
-			}
-		}
-		if(bc.result != -1)
-		{
-			if(bc.result < reg_invalid)
-			{
-				// if we have a move to the same register
-				// we don't want to spill to the stack
-				// the instruction itself would be handled by the code generation
-				// but it will result in a spill
-				if(bc.op == BC_MOVE_REG_TO_REG && bc.left_idx == bc.right_idx)
-					continue;
-
-				i32 virtual_register = phy_regs[bc.result].current_virtual_register;
-				if(virtual_register != -1)
-					free_virtual_register(virtual_register, v_regs, phy_regs, ir, new_bc, &new_count);
-			}
-			else
-			{
-				if(bc.op == BC_MOVE_REG_TO_REG)
-				{
-					if(bc.result != phy_regs[bc.left_idx].current_virtual_register)
-					{
-						if(v_regs[bc.result].in_register != reg_invalid)
-							free_virtual_register(bc.result, v_regs, phy_regs, ir, new_bc, &new_count);
-						if(phy_regs[bc.left_idx].current_virtual_register != -1)
-							free_virtual_register(phy_regs[bc.left_idx].current_virtual_register, v_regs, phy_regs, ir, new_bc, &new_count);
-
-						v_regs[bc.result].in_register = (Register)bc.left_idx;
-						v_regs[bc.result].current_type = bc.type;
-						phy_regs[bc.left_idx].current_virtual_register = bc.result;
-						phy_regs[bc.left_idx].last_updated++;
-					}
-					bc.result = bc.left_idx;
-				}
-				else
-				{
-					bc.result = free_up_register_for(bc.result, v_regs, phy_regs, ir, new_bc, &new_count, bc.type);
-				}
-			}
-		}
-		if(bc.op == BC_CALL)
-		{
-			// Clear up any links to volitile registers
-
-			// @NOTE: DO NOT CLEAR RAX THE FUNCTION IS IN THERE
-			for(int i = 1; i < reg_b; ++i)
-			{
-				Register item = (Register)i;
-				free_phyisical_register(item, phy_regs, v_regs, ir, new_bc, &new_count);
-			}
-			for(int i = reg_xmm0; i < reg_xmm6; ++i)
-			{
-				Register item = (Register)i;
-				free_phyisical_register(item, phy_regs, v_regs, ir, new_bc, &new_count);
-			}
-			allocate_for_function_calls(bc, phy_regs, v_regs, ir, new_bc, &new_count);
-		}
-#if 1
-		else if(bc.op == BC_STORE_REG)
-		{
-			for(int i = 1; i < reg_b; ++i)
-			{
-				Register item = (Register)i;
-				if(phy_regs[item].current_virtual_register != -1)
-				{
-					if(v_regs[phy_regs[item].current_virtual_register].in_memory != -1)
-						free_phyisical_register(item, phy_regs, v_regs, ir, new_bc, &new_count);
-				}
-			}
-			for(int i = reg_xmm0; i < reg_xmm6; ++i)
-			{
-				Register item = (Register)i;
-				if(phy_regs[item].current_virtual_register != -1)
-				{
-					if(v_regs[phy_regs[item].current_virtual_register].in_memory != -1)
-						free_phyisical_register(item, phy_regs, v_regs, ir, new_bc, &new_count);
-				}
-			}
-		}
-#endif
-			
-		new_bc[new_count++] = bc;
-	}
-
-	if(vstd_strcmp((char *)block->id, (char *)"entry")) {
-		if(SDCount(ir->allocated) != 0) {
-			// Subtract the necessary amount of space
-			// so when we push on the stack we don't overwrite the 
-			// memory stored with stack_pointer - offset
-			int last_idx = SDCount(ir->allocated) - 1;
-			int unaligned = ir->allocated[last_idx].position + ir->allocated[last_idx].size;
-			int to_sub = round_up_to_multiple(unaligned, 16);
-
-			// We have to shove them inside the
-			// already created bytecode
-			Bytecode bc_sub;
-			bc_sub.op = BC_SUB_VALUE;
-			bc_sub.big_idx = to_sub;
-			bc_sub.result = reg_sp;
-			bc_sub.type = type_64;
-			
-
-			// we skip the first 2 instructions
-			// since they are the stack pushing
-			// and moving of rbp
-			void *move_dst = new_bc + 3;
-			void *move_src = new_bc + 2;
-			memmove(move_dst, move_src, (new_count - 2) * sizeof(Bytecode));
-			new_bc[2] = bc_sub;
-			new_count += 1;
-			ir->stack_top = to_sub;
-		}
-	}
-	block->bc = new_bc;
-	block->bc_count = new_count;
-	ir->bc_count += new_count;
-}
-
-void
-remove_useless_stores(IR *ir)
-{
-	// @TODO: maybe make it so we fix the stack after
-	// because even though we eliminate the store ops
-	// the following stores will still write at a position
-	// further down the stack like the ops were there
-
-
-	auto block_count = SDCount(ir->blocks);
-	i32 loaded[SDCount(ir->allocated)];
-	i32 loaded_count = 0;
-	for(size_t block_idx = 0; block_idx < block_count; ++block_idx)
-	{
-		auto block = ir->blocks[block_idx];
-		auto bc_count = block->bc_count;
-		auto bc = block->bc;
-
-		for(size_t i = 0; i < bc_count; ++i)
-		{
-			if(bc[i].op == BC_LOAD_STACK || bc[i].op == BC_LOAD_ADDRESS)
-			{
-				loaded[loaded_count++] = bc[i].right_idx;
-			}
-		}
-	}
-	for(size_t block_idx = 0; block_idx < block_count; ++block_idx)
-	{
-		auto block = ir->blocks[block_idx];
-		auto bc_count = block->bc_count;
-		auto bc = block->bc;
-
-		for(size_t i = 0; i < bc_count; ++i)
-		{
-			if(bc[i].op == BC_STORE)
-			{
-				i32 memory_index = bc[i].left_idx;
-				for(size_t j = 0; j < loaded_count; ++j)
-				{
-					if(loaded[j] == memory_index)
-					{
-						goto STORE_ELIMINATION_END;
-					}
-				}
-				bc[i].op = BC_NO_OP;
-			}
-STORE_ELIMINATION_END:;
-		}
-	}
-}
-
 const char *
 register_to_name(i32 reg_in)
 {
@@ -2202,12 +2685,27 @@ register_to_name(i32 reg_in)
 	}
 }
 
+const char *
+bc_result_name(i32 result)
+{
+	if(result == -1)
+		return "FLAGS";
+	return register_to_name(result);
+}
+
 void
 print_bytecode(IR *ir, IR_Block *block, char *path)
+{
+	char *buffer = (char *)AllocatePermanentMemory(128 * block->bc_count);
+	size_t buffer_size = bytecode_to_text(ir, block, buffer);
+	platform_write_file(buffer, buffer_size, path, false);
+}
+
+// @NOTE: buffer needs 128 bytes for every instruction in the block
+size_t
+bytecode_to_text(IR *ir, IR_Block *block, char *buffer)
 {
 	size_t bc_count = block->bc_count;
-	size_t to_allocate = 128 * bc_count;
-	char *buffer = (char *)AllocatePermanentMemory(to_allocate);
 	size_t buffer_size = 0;
 	for(size_t i = 0; i < bc_count; ++i)
 	{
@@ -2235,12 +2733,12 @@ print_bytecode(IR *ir, IR_Block *block, char *path)
 			case BC_FCMP_NEQ:
 			case BC_CMP_I_NEQ:
 			{
-				buffer_size += vstd_sprintf(buffer + buffer_size, "%s:\t %s != %s\n", register_to_name(bc.result), register_to_name(bc.left_idx), register_to_name(bc.right_idx));
+				buffer_size += vstd_sprintf(buffer + buffer_size, "%s:\t %s != %s\n", bc_result_name(bc.result), register_to_name(bc.left_idx), register_to_name(bc.right_idx));
 			} break;
 			case BC_FCMP_EQ:
 			case BC_CMP_I_EQ:
 			{
-				buffer_size += vstd_sprintf(buffer + buffer_size, "%s:\t %s == %s\n", register_to_name(bc.result), register_to_name(bc.left_idx), register_to_name(bc.right_idx));
+				buffer_size += vstd_sprintf(buffer + buffer_size, "%s:\t %s == %s\n", bc_result_name(bc.result), register_to_name(bc.left_idx), register_to_name(bc.right_idx));
 			} break;
 			case BC_CMP_LOGICAL_AND:
 			{
@@ -2260,7 +2758,12 @@ print_bytecode(IR *ir, IR_Block *block, char *path)
 			} break;
 			case BC_COND_JUMP:
 			{
-				buffer_size += vstd_sprintf(buffer + buffer_size, "IF %s JUMP %s\n", register_to_name(bc.result), ((IR_Block *)bc.big_idx)->id);
+				buffer_size += vstd_sprintf(buffer + buffer_size, "IF %s JUMP %s\n", bc_result_name(bc.result), ((IR_Block *)bc.big_idx)->id);
+			} break;
+			case BC_JUMP_TABLE:
+			{
+				buffer_size += vstd_sprintf(buffer + buffer_size, "JUMP TABLE %d [%s] (%d entries)\n", bc.right_idx,
+						register_to_name(bc.left_idx), ir->jump_tables[bc.right_idx].count);
 			} break;
 			case BC_OFFSET_POINTER:
 			{
@@ -2284,6 +2787,10 @@ print_bytecode(IR *ir, IR_Block *block, char *path)
 			{
 				buffer_size += vstd_sprintf(buffer + buffer_size, "CALL %s\n", register_to_name(reg_a));
 			} break;
+			case BC_TAIL_CALL:
+			{
+				buffer_size += vstd_sprintf(buffer + buffer_size, "TAIL CALL %s\n", register_to_name(reg_a));
+			} break;
 			case BC_PUSH_OFFSET:
 			{
 				auto ds = ir->allocated[bc.left_idx];
@@ -2329,8 +2836,7 @@ print_bytecode(IR *ir, IR_Block *block, char *path)
 			} break;
 			case BC_LOAD_DATA_SEG:
 			{
-				auto ds = ir->allocated[bc.right_idx];
-				buffer_size += vstd_sprintf(buffer + buffer_size, "%s:\t LOAD GLOBAL [%X]\n", register_to_name(bc.result), ds.position + ds.size);
+				buffer_size += vstd_sprintf(buffer + buffer_size, "%s:\t LOAD GLOBAL %d\n", register_to_name(bc.result), bc.right_idx);
 			} break;
 			case BC_FNEG:
 			case BC_NEG:
@@ -2379,25 +2885,25 @@ print_bytecode(IR *ir, IR_Block *block, char *path)
 			case BC_CMP_U_LESS_THAN:
 			case BC_CMP_I_LESS_THAN:
 			{
-				buffer_size += vstd_sprintf(buffer + buffer_size, "%s:\t %s < %s\n", register_to_name(bc.result), register_to_name(bc.left_idx), register_to_name(bc.right_idx));
+				buffer_size += vstd_sprintf(buffer + buffer_size, "%s:\t %s < %s\n", bc_result_name(bc.result), register_to_name(bc.left_idx), register_to_name(bc.right_idx));
 			} break;
 			case BC_FCMP_GREATER_THAN:
 			case BC_CMP_U_GREATER_THAN:
 			case BC_CMP_I_GREATER_THAN:
 			{
-				buffer_size += vstd_sprintf(buffer + buffer_size, "%s:\t %s > %s\n", register_to_name(bc.result), register_to_name(bc.left_idx), register_to_name(bc.right_idx));
+				buffer_size += vstd_sprintf(buffer + buffer_size, "%s:\t %s > %s\n", bc_result_name(bc.result), register_to_name(bc.left_idx), register_to_name(bc.right_idx));
 			} break;
 			case BC_FCMP_LESS_EQ:
 			case BC_CMP_U_LESS_EQ:
 			case BC_CMP_I_LESS_EQ:
 			{
-				buffer_size += vstd_sprintf(buffer + buffer_size, "%s:\t %s <= %s\n", register_to_name(bc.result), register_to_name(bc.left_idx), register_to_name(bc.right_idx));
+				buffer_size += vstd_sprintf(buffer + buffer_size, "%s:\t %s <= %s\n", bc_result_name(bc.result), register_to_name(bc.left_idx), register_to_name(bc.right_idx));
 			} break;
 			case BC_FCMP_GREATER_EQ:
 			case BC_CMP_U_GREATER_EQ:
 			case BC_CMP_I_GREATER_EQ:
 			{
-				buffer_size += vstd_sprintf(buffer + buffer_size, "%s:\t %s >= \%s\n", register_to_name(bc.result), register_to_name(bc.left_idx), register_to_name(bc.right_idx));
+				buffer_size += vstd_sprintf(buffer + buffer_size, "%s:\t %s >= \%s\n", bc_result_name(bc.result), register_to_name(bc.left_idx), register_to_name(bc.right_idx));
 			} break;
 			case BC_BIT_AND:
 			{
@@ -2459,6 +2965,10 @@ print_bytecode(IR *ir, IR_Block *block, char *path)
 			{
 				buffer_size += vstd_sprintf(buffer + buffer_size, "CAST F_EXT %s TO %s\n", register_to_name(bc.left_idx), register_to_name(bc.result));
 			} break;
+			case BC_COPY_MEMORY:
+			{
+				buffer_size += vstd_sprintf(buffer + buffer_size, "COPY %s TO %s USING %s\n", register_to_name(bc.right_idx), register_to_name(bc.left_idx), register_to_name(bc.result));
+			} break;
 			case BC_NO_OP:
 			{
 				// buffer_size += vstd_sprintf(buffer + buffer_size, "NO OP\n");
@@ -2470,6 +2980,6 @@ print_bytecode(IR *ir, IR_Block *block, char *path)
 			} break;
 		}
 	}
-	platform_write_file(buffer, buffer_size, path, false);
+	return buffer_size;
 }
 
@@ -58,8 +58,16 @@ typedef enum {
 	BC_POP_OFFSET,
 	BC_ADD_VALUE,
 	BC_CALL,
+	// a call in tail position, the caller's frame is gone before it jumps
+	// to the function in rax so the callee returns to the caller's caller
+	BC_TAIL_CALL,
 	BC_JUMP,
+	// big = block to jump to, result = the bool to test, or -1
+	// to use the flags of the compare right before it
 	BC_COND_JUMP,
+	// left = the index to jump on, already checked against the table's size,
+	// right = index into the IR's jump tables, result = scratch register
+	BC_JUMP_TABLE,
 	BC_LOAD_STRING,
 	BC_OFFSET_POINTER,
 	BC_MOVE_REG_TO_REG,
@@ -91,6 +99,7 @@ typedef enum {
 	BC_CMP_LOGICAL_AND,
 	BC_CMP_LOGICAL_OR,
 	BC_LOGICAL_NOT,
+	// compares with a result of -1 only set the flags for a BC_COND_JUMP
 	BC_CMP_I_EQ,
 	BC_CMP_I_NEQ,
 	BC_CMP_I_LESS_THAN,
@@ -122,6 +131,9 @@ typedef enum {
 	BC_CAST_TRUNC,
 	BC_CAST_F_TRUNC,
 	BC_CAST_F_EXT,
+	// left = destination address, right = source address,
+	// result = scratch register, the type's size is how many bytes are copied
+	BC_COPY_MEMORY,
 	BC_NO_OP
 } BC_OP ;
 
@@ -136,6 +148,10 @@ typedef struct {
 	};
 	i32 result;
 	BC_OP op;
+	// where the statement it was lowered from starts, inlined code keeps
+	// the call's. 0 is an instruction the lowering didn't place
+	u32 line;
+	u32 column;
 } Bytecode;
 
 typedef struct {
@@ -151,10 +167,14 @@ typedef struct {
 } BC_Function_Table;
 
 typedef struct {
+	// globals: the initial bytes in memory layout, NULL when they're all zero
 	u64 init_val;
 	u64 size;
 	i32 position;
 	i32 virtual_register;
+	// globals only, the symbol is given by the code generator
+	i32 alignment;
+	i32 symbol_index;
 } Data_Segment;
 
 typedef struct _Data_Segment_Table {
@@ -167,28 +187,55 @@ typedef struct {
 	Bytecode *bc;
 	u64 start_address;
 	i32 bc_count;
+	i32 bc_capacity;
 	b32 has_terminator;
+	// the location instructions pushed to the block get
+	u32 line;
+	u32 column;
 } IR_Block;
 
+// @NOTE: outgrown bytes are left in the compile arena when a block
+// doubles or is replaced by the register allocator's output
+typedef struct {
+	u64 blocks;
+	u64 instructions;
+	u64 largest_block;
+	u64 reserved_bytes;
+	u64 abandoned_bytes;
+} IR_Memory_Stats;
+
+typedef struct {
+	IR_Block **targets;
+	i32 count;
+} BC_Jump_Table;
+
 typedef struct {
 	Data_Segment *allocated;
 	Data_Segment_Table *lookup;
 	IR_Block **blocks;
+	BC_Jump_Table *jump_tables; // SDArray
+	// where a break or continue inside the loop or switch being lowered goes
+	IR_Block *break_block;
+	IR_Block *continue_block;
 	i32 reg_count;
 	i32 bc_count;
 	i32 stack_top;
+	// leaf that never touches the stack, it has no push rbp/mov rbp, rsp
+	// prologue and returns without restoring the frame
+	b32 omit_frame;
+	// how many calls deep the function being lowered is inlining
+	i32 inline_depth;
+	// the statement being lowered, new blocks start at it
+	u32 line;
+	u32 column;
+	// text of the ir before register allocation, written to out.ir in
+	// function order once every function is generated
+	char *dump;
+	i32 dump_size;
 } IR;
 
-typedef struct {
-	Type_Info *current_type;
-	i32 in_memory;
-	Register in_register;
-} Virtual_Register_Tracker;
-
-typedef struct {
-	i32 last_updated;
-	i32 current_virtual_register;
-} Register_Allocation_Tracker;
+void
+bc_initialize_types();
 
 IR **
 ast_to_bytecode(File_Contents **files);
@@ -199,9 +246,15 @@ ast_to_bc_file_level_list(File_Contents *f, Ast_Node **list, IR *ir);
 i32
 load_pointer(File_Contents *f, u8 *id, IR *ir, IR_Block *block, Type_Info *type);
 
+i32
+load_variable(File_Contents *f, u8 *id, IR *ir, IR_Block *block, Type_Info *type);
+
 i32
 allocate_stack_space(IR *ir, size_t size);
 
+void
+padd_to_alignment(i32 alignment, IR *ir);
+
 void
 do_store_instruction(i32 idx, i32 right, i32 result, IR_Block *block, Type_Info *type, b32 is_removable);
 
@@ -209,17 +262,42 @@ IR *
 ast_to_bc_file_level(File_Contents *f, Ast_Node *node, IR *ir, b32 gen_func);
 
 void
-do_register_allocation(IR *ir, IR_Block *block, Virtual_Register_Tracker *v_regs);
+queue_bc_function(File_Contents *f, Ast_Node **list, Ast_Node *function, i32 ir_index);
 
 void
-remove_useless_stores(IR *ir);
+bc_branch(IR_Block *from, IR_Block *to);
+
+b32
+is_compare_op(BC_OP op);
+
+// How many blocks a jump can go to, and the i'th of them
+i32
+bc_jump_target_count(IR *ir, Bytecode *bc);
+
+IR_Block *
+bc_jump_target(IR *ir, Bytecode *bc, i32 i);
+
+Bytecode *
+get_flags_compare(IR_Block *block, i32 jump_idx);
 
 void
 write_blocks_to_file(IR *ir, char *path);
 
+void
+bc_print_memory_report();
+
 void
 print_bytecode(IR *ir, IR_Block *block, char *path);
 
+size_t
+bytecode_to_text(IR *ir, IR_Block *block, char *buffer);
+
+void
+ir_to_dump(IR *ir, Ast_Node *function);
+
+void
+write_ir_dump(IR *ir, const char *path);
+
 IR_Block *
 ast_to_bc_func_level_list(File_Contents *f, Ast_Node **list, i32 *optional_index, IR_Block *optional_block, u8 *id, IR *ir, IR_Block *to_go);
 
@@ -229,14 +307,24 @@ assign_to_bc(File_Contents *f, Ast_Node *node, IR_Block *block, IR *ir);
 IR
 ast_to_bc_function(File_Contents *f, Ast_Node **list, Ast_Node *function);
 
+// @NOTE: doesn't write anything, safe to run on the thread pool
+IR
+generate_bc_function(File_Contents *f, Ast_Node **list, Ast_Node *function);
+
 IR_Block *
 ast_to_bc_func_level(File_Contents *f, Ast_Node *node, IR_Block *current_block, Ast_Node **list, i32 *optional_index, IR *ir, IR_Block *to_go);
 
 i32
 do_cast(i32 source, Type_Info *from, Type_Info *to, IR *ir, IR_Block *block);
 
+i32
+cast_type_offset(Type_Info *from, Type_Info **to);
+
 i32
 expression_to_bc(File_Contents *f, Ast_Node *expr, IR_Block *block, IR *ir, b32 get_pointer);
 
+i32
+find_function_index(File_Contents *f, u8 *id);
+
 #endif // _BYTECODE_H
 
@@ -21,18 +21,43 @@ args:
         link.exe (windows default)
 	ld (linux default)
 	wasm-ld (wasm default)
+	builtin (fast backend on linux, no object file)
     --link [linker arguments]
         linker dependent
     --dump-symbols
     --debug
+        the custom backend adds line tables and call frame info to its ELF output
     --out [output file name]
     --no-link
     --backend [backend]
         llvm
 		custom
     --include [path]
+    --ir-memory-report
+        prints how much memory the custom backend's IR used
+    --time-passes
+        prints how long each of the custom backend's IR passes took
+        and how fast its x64 encoder went
+    --peephole-report
+        prints how often each of the custom backend's peephole rules fired
+    --keep-frames
+        every function of the custom backend sets up rbp and tail calls aren't jumps, for profilers
     --dll [file]
     --shared [file]
+    --jit-threshold [count]
+        calls before a compile time function is compiled, 0 disables it (default 100)
+    --interpret-only
+    --perf-map
+        lists the functions compiled at compile time in /tmp/perf-[pid].map for perf
+    --run-cache [file]
+        where $run results are cached between builds (default apoc_run.cache)
+    --no-run-cache
+    --profile-compile-time [file]
+        writes a report of the code ran at compile time and [file].folded for flame graphs
+    --run-step-limit [count]
+        statements a single compile time evaluation can execute, 0 is unlimited (default 0)
+    --run-time-limit [seconds]
+        wall clock time a single compile time evaluation can take, 0 is unlimited (default 0)
 )del";
 
 void
@@ -54,6 +79,8 @@ parse_command_line(int c_argc, char *c_argv[], std::vector<std::string> *files)
 {
 	Build_Commands build_commands = {};
 	build_commands.call_linker = true;
+	build_commands.jit_threshold = 100;
+	build_commands.run_cache_path = (u8 *)"apoc_run.cache";
 	build_commands.linker_command = NULL;
 	build_commands.output_file = NULL;
 	build_commands.included_dirs = SDCreate(u8 *);
@@ -190,9 +217,13 @@ parse_command_line(int c_argc, char *c_argv[], std::vector<std::string> *files)
 				{
 					build_commands.linker = LINK_WASM_LD;
 				}
+				else if(linker == "BUILTIN" || linker == "builtin")
+				{
+					build_commands.linker = LINK_BUILTIN;
+				}
 				else
 				{
-					raise_build_error("Unknown linker %s.\nOptions:\n\tLINK.EXE\n\tLD\n\tWASM-LD", linker.c_str());
+					raise_build_error("Unknown linker %s.\nOptions:\n\tLINK.EXE\n\tLD\n\tWASM-LD\n\tBUILTIN", linker.c_str());
 				}
 			}
 			else if(arg == "--link")
@@ -216,6 +247,63 @@ parse_command_line(int c_argc, char *c_argv[], std::vector<std::string> *files)
 					raise_build_error("Couldn't find dynamic library %s", c_str);
 				SDPush(build_commands.dynamic_libs, got);
 			}
+			else if(arg == "--jit-threshold")
+			{
+				auto count = args[++i];
+				build_commands.jit_threshold = (u32)str_to_u64(count.c_str());
+			}
+			else if(arg == "--interpret-only")
+			{
+				build_commands.interpret_only = true;
+			}
+			else if(arg == "--run-cache")
+			{
+				auto path = args[++i];
+				u8 *c_path = (u8 *)AllocatePermanentMemory(path.size() + 1);
+				memcpy(c_path, path.c_str(), path.size());
+				build_commands.run_cache_path = c_path;
+			}
+			else if(arg == "--profile-compile-time")
+			{
+				auto path = args[++i];
+				u8 *c_path = (u8 *)AllocatePermanentMemory(path.size() + 1);
+				memcpy(c_path, path.c_str(), path.size());
+				build_commands.profile_path = c_path;
+			}
+			else if(arg == "--run-step-limit")
+			{
+				auto count = args[++i];
+				build_commands.run_step_limit = str_to_u64(count.c_str());
+			}
+			else if(arg == "--run-time-limit")
+			{
+				auto seconds = args[++i];
+				build_commands.run_time_limit = str_to_u64(seconds.c_str());
+			}
+			else if(arg == "--no-run-cache")
+			{
+				build_commands.run_cache_path = NULL;
+			}
+			else if(arg == "--ir-memory-report")
+			{
+				build_commands.ir_memory_report = true;
+			}
+			else if(arg == "--time-passes")
+			{
+				build_commands.time_passes = true;
+			}
+			else if(arg == "--peephole-report")
+			{
+				build_commands.peephole_report = true;
+			}
+			else if(arg == "--keep-frames")
+			{
+				build_commands.keep_frames = true;
+			}
+			else if(arg == "--perf-map")
+			{
+				build_commands.perf_map = true;
+			}
 			else if (arg == "--dump-symbols")
 			{
 				build_commands.dump_symbols = true;
@@ -286,6 +374,14 @@ parse_command_line(int c_argc, char *c_argv[], std::vector<std::string> *files)
 		linker_command += "ld ";
 	else if(build_commands.linker == LINK_WASM_LD)
 		linker_command += "wasm-ld ";
+	else if(build_commands.linker == LINK_BUILTIN)
+	{
+#if !defined(CM_LINUX)
+		raise_build_error("The builtin linker only produces linux executables");
+#endif
+		if(build_commands.backend != Fast_Backend)
+			raise_build_error("The builtin linker only works with the fast backend");
+	}
 	else
 		LG_FATAL("----- COMPILER BUG -----\nUnkown linker");
 
@@ -305,7 +401,7 @@ parse_command_line(int c_argc, char *c_argv[], std::vector<std::string> *files)
 #if defined(_WIN32)
 			tmp_output_file += ".exe ";
 #elif defined (CM_LINUX)
-			linker_command += ".out ";
+			tmp_output_file += ".out";
 #else
 #error File extension for this platform is not defined
 #endif
@@ -3,6 +3,9 @@
 #include <math.h>
 #include <Basic.h>
 #include <Stack.h>
+#include <x64_Gen.h>
+#include <x64_Loader.h>
+#include <Profiler.h>
 
 #if !defined (NOVM)
 #include <LLVM_Helpers.h>
@@ -220,7 +223,8 @@ interp_look_up_symbol(u8 *identifier)
 		Interp_Table *table = stack_pop(symbol_scope, Interp_Table *);
 		scopes[scope_i++] = table;
 		ptrdiff_t id_idx = shgeti(table, identifier);
-		if(id_idx != -1)
+		// the innermost scope is popped first, a caller's variable with the same name can't win
+		if(id_idx != -1 && !got)
 		{
 			got = &table[id_idx].value;
 		}
@@ -572,6 +576,43 @@ copy_array(Interp_Val *_array, void *dst)
 	}
 }
 
+Interp_Val
+memory_to_interp_val(void *src, Type_Info *type)
+{
+	Interp_Val result = create_interp_val();
+	result.type = type;
+	u8 *it = (u8 *)src;
+	switch(type->type)
+	{
+		case T_STRUCT:
+		{
+			Interp_Val *members = (Interp_Val *)AllocateInterpMiscMemory(type->structure.member_count * sizeof(Interp_Val));
+			for(int i = 0; i < type->structure.member_count; ++i)
+			{
+				members[i] = memory_to_interp_val(it, &type->structure.member_types[i]);
+				it += get_type_size(type->structure.member_types[i]);
+			}
+			result.pointed = members;
+		} break;
+		case T_ARRAY:
+		{
+			Interp_Val *elems = (Interp_Val *)AllocateInterpMiscMemory(type->array.elem_count * sizeof(Interp_Val));
+			auto elem_size = get_type_size(*type->array.type);
+			for(int i = 0; i < type->array.elem_count; ++i)
+			{
+				elems[i] = memory_to_interp_val(it, type->array.type);
+				it += elem_size;
+			}
+			result.pointed = elems;
+		} break;
+		default:
+		{
+			memcpy(&result._u64, src, get_type_size(*type));
+		} break;
+	}
+	return result;
+}
+
 Interp_Val
 generate_empty(Type_Info *type)
 {
@@ -592,6 +633,24 @@ generate_empty(Type_Info *type)
 	return result;
 }
 
+// @NOTE: variables are read from the flat copy at their location,
+// so that's where a write to one has to go
+void
+interp_store(Ast_Node *lhs, void *value, Type_Info *type)
+{
+	Interp_Val *lhs_ptr = interpret_lhs(lhs);
+	size_t size = get_type_size(*type);
+	if(lhs->type == type_identifier && lhs_ptr->location)
+	{
+		memcpy(lhs_ptr->location, value, size);
+	}
+	else
+	{
+		lhs_ptr->_u64 = 0;
+		memcpy(&lhs_ptr->_u64, value, size < sizeof(u64) ? size : sizeof(u64));
+	}
+}
+
 void
 interpret_assignment(Ast_Node *node, b32 *failed)
 {
@@ -614,9 +673,24 @@ interpret_assignment(Ast_Node *node, b32 *failed)
 	}
 	else
 	{
-		Interp_Val *lhs_ptr = interpret_lhs(node->assignment.lhs);
-		// @NOTE: covers all types
-		lhs_ptr->_u64 = result._u64;
+		interp_store(node->assignment.lhs, dst, node->assignment.decl_type);
+	}
+}
+
+i64
+interp_val_to_i64(Interp_Val val)
+{
+	if(is_untyped(*val.type))
+		return val._i64;
+	switch(val.type->primitive.size)
+	{
+		case byte1:  return val._i8;
+		case byte2:  return val._i16;
+		case byte4:  return val._i32;
+		case ubyte1: return val._u8;
+		case ubyte2: return val._u16;
+		case ubyte4: return val._u32;
+		default:     return val._i64;
 	}
 }
 
@@ -631,6 +705,153 @@ val_to_bool(Interp_Val val)
 	return is_true;
 }
 
+#define MAX_INTERP_CALL_DEPTH 1024
+#define RUN_CLOCK_INTERVAL 4096
+#define RUN_REPORTED_FRAMES 16
+
+static u64 run_step_limit;
+static u64 run_time_limit_ns;
+static b32 run_active;
+static Token_Iden *run_site;
+static u64 run_steps;
+static u64 run_deadline_ns;
+static Interp_Loop_Table *run_loops;
+static Ast_Node *interp_call_stack[MAX_INTERP_CALL_DEPTH];
+static i32 interp_call_depth;
+
+void
+set_run_limits(u64 step_limit, u64 time_limit)
+{
+	run_step_limit = step_limit;
+	run_time_limit_ns = time_limit * 1000000000ull;
+}
+
+static inline void
+interp_push_call(Ast_Node *f_node)
+{
+	if(interp_call_depth < MAX_INTERP_CALL_DEPTH)
+		interp_call_stack[interp_call_depth] = f_node;
+	interp_call_depth++;
+}
+
+static inline void
+interp_pop_call()
+{
+	interp_call_depth--;
+}
+
+void
+run_limit_exceeded(const char *reason)
+{
+	char *report = (char *)AllocateCompileMemory(8192);
+	char *at = report;
+
+	at += vstd_sprintf(at, "\tcall stack:\n");
+	i32 depth = interp_call_depth > MAX_INTERP_CALL_DEPTH ? MAX_INTERP_CALL_DEPTH : interp_call_depth;
+	i32 shown = 0;
+	for(i32 i = depth - 1; i >= 0 && shown < RUN_REPORTED_FRAMES; --i, ++shown)
+	{
+		Ast_Node *func = interp_call_stack[i];
+		Token_Iden *token = func->function.identifier.token;
+		at += vstd_sprintf(at, "\t\t%s (%s:%llu)\n", func->function.identifier.name,
+				token->file, token->line);
+	}
+	if(interp_call_depth > shown)
+		at += vstd_sprintf(at, "\t\t... %d more\n", interp_call_depth - shown);
+	if(interp_call_depth == 0)
+		at += vstd_sprintf(at, "\t\t<none>\n");
+
+	Interp_Loop_Table *hottest = NULL;
+	size_t loop_count = hmlen(run_loops);
+	for(size_t i = 0; i < loop_count; ++i)
+	{
+		if(!hottest || run_loops[i].value > hottest->value)
+			hottest = &run_loops[i];
+	}
+	if(hottest)
+	{
+		Token_Iden *token = hottest->key->type == type_for ? hottest->key->for_loop.token :
+			hottest->key->for_in.token;
+		at += vstd_sprintf(at, "\thottest loop: %s (%llu, %llu) ran %llu iterations\n",
+				token->file, token->line, token->column, hottest->value);
+	}
+	*at = 0;
+
+	u8 *error_location = get_error_segment(*run_site);
+	LG_FATAL("%s (%d, %d):\n\tCompile time execution %s after %llu statements.\n\n%s\n%s",
+			run_site->file, run_site->line, run_site->column, reason, run_steps,
+			error_location, report);
+}
+
+static inline void
+run_count_step()
+{
+	if(!run_active)
+		return;
+
+	run_steps++;
+	if(run_step_limit != 0 && run_steps > run_step_limit)
+		run_limit_exceeded("went over the statement limit");
+	if(run_time_limit_ns != 0 && run_steps % RUN_CLOCK_INTERVAL == 0 && profiler_now() > run_deadline_ns)
+		run_limit_exceeded("went over the time limit");
+}
+
+static inline void
+run_count_loop_iteration(Ast_Node *loop)
+{
+	if(!run_active)
+		return;
+
+	ptrdiff_t idx = hmgeti(run_loops, loop);
+	if(idx < 0)
+	{
+		hmput(run_loops, loop, 0);
+		idx = hmgeti(run_loops, loop);
+	}
+	run_loops[idx].value++;
+}
+
+Interp_Val
+interpret_run(Ast_Node *expr, Token_Iden *site, b32 *failed)
+{
+	// @NOTE: the limits apply to the outermost evaluation
+	if(run_active)
+		return interpret_expression(expr, failed);
+
+	run_active = true;
+	run_site = site;
+	run_steps = 0;
+	interp_call_depth = 0;
+	run_deadline_ns = run_time_limit_ns != 0 ? profiler_now() + run_time_limit_ns : 0;
+	Interp_Val result = interpret_expression(expr, failed);
+	hmfree(run_loops);
+	run_active = false;
+	return result;
+}
+
+// binary search of the sorted case ranges, the else body when nothing matches
+Ast_Node *
+switch_body_for_value(Ast_Switch *sw, i64 value)
+{
+	b32 is_unsigned = !is_signed(sw->expr_type);
+	i64 low = 0;
+	i64 high = (i64)SDCount(sw->ranges) - 1;
+	while(low <= high)
+	{
+		i64 mid = (low + high) / 2;
+		Switch_Range range = sw->ranges[mid];
+		b32 below = is_unsigned ? (u64)value < (u64)range.low : value < range.low;
+		b32 above = is_unsigned ? (u64)value > (u64)range.high : value > range.high;
+		if(below)
+			high = mid - 1;
+		else if(above)
+			low = mid + 1;
+		else
+			return sw->cases[range.case_index].body;
+	}
+	return sw->default_body;
+}
+
 Interp_Val
 interpret_statement(Ast_Node *node, b32 *failed, Token_Iden *token, i32 scope_count,
 		b32 *returned, Ast_Node *node_list, size_t *idx)
@@ -642,6 +863,8 @@ interpret_statement(Ast_Node *node, b32 *failed, Token_Iden *token, i32 scope_co
 		return result;
 	}
 
+	profiler_count_statement(node);
+	run_count_step();
 	switch ((int)node->type)
 	{
 		case type_func_call:
@@ -656,7 +879,10 @@ interpret_statement(Ast_Node *node, b32 *failed, Token_Iden *token, i32 scope_co
 		{
 			interp_push_scope();
 			*token = *node->scope_desc.token;
-			scope_count++;
+			// the body ends with the scope_end that pops the scope, unless it returned first
+			result = interpret_statement_list(node->scope_desc.body, failed, token, scope_count, returned);
+			if(*returned)
+				destroy_scope();
 		} break;
 		case type_scope_end:
 		{
@@ -669,22 +895,50 @@ interpret_statement(Ast_Node *node, b32 *failed, Token_Iden *token, i32 scope_co
 			*token = *node->condition.token;
 			result = interpret_expression(node->condition.expr, failed);
 			b32 is_true = val_to_bool(result);
-			if(is_true)
+
+			// the bodies are the next statements in the list, skip past them either way
+			Ast_Node **list = node_list->statements.list;
+			size_t count = SDCount(list);
+			*idx += 1;
+			Ast_Node *body = is_true ? list[*idx] : NULL;
+			if(*idx + 2 < count && list[*idx + 1]->type == type_else)
 			{
-				interp_push_scope();
-				*idx += 1;
-				Ast_Node *next_node = node_list->statements.list[*idx];
-				if(next_node->type == type_scope_start)
+				*idx += 2;
+				if(!is_true)
+					body = list[*idx];
+			}
+			if(body)
+			{
+				if(body->type == type_scope_start)
 				{
-					result = interpret_statement_list(next_node->scope_desc.body, failed, 
-							token, scope_count, returned);
+					result = interpret_statement(body, failed, token, scope_count, returned,
+							node_list, idx);
 				}
 				else
 				{
-					result = interpret_statement(next_node, failed, token, 0, returned,
+					interp_push_scope();
+					result = interpret_statement(body, failed, token, 0, returned,
 							node_list, idx);
 					destroy_scope();
 				}
+			}
+		} break;
+		case type_switch:
+		{
+			Ast_Switch *sw = &node->switch_statement;
+			*token = *sw->token;
+			result = interpret_expression(sw->expr, failed);
+			if(*failed)
+				return result;
+			// an enum is read as the integer it's stored as
+			Interp_Val value = result;
+			value.type = &sw->expr_type;
+			Ast_Node *body = switch_body_for_value(sw, interp_val_to_i64(value));
+			if(body)
+			{
+				interp_push_scope();
+				result = interpret_statement_list(body->scope_desc.body, failed, 
+						token, scope_count, returned);
 				if(*returned)
 				{
 					destroy_scope();
@@ -720,6 +974,7 @@ interpret_statement(Ast_Node *node, b32 *failed, Token_Iden *token, i32 scope_co
 			Ast_Node *next_node = node_list->statements.list[*idx];
 			while(is_true)
 			{
+				run_count_loop_iteration(node);
 				// @TODO: Hack?
 				interp_push_scope();
 				if(next_node->type == type_scope_start)
@@ -736,6 +991,9 @@ interpret_statement(Ast_Node *node, b32 *failed, Token_Iden *token, i32 scope_co
 						raise_interpret_error("loop body couldn't be interpreted", *token);
 						return result;
 					}
+					// a return leaves before the } so the loop's own scope is still under it
+					if(*returned)
+						destroy_scope();
 				}
 				else
 				{
@@ -754,7 +1012,8 @@ interpret_statement(Ast_Node *node, b32 *failed, Token_Iden *token, i32 scope_co
 					return result;
 				}
 				
-				interpret_expression(node->for_loop.expr3, failed);
+				if(node->for_loop.expr3)
+					interpret_expression(node->for_loop.expr3, failed);
 				Interp_Val expr2 = interpret_expression(node->for_loop.expr2, failed);
 				is_true = val_to_bool(expr2);
 			}
@@ -779,6 +1038,7 @@ interpret_statement(Ast_Node *node, b32 *failed, Token_Iden *token, i32 scope_co
 			Ast_Node *next_node = node_list->statements.list[*idx];
 			while(i._i64 < elem_count._i64)
 			{
+				run_count_loop_iteration(node);
 				interp_push_scope();
 				if(node->for_in.i_nullalbe)
 					interp_add_symbol(node->for_in.i_nullalbe->identifier.name,  i);
@@ -802,6 +1062,9 @@ interpret_statement(Ast_Node *node, b32 *failed, Token_Iden *token, i32 scope_co
 						raise_interpret_error("loop body couldn't be interpreted", *token);
 						return result;
 					}
+					// a return leaves before the } so the loop's own scope is still under it
+					if(*returned)
+						destroy_scope();
 				}
 				else
 				{
@@ -833,7 +1096,7 @@ interpret_statement(Ast_Node *node, b32 *failed, Token_Iden *token, i32 scope_co
 			result = interpret_expression(node->ret.expression, failed);
 			Interp_Val casted = create_interp_val();
 			casted._u64 = result._u64;
-			*casted.type = node->ret.func_type;
+			casted.type = &node->ret.func_type;
 			return casted;
 		} break;
 		default:
@@ -861,6 +1124,275 @@ interpret_statement_list(Ast_Node *node, b32 *failed, Token_Iden *token, i32 sco
 	return result;
 }
 
+#if defined(_WIN32)
+#define JIT_MAX_ARGS 4
+#else
+#define JIT_MAX_ARGS 6
+#endif
+
+typedef u64 (*Jit_Native_Fn)(u64, u64, u64, u64, u64, u64);
+
+static Jit_Table *jit_table;
+static u32 jit_threshold;
+static b32 jit_disabled = true;
+
+void
+set_jit_options(u32 threshold, b32 interpret_only)
+{
+	jit_threshold = threshold;
+	jit_disabled = interpret_only || threshold == 0;
+}
+
+b32
+jit_is_supported_type(Type_Info *type)
+{
+	return is_integer(*type) || type->type == T_BOOLEAN;
+}
+
+b32
+jit_can_compile_expression(Ast_Node *expr)
+{
+	switch((int)expr->type)
+	{
+		case type_identifier:
+		{
+			Symbol *sym = expr->identifier.symbol_spot;
+			if(!sym || (sym->tag != S_VARIABLE && sym->tag != S_FUNC_ARG))
+				return false;
+			return jit_is_supported_type(sym->type);
+		} break;
+		case type_literal:
+		case type_size:
+		{
+			return true;
+		} break;
+		case type_run:
+		{
+			return jit_is_supported_type(expr->run.ran_val.type);
+		} break;
+		case type_cast:
+		{
+			if(!jit_is_supported_type(expr->cast.type) || !jit_is_supported_type(&expr->cast.expr_type))
+				return false;
+			return jit_can_compile_expression(expr->cast.expression);
+		} break;
+		case type_unary_expr:
+		{
+			Token op = expr->unary_expr.op->type;
+			if(op == tok_plusplus || op == tok_minusminus)
+			{
+				// only on locals, the bytecode stores through their address
+				if(expr->unary_expr.expression->type != type_identifier || !is_integer(expr->unary_expr.expr_type))
+					return false;
+			}
+			else if(op != '-' && op != '!')
+				return false;
+			return jit_can_compile_expression(expr->unary_expr.expression);
+		} break;
+		case type_binary_expr:
+		{
+			// @NOTE: remainder is not implemented in the bytecode yet
+			if(expr->binary_expr.op == '%')
+				return false;
+			if(!jit_is_supported_type(&expr->binary_expr.left))
+				return false;
+			return jit_can_compile_expression(expr->left) && jit_can_compile_expression(expr->right);
+		} break;
+	}
+	return false;
+}
+
+b32
+jit_can_compile_statement_list(Ast_Node **list, b32 in_loop)
+{
+	size_t count = SDCount(list);
+	for(size_t i = 0; i < count; ++i)
+	{
+		Ast_Node *node = list[i];
+		switch((int)node->type)
+		{
+			case type_assignment:
+			{
+				if(!node->assignment.rhs || !jit_is_supported_type(node->assignment.decl_type))
+					return false;
+				if(!node->assignment.is_declaration && node->assignment.lhs->type != type_identifier)
+					return false;
+				if(!node->assignment.is_declaration && !jit_can_compile_expression(node->assignment.lhs))
+					return false;
+				if(!jit_can_compile_expression(node->assignment.rhs))
+					return false;
+			} break;
+			case type_return:
+			{
+				if(node->ret.expression && !jit_can_compile_expression(node->ret.expression))
+					return false;
+			} break;
+			case type_if:
+			{
+				if(!jit_can_compile_expression(node->condition.expr))
+					return false;
+				if(i + 1 >= count || list[i + 1]->type != type_scope_start)
+					return false;
+				if(!jit_can_compile_statement_list(list[++i]->scope_desc.body->statements.list, in_loop))
+					return false;
+				if(i + 1 < count && list[i + 1]->type == type_else)
+				{
+					if(i + 2 >= count || list[i + 2]->type != type_scope_start)
+						return false;
+					i += 2;
+					if(!jit_can_compile_statement_list(list[i]->scope_desc.body->statements.list, in_loop))
+						return false;
+				}
+			} break;
+			case type_for:
+			{
+				Ast_Node *init = node->for_loop.expr1;
+				if(init)
+				{
+					if(!init->assignment.rhs || !jit_is_supported_type(init->assignment.decl_type) ||
+							!jit_can_compile_expression(init->assignment.rhs))
+						return false;
+					if(!init->assignment.is_declaration && !jit_can_compile_expression(init->assignment.lhs))
+						return false;
+				}
+				if(!jit_can_compile_expression(node->for_loop.expr2))
+					return false;
+				if(node->for_loop.expr3 && !jit_can_compile_expression(node->for_loop.expr3))
+					return false;
+				if(i + 1 >= count || list[i + 1]->type != type_scope_start)
+					return false;
+				if(!jit_can_compile_statement_list(list[++i]->scope_desc.body->statements.list, true))
+					return false;
+			} break;
+			case type_break:
+			case type_continue:
+			{
+				if(!in_loop)
+					return false;
+			} break;
+			case type_scope_end:
+			{
+			} break;
+			default:
+			{
+				// @TODO: function calls
+				return false;
+			} break;
+		}
+	}
+	return true;
+}
+
+b32
+jit_can_compile_function(Ast_Node *f_node)
+{
+	Type_Info *ret_type = f_node->function.type->func.return_type;
+	if(ret_type->type != T_VOID && !jit_is_supported_type(ret_type))
+		return false;
+
+	size_t arg_count = SDCount(f_node->function.arguments);
+	if(arg_count + (f_node->function.conv == CALL_APOC ? 1 : 0) > JIT_MAX_ARGS)
+		return false;
+	for(size_t i = 0; i < arg_count; ++i)
+	{
+		if(!jit_is_supported_type(f_node->function.arguments[i]->variable.type))
+			return false;
+	}
+	return jit_can_compile_statement_list(f_node->function.body->scope_desc.body->statements.list, false);
+}
+
+void *
+jit_resolve_symbol(Symbol_Descriptor *symbol)
+{
+	if(symbol->type == OBJ_FUNCTION && symbol->section == SEC_UNDEFINED)
+		return find_function(symbol->name);
+	return NULL;
+}
+
+b32
+jit_compile_function(Ast_Node *f_node, Jit_Function *jit)
+{
+	if(!jit_can_compile_function(f_node))
+		return false;
+
+	bc_initialize_types();
+
+	// @NOTE: the file is only used to look up globals and functions
+	// which jit_can_compile_function doesn't let through
+	IR ir = ast_to_bc_function(NULL, f_node->function.body->scope_desc.body->statements.list, f_node);
+
+	Relocation *relocations = NULL;
+	u32 relocation_count = 0;
+	Code_Buffer code = x64_generate_function(&ir, &relocations, &relocation_count);
+
+	Loaded_Code loaded = {};
+	if(!x64_load_code(code, relocations, relocation_count, x64_get_symbols(), jit_resolve_symbol, &loaded))
+		return false;
+	jit->code = loaded.memory;
+	x64_perf_map_function(loaded.memory, code.count, f_node->function.identifier.name);
+	return true;
+}
+
+Jit_Function *
+jit_tier_up(Ast_Node *f_node)
+{
+	if(jit_disabled || (f_node->function.flags & FF_IS_INTERP_ONLY))
+		return NULL;
+
+	Jit_Table *entry = hmgetp_null(jit_table, f_node);
+	if(!entry)
+	{
+		Jit_Function empty = {};
+		hmput(jit_table, f_node, empty);
+		entry = hmgetp_null(jit_table, f_node);
+	}
+
+	Jit_Function *jit = &entry->value;
+	if(jit->code)
+		return jit;
+	if(jit->cant_compile)
+		return NULL;
+	if(++jit->call_count < jit_threshold)
+		return NULL;
+
+	if(!jit_compile_function(f_node, jit))
+	{
+		jit->cant_compile = true;
+		LG_DEBUG("Function %s couldn't be compiled, it will stay interpreted", f_node->function.identifier.name);
+		return NULL;
+	}
+	LG_DEBUG("Compiled function %s after %d interpreted calls", f_node->function.identifier.name, jit->call_count);
+	return jit;
+}
+
+Interp_Val
+jit_call(Ast_Node *f_node, Jit_Function *jit, Interp_Val *args, size_t arg_count)
+{
+	u64 native_args[JIT_MAX_ARGS] = {};
+	u8 context[16] = {};
+	size_t at = 0;
+	if(f_node->function.conv == CALL_APOC)
+		native_args[at++] = (u64)context;
+	for(size_t i = 0; i < arg_count; ++i)
+	{
+		copy_interp_val_to_memory(&native_args[at++], &args[i], f_node->function.arguments[i]->variable.type);
+	}
+
+	Type_Info *ret_type = f_node->function.type->func.return_type;
+	u64 ret = ((Jit_Native_Fn)jit->code)(native_args[0], native_args[1], native_args[2],
+			native_args[3], native_args[4], native_args[5]);
+
+	Interp_Val result = create_interp_val();
+	result.type = ret_type;
+	if(ret_type->type != T_VOID)
+	{
+		// @NOTE: only the low bytes of the return register are set
+		auto size = get_type_size(*ret_type);
+		memcpy(&result._u64, &ret, size);
+	}
+	return result;
+}
+
 Interp_Val
 interpret_function(Interp_Val func, Ast_Call call, b32 *failed)
 {
@@ -883,6 +1415,20 @@ interpret_function(Interp_Val func, Ast_Call call, b32 *failed)
 	{
 		arg_results[i] = interpret_expression(call.arguments[i], failed);
 	}
+
+	profiler_enter_function(f_node);
+	interp_push_call(f_node);
+
+	Jit_Function *jit = jit_tier_up(f_node);
+	if(jit)
+	{
+		result = jit_call(f_node, jit, arg_results, arg_count);
+		interp_pop_call();
+		profiler_exit_function(f_node);
+		destroy_scope();
+		return result;
+	}
+
 	for(size_t i = 0; i < arg_count; ++i)
 	{
 		Ast_Variable arg = args[i]->variable;
@@ -904,6 +1450,8 @@ interpret_function(Interp_Val func, Ast_Call call, b32 *failed)
 		*failed = true;
 		raise_interpret_error("Function did not return", token);
 	}
+	interp_pop_call();
+	profiler_exit_function(f_node);
 	destroy_scope();
 	return result;
 }
@@ -1022,6 +1570,12 @@ interpret_operand(Ast_Node *node, b32 *failed)
 			{
 				result.pointed = location->pointed;
 			}
+			else if(location->type->type == T_STRUCT ||
+					(location->type->type == T_ARRAY && location->type->array.array_type == ARR_STATIC))
+			{
+				// variables are kept flat, the value doesn't fit in the union
+				result = memory_to_interp_val(location->location, location->type);
+			}
 			else
 			{
 				memcpy(&result._u64, location->location, size);
@@ -1208,14 +1762,12 @@ interpret_unary(Ast_Node *node, b32 *failed)
 				case tok_plusplus:
 				{
 					DO_U_OP(result, ++, operand);
-					if(operand.location)
-						((Interp_Val *)operand.location)->_u64 = result._u64;
+					interp_store(node->unary_expr.expression, &result._u64, operand.type);
 				} break;
 				case tok_minusminus:
 				{
 					DO_U_OP(result, --, operand);
-					if(operand.location)
-						((Interp_Val *)operand.location)->_u64 = result._u64;
+					interp_store(node->unary_expr.expression, &result._u64, operand.type);
 				} break;
 				case tok_minus:
 				{
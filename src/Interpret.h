@@ -100,6 +100,26 @@ typedef struct
 } Interp_Table;
 
 typedef struct _Ast_Call Ast_Call;
+typedef struct _abstract_syntax_tree Ast_Node;
+
+typedef struct
+{
+	void *code;
+	u32 call_count;
+	b32 cant_compile;
+} Jit_Function;
+
+typedef struct
+{
+	Ast_Node *key;
+	Jit_Function value;
+} Jit_Table;
+
+typedef struct
+{
+	Ast_Node *key;
+	u64 value;
+} Interp_Loop_Table;
 
 inline Interp_Val
 create_interp_val();
@@ -113,18 +133,38 @@ interp_push_scope();
 void
 copy_interp_val_to_memory(void *dst, Interp_Val *val, Type_Info *dst_type);
 
+// @NOTE: the reverse of copy_interp_val_to_memory
+Interp_Val
+memory_to_interp_val(void *src, Type_Info *type);
+
 void
 interp_fix_and_add_val(u8 *identifier, Interp_Val *value, Type_Info *type);
 
 void
 set_dll_array(Platform_Dynamic_Lib *libs);
 
+void
+set_jit_options(u32 threshold, b32 interpret_only);
+
+// @NOTE: 0 means no limit, time_limit is in seconds
+void
+set_run_limits(u64 step_limit, u64 time_limit);
+
 void
 interp_add_symbol(u8 *identifier, Interp_Val value);
 
 Interp_Val
 interpret_expression(Ast_Node *expr, b32 *failed);
 
+// integer of any size, extended to 64 bits by its signedness
+i64
+interp_val_to_i64(Interp_Val val);
+
+// @NOTE: interprets the expression of a $run or a global declaration at site,
+// stops the build if it goes over the limits given to set_run_limits
+Interp_Val
+interpret_run(Ast_Node *expr, Token_Iden *site, b32 *failed);
+
 Interp_Val
 interpret_function(Interp_Val func, Ast_Call call, b32 *failed);
 
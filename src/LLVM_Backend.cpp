@@ -1525,6 +1525,89 @@ generate_func_call(File_Contents *f, Ast_Node *call_node, Function *func)
 	}
 }
 
+// ranges with more values than this are checked before the switch instruction
+// instead of adding every value in them as a case
+#define MAX_SWITCH_RANGE_CASES 64
+
+BasicBlock *
+generate_switch(File_Contents *f, Ast_Node *node, Function *func,
+		BasicBlock *block, BasicBlock *to_go, Ast_Node *statements, u64 *idx)
+{
+	Ast_Switch *sw = &node->switch_statement;
+	llvm::Value *value = generate_expression(f, sw->expr, func);
+	auto int_type = llvm::cast<llvm::IntegerType>(value->getType());
+
+	BasicBlock *aftr = BasicBlock::Create(*backend.context, "switch.aftr", func);
+
+	/*******************************************************
+	 *
+	 * break leaves the switch, continue still goes to the
+	 * loop around it
+	 *
+	 ******************************************************/
+	auto break_block = f->break_block;
+	f->break_block = aftr;
+
+	size_t case_count = SDCount(sw->cases);
+	BasicBlock **case_blocks = (BasicBlock **)AllocateCompileMemory(sizeof(BasicBlock *) * case_count);
+	for(size_t i = 0; i < case_count; ++i)
+	{
+		case_blocks[i] = generate_blocks_from_list(f, sw->cases[i].body->scope_desc.body, func,
+				NULL, "switch.case", aftr);
+	}
+	BasicBlock *default_block = aftr;
+	if(sw->default_body)
+	{
+		default_block = generate_blocks_from_list(f, sw->default_body->scope_desc.body, func,
+				NULL, "switch.else", aftr);
+	}
+	f->break_block = break_block;
+
+	{
+		backend.builder->SetInsertPoint(aftr);
+		size_t count = SDCount(statements->statements.list);
+		for(*idx += 1; *idx < count; *idx += 1)
+		{
+			generate_block(f, statements->statements.list[*idx], func, aftr, "switch.aftr", to_go, statements, idx);
+			if(aftr->getTerminator() != NULL)
+				break;
+		}
+		create_branch(aftr, to_go, &backend);
+	}
+
+	/*******************************************************
+	 *
+	 * LLVM picks between a jump table, a binary search and
+	 * compares for the switch instruction by itself
+	 *
+	 ******************************************************/
+	backend.builder->SetInsertPoint(block);
+	size_t range_count = SDCount(sw->ranges);
+	for(size_t i = 0; i < range_count; ++i)
+	{
+		Switch_Range range = sw->ranges[i];
+		u64 span = (u64)range.high - (u64)range.low;
+		if(span < MAX_SWITCH_RANGE_CASES)
+			continue;
+		BasicBlock *next = BasicBlock::Create(*backend.context, "switch.range", func);
+		auto offset = backend.builder->CreateSub(value, ConstantInt::get(int_type, range.low, true));
+		auto in_range = backend.builder->CreateICmpULE(offset, ConstantInt::get(int_type, span));
+		backend.builder->CreateCondBr(in_range, case_blocks[range.case_index], next);
+		backend.builder->SetInsertPoint(next);
+	}
+	auto switch_inst = backend.builder->CreateSwitch(value, default_block, range_count);
+	for(size_t i = 0; i < range_count; ++i)
+	{
+		Switch_Range range = sw->ranges[i];
+		u64 span = (u64)range.high - (u64)range.low;
+		if(span >= MAX_SWITCH_RANGE_CASES)
+			continue;
+		for(u64 v = 0; v <= span; ++v)
+			switch_inst->addCase(ConstantInt::get(int_type, (u64)range.low + v), case_blocks[range.case_index]);
+	}
+	return aftr;
+}
+
 BasicBlock *
 generate_block(File_Contents *f, Ast_Node *node, Function *func, BasicBlock *passed_block,
 		const char *block_name, BasicBlock *to_go, Ast_Node *list, u64 *idx)
@@ -1613,6 +1696,13 @@ generate_block(File_Contents *f, Ast_Node *node, Function *func, BasicBlock *pas
 			)
 			generate_for_in_loop(f, node, func, passed_block, to_go, list, idx);
 		} break;
+		case type_switch:
+		{
+			DEBUG_INFO (
+				emit_location(f, *node->switch_statement.token);
+			)
+			result = generate_switch(f, node, func, passed_block, to_go, list, idx);
+		} break;
 		case type_if:
 		{
 			DEBUG_INFO (
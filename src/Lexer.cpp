@@ -103,6 +103,7 @@ initialize_compiler(File_Contents *f)
 		shput(keyword_table, "$union",     tok_union);
 		shput(keyword_table, "$pack",      tok_pack);
 		shput(keyword_table, "$intrinsic", tok_intrinsic);
+		shput(keyword_table, "$inline",    tok_inline);
 		shput(keyword_table, "$call",      tok_call_conv);
 		shput(keyword_table, "$if",        tok_is_defined);
 		shput(keyword_table, "$else",      tok_else_def);
@@ -366,6 +367,9 @@ Token_Iden get_token(File_Contents *f)
 			b32 found_dot = false;
 			do {
 				advance_buffer(f);
+				// the ... of a case range like 1...5 isn't part of the number
+				if(*f->at == '.' && f->at[1] == '.')
+					break;
 				if(*f->at == '.')
 				{
 					if(found_dot)
@@ -679,6 +683,7 @@ u8 *type_to_str(Ast_Type type)
 		case type_func_call: return (u8 *)"type_func_call"; break;
 		case type_for: return (u8 *)"type_for"; break;
 		case type_if: return (u8 *)"type_if"; break;
+		case type_switch: return (u8 *)"type_switch"; break;
 		case type_expression: return (u8 *)"type_expression"; break;
 		case type_literal: return (u8 *)"type_literal"; break;
 		case type_var: return (u8 *)"type_var"; break;
@@ -103,6 +103,7 @@ typedef enum : signed short
 	tok_wasm_import = -60,
 	tok_wasm_export = -61,
 	tok_in          = -62,
+	tok_inline      = -63, // inline function at every call site
 } Token;
 
 typedef struct _str_hash_table
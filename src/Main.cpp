@@ -11,11 +11,20 @@
 #include <Stack.h>
 #include <Errors.h>
 #include <Interpret.h>
+#include <RunCache.h>
+#include <Profiler.h>
 #include <CommandLine.h>
 #include <DumpInfo.h>
 #include <Bytecode.h>
+#include <RegisterAllocator.h>
+#include <Optimizer.h>
 #include <x64_Gen.h>
+#include <x64_Peephole.h>
+#include <x64_Encoding.h>
+#include <x64_Dwarf.h>
+#include <x64_Loader.h>
 #include <ObjDumper.h>
+#include <x64_Linker.h>
 #include <Threading.h>
 
 #include <platform/platform.h>
@@ -30,11 +39,20 @@
 #include <Analyzer.cpp>
 #include <Errors.cpp>
 #include <Interpret.cpp>
+#include <RunCache.cpp>
+#include <Profiler.cpp>
 #include <CommandLine.cpp>
 #include <DumpInfo.cpp>
 #include <Bytecode.cpp>
+#include <RegisterAllocator.cpp>
+#include <Optimizer.cpp>
 #include <x64_Gen.cpp>
+#include <x64_Peephole.cpp>
+#include <x64_Encoding.cpp>
+#include <x64_Dwarf.cpp>
+#include <x64_Loader.cpp>
 #include <ObjDumper.cpp>
+#include <x64_Linker.cpp>
 #include <Threading.cpp>
 
 #if !defined(NOVM)
@@ -216,6 +234,15 @@ int main(int argc, char *argv[])
 	Build_Commands build_command = parse_command_line(argc, argv, &file_names);
 
 	set_dll_array(build_command.dynamic_libs);
+	set_jit_options(build_command.jit_threshold, build_command.interpret_only);
+	set_run_limits(build_command.run_step_limit, build_command.run_time_limit);
+	set_bc_optimization(build_command.optimization);
+	set_keep_frames(build_command.keep_frames);
+	x64_set_debug_info(build_command.debug_info);
+	x64_set_perf_map(build_command.perf_map);
+	x64_set_encoder_stats(build_command.time_passes);
+	run_cache_initialize((char *)build_command.run_cache_path);
+	profiler_initialize((char *)build_command.profile_path);
 
 	if(file_names.size() == 0)
 		LG_FATAL("No source files specified");
@@ -299,8 +326,26 @@ int main(int argc, char *argv[])
 		Relocation *relocations = NULL;
 		u32 relocation_count = 0;
 		TIME_FUNC(timers, IR **ir = ast_to_bytecode(files), codegen_clock, codegen);
+		if(build_command.ir_memory_report)
+			bc_print_memory_report();
+		if(build_command.time_passes)
+			bc_print_pass_report();
 		TIME_FUNC(timers, Code_Buffer code = x64_generate_code(files, ir, &relocations, &relocation_count), codegen_clock, codegen);
-		TIME_FUNC(timers, dump_obj(files[0], code, relocations, relocation_count, obj_symbols), codegen_clock, codegen);
+		if(build_command.time_passes)
+			x64_print_encoder_report();
+		if(build_command.peephole_report)
+			x64_print_peephole_report();
+		if(build_command.linker == LINK_BUILTIN && build_command.call_linker)
+		{
+			TIME_FUNC(timers, b32 linked = x64_link_executable(code, relocations, relocation_count, obj_symbols,
+						(char *)build_command.output_file), linking_clock, linking);
+			if(!linked)
+				return 1;
+		}
+		else
+		{
+			TIME_FUNC(timers, dump_obj(files[0], code, relocations, relocation_count, obj_symbols), codegen_clock, codegen);
+		}
 	}
 #if !defined(NOVM)
 	else if(build_command.backend == LLVM_Backend)
@@ -312,11 +357,16 @@ int main(int argc, char *argv[])
 	{
 		LG_FATAL("----- COMPILER BUG -----\nBackend is not specified %d", build_command.backend);
 	}
+
+	run_cache_save();
+	profiler_write_report();
 	
 	u8 *final_linker_command = (u8 *)AllocatePermanentMemory(4096);
 	vstd_strcat((char *)final_linker_command, (char *)build_command.linker_command);
 	vstd_strcat((char *)final_linker_command, (char *)" ");
-	vstd_strcat((char *)final_linker_command, files[0]->obj_name);
+	// the builtin linker never writes an object file
+	if(build_command.linker != LINK_BUILTIN)
+		vstd_strcat((char *)final_linker_command, files[0]->obj_name);
 
 	if(build_command.linker == LINK_EXE)
 	{
@@ -335,6 +385,10 @@ int main(int argc, char *argv[])
 	{
 		vstd_strcat((char *)final_linker_command, (char *)" -o");
 	}
+	else if(build_command.linker == LINK_BUILTIN)
+	{
+		// already linked after code generation
+	}
 	else
 	{
 		LG_FATAL("----- COMPILER BUG -----\nUnkown linker after arguments parsing");
@@ -343,7 +397,7 @@ int main(int argc, char *argv[])
 	vstd_strcat((char *)final_linker_command, (char *)build_command.output_file);
 
 	LG_DEBUG("Linker Command: %s", final_linker_command);
-	if(build_command.call_linker)
+	if(build_command.call_linker && build_command.linker != LINK_BUILTIN)
 	{
 		TIME_FUNC(timers, platform_call_and_wait((char *)final_linker_command),
 				linking_clock, linking);
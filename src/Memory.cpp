@@ -82,6 +82,9 @@ free_list *FreeList[2];
 void *
 _AllocateInterpMemory(u64 Size, i8 Index)
 {
+	// @NOTE: literals are interpreted from the bytecode jobs, so the free
+	// list is walked under the lock, AllocateMemory takes it by itself
+	lock_mutex();
 	free_list *FreeListPtr = FreeList[Index - INTERP_INDEX];
 	free_list *Prev = FreeListPtr;
 	free_list *Current = FreeListPtr;
@@ -98,6 +101,7 @@ _AllocateInterpMemory(u64 Size, i8 Index)
 			{
 				Prev->Next = Current->Next;
 			}
+			unlock_mutex();
 			*(u64 *)(Ptr - sizeof(u64)) = Size;
 			memset(Ptr, 0, Size);
 			return Ptr;
@@ -105,6 +109,7 @@ _AllocateInterpMemory(u64 Size, i8 Index)
 		Prev = Current;
 		Current = Current->Next;
 	}
+	unlock_mutex();
 
 	u8 *Ptr = (u8 *)AllocateMemory(Size + sizeof(Size), Index);
 	*(u64 *)Ptr = Size;
@@ -118,8 +123,10 @@ _FreeInterpMemory(void *Ptr, i8 Index)
 		return;
 	free_list *Node = (free_list *)AllocatePermanentMemory(sizeof(free_list));
 	Node->Ptr = (u8 *)Ptr;
+	lock_mutex();
 	Node->Next = FreeList[Index - INTERP_INDEX];
 	FreeList[Index - INTERP_INDEX] = Node;
+	unlock_mutex();
 }
 
 void
@@ -3,8 +3,11 @@
 #include <Analyzer.h>
 #include <time.h>
 #include <platform/platform.h>
+#if defined(_WIN32)
 #include <vcruntime_string.h>
+#endif
 #include <x64_Gen.h>
+#include <x64_Dwarf.h>
 
 #define DUMP_T(BUFFER, DATA, TYPE) *(TYPE *)BUFFER = DATA;
 #define ADVANCE(BUFFER, TYPE) BUFFER.buffer += sizeof(TYPE); BUFFER.count += sizeof(TYPE);
@@ -19,6 +22,12 @@
 // IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ
 #define COFF_CHARACTERISTICS_RODATA 0x40000040u
 
+// IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ | IMAGE_SCN_MEM_WRITE | IMAGE_SCN_ALIGN_16BYTES
+#define COFF_CHARACTERISTICS_DATA 0xC0500040u
+
+// IMAGE_SCN_CNT_UNINITIALIZED_DATA | IMAGE_SCN_MEM_READ | IMAGE_SCN_MEM_WRITE | IMAGE_SCN_ALIGN_16BYTES
+#define COFF_CHARACTERISTICS_BSS 0xC0500080u
+
 const int IMAGE_SCN_LNK_NRELOC_OVFL = 0x01000000;
 
 const int IMAGE_FILE_MACHINE_AMD64       = 0x8664;
@@ -27,14 +36,46 @@ const int IMAGE_FILE_LARGE_ADDRESS_AWARE = 0x0020;
 
 void
 dump_obj(File_Contents *f, Code_Buffer code, Relocation *relocations, u32 relocation_count, Symbol_Descriptor *symbols)
+{
+#if defined(_WIN32)
+	dump_coff_obj(f, code, relocations, relocation_count, symbols);
+#else
+	dump_elf_obj(f, code, relocations, relocation_count, symbols);
+#endif
+}
+
+// @NOTE: the sections are streamed straight from where they already are,
+// only the small tables are put together in memory
+static void
+push_file_chunk(Platform_Write_Chunk *chunks, u32 *chunk_count, u64 *at, u64 offset, void *data, u64 size)
+{
+	Assert(offset >= *at);
+	if(offset > *at)
+		chunks[(*chunk_count)++] = { NULL, offset - *at };
+	if(size != 0)
+		chunks[(*chunk_count)++] = { data, size };
+	*at = offset + size;
+}
+
+void
+dump_coff_obj(File_Contents *f, Code_Buffer code, Relocation *relocations, u32 relocation_count, Symbol_Descriptor *symbols)
 {
 	size_t code_size = code.count;
 	size_t symbol_count = SDCount(symbols);
-	File_Buffer file_buffer;
-	file_buffer.buffer = (u8 *)AllocateCompileMemory(code_size * 8);
-	file_buffer.count = 0;
-	u8 *buffer_start = file_buffer.buffer;
-	ADVANCE(file_buffer, Obj_Header);
+	u32 ro_size = 0;
+	u32 data_size = 0;
+	u32 bss_size = 0;
+	for(size_t i = 0; i < symbol_count; ++i)
+	{
+		u32 end = symbols[i].position + symbols[i].size;
+		if(symbols[i].section == SEC_RO_DATA && end > ro_size)
+			ro_size = end;
+		else if(symbols[i].section == SEC_DATA && end > data_size)
+			data_size = end;
+		else if(symbols[i].section == SEC_BSS && end > bss_size)
+			bss_size = end;
+	}
+
 	String_Table string_table = {};
 	string_table.strings = SDCreate(u8 *);
 	string_table.size = 4;
@@ -47,66 +88,53 @@ dump_obj(File_Contents *f, Code_Buffer code, Relocation *relocations, u32 reloca
 	if(relocation_count > 0xFFFF) {
 		code_section.characteristics |= IMAGE_SCN_LNK_NRELOC_OVFL;
 	}
-	ADVANCE(file_buffer, Obj_Section);
 
 	Obj_Section ro_section = {".rdata"};
 	ro_section.characteristics = COFF_CHARACTERISTICS_RODATA;
-	ADVANCE(file_buffer, Obj_Section);
+	ro_section.size = ro_size;
 
-	ro_section.data_offset = file_buffer.count;
-	i32 last_ro = -1;
+	// @NOTE: the section numbers match Object_Section
+	Obj_Section data_section = {".data"};
+	data_section.characteristics = COFF_CHARACTERISTICS_DATA;
+	data_section.size = data_size;
+
+	Obj_Section bss_section = {".bss"};
+	bss_section.characteristics = COFF_CHARACTERISTICS_BSS;
+	bss_section.size = bss_size;
+
+	// globals are placed with their alignment, the gaps stay zero
+	u8 *ro_data = (u8 *)AllocateCompileMemory(ro_size + 1);
+	u8 *data = (u8 *)AllocateCompileMemory(data_size + 1);
 	for(size_t i = 0; i < symbol_count; ++i)
 	{
 		if(symbols[i].section == SEC_RO_DATA)
 		{
-			last_ro = i;
 			if(symbols[i].type == OBJ_STRING)
-				memcpy(file_buffer.buffer, (u8 *)symbols[i].value, symbols[i].size);
+				memcpy(ro_data + symbols[i].position, (u8 *)symbols[i].value, symbols[i].size);
 			else
-				memcpy(file_buffer.buffer, &symbols[i].value, symbols[i].size);
-			file_buffer.buffer += symbols[i].size;
-			file_buffer.count += symbols[i].size;
+				memcpy(ro_data + symbols[i].position, &symbols[i].value, symbols[i].size);
 		}
+		else if(symbols[i].section == SEC_DATA)
+			memcpy(data + symbols[i].position, (u8 *)symbols[i].value, symbols[i].size);
 	}
-	if(last_ro == -1)
-	{
-		ro_section.size = 0;
-		ro_section.data_offset = 0;
-	}
-	else
-	{
-		ro_section.size = symbols[last_ro].position + symbols[last_ro].size;
-	}
-
-
-	code_section.data_offset = file_buffer.count;
-	dump_code(&file_buffer, code.buffer, code_size);
-
-	header.machine            = IMAGE_FILE_MACHINE_AMD64;
-	header.number_of_symbols  = symbol_count;
-	header.number_of_sections = 2;
-	header.time_stamp         = time(NULL);
-	header.characteristics    = IMAGE_FILE_LARGE_ADDRESS_AWARE;
-	code_section.relocation_offset = file_buffer.buffer - buffer_start;
 
+	Relocation overflow_reloc = {};
+	u32 written_relocations = relocation_count;
 	if(code_section.characteristics & IMAGE_SCN_LNK_NRELOC_OVFL)
 	{
 		code_section.number_of_relocations = 0xFFFF;
-
-		Relocation dummy_reloc = {};
-		dummy_reloc.offset = relocation_count;
-		dump_relocation(&file_buffer, &dummy_reloc);
+		overflow_reloc.offset = relocation_count;
+		written_relocations++;
 	}
 	else
 	{
 		code_section.number_of_relocations = relocation_count;
 	}
-	for(size_t i = 0; i < relocation_count; ++i)
-	{
-		dump_relocation(&file_buffer, &relocations[i]);
-	}
 
-	header.symbol_offset = file_buffer.buffer - buffer_start;
+	File_Buffer symbol_buffer;
+	symbol_buffer.buffer = (u8 *)AllocateCompileMemory(symbol_count * sizeof(Obj_Symbol) + 1);
+	symbol_buffer.count = 0;
+	u8 *symbol_start = symbol_buffer.buffer;
 	for(size_t i = 0; i < symbol_count; ++i)
 	{
 		Obj_Symbol symbol;
@@ -116,20 +144,60 @@ dump_obj(File_Contents *f, Code_Buffer code, Relocation *relocations, u32 reloca
 		symbol.type = symbols[i].type == OBJ_FUNCTION ? 0x20 : 0;
 		symbol.storage_class = IMAGE_SYM_CLASS_EXTERNAL;
 		symbol.value = symbols[i].position;
-		dump_symbol(&file_buffer, &symbol);
+		dump_coff_symbol(&symbol_buffer, &symbol);
 	}
-	dump_string_table(&file_buffer, &string_table);
 
-	u8 *save_start = buffer_start;
-	dump_header(buffer_start, header);
-	buffer_start += sizeof(Obj_Header);
-	dump_section_header(&buffer_start, &code_section);
-	dump_section_header(&buffer_start, &ro_section);
+	File_Buffer string_buffer;
+	string_buffer.buffer = (u8 *)AllocateCompileMemory(string_table.size);
+	string_buffer.count = 0;
+	u8 *string_start = string_buffer.buffer;
+	dump_coff_string_table(&string_buffer, &string_table);
+
+	u32 offset = sizeof(Obj_Header) + 4 * sizeof(Obj_Section);
+	if(ro_size != 0)
+		ro_section.data_offset = offset;
+	offset += ro_size;
+	if(data_size != 0)
+		data_section.data_offset = offset;
+	offset += data_size;
+	code_section.data_offset = offset;
+	offset += code_size;
+	code_section.relocation_offset = offset;
+	offset += written_relocations * sizeof(Relocation);
+
+	header.machine            = IMAGE_FILE_MACHINE_AMD64;
+	header.number_of_symbols  = symbol_count;
+	header.number_of_sections = 4;
+	header.time_stamp         = time(NULL);
+	header.characteristics    = IMAGE_FILE_LARGE_ADDRESS_AWARE;
+	header.symbol_offset      = offset;
+
+	u8 headers[sizeof(Obj_Header) + 4 * sizeof(Obj_Section)];
+	u8 *headers_at = headers;
+	dump_coff_header(headers_at, header);
+	headers_at += sizeof(Obj_Header);
+	dump_coff_section_header(&headers_at, &code_section);
+	dump_coff_section_header(&headers_at, &ro_section);
+	dump_coff_section_header(&headers_at, &data_section);
+	dump_coff_section_header(&headers_at, &bss_section);
+
+	Platform_Write_Chunk chunks[16];
+	u32 chunk_count = 0;
+	u64 at = 0;
+	push_file_chunk(chunks, &chunk_count, &at, 0, headers, sizeof(headers));
+	push_file_chunk(chunks, &chunk_count, &at, at, ro_data, ro_size);
+	push_file_chunk(chunks, &chunk_count, &at, at, data, data_size);
+	push_file_chunk(chunks, &chunk_count, &at, code_section.data_offset, code.buffer, code_size);
+	if(written_relocations != relocation_count)
+		push_file_chunk(chunks, &chunk_count, &at, at, &overflow_reloc, sizeof(Relocation));
+	push_file_chunk(chunks, &chunk_count, &at, at, relocations, relocation_count * sizeof(Relocation));
+	push_file_chunk(chunks, &chunk_count, &at, header.symbol_offset, symbol_start, symbol_buffer.count);
+	push_file_chunk(chunks, &chunk_count, &at, at, string_start, string_buffer.count);
 
 	char* obj_file = change_file_extension(
 		platform_path_to_file_name((char*)f->path), (char*)"o");
 	f->obj_name = obj_file;
-	platform_write_file(save_start, file_buffer.count, f->obj_name, true);
+	platform_write_file_chunks(chunks, chunk_count, f->obj_name);
 }
 
 void
@@ -193,11 +261,399 @@ dump_coff_header(u8 *buffer, Obj_Header header)
 	DUMP_T(buffer, header, Obj_Header);
 }
 
-void
-dump_code(File_Buffer *file_buffer, u8 *code, size_t size)
+
+// System V x86-64 values, only the ones the writer uses
+const int ELF_ET_REL       = 1;
+const int ELF_EM_X86_64    = 62;
+const int ELF_SHT_PROGBITS = 1;
+const int ELF_SHT_SYMTAB   = 2;
+const int ELF_SHT_STRTAB   = 3;
+const int ELF_SHT_RELA     = 4;
+const int ELF_SHT_NOBITS   = 8;
+const int ELF_SHF_WRITE     = 0x1;
+const int ELF_SHF_ALLOC     = 0x2;
+const int ELF_SHF_EXECINSTR = 0x4;
+const int ELF_SHF_INFO_LINK = 0x40;
+const int ELF_STB_LOCAL  = 0;
+const int ELF_STB_GLOBAL = 1;
+const int ELF_STT_NOTYPE = 0;
+const int ELF_STT_OBJECT = 1;
+const int ELF_STT_FUNC   = 2;
+const int ELF_STT_SECTION = 3;
+const int ELF_R_X86_64_64    = 1;
+const int ELF_R_X86_64_PC32  = 2;
+const int ELF_R_X86_64_PLT32 = 4;
+const int ELF_R_X86_64_32    = 10;
+
+enum Elf_Section_Index {
+	ELF_SEC_NULL,
+	ELF_SEC_TEXT,
+	ELF_SEC_RODATA,
+	ELF_SEC_DATA,
+	ELF_SEC_BSS,
+	ELF_SEC_RELA_TEXT,
+	ELF_SEC_SYMTAB,
+	ELF_SEC_STRTAB,
+	ELF_SEC_SHSTRTAB,
+	ELF_SEC_NOTE_STACK, // empty, tells ld the stack isn't executable
+	// only with debug info, a section and its relocations for every Dwarf_Section_Kind
+	ELF_SEC_DEBUG,
+	ELF_SEC_RELA_DEBUG = ELF_SEC_DEBUG + DWARF_SECTION_COUNT,
+	ELF_SEC_COUNT = ELF_SEC_RELA_DEBUG + DWARF_SECTION_COUNT
+};
+
+static inline u64
+elf_align(u64 value, u64 alignment)
 {
-	memcpy(file_buffer->buffer, code, size);
-	file_buffer->buffer += size;
-	file_buffer->count  += size;
+	return (value + alignment - 1) & ~(alignment - 1);
 }
 
+// @NOTE: ELF string tables start with an empty string, so index 0 is the empty name
+static u32
+elf_put_string(String_Table *table, u8 *str)
+{
+	if(!str || *str == 0)
+		return 0;
+	u32 at = table->size;
+	SDPush(table->strings, str);
+	table->size += vstd_strlen((char *)str) + 1;
+	return at;
+}
+
+static void
+elf_write_string_table(u8 *at, String_Table *table)
+{
+	*at++ = 0;
+	size_t str_count = SDCount(table->strings);
+	for(size_t i = 0; i < str_count; ++i)
+	{
+		size_t terminated_len = vstd_strlen((char *)table->strings[i]) + 1;
+		memcpy(at, table->strings[i], terminated_len);
+		at += terminated_len;
+	}
+}
+
+static u16
+elf_section_of(Object_Section section)
+{
+	switch(section)
+	{
+		case SEC_UNDEFINED: return ELF_SEC_NULL;
+		case SEC_TEXT:      return ELF_SEC_TEXT;
+		case SEC_RO_DATA:   return ELF_SEC_RODATA;
+		case SEC_DATA:      return ELF_SEC_DATA;
+		case SEC_BSS:       return ELF_SEC_BSS;
+	}
+	Assert(false);
+	return ELF_SEC_NULL;
+}
+
+static int
+compare_u32(const void *a, const void *b)
+{
+	u32 left = *(u32 *)a;
+	u32 right = *(u32 *)b;
+	return (left > right) - (left < right);
+}
+
+void
+dump_elf_obj(File_Contents *f, Code_Buffer code, Relocation *relocations, u32 relocation_count, Symbol_Descriptor *symbols)
+{
+	size_t symbol_count = SDCount(symbols);
+	X64_Debug_Info *debug = x64_get_debug_info();
+	int section_count = debug ? ELF_SEC_COUNT : ELF_SEC_DEBUG;
+
+	String_Table strtab = {};
+	strtab.strings = SDCreate(u8 *);
+	strtab.size = 1;
+	String_Table shstrtab = {};
+	shstrtab.strings = SDCreate(u8 *);
+	shstrtab.size = 1;
+
+	// the debug info is relocated against section symbols, .text is 1 and
+	// the debug sections follow it in Dwarf_Section_Kind order
+	u32 section_symbol_count = debug ? DWARF_SECTION_COUNT + 1 : 0;
+
+	// rodata literals are local so the generated names can't clash between objects,
+	// they go first because every local has to come before the first global
+	u32 *elf_index = (u32 *)AllocateCompileMemory(symbol_count * sizeof(u32) + 1);
+	u32 elf_symbol_count = 1 + section_symbol_count;
+	for(size_t i = 0; i < symbol_count; ++i)
+	{
+		if(symbols[i].section == SEC_RO_DATA)
+			elf_index[i] = elf_symbol_count++;
+	}
+	u32 first_global = elf_symbol_count;
+	for(size_t i = 0; i < symbol_count; ++i)
+	{
+		if(symbols[i].section != SEC_RO_DATA)
+			elf_index[i] = elf_symbol_count++;
+	}
+
+	// a function ends where the next one starts
+	u32 *function_starts = (u32 *)AllocateCompileMemory(symbol_count * sizeof(u32) + 1);
+	u32 function_count = 0;
+	u64 rodata_size = 0;
+	u64 data_size = 0;
+	u64 bss_size = 0;
+	for(size_t i = 0; i < symbol_count; ++i)
+	{
+		u64 end = (u64)symbols[i].position + symbols[i].size;
+		switch(symbols[i].section)
+		{
+			case SEC_TEXT:    function_starts[function_count++] = symbols[i].position; break;
+			case SEC_RO_DATA: if(end > rodata_size) rodata_size = end; break;
+			case SEC_DATA:    if(end > data_size) data_size = end; break;
+			case SEC_BSS:     if(end > bss_size) bss_size = end; break;
+			default: break;
+		}
+	}
+	qsort(function_starts, function_count, sizeof(u32), compare_u32);
+
+	Elf_Section_Header sections[ELF_SEC_COUNT] = {};
+	sections[ELF_SEC_TEXT].name      = elf_put_string(&shstrtab, (u8 *)".text");
+	sections[ELF_SEC_TEXT].type      = ELF_SHT_PROGBITS;
+	sections[ELF_SEC_TEXT].flags     = ELF_SHF_ALLOC | ELF_SHF_EXECINSTR;
+	sections[ELF_SEC_TEXT].size      = code.count;
+	sections[ELF_SEC_TEXT].alignment = 16;
+
+	sections[ELF_SEC_RODATA].name      = elf_put_string(&shstrtab, (u8 *)".rodata");
+	sections[ELF_SEC_RODATA].type      = ELF_SHT_PROGBITS;
+	sections[ELF_SEC_RODATA].flags     = ELF_SHF_ALLOC;
+	sections[ELF_SEC_RODATA].size      = rodata_size;
+	sections[ELF_SEC_RODATA].alignment = 16;
+
+	sections[ELF_SEC_DATA].name      = elf_put_string(&shstrtab, (u8 *)".data");
+	sections[ELF_SEC_DATA].type      = ELF_SHT_PROGBITS;
+	sections[ELF_SEC_DATA].flags     = ELF_SHF_ALLOC | ELF_SHF_WRITE;
+	sections[ELF_SEC_DATA].size      = data_size;
+	sections[ELF_SEC_DATA].alignment = 16;
+
+	sections[ELF_SEC_BSS].name      = elf_put_string(&shstrtab, (u8 *)".bss");
+	sections[ELF_SEC_BSS].type      = ELF_SHT_NOBITS;
+	sections[ELF_SEC_BSS].flags     = ELF_SHF_ALLOC | ELF_SHF_WRITE;
+	sections[ELF_SEC_BSS].size      = bss_size;
+	sections[ELF_SEC_BSS].alignment = 16;
+
+	sections[ELF_SEC_RELA_TEXT].name       = elf_put_string(&shstrtab, (u8 *)".rela.text");
+	sections[ELF_SEC_RELA_TEXT].type       = ELF_SHT_RELA;
+	sections[ELF_SEC_RELA_TEXT].flags      = ELF_SHF_INFO_LINK;
+	sections[ELF_SEC_RELA_TEXT].size       = relocation_count * sizeof(Elf_Rela);
+	sections[ELF_SEC_RELA_TEXT].link       = ELF_SEC_SYMTAB;
+	sections[ELF_SEC_RELA_TEXT].info       = ELF_SEC_TEXT;
+	sections[ELF_SEC_RELA_TEXT].alignment  = 8;
+	sections[ELF_SEC_RELA_TEXT].entry_size = sizeof(Elf_Rela);
+
+	sections[ELF_SEC_SYMTAB].name       = elf_put_string(&shstrtab, (u8 *)".symtab");
+	sections[ELF_SEC_SYMTAB].type       = ELF_SHT_SYMTAB;
+	sections[ELF_SEC_SYMTAB].size       = elf_symbol_count * sizeof(Elf_Symbol);
+	sections[ELF_SEC_SYMTAB].link       = ELF_SEC_STRTAB;
+	sections[ELF_SEC_SYMTAB].info       = first_global;
+	sections[ELF_SEC_SYMTAB].alignment  = 8;
+	sections[ELF_SEC_SYMTAB].entry_size = sizeof(Elf_Symbol);
+
+	sections[ELF_SEC_STRTAB].name      = elf_put_string(&shstrtab, (u8 *)".strtab");
+	sections[ELF_SEC_STRTAB].type      = ELF_SHT_STRTAB;
+	sections[ELF_SEC_STRTAB].alignment = 1;
+
+	sections[ELF_SEC_SHSTRTAB].name      = elf_put_string(&shstrtab, (u8 *)".shstrtab");
+	sections[ELF_SEC_SHSTRTAB].type      = ELF_SHT_STRTAB;
+	sections[ELF_SEC_SHSTRTAB].alignment = 1;
+
+	sections[ELF_SEC_NOTE_STACK].name      = elf_put_string(&shstrtab, (u8 *)".note.GNU-stack");
+	sections[ELF_SEC_NOTE_STACK].type      = ELF_SHT_PROGBITS;
+	sections[ELF_SEC_NOTE_STACK].alignment = 1;
+
+	void *contents[ELF_SEC_COUNT] = {};
+	Elf_Symbol *elf_symbols = (Elf_Symbol *)AllocateCompileMemory(elf_symbol_count * sizeof(Elf_Symbol));
+	memset(elf_symbols, 0, elf_symbol_count * sizeof(Elf_Symbol));
+	if(debug)
+	{
+		elf_symbols[1].info = (ELF_STB_LOCAL << 4) | ELF_STT_SECTION;
+		elf_symbols[1].section_index = ELF_SEC_TEXT;
+		for(int i = 0; i < DWARF_SECTION_COUNT; ++i)
+		{
+			Dwarf_Section *dwarf = &debug->sections[i];
+			elf_symbols[2 + i].info = (ELF_STB_LOCAL << 4) | ELF_STT_SECTION;
+			elf_symbols[2 + i].section_index = ELF_SEC_DEBUG + i;
+
+			const char *name = dwarf_section_name((Dwarf_Section_Kind)i);
+			Elf_Section_Header *section = &sections[ELF_SEC_DEBUG + i];
+			section->name      = elf_put_string(&shstrtab, (u8 *)name);
+			section->type      = ELF_SHT_PROGBITS;
+			section->size      = dwarf->bytes.count;
+			section->alignment = 1;
+			contents[ELF_SEC_DEBUG + i] = dwarf->bytes.buffer;
+
+			// the fields hold the offset from their target, that's the addend
+			Elf_Rela *rela = (Elf_Rela *)AllocateCompileMemory(dwarf->fixup_count * sizeof(Elf_Rela) + 1);
+			for(u32 j = 0; j < dwarf->fixup_count; ++j)
+			{
+				Dwarf_Fixup fixup = dwarf->fixups[j];
+				u8 *field = dwarf->bytes.buffer + fixup.offset;
+				rela[j].offset = fixup.offset;
+				if(fixup.target == DWARF_TEXT)
+				{
+					rela[j].info = (1ull << 32) | ELF_R_X86_64_64;
+					memcpy(&rela[j].addend, field, sizeof(u64));
+				}
+				else
+				{
+					u32 addend;
+					memcpy(&addend, field, sizeof(u32));
+					rela[j].info = ((u64)(2 + fixup.target) << 32) | ELF_R_X86_64_32;
+					rela[j].addend = addend;
+				}
+			}
+
+			u8 *rela_name = (u8 *)AllocateCompileMemory(32);
+			vstd_sprintf((char *)rela_name, ".rela%s", name);
+			Elf_Section_Header *rela_section = &sections[ELF_SEC_RELA_DEBUG + i];
+			rela_section->name       = elf_put_string(&shstrtab, rela_name);
+			rela_section->type       = ELF_SHT_RELA;
+			rela_section->flags      = ELF_SHF_INFO_LINK;
+			rela_section->size       = dwarf->fixup_count * sizeof(Elf_Rela);
+			rela_section->link       = ELF_SEC_SYMTAB;
+			rela_section->info       = ELF_SEC_DEBUG + i;
+			rela_section->alignment  = 8;
+			rela_section->entry_size = sizeof(Elf_Rela);
+			contents[ELF_SEC_RELA_DEBUG + i] = rela;
+		}
+	}
+	u32 string_count = 0;
+	for(size_t i = 0; i < symbol_count; ++i)
+	{
+		Symbol_Descriptor *sym = &symbols[i];
+		Elf_Symbol *elf_sym = &elf_symbols[elf_index[i]];
+		elf_sym->section_index = elf_section_of(sym->section);
+		elf_sym->value = sym->position;
+		elf_sym->size = sym->size;
+
+		u8 *name = sym->name;
+		if(sym->type == OBJ_STRING)
+		{
+			// the name of a string symbol is its contents
+			name = (u8 *)AllocateCompileMemory(32);
+			vstd_sprintf((char *)name, "__string!@%d", string_count++);
+		}
+		elf_sym->name = elf_put_string(&strtab, name);
+
+		if(sym->section == SEC_UNDEFINED)
+		{
+			elf_sym->value = 0;
+			elf_sym->info = (ELF_STB_GLOBAL << 4) | ELF_STT_NOTYPE;
+		}
+		else if(sym->type == OBJ_FUNCTION)
+		{
+			u32 *start = (u32 *)bsearch(&sym->position, function_starts, function_count, sizeof(u32), compare_u32);
+			while(start + 1 < function_starts + function_count && *(start + 1) == *start)
+				start++;
+			u32 end = start + 1 < function_starts + function_count ? *(start + 1) : code.count;
+			elf_sym->size = end - sym->position;
+			elf_sym->info = (ELF_STB_GLOBAL << 4) | ELF_STT_FUNC;
+		}
+		else if(sym->section == SEC_RO_DATA)
+		{
+			elf_sym->info = (ELF_STB_LOCAL << 4) | ELF_STT_OBJECT;
+		}
+		else
+		{
+			elf_sym->info = (ELF_STB_GLOBAL << 4) | ELF_STT_OBJECT;
+		}
+	}
+	sections[ELF_SEC_STRTAB].size = strtab.size;
+	sections[ELF_SEC_SHSTRTAB].size = shstrtab.size;
+
+	// lay the sections out after the header, the section headers go last
+	u64 file_size = sizeof(Elf_Header);
+	for(int i = ELF_SEC_TEXT; i < section_count; ++i)
+	{
+		file_size = elf_align(file_size, sections[i].alignment);
+		sections[i].offset = file_size;
+		if(sections[i].type != ELF_SHT_NOBITS)
+			file_size += sections[i].size;
+	}
+	file_size = elf_align(file_size, 8);
+	u64 section_header_offset = file_size;
+	file_size += section_count * sizeof(Elf_Section_Header);
+
+	Elf_Header header = {};
+	header.ident[0] = 0x7F;
+	header.ident[1] = 'E';
+	header.ident[2] = 'L';
+	header.ident[3] = 'F';
+	header.ident[4] = 2; // 64 bit
+	header.ident[5] = 1; // little endian
+	header.ident[6] = 1; // current version
+	header.type                     = ELF_ET_REL;
+	header.machine                  = ELF_EM_X86_64;
+	header.version                  = 1;
+	header.section_header_offset    = section_header_offset;
+	header.header_size              = sizeof(Elf_Header);
+	header.section_header_size      = sizeof(Elf_Section_Header);
+	header.number_of_sections       = section_count;
+	header.section_name_table_index = ELF_SEC_SHSTRTAB;
+
+	u8 *rodata = (u8 *)AllocateCompileMemory(rodata_size + 1);
+	u8 *data = (u8 *)AllocateCompileMemory(data_size + 1);
+	for(size_t i = 0; i < symbol_count; ++i)
+	{
+		Symbol_Descriptor *sym = &symbols[i];
+		u8 *to = NULL;
+		if(sym->section == SEC_RO_DATA)
+			to = rodata + sym->position;
+		else if(sym->section == SEC_DATA)
+			to = data + sym->position;
+		else
+			continue;
+
+		if(sym->type == OBJ_STRING || sym->section == SEC_DATA)
+			memcpy(to, (u8 *)sym->value, sym->size);
+		else
+			memcpy(to, &sym->value, sym->size);
+	}
+
+	// @NOTE: the generator only emits rel32 fields that end the instruction,
+	// so the displacement is from 4 bytes past the relocated offset
+	Elf_Rela *rela = (Elf_Rela *)AllocateCompileMemory(relocation_count * sizeof(Elf_Rela) + 1);
+	for(u32 i = 0; i < relocation_count; ++i)
+	{
+		Relocation reloc = relocations[i];
+		Assert(reloc.symbol_index < symbol_count);
+		u64 type = symbols[reloc.symbol_index].type == OBJ_FUNCTION ? ELF_R_X86_64_PLT32 : ELF_R_X86_64_PC32;
+		rela[i].offset = reloc.offset;
+		rela[i].info   = ((u64)elf_index[reloc.symbol_index] << 32) | type;
+		rela[i].addend = -4;
+	}
+
+	u8 *strings = (u8 *)AllocateCompileMemory(strtab.size);
+	elf_write_string_table(strings, &strtab);
+	u8 *section_names = (u8 *)AllocateCompileMemory(shstrtab.size);
+	elf_write_string_table(section_names, &shstrtab);
+
+	// the code is written from the generator's buffer, the gaps between sections are zeroes
+	contents[ELF_SEC_TEXT]      = code.buffer;
+	contents[ELF_SEC_RODATA]    = rodata;
+	contents[ELF_SEC_DATA]      = data;
+	contents[ELF_SEC_RELA_TEXT] = rela;
+	contents[ELF_SEC_SYMTAB]    = elf_symbols;
+	contents[ELF_SEC_STRTAB]    = strings;
+	contents[ELF_SEC_SHSTRTAB]  = section_names;
+
+	Platform_Write_Chunk chunks[ELF_SEC_COUNT * 2 + 4];
+	u32 chunk_count = 0;
+	u64 at = 0;
+	push_file_chunk(chunks, &chunk_count, &at, 0, &header, sizeof(Elf_Header));
+	for(int i = ELF_SEC_TEXT; i < section_count; ++i)
+	{
+		if(sections[i].type != ELF_SHT_NOBITS)
+			push_file_chunk(chunks, &chunk_count, &at, sections[i].offset, contents[i], sections[i].size);
+	}
+	push_file_chunk(chunks, &chunk_count, &at, section_header_offset, sections, section_count * sizeof(Elf_Section_Header));
+	Assert(at == file_size);
+
+	char* obj_file = change_file_extension(
+		platform_path_to_file_name((char*)f->path), (char*)"o");
+	f->obj_name = obj_file;
+	platform_write_file_chunks(chunks, chunk_count, f->obj_name);
+}
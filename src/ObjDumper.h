@@ -55,18 +55,66 @@ struct String_Table {
 	u8 **strings;
 	u32 size;
 };
+
+struct Elf_Header {
+	u8  ident[16];
+	u16 type;
+	u16 machine;
+	u32 version;
+	u64 entry;
+	u64 program_header_offset;
+	u64 section_header_offset;
+	u32 flags;
+	u16 header_size;
+	u16 program_header_size;
+	u16 number_of_program_headers;
+	u16 section_header_size;
+	u16 number_of_sections;
+	u16 section_name_table_index;
+};
+
+struct Elf_Section_Header {
+	u32 name;
+	u32 type;
+	u64 flags;
+	u64 address;
+	u64 offset;
+	u64 size;
+	u32 link;
+	u32 info;
+	u64 alignment;
+	u64 entry_size;
+};
+
+struct Elf_Symbol {
+	u32 name;
+	u8  info;
+	u8  other;
+	u16 section_index;
+	u64 value;
+	u64 size;
+};
+
+struct Elf_Rela {
+	u64 offset;
+	u64 info;
+	i64 addend;
+};
 #pragma pack(pop)
 
 enum Object_Section {
 	SEC_UNDEFINED,
 	SEC_TEXT,
-	SEC_RO_DATA
+	SEC_RO_DATA,
+	SEC_DATA, // value points at the initial bytes
+	SEC_BSS,  // zero initialized, only the size is used
 };
 
 enum Object_Symbol_Type {
 	OBJ_FUNCTION = 0x20,
 	OBJ_STRING,
-	OBJ_FLOAT
+	OBJ_FLOAT,
+	OBJ_DATA, // a global variable
 };
 
 struct Symbol_Descriptor {
@@ -88,90 +136,30 @@ typedef struct _Code_Buffer Code_Buffer;
 void
 dump_obj(File_Contents *f, Code_Buffer code, Relocation *relocations, u32 relocation_count, Symbol_Descriptor *symbols);
 
-void
-dump_code(File_Buffer *file_buffer, u8 *code, size_t size);
-
 void
 put_symbol_name(u8 *str, Obj_Symbol_Name *out, String_Table *str_table);
 
+// @NOTE: dump_obj picks the object format of the platform we're running on
 void
-dump_coff_section_header(u8 **file_buffer, Obj_Section *section);
+dump_coff_obj(File_Contents *f, Code_Buffer code, Relocation *relocations, u32 relocation_count, Symbol_Descriptor *symbols);
 
+// Relocatable ELF64 for x86-64: .text, .rodata, .data, .bss, .rela.text, .symtab and .strtab
 void
-dump_elf_section_header(u8 **file_buffer, Obj_Section *section);
-
-inline void
-dump_section_header(u8 **file_buffer, Obj_Section *section)
-{
-#if defined (_WIN32)
-	dump_coff_section_header(file_buffer, section);
-#else
-	dump_elf_section_header(file_buffer, section);
-#endif
-}
+dump_elf_obj(File_Contents *f, Code_Buffer code, Relocation *relocations, u32 relocation_count, Symbol_Descriptor *symbols);
 
 void
-dump_coff_relocation(File_Buffer *file_buffer, Relocation *reloc);
+dump_coff_section_header(u8 **file_buffer, Obj_Section *section);
 
 void
-dump_elf_relocation(File_Buffer *file_buffer, Relocation *reloc);
-
-inline void
-dump_relocation(File_Buffer *file_buffer, Relocation *reloc)
-{
-#if defined (_WIN32)
-	dump_coff_relocation(file_buffer, reloc);
-#else
-	dump_elf_relocation(file_buffer, reloc);
-#endif
-}
+dump_coff_relocation(File_Buffer *file_buffer, Relocation *reloc);
 
 void
 dump_coff_string_table(File_Buffer *file_buffer, String_Table *table);
 
-void
-dump_elf_string_table(File_Buffer *file_buffer, String_Table *table);
-
-inline void
-dump_string_table(File_Buffer *file_buffer, String_Table *table)
-{
-#if defined (_WIN32)
-	dump_coff_string_table(file_buffer, table);
-#else
-	dump_elf_string_table(file_buffer, table);
-#endif
-}
-
 void
 dump_coff_symbol(File_Buffer *file_buffer, Obj_Symbol *symbol);
 
-void
-dump_elf_symbol(File_Buffer *file_buffer, Obj_Symbol *symbol);
-
-inline void
-dump_symbol(File_Buffer *file_buffer, Obj_Symbol *symbol)
-{
-#if defined (_WIN32)
-	dump_coff_symbol(file_buffer, symbol);
-#else
-	dump_elf_symbol(file_buffer, symbol);
-#endif
-}
-
 void
 dump_coff_header(u8 *file_buffer, Obj_Header header);
 
-void
-dump_elf_header(u8 *file_buffer, Obj_Header header);
-
-inline void
-dump_header(u8 *file_buffer, Obj_Header header)
-{
-#if defined (_WIN32)
-	dump_coff_header(file_buffer, header);
-#else
-	dump_elf_header(file_buffer, header);
 #endif
-};
-#endif
-
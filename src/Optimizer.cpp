@@ -0,0 +1,737 @@
+#include <Optimizer.h>
+#include <RegisterAllocator.h>
+#include <Type.h>
+#include <platform/platform.h>
+#include <Profiler.h>
+
+// @NOTE: calls only pass arguments in registers so they never get close to this
+#define MAX_OPERAND_USES 64
+// folding a mul or div only makes its result usable as a constant
+// in the next round, --optimize max keeps going until nothing changes
+#define SOME_OPTIMIZATION_ROUNDS 2
+#define MAX_OPTIMIZATION_ROUNDS 8
+
+static Optimization_Level bc_optimization = OPT_NONE;
+static Type_Info *opt_bool_type;
+
+typedef struct
+{
+	Bytecode key;
+	i32 value;
+} Expression_Table;
+
+void
+set_bc_optimization(Optimization_Level level)
+{
+	bc_optimization = level;
+	opt_bool_type = (Type_Info *)AllocatePermanentMemory(sizeof(Type_Info));
+	opt_bool_type->type = T_BOOLEAN;
+	opt_bool_type->primitive.size = byte1;
+	opt_bool_type->identifier = (u8 *)"bool";
+}
+
+Optimization_Level
+get_bc_optimization()
+{
+	return bc_optimization;
+}
+
+i32
+opt_get_uses(Bytecode *bc, i32 **out)
+{
+	BC_Operands ops = bc_get_operands(bc);
+	i32 count = 0;
+	for(i32 i = 0; i < ops.use_count; ++i)
+		out[count++] = ops.uses[i];
+	if(bc->op == BC_CALL)
+	{
+		BC_Func_Call *call = (BC_Func_Call *)bc->big_idx;
+		Assert(call->expr_count + 1 + count <= MAX_OPERAND_USES);
+		for(i32 i = 0; i < call->expr_count; ++i)
+			out[count++] = &call->expressions[i];
+		out[count++] = &call->func_register;
+	}
+	return count;
+}
+
+void
+opt_analyze(IR_Optimizer *opt)
+{
+	memset(opt->def_count, 0, sizeof(i32) * opt->reg_count);
+	memset(opt->use_count, 0, sizeof(i32) * opt->reg_count);
+	memset(opt->def_of, 0, sizeof(Bytecode *) * opt->reg_count);
+	for(i32 i = 0; i < opt->reg_count; ++i)
+		opt->replace_with[i] = -1;
+
+	size_t block_count = SDCount(opt->ir->blocks);
+	for(size_t block_idx = 0; block_idx < block_count; ++block_idx)
+	{
+		IR_Block *block = opt->ir->blocks[block_idx];
+		for(i32 i = 0; i < block->bc_count; ++i)
+		{
+			Bytecode *bc = &block->bc[i];
+			i32 *uses[MAX_OPERAND_USES];
+			i32 use_count = opt_get_uses(bc, uses);
+			for(i32 j = 0; j < use_count; ++j)
+			{
+				if(is_virtual(*uses[j]))
+					opt->use_count[*uses[j]]++;
+			}
+			BC_Operands ops = bc_get_operands(bc);
+			if(ops.def && is_virtual(*ops.def))
+			{
+				opt->def_count[*ops.def]++;
+				opt->def_of[*ops.def] = bc;
+			}
+		}
+	}
+}
+
+// A value is a virtual register that's set once and can't be changed
+// through a stack slot, so every use of it sees the same thing
+inline b32
+opt_is_value(IR_Optimizer *opt, i32 reg)
+{
+	return is_virtual(reg) && reg < opt->reg_count && opt->def_count[reg] == 1 && !opt->is_mutable[reg];
+}
+
+inline b32
+opt_get_constant(IR_Optimizer *opt, i32 reg, u64 *out)
+{
+	if(!opt_is_value(opt, reg) || opt->def_of[reg]->op != BC_MOVE_VALUE_TO_REG)
+		return false;
+	*out = opt->def_of[reg]->big_idx;
+	return true;
+}
+
+inline i32
+opt_resolve(IR_Optimizer *opt, i32 reg)
+{
+	while(is_virtual(reg) && reg < opt->reg_count && opt->replace_with[reg] != -1)
+		reg = opt->replace_with[reg];
+	return reg;
+}
+
+void
+opt_apply_replacements(IR_Optimizer *opt)
+{
+	size_t block_count = SDCount(opt->ir->blocks);
+	for(size_t block_idx = 0; block_idx < block_count; ++block_idx)
+	{
+		IR_Block *block = opt->ir->blocks[block_idx];
+		for(i32 i = 0; i < block->bc_count; ++i)
+		{
+			i32 *uses[MAX_OPERAND_USES];
+			i32 use_count = opt_get_uses(&block->bc[i], uses);
+			for(i32 j = 0; j < use_count; ++j)
+				*uses[j] = opt_resolve(opt, *uses[j]);
+		}
+	}
+}
+
+inline void
+opt_make_copy(Bytecode *bc, i32 from)
+{
+	bc->op = BC_MOVE_REG_TO_REG;
+	bc->left_idx = bc->result;
+	bc->right_idx = from;
+}
+
+Type_Info *
+opt_constant_type(Type_Info *type)
+{
+	if(!is_untyped(*type))
+		return type;
+	Type_Info *typed = (Type_Info *)AllocateCompileMemory(sizeof(Type_Info));
+	*typed = untyped_to_type(*type);
+	return typed;
+}
+
+inline void
+opt_make_constant(Bytecode *bc, u64 value, Type_Info *type)
+{
+	bc->op = BC_MOVE_VALUE_TO_REG;
+	bc->big_idx = value;
+	bc->type = type;
+}
+
+// Sign or zero extends the low bytes of a value the way the type reads them
+u64
+opt_extend(u64 value, Type_Info *type, b32 as_signed)
+{
+	i32 size = get_type_size(*type);
+	if(size >= 8)
+		return value;
+	i32 bits = size * 8;
+	u64 mask = ((u64)1 << bits) - 1;
+	value &= mask;
+	if(as_signed && (value >> (bits - 1)) & 1)
+		value |= ~mask;
+	return value;
+}
+
+b32
+is_pure_op(Bytecode *bc)
+{
+	switch(bc->op)
+	{
+		case BC_MOVE_VALUE_TO_REG:
+		case BC_MOVE_FLOAT_TO_REG:
+		case BC_MOVE_FUNCTION_TO_REG:
+		case BC_LOAD_STRING:
+		case BC_LOAD_ADDRESS:
+		case BC_GLOBAL_ADDRESS:
+		case BC_LOAD_STACK:
+		case BC_LOAD_DATA_SEG:
+		case BC_OFFSET_POINTER:
+		case BC_F_ADD:
+		case BC_ADD:
+		case BC_F_SUB:
+		case BC_SUB:
+		case BC_F_MUL:
+		case BC_F_DIV:
+		case BC_NEG:
+		case BC_FNEG:
+		case BC_SLR:
+		case BC_SAR:
+		case BC_SL:
+		case BC_LOGICAL_NOT:
+		case BC_BIT_AND:
+		case BC_BIT_XOR:
+		case BC_BIT_OR:
+			return true;
+		case BC_MOVE_REG_TO_REG:
+			// moves into a physical register set up a mul, div or call
+			return is_virtual(bc->left_idx) && bc->left_idx == bc->result;
+		default:
+		{
+			if(bc->op >= BC_CMP_I_EQ && bc->op <= BC_FCMP_GREATER_EQ)
+				return true;
+			if(bc->op >= BC_CAST_SEXT && bc->op <= BC_CAST_F_EXT)
+				return true;
+			return false;
+		}
+	}
+}
+
+/* ---- Passes ---- */
+
+// The lowering emits "r = a; r = r + b", turn it into "r = a + b" so r is only
+// set once. The allocator puts the copy back if it can't reuse a's register
+i32
+pass_three_address_form(IR_Optimizer *opt)
+{
+	i32 changes = 0;
+	size_t block_count = SDCount(opt->ir->blocks);
+	for(size_t block_idx = 0; block_idx < block_count; ++block_idx)
+	{
+		IR_Block *block = opt->ir->blocks[block_idx];
+		for(i32 i = 0; i + 1 < block->bc_count; ++i)
+		{
+			Bytecode *copy = &block->bc[i];
+			Bytecode *op = &block->bc[i + 1];
+			if(copy->op != BC_MOVE_REG_TO_REG || !is_virtual(copy->left_idx) ||
+					copy->left_idx != copy->result || !is_virtual(copy->right_idx))
+				continue;
+			if(!is_two_address_op(op->op) || op->left_idx != copy->result ||
+					op->result != copy->result || op->right_idx == copy->result)
+				continue;
+			op->left_idx = copy->right_idx;
+			copy->op = BC_NO_OP;
+			changes++;
+		}
+	}
+	return changes;
+}
+
+b32
+fold_binary(BC_OP op, u64 left, u64 right, Type_Info *type, u64 *out)
+{
+	b32 is_signed_op = (op >= BC_CMP_I_EQ && op <= BC_CMP_I_GREATER_EQ) || op == BC_SAR ||
+		op == BC_I_MUL || op == BC_I_DIV || op == BC_I_REM;
+	i64 l = (i64)opt_extend(left, type, is_signed_op);
+	i64 r = (i64)opt_extend(right, type, is_signed_op);
+	u64 ul = (u64)l;
+	u64 ur = (u64)r;
+	i32 bits = get_type_size(*type) * 8;
+	u64 result;
+	switch(op)
+	{
+		case BC_ADD:     result = ul + ur; break;
+		case BC_SUB:     result = ul - ur; break;
+		case BC_U_MUL:
+		case BC_I_MUL:   result = ul * ur; break;
+		case BC_BIT_AND: result = ul & ur; break;
+		case BC_BIT_OR:  result = ul | ur; break;
+		case BC_BIT_XOR: result = ul ^ ur; break;
+		case BC_SL:
+		case BC_SLR:
+		case BC_SAR:
+		{
+			// x64 masks the count, don't guess what was meant
+			if(ur >= (u64)bits)
+				return false;
+			if(op == BC_SL)
+				result = ul << ur;
+			else if(op == BC_SLR)
+				result = ul >> ur;
+			else
+				result = (u64)(l >> ur);
+		} break;
+		case BC_U_DIV:
+		case BC_U_REM:
+		{
+			if(ur == 0)
+				return false;
+			result = op == BC_U_DIV ? ul / ur : ul % ur;
+		} break;
+		case BC_I_DIV:
+		case BC_I_REM:
+		{
+			i64 min = bits == 64 ? INT64_MIN : -((i64)1 << (bits - 1));
+			if(r == 0 || (l == min && r == -1))
+				return false;
+			result = op == BC_I_DIV ? (u64)(l / r) : (u64)(l % r);
+		} break;
+		case BC_CMP_I_EQ:            *out = ul == ur; return true;
+		case BC_CMP_I_NEQ:           *out = ul != ur; return true;
+		case BC_CMP_I_LESS_THAN:     *out = l <  r;   return true;
+		case BC_CMP_I_GREATER_THAN:  *out = l >  r;   return true;
+		case BC_CMP_I_LESS_EQ:       *out = l <= r;   return true;
+		case BC_CMP_I_GREATER_EQ:    *out = l >= r;   return true;
+		case BC_CMP_U_LESS_THAN:     *out = ul <  ur; return true;
+		case BC_CMP_U_GREATER_THAN:  *out = ul >  ur; return true;
+		case BC_CMP_U_LESS_EQ:       *out = ul <= ur; return true;
+		case BC_CMP_U_GREATER_EQ:    *out = ul >= ur; return true;
+		default: return false;
+	}
+	*out = opt_extend(result, type, is_signed(*type));
+	return true;
+}
+
+// mul and div are lowered as
+//     r_a = left (named result)
+//     r_c = right (named right_rc)
+//     r_d ^= r_d
+//     result = result op right_rc
+b32
+fold_fixed_register_op(IR_Optimizer *opt, IR_Block *block, i32 idx)
+{
+	if(idx < 3)
+		return false;
+	Bytecode *op = &block->bc[idx];
+	Bytecode *move_a = &block->bc[idx - 3];
+	Bytecode *move_c = &block->bc[idx - 2];
+	Bytecode *clear_d = &block->bc[idx - 1];
+	if(move_a->op != BC_MOVE_REG_TO_REG || move_a->left_idx != reg_a || move_a->result != op->result)
+		return false;
+	if(move_c->op != BC_MOVE_REG_TO_REG || move_c->left_idx != reg_c || move_c->result != op->right_idx)
+		return false;
+	if(clear_d->op != BC_BIT_XOR || clear_d->left_idx != reg_d || clear_d->right_idx != reg_d)
+		return false;
+	if(op->left_idx != op->result)
+		return false;
+
+	u64 left, right, value;
+	if(!opt_get_constant(opt, move_a->right_idx, &left) || !opt_get_constant(opt, move_c->right_idx, &right))
+		return false;
+	Type_Info *type = opt_constant_type(op->type);
+	if(!fold_binary(op->op, left, right, type, &value))
+		return false;
+
+	move_a->op  = BC_NO_OP;
+	move_c->op  = BC_NO_OP;
+	clear_d->op = BC_NO_OP;
+	opt_make_constant(op, value, type);
+	return true;
+}
+
+i32
+pass_constant_folding(IR_Optimizer *opt)
+{
+	i32 changes = 0;
+	size_t block_count = SDCount(opt->ir->blocks);
+	for(size_t block_idx = 0; block_idx < block_count; ++block_idx)
+	{
+		IR_Block *block = opt->ir->blocks[block_idx];
+		for(i32 i = 0; i < block->bc_count; ++i)
+		{
+			Bytecode *bc = &block->bc[i];
+			if(bc->op >= BC_U_MUL && bc->op <= BC_U_REM && bc->op != BC_F_MUL && bc->op != BC_F_DIV &&
+					bc->op != BC_F_REM)
+			{
+				changes += fold_fixed_register_op(opt, block, i);
+				continue;
+			}
+			if(bc->op == BC_COND_JUMP)
+			{
+				u64 condition;
+				if(bc->result == -1)
+				{
+					// the jump uses the flags of a compare, fold that compare instead
+					Bytecode *compare = get_flags_compare(block, i);
+					u64 left, right;
+					if(compare->op > BC_CMP_U_GREATER_EQ || !compare->type || is_float(*compare->type))
+						continue;
+					if(!opt_get_constant(opt, compare->left_idx, &left) || !opt_get_constant(opt, compare->right_idx, &right))
+						continue;
+					if(!fold_binary(compare->op, left, right, opt_constant_type(compare->type), &condition))
+						continue;
+					compare->op = BC_NO_OP;
+				}
+				else if(!opt_get_constant(opt, bc->result, &condition))
+					continue;
+				// the jump only looks at the low byte
+				if(condition & 0xFF)
+				{
+					bc->op = BC_JUMP;
+					bc->result = -1;
+					for(i32 j = i + 1; j < block->bc_count; ++j)
+						block->bc[j].op = BC_NO_OP;
+				}
+				else
+				{
+					bc->op = BC_NO_OP;
+				}
+				changes++;
+				continue;
+			}
+
+			b32 is_compare = bc->op >= BC_CMP_I_EQ && bc->op <= BC_CMP_U_GREATER_EQ;
+			b32 is_arithmetic = bc->op == BC_ADD || bc->op == BC_SUB || bc->op == BC_SL ||
+				bc->op == BC_SAR || bc->op == BC_SLR || bc->op == BC_BIT_AND ||
+				bc->op == BC_BIT_OR || bc->op == BC_BIT_XOR;
+			if(!is_compare && !is_arithmetic)
+				continue;
+			if(!opt_is_value(opt, bc->result) || !bc->type || is_float(*bc->type) || is_vector(*bc->type))
+				continue;
+
+			u64 left, right, value;
+			Type_Info *type = opt_constant_type(bc->type);
+			b32 left_constant  = opt_get_constant(opt, bc->left_idx, &left);
+			b32 right_constant = opt_get_constant(opt, bc->right_idx, &right);
+			if(left_constant && right_constant)
+			{
+				if(fold_binary(bc->op, left, right, type, &value))
+				{
+					opt_make_constant(bc, value, is_compare ? opt_bool_type : type);
+					changes++;
+				}
+			}
+			else if((bc->op == BC_SUB || bc->op == BC_BIT_XOR) && bc->left_idx == bc->right_idx &&
+					opt_is_value(opt, bc->left_idx))
+			{
+				opt_make_constant(bc, 0, type);
+				changes++;
+			}
+			else if(is_arithmetic && bc->op != BC_BIT_AND && right_constant &&
+					opt_extend(right, bc->type, false) == 0)
+			{
+				// x + 0, x - 0, x | 0, x ^ 0, x << 0
+				opt_make_copy(bc, bc->left_idx);
+				changes++;
+			}
+			else if((bc->op == BC_ADD || bc->op == BC_BIT_OR || bc->op == BC_BIT_XOR) && left_constant &&
+					opt_extend(left, bc->type, false) == 0)
+			{
+				opt_make_copy(bc, bc->right_idx);
+				changes++;
+			}
+		}
+	}
+	return changes;
+}
+
+b32
+same_size_values(Type_Info *a, Type_Info *b)
+{
+	if(!a || !b)
+		return false;
+	return get_type_size(*a) == get_type_size(*b) && is_float(*a) == is_float(*b);
+}
+
+i32
+pass_copy_propagation(IR_Optimizer *opt)
+{
+	i32 changes = 0;
+	size_t block_count = SDCount(opt->ir->blocks);
+	for(size_t block_idx = 0; block_idx < block_count; ++block_idx)
+	{
+		IR_Block *block = opt->ir->blocks[block_idx];
+		for(i32 i = 0; i < block->bc_count; ++i)
+		{
+			Bytecode *bc = &block->bc[i];
+			if(bc->op != BC_MOVE_REG_TO_REG || !is_virtual(bc->left_idx) || bc->left_idx != bc->result)
+				continue;
+			if(!opt_is_value(opt, bc->result) || !opt_is_value(opt, bc->right_idx))
+				continue;
+			// compares are typed by their operands so their result size isn't known here
+			Bytecode *source = opt->def_of[bc->right_idx];
+			if(source->op >= BC_CMP_I_EQ && source->op <= BC_FCMP_GREATER_EQ)
+				continue;
+			if(!same_size_values(source->type, bc->type) || opt->is_variable[bc->result])
+				continue;
+			opt->replace_with[bc->result] = bc->right_idx;
+			bc->op = BC_NO_OP;
+			changes++;
+		}
+	}
+	opt_apply_replacements(opt);
+	return changes;
+}
+
+// Only within a block, the first one dominates everything after it
+// so later copies can be renamed to it
+i32
+pass_local_cse(IR_Optimizer *opt)
+{
+	i32 changes = 0;
+	size_t block_count = SDCount(opt->ir->blocks);
+	for(size_t block_idx = 0; block_idx < block_count; ++block_idx)
+	{
+		IR_Block *block = opt->ir->blocks[block_idx];
+		Expression_Table *seen = NULL;
+		for(i32 i = 0; i < block->bc_count; ++i)
+		{
+			Bytecode *bc = &block->bc[i];
+			// constants are cheaper to rematerialize than to keep in a register,
+			// merging address loads would hide assignments from promotion
+			// and a global can be stored to through its address between two loads
+			if(!is_pure_op(bc) || bc->op == BC_MOVE_VALUE_TO_REG || bc->op == BC_MOVE_FLOAT_TO_REG ||
+					bc->op == BC_LOAD_ADDRESS || bc->op == BC_LOAD_STACK || bc->op == BC_LOAD_DATA_SEG ||
+					bc->op == BC_MOVE_REG_TO_REG)
+				continue;
+			if(!opt_is_value(opt, bc->result) || opt->is_variable[bc->result])
+				continue;
+
+			Bytecode key = *bc;
+			b32 all_values = true;
+			i32 *uses[MAX_OPERAND_USES];
+			i32 use_count = opt_get_uses(&key, uses);
+			for(i32 j = 0; j < use_count; ++j)
+			{
+				*uses[j] = opt_resolve(opt, *uses[j]);
+				if(!opt_is_value(opt, *uses[j]))
+					all_values = false;
+			}
+			if(!all_values)
+				continue;
+			key.result = 0;
+			// the same expression on another line is still the same
+			key.line = 0;
+			key.column = 0;
+
+			i32 found = hmgeti(seen, key);
+			if(found != -1)
+			{
+				opt->replace_with[bc->result] = seen[found].value;
+				bc->op = BC_NO_OP;
+				changes++;
+			}
+			else
+			{
+				hmput(seen, key, bc->result);
+			}
+		}
+		hmfree(seen);
+	}
+	opt_apply_replacements(opt);
+	return changes;
+}
+
+i32
+pass_dead_code_elimination(IR_Optimizer *opt)
+{
+	i32 changes = 0;
+	i32 *worklist = (i32 *)AllocateCompileMemory(sizeof(i32) * opt->reg_count);
+	i32 worklist_count = 0;
+	for(i32 reg = reg_invalid + 1; reg < opt->reg_count; ++reg)
+	{
+		if(opt->use_count[reg] == 0 && opt_is_value(opt, reg) && !opt->is_variable[reg])
+			worklist[worklist_count++] = reg;
+	}
+
+	while(worklist_count > 0)
+	{
+		i32 reg = worklist[--worklist_count];
+		Bytecode *bc = opt->def_of[reg];
+		if(bc->op == BC_NO_OP || !is_pure_op(bc))
+			continue;
+
+		i32 *uses[MAX_OPERAND_USES];
+		i32 use_count = opt_get_uses(bc, uses);
+		for(i32 j = 0; j < use_count; ++j)
+		{
+			i32 used = *uses[j];
+			if(!is_virtual(used) || used >= opt->reg_count)
+				continue;
+			if(--opt->use_count[used] == 0 && opt_is_value(opt, used) && !opt->is_variable[used])
+				worklist[worklist_count++] = used;
+		}
+		bc->op = BC_NO_OP;
+		changes++;
+	}
+	return changes;
+}
+
+i32
+pass_unreachable_blocks(IR_Optimizer *opt)
+{
+	IR *ir = opt->ir;
+	i32 block_count = SDCount(ir->blocks);
+	if(block_count == 0)
+		return 0;
+
+	Block_Index_Table *block_index = NULL;
+	for(i32 i = 0; i < block_count; ++i)
+		hmput(block_index, ir->blocks[i], i);
+
+	b32 *reached = (b32 *)AllocateCompileMemory(sizeof(b32) * block_count);
+	i32 *worklist = (i32 *)AllocateCompileMemory(sizeof(i32) * block_count);
+	i32 worklist_count = 0;
+	reached[0] = true;
+	worklist[worklist_count++] = 0;
+	while(worklist_count > 0)
+	{
+		IR_Block *block = ir->blocks[worklist[--worklist_count]];
+		for(i32 i = 0; i < block->bc_count; ++i)
+		{
+			Bytecode *bc = &block->bc[i];
+			i32 target_count = bc_jump_target_count(ir, bc);
+			for(i32 t = 0; t < target_count; ++t)
+			{
+				IR_Block *target = bc_jump_target(ir, bc, t);
+				i32 target_idx = hmget(block_index, target);
+				if(!reached[target_idx])
+				{
+					reached[target_idx] = true;
+					worklist[worklist_count++] = target_idx;
+				}
+			}
+		}
+	}
+	hmfree(block_index);
+
+	i32 kept = 0;
+	for(i32 i = 0; i < block_count; ++i)
+	{
+		if(reached[i])
+			ir->blocks[kept++] = ir->blocks[i];
+	}
+	i32 removed = block_count - kept;
+	for(i32 i = 0; i < removed; ++i)
+		SDPop(ir->blocks);
+	return removed;
+}
+
+static IR_Pass ir_passes[] = {
+	{"three address form",   pass_three_address_form,    OPT_SOME},
+	{"constant folding",     pass_constant_folding,      OPT_SOME},
+	{"copy propagation",     pass_copy_propagation,      OPT_SOME},
+	{"local cse",            pass_local_cse,             OPT_MAX},
+	{"dead code",            pass_dead_code_elimination, OPT_SOME},
+	{"unreachable blocks",   pass_unreachable_blocks,    OPT_SOME},
+};
+
+void
+remove_no_ops(IR *ir)
+{
+	size_t block_count = SDCount(ir->blocks);
+	for(size_t block_idx = 0; block_idx < block_count; ++block_idx)
+	{
+		IR_Block *block = ir->blocks[block_idx];
+		i32 kept = 0;
+		for(i32 i = 0; i < block->bc_count; ++i)
+		{
+			if(block->bc[i].op != BC_NO_OP)
+				block->bc[kept++] = block->bc[i];
+		}
+		block->bc_count = kept;
+	}
+}
+
+// Assignments go through the variable's address, a variable that's stored
+// to once and never has its address taken keeps the value it was declared with
+void
+find_mutable_variables(IR_Optimizer *opt)
+{
+	IR *ir = opt->ir;
+	size_t slot_count = SDCount(ir->allocated);
+	i32 *store_count = (i32 *)AllocateCompileMemory(sizeof(i32) * (slot_count + 1));
+	b32 *addressed = (b32 *)AllocateCompileMemory(sizeof(b32) * (slot_count + 1));
+	size_t block_count = SDCount(ir->blocks);
+	for(size_t block_idx = 0; block_idx < block_count; ++block_idx)
+	{
+		IR_Block *block = ir->blocks[block_idx];
+		for(i32 i = 0; i < block->bc_count; ++i)
+		{
+			Bytecode *bc = &block->bc[i];
+			if(bc->op == BC_LOAD_ADDRESS)
+				addressed[bc->right_idx] = true;
+			else if(bc->op == BC_STORE || bc->op == BC_STORE_NON_REMOVABLE)
+				store_count[bc->left_idx]++;
+		}
+	}
+
+	for(size_t i = 0; i < slot_count; ++i)
+	{
+		i32 reg = ir->allocated[i].virtual_register;
+		if(!is_virtual(reg) || reg >= opt->reg_count)
+			continue;
+		opt->is_variable[reg] = true;
+		if(addressed[i] || store_count[i] != 1)
+			opt->is_mutable[reg] = true;
+	}
+}
+
+void
+optimize_ir(IR *ir)
+{
+	if(bc_optimization < OPT_SOME)
+		return;
+
+	IR_Optimizer opt = {};
+	opt.ir = ir;
+	opt.reg_count = ir->reg_count;
+	opt.def_count    = (i32 *)AllocateCompileMemory(sizeof(i32) * opt.reg_count);
+	opt.use_count    = (i32 *)AllocateCompileMemory(sizeof(i32) * opt.reg_count);
+	opt.def_of       = (Bytecode **)AllocateCompileMemory(sizeof(Bytecode *) * opt.reg_count);
+	opt.is_variable  = (b32 *)AllocateCompileMemory(sizeof(b32) * opt.reg_count);
+	opt.is_mutable   = (b32 *)AllocateCompileMemory(sizeof(b32) * opt.reg_count);
+	opt.replace_with = (i32 *)AllocateCompileMemory(sizeof(i32) * opt.reg_count);
+	find_mutable_variables(&opt);
+
+	i32 rounds = bc_optimization == OPT_MAX ? MAX_OPTIMIZATION_ROUNDS : SOME_OPTIMIZATION_ROUNDS;
+	for(i32 round = 0; round < rounds; ++round)
+	{
+		i32 changes = 0;
+		for(i32 i = 0; i < ARR_SIZE(ir_passes); ++i)
+		{
+			IR_Pass *pass = &ir_passes[i];
+			if(pass->level > bc_optimization)
+				continue;
+			u64 start = profiler_now();
+			opt_analyze(&opt);
+			i32 pass_changes = pass->run(&opt);
+			// functions are optimized on the thread pool
+			platform_interlocked_add64(&pass->ns, profiler_now() - start);
+			platform_interlocked_add64(&pass->runs, 1);
+			platform_interlocked_add64(&pass->changes, pass_changes);
+			changes += pass_changes;
+		}
+		if(changes == 0)
+			break;
+	}
+	remove_no_ops(ir);
+}
+
+void
+bc_print_pass_report()
+{
+	for(i32 i = 0; i < ARR_SIZE(ir_passes); ++i)
+	{
+		IR_Pass *pass = &ir_passes[i];
+		LG_INFO("%s: %llu runs, %llu changes, %f.3ms", pass->name, pass->runs, pass->changes,
+				(f64)pass->ns / 1000000.0);
+	}
+}
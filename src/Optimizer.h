@@ -0,0 +1,48 @@
+#ifndef _OPTIMIZER_H
+#define _OPTIMIZER_H
+#include <Basic.h>
+#include <Analyzer.h>
+#include <Bytecode.h>
+
+typedef struct
+{
+	IR *ir;
+	i32 reg_count;
+	i32 *def_count;
+	i32 *use_count;
+	Bytecode **def_of;
+	// registers a variable's stack slot was declared with, they aren't renamed
+	b32 *is_variable;
+	// variables that are assigned to, or have their address taken
+	b32 *is_mutable;
+	i32 *replace_with;
+} IR_Optimizer;
+
+// @NOTE: returns how many instructions or blocks the pass changed
+typedef i32 (*IR_Pass_Function)(IR_Optimizer *opt);
+
+typedef struct
+{
+	const char *name;
+	IR_Pass_Function run;
+	Optimization_Level level;
+	u64 runs;
+	u64 changes;
+	u64 ns;
+} IR_Pass;
+
+void
+set_bc_optimization(Optimization_Level level);
+
+Optimization_Level
+get_bc_optimization();
+
+// Runs on the IR before register allocation, while values
+// are still in virtual registers
+void
+optimize_ir(IR *ir);
+
+void
+bc_print_pass_report();
+
+#endif // Header Guard
@@ -708,6 +708,71 @@ parse_for_statement(File_Contents *f)
 	return result;
 }
 
+// switch value {
+//     case 1, 2 { ... }
+//     case 10...20 { ... }
+//     else { ... }
+// }
+Ast_Node *
+parse_switch_statement(File_Contents *f)
+{
+	Ast_Node *result = alloc_node();
+	result->type = type_switch;
+	Ast_Switch *sw = &result->switch_statement;
+	f->expression_level = -1;
+	sw->token = advance_token(f);
+	sw->expr = parse_expression(f, NO_EXPECT, false);
+	f->expression_level = 0;
+	sw->cases = SDCreate(Ast_Case);
+	sw->default_body = NULL;
+	if(f->curr_token->type != (Token)'{')
+		raise_parsing_unexpected_token("{ after the switch value.\n\tSyntax: switch value { case 1 { ... } else { ... } }", f);
+	advance_token(f);
+
+	while(f->curr_token->type != (Token)'}')
+	{
+		if(f->curr_token->type == tok_case)
+		{
+			Ast_Case new_case = {};
+			new_case.token = advance_token(f);
+			new_case.values = SDCreate(Case_Value);
+			while(true)
+			{
+				Case_Value value = {};
+				f->expression_level = -1;
+				value.low = parse_expression(f, NO_EXPECT, false);
+				if(f->curr_token->type == tok_var_args)
+				{
+					advance_token(f);
+					value.high = parse_expression(f, NO_EXPECT, false);
+				}
+				f->expression_level = 0;
+				SDPush(new_case.values, value);
+				if(f->curr_token->type != (Token)',')
+					break;
+				advance_token(f);
+			}
+			if(f->curr_token->type != (Token)'{')
+				raise_parsing_unexpected_token("{ after the case values.\n\tSyntax: case 1, 2, 5...9 { ... }", f);
+			new_case.body = parse_body(f, false, NULL);
+			SDPush(sw->cases, new_case);
+		}
+		else if(f->curr_token->type == tok_else)
+		{
+			Token_Iden *else_token = advance_token(f);
+			if(sw->default_body)
+				raise_semantic_error(f, "switch statement has more than one else", *else_token);
+			if(f->curr_token->type != (Token)'{')
+				raise_parsing_unexpected_token("{ after else in switch statement", f);
+			sw->default_body = parse_body(f, false, NULL);
+		}
+		else
+			raise_parsing_unexpected_token("case or else in switch statement", f);
+	}
+	advance_token(f);
+	return result;
+}
+
 Ast_Node *
 parse_statement(File_Contents *f)
 {
@@ -762,6 +827,10 @@ parse_statement(File_Contents *f)
 		{
 			result = parse_for_statement(f);
 		} break;
+		case tok_switch:
+		{
+			result = parse_switch_statement(f);
+		} break;
 		case tok_defer:
 		{
 			advance_token(f);
@@ -1776,7 +1845,7 @@ parse_func(File_Contents *f)
 {
 	parser_eat(f, tok_func);
 	Ast_Func this_func = {};
-	while(f->curr_token->type == tok_interp || f->curr_token->type == tok_intrinsic || f->curr_token->type == tok_call_conv || f->curr_token->type == tok_wasm_import || f->curr_token->type == tok_wasm_export)
+	while(f->curr_token->type == tok_interp || f->curr_token->type == tok_intrinsic || f->curr_token->type == tok_call_conv || f->curr_token->type == tok_wasm_import || f->curr_token->type == tok_wasm_export || f->curr_token->type == tok_inline)
 	{
 		switch((int)f->curr_token->type)
 		{
@@ -1796,6 +1865,10 @@ parse_func(File_Contents *f)
 			{
 				this_func.flags |= FF_WASM_EXPORT;
 			} break;
+			case tok_inline:
+			{
+				this_func.flags |= FF_INLINE;
+			} break;
 			case tok_call_conv:
 			{
 				advance_token(f);
@@ -21,6 +21,7 @@ typedef enum _Ast_Type
 {
 	type_root         = -100,
 		
+	type_switch       = -72,
 	type_for_in       = -71,
 	type_continue     = -70,
 	type_dunn         = -69,
@@ -168,6 +169,7 @@ typedef enum
 	FF_PASS_RETURN_PTR= 1 << 3,
 	FF_WASM_IMPORT    = 1 << 4,
 	FF_WASM_EXPORT    = 1 << 5,
+	FF_INLINE         = 1 << 6,
 } Func_Flags;
 
 typedef enum
@@ -325,6 +327,37 @@ typedef struct
 	Type_Info expr_type;
 } Ast_Cast;
 
+typedef struct
+{
+	Ast_Node *low;
+	Ast_Node *high; // @NOTE: NULL unless the value is a range, low...high
+} Case_Value;
+
+typedef struct
+{
+	Case_Value *values; // SDArray
+	Ast_Node *body;     // type_scope_start
+	Token_Iden *token;
+} Ast_Case;
+
+// @NOTE: every value of every case, merged and sorted by the analyzer
+typedef struct
+{
+	i64 low;
+	i64 high;
+	i32 case_index;
+} Switch_Range;
+
+typedef struct
+{
+	Ast_Node *expr;
+	Ast_Case *cases;        // SDArray
+	Ast_Node *default_body; // type_scope_start, NULL without an else
+	Token_Iden *token;
+	Type_Info expr_type;    // @NOTE: after analysis
+	Switch_Range *ranges;   // @NOTE: after analysis, SDArray
+} Ast_Switch;
+
 typedef enum 
 {
 	SEL_NORMAL = 0,
@@ -391,6 +424,7 @@ struct _abstract_syntax_tree
 		Ast_Cast cast;
 		Ast_For for_loop;
 		Ast_For_In for_in;
+		Ast_Switch switch_statement;
 		Ast_Selector selector;
 		Ast_Func function;
 		Ast_Condition condition;
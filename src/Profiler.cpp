@@ -0,0 +1,245 @@
+#include <Profiler.h>
+#include <Parser.h>
+#include <platform/platform.h>
+#include <chrono>
+
+#define MAX_PROFILE_DEPTH 1024
+
+static b32 profiling;
+static char *profile_path;
+static Profile_Function_Table *profile_functions;
+static Profile_Statement_Table *profile_statements;
+static Profile_Stack_Table *profile_stacks;
+static Profile_Frame profile_stack[MAX_PROFILE_DEPTH];
+static i32 profile_depth;
+static i32 profile_dropped_depth;
+
+u64
+profiler_now()
+{
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+void
+profiler_initialize(char *path)
+{
+	profile_path = path;
+	profiling = path != NULL;
+	sh_new_arena(profile_stacks);
+}
+
+b32
+profiler_is_enabled()
+{
+	return profiling;
+}
+
+Profile_Function *
+profiler_get_function(Ast_Node *func)
+{
+	Profile_Function_Table *entry = hmgetp_null(profile_functions, func);
+	if(!entry)
+	{
+		Profile_Function new_func = {};
+		new_func.name = func->function.identifier.name;
+		new_func.token = func->function.identifier.token;
+		hmput(profile_functions, func, new_func);
+		entry = hmgetp_null(profile_functions, func);
+	}
+	return &entry->value;
+}
+
+void
+profiler_enter_function(Ast_Node *func)
+{
+	if(!profiling)
+		return;
+
+	if(profile_depth == MAX_PROFILE_DEPTH)
+	{
+		profile_dropped_depth++;
+		return;
+	}
+
+	Profile_Function *stats = profiler_get_function(func);
+	stats->calls++;
+	stats->active++;
+
+	Profile_Frame frame = {};
+	frame.function = func;
+	frame.start_ns = profiler_now();
+	profile_stack[profile_depth++] = frame;
+}
+
+void
+profiler_add_folded_stack(u64 self_ns)
+{
+	char stack[4096];
+	size_t at = 0;
+	for(i32 i = 0; i < profile_depth; ++i)
+	{
+		u8 *name = profile_stack[i].function->function.identifier.name;
+		size_t len = vstd_strlen((char *)name);
+		if(at + len + 2 >= sizeof(stack))
+			break;
+		if(i != 0)
+			stack[at++] = ';';
+		memcpy(stack + at, name, len);
+		at += len;
+	}
+	stack[at] = 0;
+
+	ptrdiff_t idx = shgeti(profile_stacks, stack);
+	if(idx == -1)
+		shput(profile_stacks, stack, self_ns);
+	else
+		profile_stacks[idx].value += self_ns;
+}
+
+void
+profiler_exit_function(Ast_Node *func)
+{
+	if(!profiling)
+		return;
+
+	if(profile_dropped_depth > 0)
+	{
+		profile_dropped_depth--;
+		return;
+	}
+
+	Assert(profile_depth > 0);
+	Profile_Frame *frame = &profile_stack[profile_depth - 1];
+	Assert(frame->function == func);
+
+	u64 elapsed = profiler_now() - frame->start_ns;
+	u64 self_ns = elapsed - frame->child_ns;
+
+	Profile_Function *stats = profiler_get_function(func);
+	stats->self_ns += self_ns;
+	if(--stats->active == 0)
+		stats->total_ns += elapsed;
+
+	profiler_add_folded_stack(self_ns);
+
+	profile_depth--;
+	if(profile_depth > 0)
+		profile_stack[profile_depth - 1].child_ns += elapsed;
+}
+
+void
+profiler_count_statement(Ast_Node *node)
+{
+	if(!profiling)
+		return;
+
+	ptrdiff_t idx = hmgeti(profile_statements, node);
+	if(idx == -1)
+		hmput(profile_statements, node, 1);
+	else
+		profile_statements[idx].value++;
+}
+
+Token_Iden *
+profiler_statement_token(Ast_Node *node)
+{
+	switch((int)node->type)
+	{
+		case type_assignment: return &node->assignment.token;
+		case type_return:     return &node->ret.token;
+		case type_func_call:  return node->func_call.token;
+		case type_if:         return node->condition.token;
+		case type_for:        return node->for_loop.token;
+		case type_for_in:     return node->for_in.token;
+		case type_switch:     return node->switch_statement.token;
+		case type_break:      return node->brk.token;
+		case type_continue:   return node->cont.token;
+		case type_postfix:    return node->postfix.token;
+		case type_scope_start:
+		case type_scope_end:  return node->scope_desc.token;
+	}
+	return NULL;
+}
+
+static inline void
+profiler_append(char **at, const char *str)
+{
+	size_t len = vstd_strlen((char *)str);
+	memcpy(*at, str, len);
+	*at += len;
+}
+
+int
+profiler_compare_functions(const void *a, const void *b)
+{
+	u64 left  = ((Profile_Function_Table *)a)->value.self_ns;
+	u64 right = ((Profile_Function_Table *)b)->value.self_ns;
+	return left < right ? 1 : left > right ? -1 : 0;
+}
+
+int
+profiler_compare_statements(const void *a, const void *b)
+{
+	u64 left  = ((Profile_Statement_Table *)a)->value;
+	u64 right = ((Profile_Statement_Table *)b)->value;
+	return left < right ? 1 : left > right ? -1 : 0;
+}
+
+void
+profiler_write_report()
+{
+	if(!profiling)
+		return;
+
+	size_t func_count = hmlen(profile_functions);
+	size_t statement_count = hmlen(profile_statements);
+	size_t stack_count = shlen(profile_stacks);
+
+	qsort(profile_functions, func_count, sizeof(Profile_Function_Table), profiler_compare_functions);
+	qsort(profile_statements, statement_count, sizeof(Profile_Statement_Table), profiler_compare_statements);
+	// @NOTE: sorting moved the entries around, the lookups are useless from here
+	profiling = false;
+
+	size_t report_size = 256 + (func_count + statement_count) * 512;
+	char *report = (char *)AllocateCompileMemory(report_size);
+	char *at = report;
+	profiler_append(&at, "Compile time execution profile\n\ncalls\ttotal (ms)\tself (ms)\tfunction\n");
+	for(size_t i = 0; i < func_count; ++i)
+	{
+		Profile_Function *stats = &profile_functions[i].value;
+		at += vstd_sprintf(at, "%llu\t%f\t%f\t%s (%s:%llu)\n", stats->calls,
+				(f64)stats->total_ns / 1000000.0, (f64)stats->self_ns / 1000000.0,
+				stats->name, stats->token->file, stats->token->line);
+	}
+
+	profiler_append(&at, "\nhits\tstatement\n");
+	for(size_t i = 0; i < statement_count; ++i)
+	{
+		Token_Iden *token = profiler_statement_token(profile_statements[i].key);
+		if(token)
+			at += vstd_sprintf(at, "%llu\t%s:%llu:%llu\n", profile_statements[i].value, token->file, token->line, token->column);
+		else
+			at += vstd_sprintf(at, "%llu\t<unknown>\n", profile_statements[i].value);
+	}
+
+	if(!platform_write_file(report, at - report, profile_path, true))
+		LG_ERROR("Couldn't write compile time profile to %s", profile_path);
+
+	size_t folded_size = 64;
+	for(size_t i = 0; i < stack_count; ++i)
+		folded_size += vstd_strlen(profile_stacks[i].key) + 32;
+	char *folded = (char *)AllocateCompileMemory(folded_size);
+	at = folded;
+	for(size_t i = 0; i < stack_count; ++i)
+	{
+		// @NOTE: weights are in microseconds
+		at += vstd_sprintf(at, "%s %llu\n", profile_stacks[i].key, profile_stacks[i].value / 1000);
+	}
+
+	char *folded_path = (char *)AllocateCompileMemory(vstd_strlen(profile_path) + 8);
+	vstd_sprintf(folded_path, "%s.folded", profile_path);
+	if(!platform_write_file(folded, at - folded, folded_path, true))
+		LG_ERROR("Couldn't write folded stacks to %s", folded_path);
+}
+
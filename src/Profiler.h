@@ -0,0 +1,72 @@
+
+#ifndef _PROFILER_H
+#define _PROFILER_H
+#include <Basic.h>
+#include <Lexer.h>
+
+typedef struct _abstract_syntax_tree Ast_Node;
+
+typedef struct
+{
+	u8 *name;
+	Token_Iden *token;
+	u64 calls;
+	u64 self_ns;
+	u64 total_ns;
+	u32 active; // @NOTE: recursive calls only count towards total time once
+} Profile_Function;
+
+typedef struct
+{
+	Ast_Node *key;
+	Profile_Function value;
+} Profile_Function_Table;
+
+typedef struct
+{
+	Ast_Node *key;
+	u64 value;
+} Profile_Statement_Table;
+
+typedef struct
+{
+	char *key;
+	u64 value;
+} Profile_Stack_Table;
+
+typedef struct
+{
+	Ast_Node *function;
+	u64 start_ns;
+	u64 child_ns;
+} Profile_Frame;
+
+// monotonic nanoseconds, the clock every compile time measurement uses
+u64
+profiler_now();
+
+// @NOTE: path == NULL disables profiling, the folded stacks go
+// to the same path with .folded appended
+void
+profiler_initialize(char *path);
+
+b32
+profiler_is_enabled();
+
+void
+profiler_enter_function(Ast_Node *func);
+
+void
+profiler_exit_function(Ast_Node *func);
+
+void
+profiler_count_statement(Ast_Node *node);
+
+// where a statement starts, NULL for the ones that aren't counted
+Token_Iden *
+profiler_statement_token(Ast_Node *node);
+
+void
+profiler_write_report();
+
+#endif // Header Guard
@@ -0,0 +1,1822 @@
+#include <RegisterAllocator.h>
+#include <Optimizer.h>
+#include <Type.h>
+#include <platform/platform.h>
+
+// @NOTE: the allocator keeps rewriting the spilled intervals into short
+// lived temporaries and starts over, it should be done after 2 passes
+#define MAX_ALLOCATION_PASSES 8
+
+static b32 keep_frames = false;
+
+#if defined(_WIN32)
+static const Register int_argument_registers[] = {
+	reg_c, reg_d, reg_r8, reg_r9
+};
+// xmm6-xmm15 are callee saved on windows and we don't save them
+#define LAST_ALLOCATABLE_XMM reg_xmm5
+#else
+static const Register int_argument_registers[] = {
+	reg_di, reg_si, reg_d, reg_c, reg_r8, reg_r9
+};
+// @NOTE: the encoders don't emit REX prefixes for every float op yet
+#define LAST_ALLOCATABLE_XMM reg_xmm7
+#endif
+static const Register float_argument_registers[] = {
+	reg_xmm0, reg_xmm1, reg_xmm2, reg_xmm3
+};
+
+// Volatile registers come first so values that don't live across
+// calls don't make us save anything in the prologue.
+// rsi and rdi are left out since their low byte needs a REX prefix
+// and they are argument registers on linux anyway
+static const Register int_allocation_order[] = {
+	reg_a, reg_c, reg_d, reg_r8, reg_r9, reg_r10, reg_r11,
+	reg_b, reg_r12, reg_r13, reg_r14, reg_r15
+};
+static const Register caller_saved_int[] = {
+	reg_a, reg_c, reg_d, reg_r8, reg_r9, reg_r10, reg_r11
+};
+static const Register callee_saved_int[] = {
+	reg_b, reg_r12, reg_r13, reg_r14, reg_r15
+};
+
+inline b32
+is_virtual(i32 reg)
+{
+	return reg > reg_invalid;
+}
+
+inline b32
+is_allocatable(i32 reg)
+{
+	if(reg < 0 || reg >= reg_invalid)
+		return false;
+	if(reg >= reg_xmm0)
+		return reg <= LAST_ALLOCATABLE_XMM;
+	return reg != reg_sp && reg != reg_bp && reg != reg_si && reg != reg_di;
+}
+
+inline b32
+is_low_register(Register reg)
+{
+	return reg <= reg_b || (reg >= reg_xmm0 && reg <= reg_xmm7);
+}
+
+inline b32
+is_callee_saved(Register reg)
+{
+	return reg == reg_b || (reg >= reg_r12 && reg <= reg_r15);
+}
+
+inline b32
+is_two_address_op(BC_OP op)
+{
+	switch(op)
+	{
+		case BC_ADD:
+		case BC_SUB:
+		case BC_F_ADD:
+		case BC_F_SUB:
+		case BC_F_MUL:
+		case BC_F_DIV:
+		case BC_BIT_AND:
+		case BC_BIT_OR:
+		case BC_BIT_XOR:
+		case BC_SL:
+		case BC_SAR:
+		case BC_SLR:
+		case BC_OFFSET_POINTER:
+		case BC_NEG:
+		case BC_FNEG:
+			return true;
+		default:
+			return false;
+	}
+}
+
+inline b32
+is_rax_rdx_op(BC_OP op)
+{
+	return op >= BC_U_MUL && op <= BC_U_REM && op != BC_F_DIV;
+}
+
+BC_Operands
+bc_get_operands(Bytecode *bc)
+{
+	BC_Operands result = {};
+	switch(bc->op)
+	{
+		case BC_STORE:
+		case BC_STORE_NON_REMOVABLE:
+		case BC_PUSH_OFFSET:
+		{
+			result.uses[result.use_count++] = &bc->right_idx;
+		} break;
+		case BC_STORE_REG:
+		{
+			result.uses[result.use_count++] = &bc->left_idx;
+			result.uses[result.use_count++] = &bc->right_idx;
+		} break;
+		case BC_MOVE_VALUE_TO_REG:
+		case BC_MOVE_FLOAT_TO_REG:
+		case BC_MOVE_FUNCTION_TO_REG:
+		case BC_LOAD_STRING:
+		case BC_LOAD_ADDRESS:
+		case BC_GLOBAL_ADDRESS:
+		case BC_LOAD_STACK:
+		case BC_LOAD_DATA_SEG:
+		case BC_POP_OFFSET:
+		{
+			result.def = &bc->result;
+		} break;
+		case BC_ADD_VALUE:
+		case BC_SUB_VALUE:
+		{
+			result.uses[result.use_count++] = &bc->result;
+			result.def = &bc->result;
+		} break;
+		case BC_COND_JUMP:
+		{
+			if(bc->result != -1)
+				result.uses[result.use_count++] = &bc->result;
+		} break;
+		case BC_JUMP_TABLE:
+		{
+			// the scratch register holds the table address while the index is read
+			result.uses[result.use_count++] = &bc->left_idx;
+			result.def = &bc->result;
+			result.early_def = true;
+		} break;
+		case BC_CALL:
+		case BC_JUMP:
+		case BC_PUSH_REG:
+		case BC_POP_REG:
+		case BC_NO_OP:
+		{
+		} break;
+		case BC_MOVE_REG_TO_REG:
+		{
+			// @NOTE: left is the same as result once the physical
+			// registers are set up, it's fixed when assigning
+			result.uses[result.use_count++] = &bc->right_idx;
+			result.def = &bc->result;
+		} break;
+		case BC_RETURN:
+		{
+			if(bc->left_idx != -1)
+				result.uses[result.use_count++] = &bc->left_idx;
+		} break;
+		case BC_BIT_XOR:
+		{
+			// the lowering clears rdx by xoring it with itself,
+			// that doesn't read the old value
+			if(bc->left_idx != bc->right_idx || is_virtual(bc->left_idx))
+			{
+				result.uses[result.use_count++] = &bc->left_idx;
+				result.uses[result.use_count++] = &bc->right_idx;
+			}
+			result.def = &bc->result;
+		} break;
+		case BC_DEREFRENCE:
+		case BC_LOGICAL_NOT:
+		case BC_NEG:
+		case BC_FNEG:
+		{
+			result.uses[result.use_count++] = &bc->left_idx;
+			result.def = &bc->result;
+		} break;
+		case BC_COPY_MEMORY:
+		{
+			// the scratch register is written while both addresses are still read
+			result.uses[result.use_count++] = &bc->left_idx;
+			result.uses[result.use_count++] = &bc->right_idx;
+			result.def = &bc->result;
+			result.early_def = true;
+		} break;
+		default:
+		{
+			if(bc->op >= BC_CAST_SEXT && bc->op <= BC_CAST_F_EXT)
+			{
+				// right holds the offset to the source type
+				result.uses[result.use_count++] = &bc->left_idx;
+				result.def = &bc->result;
+				if(bc->op == BC_CAST_F_TRUNC || bc->op == BC_CAST_F_EXT ||
+						bc->op == BC_CAST_F_TO_I || bc->op == BC_CAST_D_TO_I)
+					result.early_def = true;
+			}
+			else
+			{
+				result.uses[result.use_count++] = &bc->left_idx;
+				result.uses[result.use_count++] = &bc->right_idx;
+				if(bc->result != -1)
+					result.def = &bc->result;
+				if(bc->op == BC_CMP_LOGICAL_AND || bc->op == BC_CMP_LOGICAL_OR)
+					result.early_def = true;
+			}
+		} break;
+	}
+	return result;
+}
+
+// left_idx is only a register when the operands list it as a use,
+// on the value moves it's the low half of big_idx
+b32
+left_is_register(BC_Operands *ops, Bytecode *bc)
+{
+	for(i32 i = 0; i < ops->use_count; ++i)
+	{
+		if(ops->uses[i] == &bc->left_idx)
+			return true;
+	}
+	return false;
+}
+
+i32
+get_call_registers(BC_Func_Call *call, Register *out)
+{
+	i32 int_count = 0;
+	i32 float_count = 0;
+	for(i32 i = 0; i < call->expr_count; ++i)
+	{
+		out[i] = reg_invalid;
+		if(is_float(*call->expr_types[i]) || is_vector(*call->expr_types[i]))
+		{
+			if(float_count < ARR_SIZE(float_argument_registers))
+				out[i] = float_argument_registers[float_count++];
+		}
+		else
+		{
+			if(int_count < ARR_SIZE(int_argument_registers))
+				out[i] = int_argument_registers[int_count++];
+		}
+	}
+	return call->expr_count;
+}
+
+void
+replace_block_code(IR_Block *block, IR_Block *with)
+{
+	ir_memory.abandoned_bytes += sizeof(Bytecode) * block->bc_capacity;
+	block->bc = with->bc;
+	block->bc_count = with->bc_count;
+	block->bc_capacity = with->bc_capacity;
+}
+
+IR_Block
+begin_block_rewrite(IR_Block *block)
+{
+	IR_Block out = {};
+	out.id = block->id;
+	out.line = block->bc_count ? block->bc[0].line : block->line;
+	out.column = block->bc_count ? block->bc[0].column : block->column;
+	reserve_bytecode(&out, block->bc_count + block->bc_count / 2 + BC_BLOCK_INITIAL_SIZE);
+	return out;
+}
+
+/* ---- Preparing the IR ----
+ * Turns the IR into something where every virtual register can get one
+ * physical register for its whole life:
+ *  - variables that only have their address taken to be assigned to are
+ *    promoted to registers, assignments become moves
+ *  - other variables are reloaded from their stack slot on every use since
+ *    anything with their address can change them
+ *  - values the lowering put into fixed registers (mul, div, calls and
+ *    returns) are moved there explicitly
+ *  - two address x64 ops get a copy of their left operand so they don't
+ *    overwrite it
+ */
+
+typedef struct
+{
+	IR *ir;
+	i32 reg_count;
+	i32 *slot_of;
+	i32 *address_of;
+	b32 *promoted;
+	b32 *declared;
+	Type_Info **slot_type;
+	Register *alias;
+	i32 *aliased;
+	i32 aliased_count;
+} Allocator_Prepare;
+
+b32
+is_promotable_type(Type_Info *type)
+{
+	if(!type)
+		return false;
+	if(type->type != T_INTEGER && type->type != T_FLOAT && type->type != T_POINTER && type->type != T_BOOLEAN)
+		return false;
+	return get_type_size(*type) <= 8 || is_vector(*type);
+}
+
+void
+find_promotable_variables(Allocator_Prepare *p)
+{
+	IR *ir = p->ir;
+	i32 slot_count = SDCount(ir->allocated);
+	i32 *store_count = (i32 *)AllocateCompileMemory(sizeof(i32) * (slot_count + 1));
+	b32 *escaped = (b32 *)AllocateCompileMemory(sizeof(b32) * (slot_count + 1));
+	p->promoted  = (b32 *)AllocateCompileMemory(sizeof(b32) * (slot_count + 1));
+	p->slot_type = (Type_Info **)AllocateCompileMemory(sizeof(Type_Info *) * (slot_count + 1));
+
+	for(i32 i = 0; i < p->reg_count; ++i)
+	{
+		p->slot_of[i] = -1;
+		p->address_of[i] = -1;
+	}
+	for(i32 i = 0; i < slot_count; ++i)
+	{
+		// a variable copied into a struct member shares its register,
+		// the declaration comes first and is the one the register reloads from
+		i32 value = ir->allocated[i].virtual_register;
+		if(is_virtual(value) && value < p->reg_count && p->slot_of[value] == -1)
+			p->slot_of[value] = i;
+	}
+
+	size_t block_count = SDCount(ir->blocks);
+	for(size_t block_idx = 0; block_idx < block_count; ++block_idx)
+	{
+		IR_Block *block = ir->blocks[block_idx];
+		for(i32 i = 0; i < block->bc_count; ++i)
+		{
+			Bytecode *bc = &block->bc[i];
+			if(bc->op == BC_LOAD_ADDRESS)
+			{
+				// copy_memory and returned structs keep the address in the slot's register
+				if(p->slot_of[bc->result] == bc->right_idx)
+					p->slot_of[bc->result] = -1;
+				p->address_of[bc->result] = bc->right_idx;
+			}
+			else if(bc->op == BC_STORE || bc->op == BC_STORE_NON_REMOVABLE)
+			{
+				store_count[bc->left_idx]++;
+				p->slot_type[bc->left_idx] = bc->type;
+				// non removable stores are struct and array members
+				if(bc->op == BC_STORE_NON_REMOVABLE || bc->right_idx != ir->allocated[bc->left_idx].virtual_register)
+					escaped[bc->left_idx] = true;
+			}
+		}
+	}
+
+	for(size_t block_idx = 0; block_idx < block_count; ++block_idx)
+	{
+		IR_Block *block = ir->blocks[block_idx];
+		for(i32 i = 0; i < block->bc_count; ++i)
+		{
+			Bytecode *bc = &block->bc[i];
+			if(bc->op == BC_CALL)
+			{
+				BC_Func_Call *call = (BC_Func_Call *)bc->big_idx;
+				for(i32 j = 0; j < call->expr_count; ++j)
+				{
+					i32 reg = call->expressions[j];
+					if(is_virtual(reg) && p->address_of[reg] != -1)
+						escaped[p->address_of[reg]] = true;
+				}
+				if(is_virtual(call->func_register) && p->address_of[call->func_register] != -1)
+					escaped[p->address_of[call->func_register]] = true;
+				continue;
+			}
+
+			BC_Operands ops = bc_get_operands(bc);
+			for(i32 j = 0; j < ops.use_count; ++j)
+			{
+				i32 reg = *ops.uses[j];
+				if(!is_virtual(reg) || p->address_of[reg] == -1)
+					continue;
+				i32 slot = p->address_of[reg];
+				// the only thing we allow is assigning through the address
+				b32 is_assignment = bc->op == BC_STORE_REG && ops.uses[j] == &bc->left_idx && bc->right_idx != reg;
+				if(!is_assignment || !p->slot_type[slot] ||
+						get_type_size(*bc->type) != get_type_size(*p->slot_type[slot]) ||
+						is_float(*bc->type) != is_float(*p->slot_type[slot]))
+					escaped[slot] = true;
+			}
+			if(ops.def && is_virtual(*ops.def) && bc->op != BC_LOAD_ADDRESS && p->address_of[*ops.def] != -1)
+				escaped[p->address_of[*ops.def]] = true;
+		}
+	}
+
+	for(i32 i = 0; i < slot_count; ++i)
+	{
+		i32 value = ir->allocated[i].virtual_register;
+		b32 is_variable = is_virtual(value) && value < p->reg_count && p->slot_of[value] == i;
+		p->promoted[i] = is_variable && !escaped[i] && store_count[i] == 1 && is_promotable_type(p->slot_type[i]);
+	}
+}
+
+i32
+prepare_use(Allocator_Prepare *p, i32 reg, Type_Info *type, IR_Block *out)
+{
+	if(!is_virtual(reg) || reg >= p->reg_count)
+		return reg;
+	if(p->alias[reg] != reg_invalid)
+		return p->alias[reg];
+
+	i32 slot = p->slot_of[reg];
+	if(slot != -1 && !p->promoted[slot] && p->declared[reg])
+	{
+		i32 loaded = allocate_register(p->ir);
+		Type_Info *load_type = p->slot_type[slot] ? p->slot_type[slot] : type;
+		out_instruction(-1, slot, loaded, BC_LOAD_STACK, out, load_type);
+		return loaded;
+	}
+	return reg;
+}
+
+void
+clear_aliases(Allocator_Prepare *p)
+{
+	for(i32 i = 0; i < p->aliased_count; ++i)
+		p->alias[p->aliased[i]] = reg_invalid;
+	p->aliased_count = 0;
+}
+
+void
+prepare_block(Allocator_Prepare *p, IR_Block *block)
+{
+	IR_Block out = begin_block_rewrite(block);
+	for(i32 i = 0; i < block->bc_count; ++i)
+	{
+		Bytecode bc = block->bc[i];
+		switch(bc.op)
+		{
+			case BC_LOAD_ADDRESS:
+			{
+				if(p->promoted[bc.right_idx])
+					continue;
+			} break;
+			case BC_STORE_REG:
+			{
+				if(is_virtual(bc.left_idx) && bc.left_idx < p->reg_count && p->address_of[bc.left_idx] != -1 &&
+						p->promoted[p->address_of[bc.left_idx]])
+				{
+					i32 variable = p->ir->allocated[p->address_of[bc.left_idx]].virtual_register;
+					i32 value = prepare_use(p, bc.right_idx, bc.type, &out);
+					out_instruction(variable, value, variable, BC_MOVE_REG_TO_REG, &out, bc.type);
+					continue;
+				}
+			} break;
+			case BC_STORE:
+			case BC_STORE_NON_REMOVABLE:
+			{
+				if(is_virtual(bc.right_idx) && bc.right_idx < p->reg_count && p->slot_of[bc.right_idx] == bc.left_idx)
+				{
+					p->declared[bc.right_idx] = true;
+					// nothing reads the slot of a promoted variable
+					if(!p->promoted[bc.left_idx])
+						push_bytecode(&out, bc);
+					continue;
+				}
+			} break;
+			case BC_CALL:
+			{
+				BC_Func_Call *call = (BC_Func_Call *)bc.big_idx;
+				Register registers[call->expr_count + 1];
+				get_call_registers(call, registers);
+				for(i32 j = 0; j < call->expr_count; ++j)
+				{
+					// @TODO: pass arguments on the stack
+					Assert(registers[j] != reg_invalid);
+					i32 value = prepare_use(p, call->expressions[j], call->expr_types[j], &out);
+					out_instruction(registers[j], value, registers[j], BC_MOVE_REG_TO_REG, &out, call->expr_types[j]);
+				}
+				i32 function = prepare_use(p, call->func_register, ptr_type, &out);
+				out_instruction(reg_a, function, reg_a, BC_MOVE_REG_TO_REG, &out, ptr_type);
+				push_bytecode(&out, bc);
+				clear_aliases(p);
+				continue;
+			} break;
+			case BC_RETURN:
+			{
+				if(bc.left_idx != -1)
+				{
+					Register ret = is_float(*bc.type) || is_vector(*bc.type) ? reg_xmm0 : reg_a;
+					i32 value = prepare_use(p, bc.left_idx, bc.type, &out);
+					out_instruction(ret, value, ret, BC_MOVE_REG_TO_REG, &out, bc.type);
+					bc.left_idx = ret;
+				}
+				push_bytecode(&out, bc);
+				continue;
+			} break;
+			case BC_MOVE_REG_TO_REG:
+			{
+				if(bc.left_idx < reg_invalid && is_virtual(bc.result))
+				{
+					// the lowering names a value that has to be in a specific register,
+					// uses of that name until it's redefined are that register
+					i32 value = prepare_use(p, bc.right_idx, bc.type, &out);
+					out_instruction(bc.left_idx, value, bc.left_idx, BC_MOVE_REG_TO_REG, &out, bc.type);
+					if(bc.result < p->reg_count)
+					{
+						p->alias[bc.result] = (Register)bc.left_idx;
+						p->aliased[p->aliased_count++] = bc.result;
+					}
+					continue;
+				}
+			} break;
+			default: break;
+		}
+
+		BC_Operands ops = bc_get_operands(&bc);
+		for(i32 j = 0; j < ops.use_count; ++j)
+			*ops.uses[j] = prepare_use(p, *ops.uses[j], bc.type, &out);
+
+		if(is_two_address_op(bc.op) && is_virtual(bc.result) && bc.left_idx != bc.result)
+		{
+			// an offset is typed with what it points to, the copy is of the whole pointer
+			Type_Info *copy_type = bc.op == BC_OFFSET_POINTER ? ptr_type : bc.type;
+			out_instruction(bc.result, bc.left_idx, bc.result, BC_MOVE_REG_TO_REG, &out, copy_type);
+			bc.left_idx = bc.result;
+		}
+
+		i32 renamed = -1;
+		if(ops.def && is_virtual(*ops.def) && *ops.def < p->reg_count && p->alias[*ops.def] != reg_invalid)
+		{
+			renamed = *ops.def;
+			*ops.def = p->alias[renamed];
+			if(left_is_register(&ops, &bc) && bc.left_idx == renamed)
+				bc.left_idx = *ops.def;
+		}
+		push_bytecode(&out, bc);
+		if(renamed != -1)
+		{
+			Register from = p->alias[renamed];
+			clear_aliases(p);
+			out_instruction(renamed, from, renamed, BC_MOVE_REG_TO_REG, &out, bc.type);
+		}
+		else if(is_rax_rdx_op(bc.op))
+		{
+			clear_aliases(p);
+		}
+	}
+	replace_block_code(block, &out);
+}
+
+void
+prepare_for_allocation(IR *ir)
+{
+	Allocator_Prepare p = {};
+	p.ir = ir;
+	p.reg_count = ir->reg_count;
+	p.slot_of    = (i32 *)AllocateCompileMemory(sizeof(i32) * p.reg_count);
+	p.address_of = (i32 *)AllocateCompileMemory(sizeof(i32) * p.reg_count);
+	p.declared   = (b32 *)AllocateCompileMemory(sizeof(b32) * p.reg_count);
+	p.alias      = (Register *)AllocateCompileMemory(sizeof(Register) * p.reg_count);
+	p.aliased    = (i32 *)AllocateCompileMemory(sizeof(i32) * p.reg_count);
+	for(i32 i = 0; i < p.reg_count; ++i)
+		p.alias[i] = reg_invalid;
+
+	find_promotable_variables(&p);
+
+	size_t block_count = SDCount(ir->blocks);
+	for(size_t i = 0; i < block_count; ++i)
+	{
+		prepare_block(&p, ir->blocks[i]);
+		clear_aliases(&p);
+	}
+}
+
+/* ---- Liveness ---- */
+
+inline b32
+bit_is_set(u64 *set, i32 bit)
+{
+	return (set[bit >> 6] >> (bit & 63)) & 1;
+}
+
+inline void
+set_bit(u64 *set, i32 bit)
+{
+	set[bit >> 6] |= (u64)1 << (bit & 63);
+}
+
+inline void
+extend_interval(i32 *start, i32 *end, i32 reg, i32 position)
+{
+	if(position < start[reg])
+		start[reg] = position;
+	if(position > end[reg])
+		end[reg] = position;
+}
+
+Block_Successors
+get_block_successors(IR *ir, Block_Index_Table *block_index)
+{
+	i32 block_count = SDCount(ir->blocks);
+	Block_Successors result = {};
+	result.first = (i32 *)AllocateCompileMemory(sizeof(i32) * (block_count + 1));
+	i32 total = 0;
+	for(i32 b = 0; b < block_count; ++b)
+	{
+		IR_Block *block = ir->blocks[b];
+		result.first[b] = total;
+		for(i32 i = 0; i < block->bc_count; ++i)
+			total += bc_jump_target_count(ir, &block->bc[i]);
+	}
+	result.first[block_count] = total;
+
+	result.list = (i32 *)AllocateCompileMemory(sizeof(i32) * (total + 1));
+	i32 written = 0;
+	for(i32 b = 0; b < block_count; ++b)
+	{
+		IR_Block *block = ir->blocks[b];
+		for(i32 i = 0; i < block->bc_count; ++i)
+		{
+			Bytecode *bc = &block->bc[i];
+			i32 target_count = bc_jump_target_count(ir, bc);
+			for(i32 t = 0; t < target_count; ++t)
+			{
+				IR_Block *target = bc_jump_target(ir, bc, t);
+				result.list[written++] = hmget(block_index, target);
+			}
+		}
+	}
+	return result;
+}
+
+void
+compute_live_intervals(Register_Allocator *ra, i32 *start, i32 *end)
+{
+	IR *ir = ra->ir;
+	i32 block_count = ra->block_count;
+	i32 words = ra->words;
+	u64 *use_sets = (u64 *)AllocateCompileMemory(sizeof(u64) * words * block_count);
+	u64 *def_sets = (u64 *)AllocateCompileMemory(sizeof(u64) * words * block_count);
+	ra->live_in   = (u64 *)AllocateCompileMemory(sizeof(u64) * words * block_count);
+	ra->live_out  = (u64 *)AllocateCompileMemory(sizeof(u64) * words * block_count);
+	Block_Successors successors = get_block_successors(ir, ra->block_index);
+
+	i32 position = 0;
+	for(i32 b = 0; b < block_count; ++b)
+	{
+		IR_Block *block = ir->blocks[b];
+		u64 *use = use_sets + b * words;
+		u64 *def = def_sets + b * words;
+		ra->block_start[b] = position * 2;
+		for(i32 i = 0; i < block->bc_count; ++i)
+		{
+			Bytecode *bc = &block->bc[i];
+			BC_Operands ops = bc_get_operands(bc);
+			for(i32 j = 0; j < ops.use_count; ++j)
+			{
+				i32 reg = *ops.uses[j];
+				if(is_virtual(reg) && !bit_is_set(def, reg))
+					set_bit(use, reg);
+			}
+			if(ops.def && is_virtual(*ops.def))
+				set_bit(def, *ops.def);
+			position++;
+		}
+		ra->block_end[b] = position * 2 - 1;
+	}
+
+	b32 changed = true;
+	while(changed)
+	{
+		changed = false;
+		for(i32 b = block_count - 1; b >= 0; --b)
+		{
+			u64 *out = ra->live_out + b * words;
+			u64 *in  = ra->live_in + b * words;
+			u64 *use = use_sets + b * words;
+			u64 *def = def_sets + b * words;
+			for(i32 s = successors.first[b]; s < successors.first[b + 1]; ++s)
+			{
+				u64 *successor_in = ra->live_in + successors.list[s] * words;
+				for(i32 w = 0; w < words; ++w)
+					out[w] |= successor_in[w];
+			}
+			for(i32 w = 0; w < words; ++w)
+			{
+				u64 new_in = use[w] | (out[w] & ~def[w]);
+				if(new_in != in[w])
+				{
+					in[w] = new_in;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	for(i32 i = 0; i < ra->reg_count; ++i)
+	{
+		start[i] = INT32_MAX;
+		end[i] = -1;
+	}
+
+	position = 0;
+	for(i32 b = 0; b < block_count; ++b)
+	{
+		u64 *out = ra->live_out + b * words;
+		u64 *in  = ra->live_in + b * words;
+		for(i32 w = 0; w < words; ++w)
+		{
+			u64 bits = in[w];
+			while(bits)
+			{
+				i32 reg = w * 64 + __builtin_ctzll(bits);
+				extend_interval(start, end, reg, ra->block_start[b]);
+				bits &= bits - 1;
+			}
+			bits = out[w];
+			while(bits)
+			{
+				i32 reg = w * 64 + __builtin_ctzll(bits);
+				extend_interval(start, end, reg, ra->block_end[b]);
+				bits &= bits - 1;
+			}
+		}
+
+		IR_Block *block = ir->blocks[b];
+		for(i32 i = 0; i < block->bc_count; ++i, ++position)
+		{
+			Bytecode *bc = &block->bc[i];
+			BC_Operands ops = bc_get_operands(bc);
+			for(i32 j = 0; j < ops.use_count; ++j)
+			{
+				if(is_virtual(*ops.uses[j]))
+					extend_interval(start, end, *ops.uses[j], position * 2);
+			}
+			if(ops.def && is_virtual(*ops.def))
+				extend_interval(start, end, *ops.def, ops.early_def ? position * 2 : position * 2 + 1);
+		}
+	}
+}
+
+/* ---- Fixed registers ----
+ * Physical registers written by the IR (arguments, calls, mul and div)
+ * block the register from the write until the last read of it
+ */
+
+void
+fixed_def(Register_Allocator *ra, i32 *counts, Register reg, i32 position)
+{
+	if(!is_allocatable(reg))
+		return;
+	Register_Range range = {position, position};
+	ra->fixed[reg][counts[reg]++] = range;
+}
+
+void
+fixed_use(Register_Allocator *ra, i32 *counts, Register reg, i32 position)
+{
+	if(!is_allocatable(reg))
+		return;
+	if(counts[reg] == 0)
+	{
+		// live on entry, function arguments
+		Register_Range range = {0, position};
+		ra->fixed[reg][counts[reg]++] = range;
+	}
+	else
+		ra->fixed[reg][counts[reg] - 1].end = position;
+}
+
+void
+clobber_caller_saved(Register_Allocator *ra, i32 *counts, i32 position)
+{
+	for(i32 i = 0; i < ARR_SIZE(caller_saved_int); ++i)
+		fixed_def(ra, counts, caller_saved_int[i], position);
+	for(i32 reg = reg_xmm0; reg <= LAST_ALLOCATABLE_XMM; ++reg)
+		fixed_def(ra, counts, (Register)reg, position);
+}
+
+void
+compute_fixed_ranges(Register_Allocator *ra, i32 *counts)
+{
+	IR *ir = ra->ir;
+	i32 position = 0;
+	for(i32 b = 0; b < ra->block_count; ++b)
+	{
+		IR_Block *block = ir->blocks[b];
+		for(i32 i = 0; i < block->bc_count; ++i, ++position)
+		{
+			Bytecode *bc = &block->bc[i];
+			BC_Operands ops = bc_get_operands(bc);
+			for(i32 j = 0; j < ops.use_count; ++j)
+			{
+				if(*ops.uses[j] >= 0 && *ops.uses[j] < reg_invalid)
+					fixed_use(ra, counts, (Register)*ops.uses[j], position * 2);
+			}
+			if(bc->op == BC_CALL)
+			{
+				BC_Func_Call *call = (BC_Func_Call *)bc->big_idx;
+				Register registers[call->expr_count + 1];
+				get_call_registers(call, registers);
+				for(i32 j = 0; j < call->expr_count; ++j)
+					fixed_use(ra, counts, registers[j], position * 2);
+				fixed_use(ra, counts, reg_a, position * 2);
+				clobber_caller_saved(ra, counts, position * 2 + 1);
+			}
+			else if(is_rax_rdx_op(bc->op))
+			{
+				fixed_use(ra, counts, reg_d, position * 2);
+				fixed_def(ra, counts, reg_a, position * 2 + 1);
+				fixed_def(ra, counts, reg_d, position * 2 + 1);
+			}
+			if(ops.def && *ops.def >= 0 && *ops.def < reg_invalid)
+				fixed_def(ra, counts, (Register)*ops.def, position * 2 + 1);
+		}
+	}
+}
+
+void
+allocate_fixed_ranges(Register_Allocator *ra, i32 *counts)
+{
+	// count the writes first so every register gets one array
+	i32 capacity[reg_invalid] = {};
+	IR *ir = ra->ir;
+	for(i32 b = 0; b < ra->block_count; ++b)
+	{
+		IR_Block *block = ir->blocks[b];
+		for(i32 i = 0; i < block->bc_count; ++i)
+		{
+			Bytecode *bc = &block->bc[i];
+			if(bc->op == BC_CALL)
+			{
+				for(i32 reg = 0; reg < reg_invalid; ++reg)
+					capacity[reg]++;
+			}
+			else if(is_rax_rdx_op(bc->op))
+			{
+				capacity[reg_a]++;
+				capacity[reg_d]++;
+			}
+			BC_Operands ops = bc_get_operands(bc);
+			if(ops.def && *ops.def >= 0 && *ops.def < reg_invalid)
+				capacity[*ops.def]++;
+		}
+	}
+	for(i32 reg = 0; reg < reg_invalid; ++reg)
+	{
+		counts[reg] = 0;
+		ra->fixed[reg] = (Register_Range *)AllocateCompileMemory(sizeof(Register_Range) * (capacity[reg] + 1));
+	}
+	compute_fixed_ranges(ra, counts);
+}
+
+b32
+fixed_overlaps(Register_Allocator *ra, i32 *counts, i32 *cursors, Register reg, i32 start, i32 end)
+{
+	Register_Range *ranges = ra->fixed[reg];
+	i32 count = counts[reg];
+	// intervals come sorted by start, ranges that ended can be skipped forever
+	while(cursors[reg] < count && ranges[cursors[reg]].end < start && ranges[cursors[reg]].start <= start)
+		cursors[reg]++;
+	for(i32 i = cursors[reg]; i < count && ranges[i].start <= end; ++i)
+	{
+		if(ranges[i].end >= start)
+			return true;
+	}
+	return false;
+}
+
+/* ---- Linear scan ---- */
+
+int
+compare_intervals(const void *a, const void *b)
+{
+	i32 left  = ((Live_Interval *)a)->start;
+	i32 right = ((Live_Interval *)b)->start;
+	return left < right ? -1 : left > right ? 1 : 0;
+}
+
+Type_Info *
+get_def_type(Bytecode *bc)
+{
+	if(bc->op >= BC_CMP_LOGICAL_AND && bc->op <= BC_FCMP_GREATER_EQ)
+		return type_u8;
+	return bc->type;
+}
+
+void
+collect_register_info(Register_Allocator *ra)
+{
+	IR *ir = ra->ir;
+	for(i32 b = 0; b < ra->block_count; ++b)
+	{
+		IR_Block *block = ir->blocks[b];
+		for(i32 i = 0; i < block->bc_count; ++i)
+		{
+			Bytecode *bc = &block->bc[i];
+			BC_Operands ops = bc_get_operands(bc);
+			if(ops.def && is_virtual(*ops.def) && !ra->vreg_type[*ops.def])
+				ra->vreg_type[*ops.def] = get_def_type(bc);
+			for(i32 j = 0; j < ops.use_count; ++j)
+			{
+				i32 reg = *ops.uses[j];
+				if(is_virtual(reg) && !ra->vreg_type[reg])
+				{
+					if(bc->op >= BC_CAST_SEXT && bc->op <= BC_CAST_F_EXT)
+						ra->vreg_type[reg] = (Type_Info *)((u8 *)bc->type + bc->right_idx);
+					else
+						ra->vreg_type[reg] = bc->type;
+				}
+			}
+
+			if(bc->op == BC_MOVE_REG_TO_REG)
+			{
+				if(is_virtual(bc->result) && bc->right_idx >= 0 && bc->right_idx < reg_invalid)
+					ra->hint[bc->result] = (Register)bc->right_idx;
+				else if(bc->result >= 0 && bc->result < reg_invalid && is_virtual(bc->right_idx) &&
+						ra->hint[bc->right_idx] == reg_invalid)
+					ra->hint[bc->right_idx] = (Register)bc->result;
+			}
+			else if(bc->op == BC_CAST_I_TO_F || bc->op == BC_CAST_I_TO_D ||
+					bc->op == BC_CAST_U_TO_F || bc->op == BC_CAST_U_TO_D)
+			{
+				if(is_virtual(bc->left_idx))
+					ra->needs_low[bc->left_idx] = true;
+			}
+			else if(bc->op == BC_CAST_F_TO_I || bc->op == BC_CAST_D_TO_I)
+			{
+				if(is_virtual(bc->result))
+					ra->needs_low[bc->result] = true;
+			}
+		}
+	}
+}
+
+b32
+can_use_register(Register_Allocator *ra, i32 *counts, i32 *cursors, Live_Interval *interval, Register reg)
+{
+	if(interval->needs_low && !is_low_register(reg))
+		return false;
+	return !fixed_overlaps(ra, counts, cursors, reg, interval->start, interval->end);
+}
+
+// returns the number of spilled intervals
+i32
+linear_scan(Register_Allocator *ra, b32 *spilled)
+{
+	i32 *start = (i32 *)AllocateCompileMemory(sizeof(i32) * ra->reg_count);
+	i32 *end   = (i32 *)AllocateCompileMemory(sizeof(i32) * ra->reg_count);
+	compute_live_intervals(ra, start, end);
+
+	i32 counts[reg_invalid];
+	i32 cursors[reg_invalid] = {};
+	allocate_fixed_ranges(ra, counts);
+
+	i32 interval_count = 0;
+	ra->intervals = (Live_Interval *)AllocateCompileMemory(sizeof(Live_Interval) * ra->reg_count);
+	for(i32 reg = reg_invalid + 1; reg < ra->reg_count; ++reg)
+	{
+		if(end[reg] < 0)
+			continue;
+		Live_Interval interval = {};
+		interval.start = start[reg];
+		interval.end = end[reg];
+		interval.virtual_register = reg;
+		interval.hint = ra->hint[reg];
+		interval.assigned = reg_invalid;
+		// vectors are in xmm registers too
+		interval.is_float = ra->vreg_type[reg] && (is_float(*ra->vreg_type[reg]) || is_vector(*ra->vreg_type[reg]));
+		interval.needs_low = ra->needs_low[reg];
+		interval.no_spill = ra->no_spill[reg];
+		ra->intervals[interval_count++] = interval;
+	}
+	qsort(ra->intervals, interval_count, sizeof(Live_Interval), compare_intervals);
+
+	i32 owner[reg_invalid];
+	for(i32 reg = 0; reg < reg_invalid; ++reg)
+		owner[reg] = -1;
+	i32 *active = (i32 *)AllocateCompileMemory(sizeof(i32) * (interval_count + 1));
+	i32 active_count = 0;
+	i32 spill_count = 0;
+
+	for(i32 i = 0; i < interval_count; ++i)
+	{
+		Live_Interval *current = &ra->intervals[i];
+
+		for(i32 j = 0; j < active_count; )
+		{
+			Live_Interval *other = &ra->intervals[active[j]];
+			if(other->end < current->start)
+			{
+				owner[other->assigned] = -1;
+				active[j] = active[--active_count];
+			}
+			else
+				++j;
+		}
+
+		Register picked = reg_invalid;
+		if(current->hint != reg_invalid && is_allocatable(current->hint) &&
+				(current->hint >= reg_xmm0) == (b32)current->is_float && owner[current->hint] == -1 &&
+				can_use_register(ra, counts, cursors, current, current->hint))
+			picked = current->hint;
+
+		if(picked == reg_invalid)
+		{
+			if(current->is_float)
+			{
+				for(i32 reg = reg_xmm0; reg <= LAST_ALLOCATABLE_XMM; ++reg)
+				{
+					if(owner[reg] == -1 && can_use_register(ra, counts, cursors, current, (Register)reg))
+					{
+						picked = (Register)reg;
+						break;
+					}
+				}
+			}
+			else
+			{
+				for(i32 k = 0; k < ARR_SIZE(int_allocation_order); ++k)
+				{
+					Register reg = int_allocation_order[k];
+					if(owner[reg] == -1 && can_use_register(ra, counts, cursors, current, reg))
+					{
+						picked = reg;
+						break;
+					}
+				}
+			}
+		}
+
+		if(picked == reg_invalid)
+		{
+			// spill whatever lives the longest, the current interval included
+			i32 victim = -1;
+			i32 furthest = current->no_spill ? -1 : current->end;
+			for(i32 j = 0; j < active_count; ++j)
+			{
+				Live_Interval *other = &ra->intervals[active[j]];
+				if(other->no_spill || other->is_float != current->is_float)
+					continue;
+				if(other->end > furthest && can_use_register(ra, counts, cursors, current, other->assigned))
+				{
+					furthest = other->end;
+					victim = j;
+				}
+			}
+			if(victim == -1)
+			{
+				if(current->no_spill)
+					LG_FATAL("----- COMPILER BUG -----\nCouldn't find a register for a spill temporary");
+				spilled[current->virtual_register] = true;
+				spill_count++;
+				continue;
+			}
+			Live_Interval *other = &ra->intervals[active[victim]];
+			picked = other->assigned;
+			other->assigned = reg_invalid;
+			spilled[other->virtual_register] = true;
+			spill_count++;
+			active[victim] = active[--active_count];
+		}
+
+		current->assigned = picked;
+		owner[picked] = i;
+		active[active_count++] = i;
+	}
+	ra->interval_count = interval_count;
+	return spill_count;
+}
+
+/* ---- Spilling ---- */
+
+Type_Info *
+get_spill_type(Type_Info *type)
+{
+	if(type && (is_float(*type) || is_vector(*type)))
+		return type;
+	return type_64;
+}
+
+void
+rewrite_spilled(Register_Allocator *ra, b32 *spilled)
+{
+	IR *ir = ra->ir;
+	i32 old_reg_count = ra->reg_count;
+	i32 *slots = (i32 *)AllocateCompileMemory(sizeof(i32) * old_reg_count);
+	for(i32 reg = reg_invalid + 1; reg < old_reg_count; ++reg)
+	{
+		if(!spilled[reg])
+			continue;
+		if(ra->vreg_type[reg] && is_vector(*ra->vreg_type[reg]))
+		{
+			// so the spill can use aligned moves
+			if(SDCount(ir->allocated) != 0)
+				padd_to_alignment(16, ir);
+			slots[reg] = allocate_stack_space(ir, 16);
+		}
+		else
+			slots[reg] = allocate_stack_space(ir, 8);
+	}
+
+	for(i32 b = 0; b < ra->block_count; ++b)
+	{
+		IR_Block *block = ir->blocks[b];
+		IR_Block out = begin_block_rewrite(block);
+		for(i32 i = 0; i < block->bc_count; ++i)
+		{
+			Bytecode bc = block->bc[i];
+			BC_Operands ops = bc_get_operands(&bc);
+			i32 from[4];
+			i32 to[4];
+			i32 renamed = 0;
+			for(i32 j = 0; j < ops.use_count; ++j)
+			{
+				i32 reg = *ops.uses[j];
+				if(!is_virtual(reg) || reg >= old_reg_count || !spilled[reg])
+					continue;
+				i32 temp = -1;
+				for(i32 k = 0; k < renamed; ++k)
+				{
+					if(from[k] == reg)
+						temp = to[k];
+				}
+				if(temp == -1)
+				{
+					temp = allocate_register(ir);
+					from[renamed] = reg;
+					to[renamed++] = temp;
+					out_instruction(-1, slots[reg], temp, BC_LOAD_STACK, &out, get_spill_type(ra->vreg_type[reg]));
+				}
+				*ops.uses[j] = temp;
+			}
+			i32 stored = -1;
+			i32 spilled_def = -1;
+			if(ops.def && is_virtual(*ops.def) && *ops.def < old_reg_count && spilled[*ops.def])
+			{
+				spilled_def = *ops.def;
+				for(i32 k = 0; k < renamed; ++k)
+				{
+					if(from[k] == spilled_def)
+						stored = to[k];
+				}
+				if(stored == -1)
+					stored = allocate_register(ir);
+				*ops.def = stored;
+				if(bc.op != BC_MOVE_REG_TO_REG && left_is_register(&ops, &bc) && bc.left_idx == spilled_def)
+					bc.left_idx = stored;
+			}
+			push_bytecode(&out, bc);
+			// nothing reads a jump table's scratch register after the jump
+			if(stored != -1 && bc.op != BC_JUMP_TABLE)
+				out_instruction(slots[spilled_def], stored, stored, BC_STORE, &out, get_spill_type(ra->vreg_type[spilled_def]));
+		}
+		replace_block_code(block, &out);
+	}
+}
+
+void
+grow_allocator_arrays(Register_Allocator *ra)
+{
+	i32 new_count = ra->ir->reg_count;
+	Type_Info **vreg_type = (Type_Info **)AllocateCompileMemory(sizeof(Type_Info *) * new_count);
+	b32 *no_spill  = (b32 *)AllocateCompileMemory(sizeof(b32) * new_count);
+	b32 *needs_low = (b32 *)AllocateCompileMemory(sizeof(b32) * new_count);
+	Register *hint = (Register *)AllocateCompileMemory(sizeof(Register) * new_count);
+	for(i32 reg = 0; reg < new_count; ++reg)
+	{
+		hint[reg] = reg_invalid;
+		if(reg < ra->reg_count)
+		{
+			vreg_type[reg] = ra->vreg_type[reg];
+			no_spill[reg] = ra->no_spill[reg];
+		}
+		else if(ra->reg_count != 0)
+		{
+			// temporaries made by spilling only live around one instruction
+			no_spill[reg] = true;
+		}
+	}
+	ra->vreg_type = vreg_type;
+	ra->no_spill = no_spill;
+	ra->needs_low = needs_low;
+	ra->hint = hint;
+	ra->reg_count = new_count;
+	ra->words = (new_count + 63) / 64;
+}
+
+/* ---- Assigning ---- */
+
+void
+assign_registers(Register_Allocator *ra)
+{
+	IR *ir = ra->ir;
+	Register *assigned = (Register *)AllocateCompileMemory(sizeof(Register) * ra->reg_count);
+	for(i32 reg = 0; reg < ra->reg_count; ++reg)
+		assigned[reg] = reg_invalid;
+	for(i32 i = 0; i < ra->interval_count; ++i)
+	{
+		Live_Interval *interval = &ra->intervals[i];
+		assigned[interval->virtual_register] = interval->assigned;
+		if(is_callee_saved(interval->assigned))
+			ra->used_callee_saved[interval->assigned] = true;
+	}
+
+	for(i32 b = 0; b < ra->block_count; ++b)
+	{
+		IR_Block *block = ir->blocks[b];
+		for(i32 i = 0; i < block->bc_count; ++i)
+		{
+			Bytecode *bc = &block->bc[i];
+			BC_Operands ops = bc_get_operands(bc);
+			for(i32 j = 0; j < ops.use_count; ++j)
+			{
+				if(is_virtual(*ops.uses[j]))
+					*ops.uses[j] = assigned[*ops.uses[j]];
+			}
+			if(ops.def && is_virtual(*ops.def))
+			{
+				if(bc->op != BC_MOVE_REG_TO_REG && left_is_register(&ops, bc) && bc->left_idx == *ops.def)
+					bc->left_idx = assigned[*ops.def];
+				*ops.def = assigned[*ops.def];
+			}
+			if(bc->op == BC_MOVE_REG_TO_REG)
+			{
+				bc->left_idx = bc->result;
+				if(bc->left_idx == bc->right_idx)
+					bc->op = BC_NO_OP;
+			}
+		}
+	}
+}
+
+void
+insert_prologue_and_epilogues(Register_Allocator *ra)
+{
+	IR *ir = ra->ir;
+	Register saved[ARR_SIZE(callee_saved_int)];
+	i32 saved_slots[ARR_SIZE(callee_saved_int)];
+	i32 saved_count = 0;
+	for(i32 i = 0; i < ARR_SIZE(callee_saved_int); ++i)
+	{
+		Register reg = callee_saved_int[i];
+		if(ra->used_callee_saved[reg])
+		{
+			saved[saved_count] = reg;
+			saved_slots[saved_count++] = allocate_stack_space(ir, 8);
+		}
+	}
+
+	for(i32 b = 0; b < ra->block_count; ++b)
+	{
+		IR_Block *block = ir->blocks[b];
+		b32 is_entry = b == 0;
+		if(!is_entry && saved_count == 0)
+			continue;
+
+		IR_Block out = begin_block_rewrite(block);
+		i32 i = 0;
+		if(is_entry)
+		{
+			// Copy the stack manipulation instructions
+			push_bytecode(&out, block->bc[i++]);
+			push_bytecode(&out, block->bc[i++]);
+			if(SDCount(ir->allocated) != 0)
+			{
+				// Subtract the necessary amount of space
+				// so when we push on the stack we don't overwrite the
+				// memory stored with stack_pointer - offset
+				int last_idx = SDCount(ir->allocated) - 1;
+				int unaligned = ir->allocated[last_idx].position + ir->allocated[last_idx].size;
+				int to_sub = round_up_to_multiple(unaligned, 16);
+				out_instruction(to_sub, reg_sp, BC_SUB_VALUE, &out, type_64);
+				ir->stack_top = to_sub;
+			}
+			for(i32 j = 0; j < saved_count; ++j)
+				out_instruction(saved_slots[j], saved[j], saved[j], BC_STORE_NON_REMOVABLE, &out, type_64);
+		}
+		for(; i < block->bc_count; ++i)
+		{
+			if(block->bc[i].op == BC_RETURN)
+			{
+				for(i32 j = 0; j < saved_count; ++j)
+					out_instruction(-1, saved_slots[j], saved[j], BC_LOAD_STACK, &out, type_64);
+			}
+			push_bytecode(&out, block->bc[i]);
+		}
+		replace_block_code(block, &out);
+	}
+}
+
+void
+allocate_registers(IR *ir)
+{
+	Register_Allocator ra = {};
+	ra.ir = ir;
+	ra.block_count = SDCount(ir->blocks);
+	ra.block_start = (i32 *)AllocateCompileMemory(sizeof(i32) * ra.block_count);
+	ra.block_end   = (i32 *)AllocateCompileMemory(sizeof(i32) * ra.block_count);
+	for(i32 b = 0; b < ra.block_count; ++b)
+		hmput(ra.block_index, ir->blocks[b], b);
+
+	prepare_for_allocation(ir);
+	grow_allocator_arrays(&ra);
+
+	i32 pass = 0;
+	for(;;)
+	{
+		collect_register_info(&ra);
+		b32 *spilled = (b32 *)AllocateCompileMemory(sizeof(b32) * ra.reg_count);
+		if(linear_scan(&ra, spilled) == 0)
+			break;
+		if(++pass == MAX_ALLOCATION_PASSES)
+			LG_FATAL("----- COMPILER BUG -----\nRegister allocation didn't finish after %d passes", MAX_ALLOCATION_PASSES);
+		rewrite_spilled(&ra, spilled);
+		grow_allocator_arrays(&ra);
+	}
+
+	assign_registers(&ra);
+	insert_prologue_and_epilogues(&ra);
+	hmfree(ra.block_index);
+
+	ir->bc_count = 0;
+	u64 largest_block = 0;
+	for(i32 b = 0; b < ra.block_count; ++b)
+	{
+		IR_Block *block = ir->blocks[b];
+		ir->bc_count += block->bc_count;
+		if(block->bc_count > largest_block)
+			largest_block = block->bc_count;
+	}
+	platform_interlocked_add64(&ir_memory.instructions, ir->bc_count);
+	lock_mutex();
+	if(largest_block > ir_memory.largest_block)
+		ir_memory.largest_block = largest_block;
+	unlock_mutex();
+}
+
+/* ---- Stack slots ----
+ * Variables that never have their address taken and spills are only ever
+ * stored to and loaded from directly, so they get liveness like registers do.
+ * Stores to them that nothing reads are removed, and ones that are never live
+ * at the same time share memory. Anything reached through an address
+ * (structs, arrays, contexts) keeps its layout and is placed first.
+ */
+
+void
+classify_stack_slots(IR *ir, Slot_Kind *kind)
+{
+	size_t block_count = SDCount(ir->blocks);
+	for(size_t block_idx = 0; block_idx < block_count; ++block_idx)
+	{
+		IR_Block *block = ir->blocks[block_idx];
+		for(i32 i = 0; i < block->bc_count; ++i)
+		{
+			Bytecode *bc = &block->bc[i];
+			switch(bc->op)
+			{
+				case BC_STORE:
+				{
+					i32 slot = bc->left_idx;
+					if(kind[slot] == SLOT_UNUSED)
+						kind[slot] = SLOT_INDEPENDENT;
+					// the rest of the slot is written some other way
+					if(get_type_size(*bc->type) < ir->allocated[slot].size)
+						kind[slot] = SLOT_FIXED;
+				} break;
+				case BC_LOAD_STACK:
+				{
+					if(kind[bc->right_idx] == SLOT_UNUSED)
+						kind[bc->right_idx] = SLOT_INDEPENDENT;
+				} break;
+				case BC_STORE_NON_REMOVABLE:
+				case BC_PUSH_OFFSET:
+				{
+					kind[bc->left_idx] = SLOT_FIXED;
+				} break;
+				case BC_LOAD_ADDRESS:
+				{
+					kind[bc->right_idx] = SLOT_FIXED;
+				} break;
+				default: break;
+			}
+		}
+	}
+}
+
+void
+compute_slot_liveness(IR *ir, Slot_Kind *kind, i32 words, u64 *live_in, u64 *live_out)
+{
+	i32 block_count = SDCount(ir->blocks);
+	u64 *use_sets = (u64 *)AllocateCompileMemory(sizeof(u64) * words * block_count);
+	u64 *def_sets = (u64 *)AllocateCompileMemory(sizeof(u64) * words * block_count);
+	Block_Index_Table *block_index = NULL;
+	for(i32 b = 0; b < block_count; ++b)
+		hmput(block_index, ir->blocks[b], b);
+	Block_Successors successors = get_block_successors(ir, block_index);
+
+	for(i32 b = 0; b < block_count; ++b)
+	{
+		IR_Block *block = ir->blocks[b];
+		u64 *use = use_sets + b * words;
+		u64 *def = def_sets + b * words;
+		for(i32 i = 0; i < block->bc_count; ++i)
+		{
+			Bytecode *bc = &block->bc[i];
+			if(bc->op == BC_LOAD_STACK && kind[bc->right_idx] == SLOT_INDEPENDENT)
+			{
+				if(!bit_is_set(def, bc->right_idx))
+					set_bit(use, bc->right_idx);
+			}
+			else if(bc->op == BC_STORE && kind[bc->left_idx] == SLOT_INDEPENDENT)
+			{
+				set_bit(def, bc->left_idx);
+			}
+		}
+	}
+	hmfree(block_index);
+
+	b32 changed = true;
+	while(changed)
+	{
+		changed = false;
+		for(i32 b = block_count - 1; b >= 0; --b)
+		{
+			u64 *out = live_out + b * words;
+			u64 *in  = live_in + b * words;
+			u64 *use = use_sets + b * words;
+			u64 *def = def_sets + b * words;
+			for(i32 s = successors.first[b]; s < successors.first[b + 1]; ++s)
+			{
+				u64 *successor_in = live_in + successors.list[s] * words;
+				for(i32 w = 0; w < words; ++w)
+					out[w] |= successor_in[w];
+			}
+			for(i32 w = 0; w < words; ++w)
+			{
+				u64 new_in = use[w] | (out[w] & ~def[w]);
+				if(new_in != in[w])
+				{
+					in[w] = new_in;
+					changed = true;
+				}
+			}
+		}
+	}
+}
+
+void
+remove_dead_stores(IR *ir, Slot_Kind *kind, i32 words, u64 *live_out)
+{
+	i32 block_count = SDCount(ir->blocks);
+	u64 *live = (u64 *)AllocateCompileMemory(sizeof(u64) * words);
+	for(i32 b = 0; b < block_count; ++b)
+	{
+		IR_Block *block = ir->blocks[b];
+		memcpy(live, live_out + b * words, sizeof(u64) * words);
+		for(i32 i = block->bc_count - 1; i >= 0; --i)
+		{
+			Bytecode *bc = &block->bc[i];
+			if(bc->op == BC_LOAD_STACK && kind[bc->right_idx] == SLOT_INDEPENDENT)
+			{
+				set_bit(live, bc->right_idx);
+			}
+			else if(bc->op == BC_STORE && kind[bc->left_idx] == SLOT_INDEPENDENT)
+			{
+				if(bit_is_set(live, bc->left_idx))
+					live[bc->left_idx >> 6] &= ~((u64)1 << (bc->left_idx & 63));
+				else
+					bc->op = BC_NO_OP;
+			}
+		}
+	}
+}
+
+int
+compare_slot_intervals(const void *a, const void *b)
+{
+	i32 left  = ((Slot_Interval *)a)->start;
+	i32 right = ((Slot_Interval *)b)->start;
+	return left < right ? -1 : left > right ? 1 : 0;
+}
+
+inline i32
+slot_alignment(i32 size)
+{
+	if(size >= 16)
+		return 16;
+	if(size >= 8)
+		return 8;
+	if(size >= 4)
+		return 4;
+	if(size >= 2)
+		return 2;
+	return 1;
+}
+
+// Every independent slot gets a live range over the linear order of the blocks,
+// slots whose ranges don't overlap share a color and with it their memory
+i32
+color_stack_slots(IR *ir, Slot_Kind *kind, i32 words, u64 *live_in, u64 *live_out,
+		i32 *color_of, Slot_Color *colors)
+{
+	i32 slot_count = SDCount(ir->allocated);
+	i32 block_count = SDCount(ir->blocks);
+	i32 *start = (i32 *)AllocateCompileMemory(sizeof(i32) * slot_count);
+	i32 *end   = (i32 *)AllocateCompileMemory(sizeof(i32) * slot_count);
+	for(i32 slot = 0; slot < slot_count; ++slot)
+	{
+		start[slot] = INT32_MAX;
+		end[slot] = -1;
+	}
+
+	i32 position = 0;
+	for(i32 b = 0; b < block_count; ++b)
+	{
+		IR_Block *block = ir->blocks[b];
+		i32 block_start = position;
+		i32 block_end = position + block->bc_count;
+		for(i32 slot = 0; slot < slot_count; ++slot)
+		{
+			if(kind[slot] != SLOT_INDEPENDENT)
+				continue;
+			if(bit_is_set(live_in + b * words, slot))
+				extend_interval(start, end, slot, block_start);
+			if(bit_is_set(live_out + b * words, slot))
+				extend_interval(start, end, slot, block_end);
+		}
+		for(i32 i = 0; i < block->bc_count; ++i, ++position)
+		{
+			Bytecode *bc = &block->bc[i];
+			if(bc->op == BC_LOAD_STACK && kind[bc->right_idx] == SLOT_INDEPENDENT)
+				extend_interval(start, end, bc->right_idx, position);
+			else if(bc->op == BC_STORE && kind[bc->left_idx] == SLOT_INDEPENDENT)
+				extend_interval(start, end, bc->left_idx, position);
+		}
+	}
+
+	Slot_Interval *intervals = (Slot_Interval *)AllocateCompileMemory(sizeof(Slot_Interval) * slot_count);
+	i32 interval_count = 0;
+	for(i32 slot = 0; slot < slot_count; ++slot)
+	{
+		if(kind[slot] != SLOT_INDEPENDENT)
+			continue;
+		// every store to it was dead
+		if(end[slot] < 0)
+		{
+			kind[slot] = SLOT_UNUSED;
+			continue;
+		}
+		Slot_Interval interval = {};
+		interval.slot = slot;
+		interval.start = start[slot];
+		interval.end = end[slot];
+		interval.size = ir->allocated[slot].size;
+		intervals[interval_count++] = interval;
+	}
+	qsort(intervals, interval_count, sizeof(Slot_Interval), compare_slot_intervals);
+
+	i32 color_count = 0;
+	for(i32 i = 0; i < interval_count; ++i)
+	{
+		Slot_Interval *interval = &intervals[i];
+		i32 color = -1;
+		for(i32 c = 0; c < color_count; ++c)
+		{
+			if(colors[c].size == interval->size && colors[c].busy_until < interval->start)
+			{
+				color = c;
+				break;
+			}
+		}
+		if(color == -1)
+		{
+			color = color_count++;
+			colors[color].size = interval->size;
+		}
+		colors[color].busy_until = interval->end;
+		color_of[interval->slot] = color;
+	}
+	return color_count;
+}
+
+void
+allocate_stack_slots(IR *ir)
+{
+	i32 slot_count = SDCount(ir->allocated);
+	if(slot_count == 0)
+		return;
+	i32 block_count = SDCount(ir->blocks);
+	i32 words = (slot_count + 63) / 64;
+	Slot_Kind *kind = (Slot_Kind *)AllocateCompileMemory(sizeof(Slot_Kind) * slot_count);
+	u64 *live_in  = (u64 *)AllocateCompileMemory(sizeof(u64) * words * block_count);
+	u64 *live_out = (u64 *)AllocateCompileMemory(sizeof(u64) * words * block_count);
+	i32 *color_of = (i32 *)AllocateCompileMemory(sizeof(i32) * slot_count);
+	Slot_Color *colors = (Slot_Color *)AllocateCompileMemory(sizeof(Slot_Color) * slot_count);
+
+	classify_stack_slots(ir, kind);
+	compute_slot_liveness(ir, kind, words, live_in, live_out);
+	remove_dead_stores(ir, kind, words, live_out);
+	i32 color_count = color_stack_slots(ir, kind, words, live_in, live_out, color_of, colors);
+
+	// Fixed slots are moved in runs that keep their offsets from each other
+	// and their alignment, padding between them is part of the run
+	Data_Segment *allocated = ir->allocated;
+	i32 frame_size = 0;
+	for(i32 slot = 0; slot < slot_count; )
+	{
+		if(kind[slot] != SLOT_FIXED)
+		{
+			slot++;
+			continue;
+		}
+		i32 last = slot;
+		for(i32 next = slot + 1; next < slot_count && kind[next] != SLOT_INDEPENDENT; ++next)
+		{
+			if(kind[next] == SLOT_FIXED)
+				last = next;
+		}
+		i32 old_start = allocated[slot].position;
+		i32 new_start = frame_size + (((old_start - frame_size) % 16) + 16) % 16;
+		for(i32 moved = slot; moved <= last; ++moved)
+			allocated[moved].position = new_start + (allocated[moved].position - old_start);
+		frame_size = allocated[last].position + allocated[last].size;
+		slot = last + 1;
+	}
+
+	// biggest alignment first so the smaller slots pack without padding
+	for(i32 alignment = 16; alignment >= 1; alignment /= 2)
+	{
+		for(i32 c = 0; c < color_count; ++c)
+		{
+			if(slot_alignment(colors[c].size) != alignment)
+				continue;
+			frame_size = (frame_size + alignment - 1) & ~(alignment - 1);
+			colors[c].position = frame_size;
+			frame_size += colors[c].size;
+		}
+	}
+	for(i32 slot = 0; slot < slot_count; ++slot)
+	{
+		if(kind[slot] == SLOT_INDEPENDENT)
+			allocated[slot].position = colors[color_of[slot]].position;
+	}
+
+	// the prologue subtracted the size before the slots were packed
+	i32 to_sub = (frame_size + 15) & ~15;
+	IR_Block *entry = ir->blocks[0];
+	for(i32 i = 0; i < entry->bc_count; ++i)
+	{
+		Bytecode *bc = &entry->bc[i];
+		if(bc->op == BC_SUB_VALUE && bc->result == reg_sp)
+		{
+			if(to_sub == 0)
+				bc->op = BC_NO_OP;
+			else
+				bc->big_idx = to_sub;
+			ir->stack_top = to_sub;
+			break;
+		}
+	}
+}
+
+/* ---- Frames ----
+ * Once the stack slots are placed we know what the function does with its
+ * frame. A call whose result is returned as is jumps to the callee after
+ * tearing the frame down, as long as nothing can point into it, and a
+ * function that never calls or touches the stack doesn't set up rbp at all.
+ * --keep-frames turns both off so profilers can walk the rbp chain.
+ */
+
+void
+set_keep_frames(b32 keep)
+{
+	keep_frames = keep;
+}
+
+b32
+can_omit_frames()
+{
+	return !keep_frames && get_bc_optimization() >= OPT_SOME;
+}
+
+// Checks that everything after the call at call_idx only moves its result
+// around and restores callee saved registers before returning it
+static b32
+is_tail_call(IR_Block *block, i32 call_idx)
+{
+	// registers holding the callee's result
+	b32 holds_result[reg_invalid] = {};
+	holds_result[reg_a] = true;
+	holds_result[reg_xmm0] = true;
+	for(i32 i = call_idx + 1; i < block->bc_count; ++i)
+	{
+		Bytecode *bc = &block->bc[i];
+		switch(bc->op)
+		{
+			case BC_NO_OP:
+			break;
+			case BC_MOVE_REG_TO_REG:
+			{
+				holds_result[bc->result] = holds_result[bc->right_idx];
+			} break;
+			case BC_LOAD_STACK:
+			{
+				if(!is_callee_saved((Register)bc->result))
+					return false;
+				holds_result[bc->result] = false;
+			} break;
+			case BC_RETURN:
+			{
+				return bc->left_idx == -1 || holds_result[bc->left_idx];
+			} break;
+			default:
+			return false;
+		}
+	}
+	return false;
+}
+
+static void
+lower_tail_calls(IR *ir)
+{
+	size_t block_count = SDCount(ir->blocks);
+	// the callee could be handed a pointer into our frame
+	for(size_t b = 0; b < block_count; ++b)
+	{
+		IR_Block *block = ir->blocks[b];
+		for(i32 i = 0; i < block->bc_count; ++i)
+		{
+			if(block->bc[i].op == BC_LOAD_ADDRESS)
+				return;
+		}
+	}
+
+	for(size_t b = 0; b < block_count; ++b)
+	{
+		IR_Block *block = ir->blocks[b];
+		i32 call_idx = -1;
+		for(i32 i = 0; i < block->bc_count; ++i)
+		{
+			if(block->bc[i].op == BC_CALL)
+				call_idx = i;
+		}
+		if(call_idx == -1 || !is_tail_call(block, call_idx))
+			continue;
+
+		// the callee saved registers are restored before the jump, the call
+		// only reads rax and the argument registers so it doesn't need them
+		IR_Block out = begin_block_rewrite(block);
+		for(i32 i = 0; i < call_idx; ++i)
+			push_bytecode(&out, block->bc[i]);
+		for(i32 i = call_idx + 1; i < block->bc_count; ++i)
+		{
+			if(block->bc[i].op == BC_LOAD_STACK)
+				push_bytecode(&out, block->bc[i]);
+		}
+		Bytecode jump = block->bc[call_idx];
+		jump.op = BC_TAIL_CALL;
+		push_bytecode(&out, jump);
+		replace_block_code(block, &out);
+	}
+}
+
+static b32
+uses_frame(IR *ir)
+{
+	size_t block_count = SDCount(ir->blocks);
+	for(size_t b = 0; b < block_count; ++b)
+	{
+		IR_Block *block = ir->blocks[b];
+		for(i32 i = 0; i < block->bc_count; ++i)
+		{
+			Bytecode *bc = &block->bc[i];
+			switch(bc->op)
+			{
+				// a call needs rsp aligned to 16, our return address leaves it at 8
+				case BC_CALL:
+				case BC_STORE:
+				case BC_STORE_NON_REMOVABLE:
+				case BC_LOAD_STACK:
+				case BC_LOAD_ADDRESS:
+				case BC_PUSH_OFFSET:
+				case BC_POP_OFFSET:
+				return true;
+				case BC_SUB_VALUE:
+				case BC_ADD_VALUE:
+				{
+					if(bc->result == reg_sp)
+						return true;
+				} break;
+				default: break;
+			}
+		}
+	}
+	return false;
+}
+
+void
+lower_frame(IR *ir)
+{
+	if(!can_omit_frames())
+		return;
+
+	lower_tail_calls(ir);
+	if(uses_frame(ir))
+		return;
+
+	// push rbp and mov rbp, rsp
+	IR_Block *entry = ir->blocks[0];
+	Assert(entry->bc[0].op == BC_PUSH_REG && entry->bc[1].op == BC_MOVE_REG_TO_REG);
+	entry->bc[0].op = BC_NO_OP;
+	entry->bc[1].op = BC_NO_OP;
+	ir->omit_frame = true;
+}
@@ -0,0 +1,121 @@
+
+#ifndef _REGISTER_ALLOCATOR_H
+#define _REGISTER_ALLOCATOR_H
+#include <Basic.h>
+#include <Bytecode.h>
+
+typedef struct
+{
+	i32 *uses[3];
+	i32 use_count;
+	i32 *def;
+	// @NOTE: the x64 encoding writes the result before it's done
+	// reading the operands, so they can't share a register
+	b32 early_def;
+} BC_Operands;
+
+typedef struct
+{
+	i32 start;
+	i32 end;
+} Register_Range;
+
+typedef struct
+{
+	i32 start;
+	i32 end;
+	i32 virtual_register;
+	Register hint;
+	Register assigned;
+	b32 is_float;
+	b32 needs_low;
+	b32 no_spill;
+} Live_Interval;
+
+typedef struct
+{
+	IR_Block *key;
+	i32 value;
+} Block_Index_Table;
+
+// block b's successors are list[first[b]] up to list[first[b + 1]]
+typedef struct
+{
+	i32 *first;
+	i32 *list;
+} Block_Successors;
+
+typedef enum
+{
+	SLOT_UNUSED,
+	// only stored to and loaded from directly, can be moved anywhere
+	SLOT_INDEPENDENT,
+	// reached through an address, keeps its place next to its neighbours
+	SLOT_FIXED
+} Slot_Kind;
+
+typedef struct
+{
+	i32 slot;
+	i32 start;
+	i32 end;
+	i32 size;
+} Slot_Interval;
+
+typedef struct
+{
+	i32 position;
+	i32 size;
+	i32 busy_until;
+} Slot_Color;
+
+typedef struct
+{
+	IR *ir;
+	i32 block_count;
+	i32 reg_count;
+	i32 words;
+	Block_Index_Table *block_index;
+	i32 *block_start;
+	i32 *block_end;
+	u64 *live_in;
+	u64 *live_out;
+	Type_Info **vreg_type;
+	i32 *interval_of;
+	b32 *no_spill;
+	b32 *needs_low;
+	Register *hint;
+	Live_Interval *intervals;
+	i32 interval_count;
+	Register_Range *fixed[reg_invalid];
+	b32 used_callee_saved[reg_invalid];
+} Register_Allocator;
+
+BC_Operands
+bc_get_operands(Bytecode *bc);
+
+// @NOTE: function wide linear scan, variables that never have their address
+// taken are kept in registers across blocks and values are only spilled
+// around calls or when we run out of registers
+void
+allocate_registers(IR *ir);
+
+// @NOTE: runs after register allocation so spill slots are included,
+// removes stores nothing reads and lets slots that are never live at
+// the same time share memory, then shrinks the frame to fit
+void
+allocate_stack_slots(IR *ir);
+
+void
+set_keep_frames(b32 keep);
+
+// false at --optimize none or with --keep-frames
+b32
+can_omit_frames();
+
+// @NOTE: runs last, turns calls in tail position into jumps and drops the
+// rbp frame of leaves that never touch the stack
+void
+lower_frame(IR *ir);
+
+#endif // Header Guard
@@ -0,0 +1,623 @@
+#include <RunCache.h>
+#include <Parser.h>
+#include <platform/platform.h>
+
+typedef struct
+{
+	Ast_Node *key;
+	b32 value;
+} Run_Hash_Visited;
+
+#define RUN_CACHE_CHECK_SEED 0x9E3779B97F4A7C15
+
+typedef struct
+{
+	u64 hash;
+	u64 check;
+	b32 cacheable;
+	Run_Hash_Visited *visited_functions;
+} Run_Hash;
+
+static Run_Cache_Table *run_cache;
+static char *run_cache_path;
+static b32 run_cache_dirty;
+
+static inline void
+run_hash_bytes(Run_Hash *h, void *data, size_t size)
+{
+	h->hash = stbds_hash_bytes(data, size, h->hash);
+	h->check = stbds_hash_bytes(data, size, h->check);
+}
+
+static inline void
+run_hash_u64(Run_Hash *h, u64 value)
+{
+	run_hash_bytes(h, &value, sizeof(u64));
+}
+
+static inline void
+run_hash_string(Run_Hash *h, u8 *str)
+{
+	if(!str)
+		run_hash_u64(h, 0);
+	else
+	{
+		h->hash = stbds_hash_string((char *)str, h->hash);
+		h->check = stbds_hash_string((char *)str, h->check);
+	}
+}
+
+void
+run_hash_type(Run_Hash *h, Type_Info *type, b32 follow_pointers);
+
+void
+run_hash_node(Run_Hash *h, Ast_Node *node);
+
+void
+run_hash_type(Run_Hash *h, Type_Info *type, b32 follow_pointers)
+{
+	if(!type)
+	{
+		run_hash_u64(h, 0);
+		return;
+	}
+	run_hash_u64(h, type->type);
+	run_hash_string(h, type->identifier);
+	switch(type->type)
+	{
+		case T_UNTYPED_INTEGER:
+		case T_UNTYPED_FLOAT:
+		case T_INTEGER:
+		case T_FLOAT:
+		case T_BOOLEAN:
+		{
+			run_hash_u64(h, type->primitive.size);
+		} break;
+		case T_STRUCT:
+		{
+			run_hash_u64(h, type->structure.member_count);
+			run_hash_u64(h, type->structure.is_union);
+			run_hash_u64(h, type->structure.is_packed);
+			for(int i = 0; i < type->structure.member_count; ++i)
+			{
+				run_hash_string(h, type->structure.member_names[i]);
+				run_hash_type(h, &type->structure.member_types[i], false);
+			}
+		} break;
+		case T_ARRAY:
+		{
+			run_hash_u64(h, type->array.array_type);
+			run_hash_u64(h, type->array.elem_count);
+			run_hash_type(h, type->array.type, follow_pointers);
+		} break;
+		case T_POINTER:
+		{
+			// @NOTE: self referencing structs would never stop, the pointed
+			// struct gets hashed wherever it's used by value
+			if(follow_pointers)
+				run_hash_type(h, type->pointer.type, false);
+			else if(type->pointer.type)
+				run_hash_string(h, type->pointer.type->identifier);
+		} break;
+		case T_ENUM:
+		{
+			run_hash_node(h, type->enumerator.node);
+		} break;
+		case T_FUNC:
+		{
+			size_t param_count = type->func.param_types ? SDCount(type->func.param_types) : 0;
+			for(size_t i = 0; i < param_count; ++i)
+				run_hash_type(h, &type->func.param_types[i], false);
+			run_hash_type(h, type->func.return_type, false);
+		} break;
+		default:
+		{
+		} break;
+	}
+}
+
+void
+run_hash_function(Run_Hash *h, Ast_Node *func)
+{
+	run_hash_string(h, func->function.identifier.name);
+	if(hmgetp_null(h->visited_functions, func))
+		return;
+	hmput(h->visited_functions, func, true);
+
+	// @NOTE: we don't know what foreign functions do
+	if(!func->function.body)
+	{
+		h->cacheable = false;
+		return;
+	}
+	run_hash_type(h, func->function.type, true);
+	run_hash_node(h, func->function.body);
+
+	if(func->function.overloads)
+	{
+		size_t overload_count = SDCount(func->function.overloads);
+		for(size_t i = 0; i < overload_count; ++i)
+			run_hash_function(h, func->function.overloads[i]);
+	}
+}
+
+void
+run_hash_identifier(Run_Hash *h, Ast_Node *node)
+{
+	run_hash_string(h, node->identifier.name);
+	Symbol *sym = node->identifier.symbol_spot;
+	// @NOTE: not analyzed yet, so we can't follow it to what it refers to
+	if(!sym)
+	{
+		h->cacheable = false;
+		return;
+	}
+
+	run_hash_u64(h, sym->tag);
+	switch(sym->tag)
+	{
+		case S_FUNCTION:
+		{
+			run_hash_function(h, sym->node);
+		} break;
+		case S_GLOBAL_VAR:
+		{
+			run_hash_type(h, sym->type, true);
+			if(sym->node->type != type_assignment)
+			{
+				// enum members, their value is the node
+				run_hash_node(h, sym->node);
+			}
+			else if(!sym->type->is_const)
+			{
+				// @NOTE: other $runs can change it before this one, its initializer
+				// doesn't say what it holds now
+				h->cacheable = false;
+			}
+			else if(sym->node->assignment.rhs)
+			{
+				run_hash_node(h, sym->node->assignment.rhs);
+			}
+		} break;
+		case S_ENUM:
+		{
+			run_hash_type(h, sym->type, true);
+		} break;
+		default:
+		{
+			run_hash_type(h, sym->type, true);
+		} break;
+	}
+}
+
+// @NOTE: writes that can outlive the $run, to a global or through
+// a pointer, are side effects later runs could see
+void
+run_hash_write(Run_Hash *h, Ast_Node *lhs)
+{
+	while(lhs)
+	{
+		switch((int)lhs->type)
+		{
+			case type_identifier:
+			{
+				Symbol *sym = lhs->identifier.symbol_spot;
+				if(!sym || sym->tag == S_GLOBAL_VAR)
+					h->cacheable = false;
+				return;
+			}
+			case type_index:
+			{
+				Type_Info *operand_type = &lhs->index.operand_type;
+				if(operand_type->type != T_ARRAY || operand_type->array.array_type != ARR_STATIC)
+				{
+					h->cacheable = false;
+					return;
+				}
+				lhs = lhs->index.operand;
+			} break;
+			case type_selector:
+			{
+				if(!lhs->selector.operand_type || lhs->selector.operand_type->type == T_POINTER)
+				{
+					h->cacheable = false;
+					return;
+				}
+				lhs = lhs->selector.operand;
+			} break;
+			default:
+			{
+				h->cacheable = false;
+				return;
+			}
+		}
+	}
+}
+
+void
+run_hash_node(Run_Hash *h, Ast_Node *node)
+{
+	if(!h->cacheable)
+		return;
+	if(!node)
+	{
+		run_hash_u64(h, 0);
+		return;
+	}
+
+	run_hash_u64(h, node->type);
+	switch((int)node->type)
+	{
+		case type_identifier:
+		{
+			run_hash_identifier(h, node);
+		} break;
+		case type_literal:
+		case type_const_str:
+		{
+			run_hash_u64(h, node->atom.type);
+			run_hash_string(h, node->atom.identifier.name);
+		} break;
+		case type_interp_val:
+		{
+			run_hash_u64(h, node->interp_val.val._u64);
+			run_hash_type(h, node->interp_val.val.type, true);
+		} break;
+		case type_binary_expr:
+		{
+			run_hash_u64(h, node->binary_expr.op);
+			run_hash_type(h, &node->binary_expr.left, true);
+			run_hash_type(h, &node->binary_expr.right, true);
+			run_hash_node(h, node->left);
+			run_hash_node(h, node->right);
+		} break;
+		case type_unary_expr:
+		{
+			if(node->unary_expr.op->type == tok_plusplus || node->unary_expr.op->type == tok_minusminus)
+				run_hash_write(h, node->unary_expr.expression);
+			run_hash_u64(h, node->unary_expr.op->type);
+			run_hash_type(h, &node->unary_expr.expr_type, true);
+			run_hash_node(h, node->unary_expr.expression);
+		} break;
+		case type_postfix:
+		{
+			run_hash_write(h, node->postfix.operand);
+			run_hash_u64(h, node->postfix.token->type);
+			run_hash_node(h, node->postfix.operand);
+		} break;
+		case type_cast:
+		{
+			run_hash_type(h, node->cast.type, true);
+			run_hash_type(h, &node->cast.expr_type, true);
+			run_hash_node(h, node->cast.expression);
+		} break;
+		case type_size:
+		{
+			run_hash_type(h, &node->size.operand_type, true);
+		} break;
+		case type_run:
+		{
+			run_hash_node(h, node->run.to_run);
+		} break;
+		case type_func_call:
+		{
+			// @NOTE: only direct calls, otherwise we can't tell what gets called
+			Ast_Node *operand = node->func_call.operand;
+			if(node->func_call.overload_name || operand->type != type_identifier ||
+					!operand->identifier.symbol_spot || operand->identifier.symbol_spot->tag != S_FUNCTION)
+			{
+				h->cacheable = false;
+				return;
+			}
+			run_hash_node(h, operand);
+			size_t arg_count = SDCount(node->func_call.arguments);
+			for(size_t i = 0; i < arg_count; ++i)
+				run_hash_node(h, node->func_call.arguments[i]);
+		} break;
+		case type_index:
+		{
+			run_hash_type(h, &node->index.operand_type, true);
+			run_hash_node(h, node->index.operand);
+			run_hash_node(h, node->index.expression);
+		} break;
+		case type_selector:
+		{
+			if(node->selector.flags & SEL_MODULE)
+			{
+				h->cacheable = false;
+				return;
+			}
+			run_hash_u64(h, node->selector.selected_index);
+			run_hash_type(h, node->selector.operand_type, true);
+			run_hash_node(h, node->selector.operand);
+		} break;
+		case type_struct_init:
+		{
+			run_hash_type(h, &node->struct_init.type, true);
+			size_t expr_count = SDCount(node->struct_init.expressions);
+			for(size_t i = 0; i < expr_count; ++i)
+				run_hash_node(h, node->struct_init.expressions[i]);
+		} break;
+		case type_array_list:
+		{
+			run_hash_type(h, &node->array_list.type, true);
+			size_t expr_count = SDCount(node->array_list.list);
+			for(size_t i = 0; i < expr_count; ++i)
+				run_hash_node(h, node->array_list.list[i]);
+		} break;
+		case type_assignment:
+		{
+			Ast_Node *lhs = node->assignment.lhs;
+			if(!node->assignment.is_declaration)
+				run_hash_write(h, lhs);
+			run_hash_u64(h, node->assignment.is_declaration);
+			run_hash_u64(h, node->assignment.assign_type);
+			run_hash_type(h, node->assignment.decl_type, true);
+			if(node->assignment.is_declaration && lhs && lhs->type == type_identifier)
+				run_hash_string(h, lhs->identifier.name);
+			else
+				run_hash_node(h, lhs);
+			run_hash_node(h, node->assignment.rhs);
+		} break;
+		case type_return:
+		{
+			run_hash_node(h, node->ret.expression);
+		} break;
+		case type_if:
+		{
+			run_hash_node(h, node->condition.expr);
+		} break;
+		case type_switch:
+		{
+			Ast_Switch *sw = &node->switch_statement;
+			run_hash_node(h, sw->expr);
+			size_t case_count = SDCount(sw->cases);
+			for(size_t i = 0; i < case_count; ++i)
+			{
+				size_t value_count = SDCount(sw->cases[i].values);
+				run_hash_u64(h, value_count);
+				for(size_t j = 0; j < value_count; ++j)
+				{
+					run_hash_node(h, sw->cases[i].values[j].low);
+					run_hash_node(h, sw->cases[i].values[j].high);
+				}
+				run_hash_node(h, sw->cases[i].body);
+			}
+			run_hash_node(h, sw->default_body);
+		} break;
+		case type_for:
+		{
+			run_hash_node(h, node->for_loop.expr1);
+			run_hash_node(h, node->for_loop.expr2);
+			run_hash_node(h, node->for_loop.expr3);
+		} break;
+		case type_for_in:
+		{
+			// @NOTE: item and index are declared here, they have no symbol yet
+			run_hash_string(h, node->for_in.item->identifier.name);
+			if(node->for_in.i_nullalbe)
+				run_hash_string(h, node->for_in.i_nullalbe->identifier.name);
+			run_hash_node(h, node->for_in.array);
+		} break;
+		case type_scope_start:
+		{
+			run_hash_node(h, node->scope_desc.body);
+		} break;
+		case type_statements:
+		case type_root:
+		{
+			size_t count = node->statements.list ? SDCount(node->statements.list) : 0;
+			for(size_t i = 0; i < count; ++i)
+				run_hash_node(h, node->statements.list[i]);
+		} break;
+		case type_enum:
+		{
+			run_hash_string(h, node->enumerator.id.name);
+			size_t member_count = SDCount(node->enumerator.members);
+			for(size_t i = 0; i < member_count; ++i)
+			{
+				run_hash_string(h, node->enumerator.members[i]->interp_val.id.name);
+				run_hash_node(h, node->enumerator.members[i]);
+			}
+		} break;
+		case type_else:
+		case type_scope_end:
+		case type_break:
+		case type_continue:
+		{
+		} break;
+		default:
+		{
+			h->cacheable = false;
+		} break;
+	}
+}
+
+void
+run_cache_initialize(char *path)
+{
+	run_cache_path = path;
+	if(!path)
+		return;
+
+	u64 size = platform_get_file_size(path);
+	if(size < sizeof(u32) * 3)
+		return;
+
+	u8 *data = (u8 *)AllocateCompileMemory(size);
+	if(!platform_read_entire_file(data, &size, path))
+		return;
+
+	u32 *header = (u32 *)data;
+	if(header[0] != RUN_CACHE_MAGIC || header[1] != RUN_CACHE_VERSION)
+	{
+		LG_WARN("Ignoring outdated compile time cache %s", path);
+		return;
+	}
+	u32 entry_count = header[2];
+	if(size < sizeof(u32) * 3 + entry_count * sizeof(Run_Cache_Entry))
+	{
+		LG_WARN("Ignoring corrupted compile time cache %s", path);
+		return;
+	}
+
+	u8 *at = (u8 *)(header + 3);
+	u8 *end = data + size;
+	for(u32 i = 0; i < entry_count; ++i)
+	{
+		Run_Cache_Entry entry;
+		if((u64)(end - at) < sizeof(Run_Cache_Entry))
+		{
+			LG_WARN("Ignoring corrupted compile time cache %s", path);
+			hmfree(run_cache);
+			return;
+		}
+		memcpy(&entry, at, sizeof(Run_Cache_Entry));
+		at += sizeof(Run_Cache_Entry);
+		if((u64)(end - at) < entry.data_size)
+		{
+			LG_WARN("Ignoring corrupted compile time cache %s", path);
+			hmfree(run_cache);
+			return;
+		}
+		entry.data = entry.data_size ? at : NULL;
+		at += entry.data_size;
+		hmput(run_cache, entry.hash, entry);
+	}
+}
+
+void
+run_cache_save()
+{
+	if(!run_cache_path || !run_cache_dirty)
+		return;
+
+	u32 entry_count = hmlen(run_cache);
+	size_t size = sizeof(u32) * 3 + entry_count * sizeof(Run_Cache_Entry);
+	for(u32 i = 0; i < entry_count; ++i)
+		size += run_cache[i].value.data_size;
+
+	u8 *data = (u8 *)AllocateCompileMemory(size);
+	u32 *header = (u32 *)data;
+	header[0] = RUN_CACHE_MAGIC;
+	header[1] = RUN_CACHE_VERSION;
+	header[2] = entry_count;
+	u8 *at = (u8 *)(header + 3);
+	for(u32 i = 0; i < entry_count; ++i)
+	{
+		Run_Cache_Entry entry = run_cache[i].value;
+		entry.data = NULL;
+		memcpy(at, &entry, sizeof(Run_Cache_Entry));
+		at += sizeof(Run_Cache_Entry);
+		if(entry.data_size)
+			memcpy(at, run_cache[i].value.data, entry.data_size);
+		at += entry.data_size;
+	}
+
+	if(!platform_write_file(data, size, run_cache_path, true))
+		LG_WARN("Couldn't write compile time cache %s", run_cache_path);
+	run_cache_dirty = false;
+}
+
+// @NOTE: anything holding an address is left out, it wouldn't mean anything in the next build
+b32
+run_cache_can_store(Type_Info *type)
+{
+	switch(type->type)
+	{
+		case T_STRUCT:
+		{
+			if(type->structure.is_union)
+				return false;
+			for(int i = 0; i < type->structure.member_count; ++i)
+			{
+				if(!run_cache_can_store(&type->structure.member_types[i]))
+					return false;
+			}
+			return true;
+		}
+		case T_ARRAY:
+		{
+			return type->array.array_type == ARR_STATIC && run_cache_can_store(type->array.type);
+		}
+		default:
+		{
+			return (is_integer(*type) || is_float(*type) || type->type == T_BOOLEAN) && !is_vector(*type);
+		}
+	}
+}
+
+b32
+run_cache_is_aggregate(Type_Info *type)
+{
+	return type->type == T_STRUCT || type->type == T_ARRAY;
+}
+
+Interp_Val
+interpret_cached_expression(Ast_Node *expr, Type_Info *expr_type, Token_Iden *site, b32 *failed)
+{
+	if(!run_cache_path || !run_cache_can_store(expr_type))
+		return interpret_run(expr, site, failed);
+
+	Run_Hash h = {};
+	h.hash = RUN_CACHE_VERSION;
+	h.check = RUN_CACHE_CHECK_SEED;
+	h.cacheable = true;
+	run_hash_u64(&h, get_register_bit_size());
+	run_hash_type(&h, expr_type, true);
+	run_hash_node(&h, expr);
+	hmfree(h.visited_functions);
+
+	if(!h.cacheable)
+		return interpret_run(expr, site, failed);
+
+	Run_Cache_Table *found = hmgetp_null(run_cache, h.hash);
+	if(found && found->value.check == h.check)
+	{
+		Interp_Val result = create_interp_val();
+		result.type = NewType(Type_Info);
+		memcpy(result.type, expr_type, sizeof(Type_Info));
+		if(run_cache_is_aggregate(result.type))
+		{
+			if(found->value.data_size == get_type_size(*result.type))
+				return memory_to_interp_val(found->value.data, result.type);
+		}
+		else if(!found->value.data_size)
+		{
+			result.type->type = found->value.type;
+			result.type->primitive.size = found->value.size;
+			result._u64 = found->value.value;
+			return result;
+		}
+	}
+
+	Interp_Val result = interpret_run(expr, site, failed);
+	if(*failed || !result.type || !run_cache_can_store(result.type))
+		return result;
+
+	Run_Cache_Entry entry = {};
+	entry.hash = h.hash;
+	entry.check = h.check;
+	entry.type = result.type->type;
+	if(run_cache_is_aggregate(result.type))
+	{
+		size_t size = get_type_size(*result.type);
+		u8 *data = (u8 *)AllocateCompileMemory(size);
+		memset(data, 0, size);
+		// flattening frees the interpreted value, so what's returned is read back
+		// from the bytes, the same as the next build gets
+		copy_interp_val_to_memory(data, &result, result.type);
+		entry.data_size = size;
+		entry.data = data;
+		result = memory_to_interp_val(data, result.type);
+	}
+	else
+	{
+		entry.value = result._u64;
+		entry.size = result.type->primitive.size;
+	}
+	hmput(run_cache, h.hash, entry);
+	run_cache_dirty = true;
+	return result;
+}
+
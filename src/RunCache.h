@@ -0,0 +1,43 @@
+
+#ifndef _RUN_CACHE_H
+#define _RUN_CACHE_H
+#include <Basic.h>
+#include <Type.h>
+#include <Interpret.h>
+
+#define RUN_CACHE_MAGIC   0x43525041 // APRC
+#define RUN_CACHE_VERSION 2
+
+typedef struct
+{
+	u64 hash;
+	// the same key hashed from another seed, a collision on hash alone isn't trusted
+	u64 check;
+	u64 value;
+	Type_Type type;
+	Var_Size size;
+	// structs and arrays are flattened like global initializers,
+	// in the file their data_size bytes follow the entry
+	u32 data_size;
+	u8 *data;
+} Run_Cache_Entry;
+
+typedef struct
+{
+	u64 key;
+	Run_Cache_Entry value;
+} Run_Cache_Table;
+
+// @NOTE: path == NULL disables the cache
+void
+run_cache_initialize(char *path);
+
+void
+run_cache_save();
+
+// @NOTE: interprets expr unless a result for the same expression, callees
+// and arguments was stored by this or a previous build
+Interp_Val
+interpret_cached_expression(Ast_Node *expr, Type_Info *expr_type, Token_Iden *site, b32 *failed);
+
+#endif // Header Guard
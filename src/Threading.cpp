@@ -3,6 +3,7 @@
 #include <x64_Gen.h>
 
 #define THREAD_COUNT 8
+#define JOB_QUEUE_SIZE 1024
 
 static Thread_Queue thread_queue;
 static Platform_Object thread_mutex;
@@ -18,6 +19,17 @@ do_job(Job_Posting *posting)
 			Generate_Code_Args *args = (Generate_Code_Args *)posting->args;
 			x64_gen_ir(args->ir, args->buffer, args->relocs, args->global_ds, args->buffer_index, args->fixable_arr);
 		} break;
+		case JOB_PLACE_CODE:
+		{
+			Place_Code_Args *args = (Place_Code_Args *)posting->args;
+			x64_place_functions(args->buffers, args->relocs, args->code_offsets, args->relocation_offsets,
+					args->program, args->out_relocations, args->start, args->end);
+		} break;
+		case JOB_GENERATE_BYTECODE:
+		{
+			Generate_Bytecode_Args *args = (Generate_Bytecode_Args *)posting->args;
+			*args->out = generate_bc_function(args->f, args->list, args->function);
+		} break;
 		default:
 		{
 			Assert(false);
@@ -29,18 +41,16 @@ void
 wait_for_job(int *id)
 {
 	while(true) {
-		if(thread_queue.last_started < thread_queue.last_posting) {
-			i32 idx = platform_interlocked_increment(&thread_queue.last_started) - 1;
-			// @TODO: check
-			// idk if that works
-			if(idx >= 1024) {
-				thread_queue.last_started = 0;
-				thread_queue.last_done = 0;
+		long started = thread_queue.last_started;
+		if(started < thread_queue.last_posting) {
+			// more than one thread can see the same job free, only the one
+			// that moves last_started past it gets to run it. The posting is
+			// copied first, its slot can be reused as soon as it's claimed
+			Job_Posting posting = thread_queue.postings[started % JOB_QUEUE_SIZE];
+			if(platform_interlocked_compare_exchange(&thread_queue.last_started, started + 1, started) != started)
 				continue;
-			}
-			Job_Posting *posting = &thread_queue.postings[idx];
 			platform_interlocked_increment(&thread_queue.currently_working);
-			do_job(posting);
+			do_job(&posting);
 			platform_interlocked_decrement(&thread_queue.currently_working);
 			platform_interlocked_increment(&thread_queue.last_done);
 		}
@@ -53,10 +63,11 @@ wait_for_job(int *id)
 void
 post_job_listing(Job_Types job_type, void *function, void *args)
 {
-	// if all threads are working do the work on the main one
-	if(thread_queue.last_posting >= 1024)
-		thread_queue.last_posting = 0;
-	if(thread_queue.currently_working == THREAD_COUNT) {
+	// if all threads are working or the queue is full do the work on the main one,
+	// the counters only go up and wrap around the postings. A slot is free once
+	// its job was claimed, the worker copied it before claiming it
+	if(thread_queue.currently_working == THREAD_COUNT ||
+			thread_queue.last_posting - thread_queue.last_started >= JOB_QUEUE_SIZE) {
 		Job_Posting *main_thread_post = (Job_Posting *)AllocatePermanentMemory(sizeof(Job_Posting));
 		main_thread_post->type = job_type;
 		main_thread_post->func = function;
@@ -65,7 +76,7 @@ post_job_listing(Job_Types job_type, void *function, void *args)
 	}
 	else {
 		// post to work queue
-		thread_queue.postings[thread_queue.last_posting] = { job_type, function, args };
+		thread_queue.postings[thread_queue.last_posting % JOB_QUEUE_SIZE] = { job_type, function, args };
 		platform_write_barrirer;
 		thread_queue.last_posting++;
 		platform_alert_semaphore(thread_queue.semaphore);
@@ -91,7 +102,7 @@ initialize_thread_pool()
 	// @TODO: check thread count
 	// @TODO: check thread count
 	thread_mutex = platform_create_mutex();
-	thread_queue.postings = (Job_Posting *)AllocateCompileMemory(sizeof(Job_Posting) * 1024);
+	thread_queue.postings = (Job_Posting *)AllocateCompileMemory(sizeof(Job_Posting) * JOB_QUEUE_SIZE);
 	thread_queue.semaphore = platform_create_semaphore(0, THREAD_COUNT);
 	for(size_t i = 0; i < THREAD_COUNT; ++i)
 	{
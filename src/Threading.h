@@ -8,9 +8,19 @@
 
 enum Job_Types {
 	JOB_GENERATE_CODE,
+	JOB_PLACE_CODE,
+	JOB_GENERATE_BYTECODE,
 	JOB_ANALYZE_FUNCTION
 };
 
+struct Generate_Bytecode_Args
+{
+	File_Contents *f;
+	Ast_Node **list;
+	Ast_Node *function;
+	IR *out;
+};
+
 struct Generate_Code_Args
 {
 	IR *ir;
@@ -21,6 +31,18 @@ struct Generate_Code_Args
 	int buffer_index;
 };
 
+struct Place_Code_Args
+{
+	Code_Buffer *buffers;
+	Relative_Relocation_Array *relocs;
+	u32 *code_offsets;
+	u32 *relocation_offsets;
+	Code_Buffer *program;
+	Relocation *out_relocations;
+	int start;
+	int end;
+};
+
 struct Job_Posting
 {
 	Job_Types type;
@@ -255,6 +255,14 @@ is_float(Type_Info type)
 	return type.type == T_FLOAT || type.type == T_UNTYPED_FLOAT;
 }
 
+b32
+is_vector(Type_Info type)
+{
+	if(type.type != T_FLOAT && type.type != T_INTEGER)
+		return false;
+	return type.primitive.size == real128 || type.primitive.size == byte128;
+}
+
 b32
 is_castable(Type_Info type, Type_Info cast)
 {
@@ -166,6 +166,10 @@ is_float(Type_Info type);
 b32
 is_integer(Type_Info type);
 
+// f128 and i128, four 32 bit lanes kept in an xmm register
+b32
+is_vector(Type_Info type);
+
 b32
 is_accessible(Type_Info type);
 
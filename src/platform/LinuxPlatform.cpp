@@ -8,6 +8,7 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <dlfcn.h>
 #include <dirent.h>
@@ -87,6 +88,18 @@ platform_call_and_wait(const char *command)
 	execve((char const *)"", (char * const *)command, (char * const *)"");
 }
 
+b32
+platform_mark_executable(const char *path)
+{
+	return chmod(path, 0755) == 0;
+}
+
+u32
+platform_get_process_id()
+{
+	return (u32)getpid();
+}
+
 void
 platform_alert_semaphore(Platform_Object semaphore)
 {
@@ -172,7 +185,7 @@ platform_write_file(void *data, u32 bytes_to_write, const char *path, b32 overwr
 		{
 			delete_file(path);
 		}
-		file = open(path, O_APPEND | O_CREAT | O_RDWR);
+		file = open(path, O_APPEND | O_CREAT | O_RDWR, 0644);
 	}
 	
 	i32 written = write(file, data, bytes_to_write);
@@ -181,6 +194,76 @@ platform_write_file(void *data, u32 bytes_to_write, const char *path, b32 overwr
 	return true;
 }
 
+// writev can stop early, so keep going from where it left off
+static b32
+write_vectors(int file, struct iovec *vectors, int count)
+{
+	while(count > 0)
+	{
+		ssize_t written = writev(file, vectors, count);
+		if(written < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return false;
+		}
+		while(count > 0 && (size_t)written >= vectors->iov_len)
+		{
+			written -= vectors->iov_len;
+			vectors++;
+			count--;
+		}
+		if(count > 0)
+		{
+			vectors->iov_base = (u8 *)vectors->iov_base + written;
+			vectors->iov_len -= written;
+		}
+	}
+	return true;
+}
+
+b32
+platform_write_file_chunks(Platform_Write_Chunk *chunks, u32 chunk_count, const char *path)
+{
+	static const u8 zeroes[4096] = {};
+	const int batch_size = 64;
+
+	int file = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	if(file == -1)
+		return false;
+
+	struct iovec vectors[batch_size];
+	int count = 0;
+	b32 result = true;
+	for(u32 i = 0; i < chunk_count && result; ++i)
+	{
+		u8 *data = (u8 *)chunks[i].data;
+		u64 left = chunks[i].size;
+		while(left > 0 && result)
+		{
+			u64 size = left;
+			if(!data && size > sizeof(zeroes))
+				size = sizeof(zeroes);
+			vectors[count].iov_base = data ? (void *)data : (void *)zeroes;
+			vectors[count].iov_len = size;
+			count++;
+			if(data)
+				data += size;
+			left -= size;
+			if(count == batch_size)
+			{
+				result = write_vectors(file, vectors, count);
+				count = 0;
+			}
+		}
+	}
+	if(result && count != 0)
+		result = write_vectors(file, vectors, count);
+
+	close(file);
+	return result;
+}
+
 typedef void *(*pthread_fn)(void *);
 
 Platform_Thread
@@ -297,6 +380,18 @@ platform_allocate_chunk(u64 size)
 	return (u8 *)result + sizeof(i64);
 }
 
+void *
+platform_allocate_executable_memory(u64 size)
+{
+	void *result = mmap(NULL, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_ANON | MAP_PRIVATE, -1, 0);
+	if(result == MAP_FAILED)
+	{
+		LG_ERROR("Mmap failed to allocate executable memory: %d", errno);
+		return NULL;
+	}
+	return result;
+}
+
 void
 platform_free_chunk(void *address)
 {
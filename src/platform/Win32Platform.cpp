@@ -40,6 +40,19 @@ platform_call_and_wait(const char *command)
 	WaitForSingleObject(pc.hProcess, INFINITE);
 }
 
+b32
+platform_mark_executable(const char *path)
+{
+	// anything with the right extension can be run
+	return true;
+}
+
+u32
+platform_get_process_id()
+{
+	return (u32)GetCurrentProcessId();
+}
+
 Platform_Dynamic_Lib
 platform_load_dynamic_lib(const char *name_no_extension)
 {
@@ -187,6 +200,38 @@ platform_write_file(void *Data, u32 BytesToWrite, const char *InPath, b32 Overwr
     return true;
 }
 
+b32
+platform_write_file_chunks(Platform_Write_Chunk *Chunks, u32 ChunkCount, const char *InPath)
+{
+	static const u8 Zeroes[4096] = {};
+	wchar_t	*Path = platform_ascii_to_wchar(InPath);
+	HANDLE File = CreateFile(Path, FILE_GENERIC_WRITE, 0, 0,
+							 CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL,
+							 0);
+	if(File == INVALID_HANDLE_VALUE)
+		return false;
+
+	b32 Result = true;
+	for(u32 Index = 0; Index < ChunkCount && Result; ++Index)
+	{
+		u8 *Data = (u8 *)Chunks[Index].data;
+		u64 Left = Chunks[Index].size;
+		while(Left > 0 && Result)
+		{
+			DWORD Size = Left > 0x40000000 ? 0x40000000 : (DWORD)Left;
+			if(!Data && Size > sizeof(Zeroes))
+				Size = sizeof(Zeroes);
+			DWORD BytesWritten = 0;
+			Result = WriteFile(File, Data ? Data : Zeroes, Size, &BytesWritten, 0) && BytesWritten == Size;
+			if(Data)
+				Data += Size;
+			Left -= Size;
+		}
+	}
+	CloseHandle(File);
+	return Result;
+}
+
 Platform_Thread
 platform_create_thread(void *Func, void *Args)
 {
@@ -36,13 +36,23 @@ typedef struct _Quad
 	u16 Height;
 } Quad;
 
+typedef struct _Platform_Write_Chunk
+{
+	void *data;
+	u64 size;
+} Platform_Write_Chunk;
+
 #if defined(_WIN32)
 #define platform_interlocked_increment(num) _InterlockedIncrement(num)
 #define platform_interlocked_decrement(num) _InterlockedDecrement(num)
+#define platform_interlocked_add64(num, value) _InterlockedExchangeAdd64((volatile long long *)(num), (long long)(value))
+#define platform_interlocked_compare_exchange(num, new_value, expected) _InterlockedCompareExchange(num, new_value, expected)
 #define platform_write_barrirer _WriteBarrier(); _mm_sfence()
 #else
-#define platform_interlocked_increment(num) __sync_fetch_and_add(num, 1)
-#define platform_interlocked_decrement(num) __sync_fetch_and_sub(num, 1)
+#define platform_interlocked_increment(num) __sync_add_and_fetch(num, 1)
+#define platform_interlocked_decrement(num) __sync_sub_and_fetch(num, 1)
+#define platform_interlocked_add64(num, value) __sync_add_and_fetch(num, value)
+#define platform_interlocked_compare_exchange(num, new_value, expected) __sync_val_compare_and_swap(num, expected, new_value)
 #define platform_write_barrirer __asm__ __volatile__("":::"memory"); _mm_sfence()
 #endif
 
@@ -140,12 +150,24 @@ platform_get_state();
 b32
 platform_write_file(void *Data, u32 BytesToWrite, const char *Path, b32 Overwrite);
 
+// @NOTE: writes the chunks back to back into a new file without joining
+// them in memory first, a chunk without data is written as zeroes
+b32
+platform_write_file_chunks(Platform_Write_Chunk *chunks, u32 chunk_count, const char *path);
+
 b32
 platform_read_entire_file(void *Data, u64 *Size, char *Path);
 
 void
 platform_call_and_wait(const char *command);
 
+// @NOTE: lets the file be run, for executables the compiler writes itself
+b32
+platform_mark_executable(const char *path);
+
+u32
+platform_get_process_id();
+
 inline char *
 platform_path_to_file_name(char *path)
 {
@@ -0,0 +1,496 @@
+#include <x64_Dwarf.h>
+#include <platform/platform.h>
+
+static b32 debug_info_enabled = false;
+static X64_Debug_Info *last_debug_info;
+
+const int DW_TAG_compile_unit    = 0x11;
+const int DW_TAG_subprogram      = 0x2E;
+const int DW_CHILDREN_no         = 0;
+const int DW_CHILDREN_yes        = 1;
+const int DW_AT_name             = 0x03;
+const int DW_AT_stmt_list        = 0x10;
+const int DW_AT_low_pc           = 0x11;
+const int DW_AT_high_pc          = 0x12;
+const int DW_AT_comp_dir         = 0x1B;
+const int DW_AT_producer         = 0x25;
+const int DW_AT_external         = 0x3F;
+const int DW_FORM_addr           = 0x01;
+const int DW_FORM_data4          = 0x06;
+const int DW_FORM_data8          = 0x07;
+const int DW_FORM_string         = 0x08;
+const int DW_FORM_sec_offset     = 0x17;
+const int DW_FORM_flag_present   = 0x19;
+const int DW_LNS_copy            = 0x01;
+const int DW_LNS_advance_pc      = 0x02;
+const int DW_LNS_advance_line    = 0x03;
+const int DW_LNS_set_file        = 0x04;
+const int DW_LNS_set_column      = 0x05;
+const int DW_LNE_end_sequence    = 0x01;
+const int DW_LNE_set_address     = 0x02;
+const int DW_CFA_advance_loc     = 0x40;
+const int DW_CFA_offset          = 0x80;
+const int DW_CFA_restore         = 0xC0;
+const int DW_CFA_advance_loc1    = 0x02;
+const int DW_CFA_advance_loc2    = 0x03;
+const int DW_CFA_advance_loc4    = 0x04;
+const int DW_CFA_remember_state  = 0x0A;
+const int DW_CFA_restore_state   = 0x0B;
+const int DW_CFA_def_cfa         = 0x0C;
+const int DW_CFA_def_cfa_register= 0x0D;
+const int DW_CFA_def_cfa_offset  = 0x0E;
+
+// DWARF numbers for the x64 registers, the return address is a column of its own
+const int DWARF_REG_RBP = 6;
+const int DWARF_REG_RSP = 7;
+const int DWARF_REG_RA  = 16;
+
+// the usual line program parameters, a special opcode covers
+// lines from LINE_BASE to LINE_BASE + LINE_RANGE - 1 ahead
+#define LINE_BASE   -5
+#define LINE_RANGE  14
+#define OPCODE_BASE 13
+static const u8 standard_opcode_lengths[OPCODE_BASE - 1] = { 0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1 };
+
+void
+x64_set_debug_info(b32 enable)
+{
+	debug_info_enabled = enable;
+}
+
+b32
+x64_debug_info_enabled()
+{
+	return debug_info_enabled;
+}
+
+X64_Debug_Info *
+x64_get_debug_info()
+{
+	return last_debug_info;
+}
+
+void
+x64_push_line(Debug_Rows *rows, u32 offset, u32 line, u32 column)
+{
+	// nothing was emitted for the row before, it's replaced
+	if(rows->line_count && rows->lines[rows->line_count - 1].offset == offset)
+	{
+		rows->lines[rows->line_count - 1] = { offset, line, column };
+		return;
+	}
+	if(rows->line_count == rows->line_capacity)
+	{
+		u32 capacity = rows->line_capacity ? rows->line_capacity * 2 : 16;
+		Code_Line *grown = (Code_Line *)AllocateCompileMemory(capacity * sizeof(Code_Line));
+		memcpy(grown, rows->lines, rows->line_count * sizeof(Code_Line));
+		rows->lines = grown;
+		rows->line_capacity = capacity;
+	}
+	rows->lines[rows->line_count++] = { offset, line, column };
+}
+
+void
+x64_push_frame_event(Debug_Rows *rows, u32 offset, Frame_Event_Kind kind)
+{
+	if(rows->frame_count == rows->frame_capacity)
+	{
+		u32 capacity = rows->frame_capacity ? rows->frame_capacity * 2 : 8;
+		Frame_Event *grown = (Frame_Event *)AllocateCompileMemory(capacity * sizeof(Frame_Event));
+		memcpy(grown, rows->frames, rows->frame_count * sizeof(Frame_Event));
+		rows->frames = grown;
+		rows->frame_capacity = capacity;
+	}
+	rows->frames[rows->frame_count++] = { offset, kind };
+}
+
+const char *
+dwarf_section_name(Dwarf_Section_Kind kind)
+{
+	switch(kind)
+	{
+		case DWARF_ABBREV: return ".debug_abbrev";
+		case DWARF_INFO:   return ".debug_info";
+		case DWARF_LINE:   return ".debug_line";
+		case DWARF_FRAME:  return ".debug_frame";
+		default: break;
+	}
+	Assert(false);
+	return "";
+}
+
+static inline void
+dwarf_u16(Dwarf_Section *section, u16 value)
+{
+	push_byte(&section->bytes, value & 0xFF);
+	push_byte(&section->bytes, value >> 8);
+}
+
+static inline void
+dwarf_u32(Dwarf_Section *section, u32 value)
+{
+	push_i32(&section->bytes, (i32)value);
+}
+
+static inline void
+dwarf_u64(Dwarf_Section *section, u64 value)
+{
+	push_i32(&section->bytes, (i32)value);
+	push_i32(&section->bytes, (i32)(value >> 32));
+}
+
+static void
+dwarf_uleb(Dwarf_Section *section, u64 value)
+{
+	do {
+		u8 byte = value & 0x7F;
+		value >>= 7;
+		if(value)
+			byte |= 0x80;
+		push_byte(&section->bytes, byte);
+	} while(value);
+}
+
+static void
+dwarf_sleb(Dwarf_Section *section, i64 value)
+{
+	b32 more = true;
+	while(more)
+	{
+		u8 byte = value & 0x7F;
+		value >>= 7;
+		// done once the rest is all sign bits and the sign is in this byte
+		if((value == 0 && !(byte & 0x40)) || (value == -1 && (byte & 0x40)))
+			more = false;
+		else
+			byte |= 0x80;
+		push_byte(&section->bytes, byte);
+	}
+}
+
+static void
+dwarf_string(Dwarf_Section *section, const char *str)
+{
+	size_t len = vstd_strlen((char *)str);
+	for(size_t i = 0; i <= len; ++i)
+		push_byte(&section->bytes, str[i]);
+}
+
+// the field written next is relative to target
+static void
+dwarf_fixup(Dwarf_Section *section, Dwarf_Section_Kind target)
+{
+	if(section->fixup_count == section->fixup_capacity)
+	{
+		u32 capacity = section->fixup_capacity ? section->fixup_capacity * 2 : 16;
+		Dwarf_Fixup *grown = (Dwarf_Fixup *)AllocateCompileMemory(capacity * sizeof(Dwarf_Fixup));
+		memcpy(grown, section->fixups, section->fixup_count * sizeof(Dwarf_Fixup));
+		section->fixups = grown;
+		section->fixup_capacity = capacity;
+	}
+	section->fixups[section->fixup_count++] = { section->bytes.count, target };
+}
+
+// reserves a 4 byte length, dwarf_end_length writes how much came after it
+static u32
+dwarf_begin_length(Dwarf_Section *section)
+{
+	u32 at = section->bytes.count;
+	dwarf_u32(section, 0);
+	return at;
+}
+
+static void
+dwarf_end_length(Dwarf_Section *section, u32 at)
+{
+	u32 length = section->bytes.count - (at + 4);
+	memcpy(section->bytes.buffer + at, &length, sizeof(u32));
+}
+
+static void
+dwarf_abbreviations(Dwarf_Section *abbrev)
+{
+	dwarf_uleb(abbrev, 1);
+	dwarf_uleb(abbrev, DW_TAG_compile_unit);
+	push_byte(&abbrev->bytes, DW_CHILDREN_yes);
+	dwarf_uleb(abbrev, DW_AT_producer);  dwarf_uleb(abbrev, DW_FORM_string);
+	dwarf_uleb(abbrev, DW_AT_name);      dwarf_uleb(abbrev, DW_FORM_string);
+	dwarf_uleb(abbrev, DW_AT_comp_dir);  dwarf_uleb(abbrev, DW_FORM_string);
+	dwarf_uleb(abbrev, DW_AT_stmt_list); dwarf_uleb(abbrev, DW_FORM_sec_offset);
+	dwarf_uleb(abbrev, DW_AT_low_pc);    dwarf_uleb(abbrev, DW_FORM_addr);
+	dwarf_uleb(abbrev, DW_AT_high_pc);   dwarf_uleb(abbrev, DW_FORM_data8);
+	dwarf_uleb(abbrev, 0);               dwarf_uleb(abbrev, 0);
+
+	dwarf_uleb(abbrev, 2);
+	dwarf_uleb(abbrev, DW_TAG_subprogram);
+	push_byte(&abbrev->bytes, DW_CHILDREN_no);
+	dwarf_uleb(abbrev, DW_AT_name);      dwarf_uleb(abbrev, DW_FORM_string);
+	dwarf_uleb(abbrev, DW_AT_external);  dwarf_uleb(abbrev, DW_FORM_flag_present);
+	dwarf_uleb(abbrev, DW_AT_low_pc);    dwarf_uleb(abbrev, DW_FORM_addr);
+	dwarf_uleb(abbrev, DW_AT_high_pc);   dwarf_uleb(abbrev, DW_FORM_data4);
+	dwarf_uleb(abbrev, 0);               dwarf_uleb(abbrev, 0);
+
+	dwarf_uleb(abbrev, 0);
+}
+
+static void
+dwarf_compile_unit(X64_Debug_Info *info, Dwarf_Section *section, char *unit_name)
+{
+	u32 length = dwarf_begin_length(section);
+	dwarf_u16(section, 4);
+	dwarf_fixup(section, DWARF_ABBREV);
+	dwarf_u32(section, 0);
+	push_byte(&section->bytes, 8); // address size
+
+	char *comp_dir = platform_relative_to_absolute_path((char *)".");
+	dwarf_uleb(section, 1);
+	dwarf_string(section, "apoc");
+	dwarf_string(section, unit_name);
+	dwarf_string(section, comp_dir ? comp_dir : "");
+	dwarf_fixup(section, DWARF_LINE);
+	dwarf_u32(section, 0);
+	dwarf_fixup(section, DWARF_TEXT);
+	dwarf_u64(section, 0);
+	dwarf_u64(section, info->code_size);
+
+	for(u32 i = 0; i < info->function_count; ++i)
+	{
+		Debug_Function *function = &info->functions[i];
+		dwarf_uleb(section, 2);
+		dwarf_string(section, (char *)function->name);
+		dwarf_fixup(section, DWARF_TEXT);
+		dwarf_u64(section, function->start);
+		dwarf_u32(section, function->size);
+	}
+	push_byte(&section->bytes, 0);
+	dwarf_end_length(section, length);
+}
+
+// a special opcode when the step fits in one, otherwise the long forms and a copy
+static void
+dwarf_line_row(Dwarf_Section *section, u32 address_delta, i64 line_delta)
+{
+	if(line_delta < LINE_BASE || line_delta >= LINE_BASE + LINE_RANGE)
+	{
+		push_byte(&section->bytes, DW_LNS_advance_line);
+		dwarf_sleb(section, line_delta);
+		line_delta = 0;
+	}
+	u64 opcode = (line_delta - LINE_BASE) + (u64)LINE_RANGE * address_delta + OPCODE_BASE;
+	if(opcode > 255)
+	{
+		push_byte(&section->bytes, DW_LNS_advance_pc);
+		dwarf_uleb(section, address_delta);
+		opcode = (line_delta - LINE_BASE) + OPCODE_BASE;
+	}
+	push_byte(&section->bytes, (u8)opcode);
+}
+
+static void
+dwarf_line_program(X64_Debug_Info *info, Dwarf_Section *section)
+{
+	// file numbers start at 1, every function's file is in the header once
+	struct { char *key; u32 value; } *file_numbers = NULL;
+	char **files = (char **)AllocateCompileMemory(info->function_count * sizeof(char *) + 1);
+	u32 file_count = 0;
+	u32 *function_file = (u32 *)AllocateCompileMemory(info->function_count * sizeof(u32) + 1);
+	for(u32 i = 0; i < info->function_count; ++i)
+	{
+		char *file = info->functions[i].file;
+		ptrdiff_t idx = shgeti(file_numbers, file);
+		if(idx == -1)
+		{
+			files[file_count++] = file;
+			shput(file_numbers, file, file_count);
+			function_file[i] = file_count;
+		}
+		else
+			function_file[i] = file_numbers[idx].value;
+	}
+	shfree(file_numbers);
+
+	u32 length = dwarf_begin_length(section);
+	dwarf_u16(section, 4);
+	u32 header_length = dwarf_begin_length(section);
+	push_byte(&section->bytes, 1); // minimum instruction length
+	push_byte(&section->bytes, 1); // operations per instruction
+	push_byte(&section->bytes, 1); // rows are statements by default
+	push_byte(&section->bytes, (u8)LINE_BASE);
+	push_byte(&section->bytes, LINE_RANGE);
+	push_byte(&section->bytes, OPCODE_BASE);
+	for(int i = 0; i < OPCODE_BASE - 1; ++i)
+		push_byte(&section->bytes, standard_opcode_lengths[i]);
+	// no include directories, the paths are absolute
+	push_byte(&section->bytes, 0);
+	for(u32 i = 0; i < file_count; ++i)
+	{
+		dwarf_string(section, files[i]);
+		dwarf_uleb(section, 0);
+		dwarf_uleb(section, 0);
+		dwarf_uleb(section, 0);
+	}
+	push_byte(&section->bytes, 0);
+	dwarf_end_length(section, header_length);
+
+	for(u32 i = 0; i < info->function_count; ++i)
+	{
+		Debug_Function *function = &info->functions[i];
+		Debug_Rows *rows = function->rows;
+		if(!rows || rows->line_count == 0)
+			continue;
+
+		push_byte(&section->bytes, 0);
+		dwarf_uleb(section, 9);
+		push_byte(&section->bytes, DW_LNE_set_address);
+		dwarf_fixup(section, DWARF_TEXT);
+		dwarf_u64(section, function->start);
+		if(function_file[i] != 1)
+		{
+			push_byte(&section->bytes, DW_LNS_set_file);
+			dwarf_uleb(section, function_file[i]);
+		}
+
+		// the state machine starts at line 1 column 0 for every sequence
+		u32 address = 0;
+		u32 line = 1;
+		u32 column = 0;
+		for(u32 r = 0; r < rows->line_count; ++r)
+		{
+			Code_Line *row = &rows->lines[r];
+			// a dropped jump can leave two rows at one address, the second is what runs
+			if(r + 1 < rows->line_count && rows->lines[r + 1].offset == row->offset)
+				continue;
+			if(row->column != column)
+			{
+				push_byte(&section->bytes, DW_LNS_set_column);
+				dwarf_uleb(section, row->column);
+				column = row->column;
+			}
+			dwarf_line_row(section, row->offset - address, (i64)row->line - (i64)line);
+			address = row->offset;
+			line = row->line;
+		}
+		push_byte(&section->bytes, DW_LNS_advance_pc);
+		dwarf_uleb(section, function->size - address);
+		push_byte(&section->bytes, 0);
+		dwarf_uleb(section, 1);
+		push_byte(&section->bytes, DW_LNE_end_sequence);
+	}
+	dwarf_end_length(section, length);
+}
+
+static void
+dwarf_advance_loc(Dwarf_Section *section, u32 delta)
+{
+	if(delta == 0)
+		return;
+	if(delta < 0x40)
+		push_byte(&section->bytes, DW_CFA_advance_loc | delta);
+	else if(delta <= 0xFF)
+	{
+		push_byte(&section->bytes, DW_CFA_advance_loc1);
+		push_byte(&section->bytes, delta);
+	}
+	else if(delta <= 0xFFFF)
+	{
+		push_byte(&section->bytes, DW_CFA_advance_loc2);
+		dwarf_u16(section, delta);
+	}
+	else
+	{
+		push_byte(&section->bytes, DW_CFA_advance_loc4);
+		dwarf_u32(section, delta);
+	}
+}
+
+// entries are padded with DW_CFA_nop to the address size
+static void
+dwarf_end_frame_entry(Dwarf_Section *section, u32 length)
+{
+	while((section->bytes.count - length) % 8)
+		push_byte(&section->bytes, 0);
+	dwarf_end_length(section, length);
+}
+
+// @NOTE: the CIE is the state at a call, the FDEs of functions with a frame
+// follow push rbp and mov rbp, rsp and every epilogue. The callee saved
+// registers the allocator spills aren't described, only how to get to the caller
+static void
+dwarf_call_frames(X64_Debug_Info *info, Dwarf_Section *section)
+{
+	u32 cie = dwarf_begin_length(section);
+	dwarf_u32(section, 0xFFFFFFFF);
+	push_byte(&section->bytes, 1); // version
+	push_byte(&section->bytes, 0); // no augmentation
+	dwarf_uleb(section, 1);        // code alignment
+	dwarf_sleb(section, -8);       // data alignment
+	push_byte(&section->bytes, DWARF_REG_RA);
+	push_byte(&section->bytes, DW_CFA_def_cfa);
+	dwarf_uleb(section, DWARF_REG_RSP);
+	dwarf_uleb(section, 8);
+	push_byte(&section->bytes, DW_CFA_offset | DWARF_REG_RA);
+	dwarf_uleb(section, 1);
+	dwarf_end_frame_entry(section, cie);
+
+	for(u32 i = 0; i < info->function_count; ++i)
+	{
+		Debug_Function *function = &info->functions[i];
+		u32 fde = dwarf_begin_length(section);
+		dwarf_fixup(section, DWARF_FRAME);
+		dwarf_u32(section, cie);
+		dwarf_fixup(section, DWARF_TEXT);
+		dwarf_u64(section, function->start);
+		dwarf_u64(section, function->size);
+
+		Debug_Rows *rows = function->rows;
+		u32 at = 0;
+		for(u32 e = 0; rows && e < rows->frame_count; ++e)
+		{
+			Frame_Event *event = &rows->frames[e];
+			dwarf_advance_loc(section, event->offset - at);
+			at = event->offset;
+			switch(event->kind)
+			{
+				case FRAME_PUSHED_BP:
+				{
+					push_byte(&section->bytes, DW_CFA_def_cfa_offset);
+					dwarf_uleb(section, 16);
+					push_byte(&section->bytes, DW_CFA_offset | DWARF_REG_RBP);
+					dwarf_uleb(section, 2);
+				} break;
+				case FRAME_SET_BP:
+				{
+					push_byte(&section->bytes, DW_CFA_def_cfa_register);
+					dwarf_uleb(section, DWARF_REG_RBP);
+				} break;
+				case FRAME_LEFT:
+				{
+					push_byte(&section->bytes, DW_CFA_remember_state);
+					push_byte(&section->bytes, DW_CFA_def_cfa);
+					dwarf_uleb(section, DWARF_REG_RSP);
+					dwarf_uleb(section, 8);
+					push_byte(&section->bytes, DW_CFA_restore | DWARF_REG_RBP);
+				} break;
+				case FRAME_RETURNED:
+				{
+					if(event->offset < function->size)
+						push_byte(&section->bytes, DW_CFA_restore_state);
+				} break;
+			}
+		}
+		dwarf_end_frame_entry(section, fde);
+	}
+}
+
+void
+x64_build_dwarf(X64_Debug_Info *info, char *unit_name)
+{
+	for(int i = 0; i < DWARF_SECTION_COUNT; ++i)
+		info->sections[i].bytes = make_code_buffer(256);
+
+	dwarf_abbreviations(&info->sections[DWARF_ABBREV]);
+	dwarf_compile_unit(info, &info->sections[DWARF_INFO], unit_name);
+	dwarf_line_program(info, &info->sections[DWARF_LINE]);
+	dwarf_call_frames(info, &info->sections[DWARF_FRAME]);
+	last_debug_info = info;
+}
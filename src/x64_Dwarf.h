@@ -0,0 +1,72 @@
+#ifndef _X64_DWARF_H
+#define _X64_DWARF_H
+#include <Basic.h>
+#include <x64_Gen.h>
+
+enum Dwarf_Section_Kind {
+	DWARF_ABBREV,
+	DWARF_INFO,
+	DWARF_LINE,
+	DWARF_FRAME,
+	DWARF_SECTION_COUNT,
+	// not a debug section, only something a fixup points at
+	DWARF_TEXT = DWARF_SECTION_COUNT,
+};
+
+// A field that depends on where the sections end up, an 8 byte address
+// in .text or a 4 byte offset into a debug section. The field holds the
+// offset from the start of its target, the writers relocate or patch it
+struct Dwarf_Fixup {
+	u32 offset;
+	Dwarf_Section_Kind target;
+};
+
+struct Dwarf_Section {
+	Code_Buffer bytes;
+	Dwarf_Fixup *fixups;
+	u32 fixup_count;
+	u32 fixup_capacity;
+};
+
+struct Debug_Function {
+	u8 *name;
+	char *file;
+	u32 start; // offset in the program's code
+	u32 size;
+	Debug_Rows *rows;
+};
+
+// @NOTE: DWARF 4 with a single compile unit for the program, every function
+// is its own line sequence so it can come from any of the files
+struct X64_Debug_Info {
+	Debug_Function *functions;
+	u32 function_count;
+	u32 code_size;
+	Dwarf_Section sections[DWARF_SECTION_COUNT];
+};
+
+void
+x64_set_debug_info(b32 enable);
+
+b32
+x64_debug_info_enabled();
+
+// the debug info of the last x64_generate_code, NULL unless it's enabled
+X64_Debug_Info *
+x64_get_debug_info();
+
+void
+x64_push_line(Debug_Rows *rows, u32 offset, u32 line, u32 column);
+
+void
+x64_push_frame_event(Debug_Rows *rows, u32 offset, Frame_Event_Kind kind);
+
+// Builds .debug_abbrev, .debug_info, .debug_line and .debug_frame for the
+// functions and keeps them for the writers, unit_name is the main file
+void
+x64_build_dwarf(X64_Debug_Info *info, char *unit_name);
+
+const char *
+dwarf_section_name(Dwarf_Section_Kind kind);
+
+#endif
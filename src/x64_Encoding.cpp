@@ -0,0 +1,203 @@
+#include <x64_Encoding.h>
+#include <platform/platform.h>
+#include <Type.h>
+
+static struct {
+	b32 enabled;
+	u64 instructions;
+	u64 bytes;
+	u64 ns;
+} encoder_stats;
+
+// @NOTE: looks at the type through the pointer, get_type_size and is_vector
+// copy the whole Type_Info and this runs for every instruction
+X64_Size
+x64_size_class(Type_Info *type)
+{
+	if(!type)
+		return X64_SIZE_NONE;
+	switch(type->type)
+	{
+		case T_INTEGER:
+		case T_FLOAT:
+		{
+			switch(type->primitive.size)
+			{
+				case byte1:
+				case ubyte1:
+				return X64_SIZE_8;
+				case byte2:
+				case ubyte2:
+				return X64_SIZE_16;
+				case byte4:
+				case ubyte4:
+				return X64_SIZE_32;
+				case byte8:
+				case ubyte8:
+				return X64_SIZE_64;
+				case real32:
+				return X64_SIZE_F32;
+				case real64:
+				return X64_SIZE_F64;
+				case real128:
+				return X64_SIZE_F128;
+				case byte128:
+				return X64_SIZE_I128;
+				default:
+				return X64_SIZE_NONE;
+			}
+		}
+		case T_UNTYPED_INTEGER:
+		case T_POINTER:
+		case T_FUNC:
+		return X64_SIZE_64;
+		case T_UNTYPED_FLOAT:
+		return X64_SIZE_F64;
+		case T_BOOLEAN:
+		case T_STRING:
+		case T_ARRAY:
+		{
+			// strings and arrays become the pointer they're passed as, the
+			// same fixup the encoder always did before looking at their size
+			is_standard_type(type);
+			return type->type == T_BOOLEAN ? X64_SIZE_8 : X64_SIZE_64;
+		}
+		default:
+		return X64_SIZE_NONE;
+	}
+}
+
+void
+x64_set_encoder_stats(b32 enable)
+{
+	encoder_stats.enabled = enable;
+}
+
+b32
+x64_encoder_stats_enabled()
+{
+	return encoder_stats.enabled;
+}
+
+// the low 3 bits of a general purpose or xmm register, high says it needs a rex bit
+static inline u8
+x64_register_bits(Register reg, b32 *high)
+{
+	u8 number = reg >= reg_xmm0 ? reg - reg_xmm0 : reg;
+	*high = number >= 8;
+	return number & 7;
+}
+
+// everything up to and including the opcode, returns the ModRM reg field
+static inline u8
+x64_emit_opcode(Code_Buffer *buffer, const X64_Encoding *encoding, Register reg, Register rm)
+{
+	Assert(encoding->valid);
+	u8 rex = encoding->rex;
+	u8 reg_bits = encoding->extension;
+	if(reg_bits == X64_NO_EXTENSION)
+	{
+		b32 high;
+		reg_bits = x64_register_bits(reg, &high);
+		if(high)
+			rex |= REX_R;
+	}
+	b32 rm_high;
+	x64_register_bits(rm, &rm_high);
+	if(rm_high)
+		rex |= REX_B;
+
+	if(encoding->legacy)
+		push_byte(buffer, encoding->legacy);
+	if(rex)
+		push_byte(buffer, rex);
+	if(encoding->escape)
+		push_byte(buffer, encoding->escape);
+	push_byte(buffer, encoding->opcode);
+	return reg_bits;
+}
+
+void
+x64_emit_rr(Code_Buffer *buffer, X64_Op op, X64_Size size, Register reg, Register rm)
+{
+	const X64_Encoding *encoding = &x64_encodings.entries[op][size];
+	u8 reg_bits = x64_emit_opcode(buffer, encoding, reg, rm);
+	b32 high;
+	push_byte(buffer, encode_postfix(MOD_register, reg_bits, x64_register_bits(rm, &high)));
+}
+
+void
+x64_emit_rbp(Code_Buffer *buffer, X64_Op op, X64_Size size, Register reg, i32 displacement)
+{
+	const X64_Encoding *encoding = &x64_encodings.entries[op][size];
+	u8 reg_bits = x64_emit_opcode(buffer, encoding, reg, reg_bp);
+	// rbp as a base always has a displacement
+	MOD mod = MOD_displacement_i32;
+	if(displacement > -129 && displacement < 128)
+		mod = MOD_displacement_i8;
+	push_byte(buffer, encode_postfix(mod, reg_bits, reg_bp));
+	push_displacement(mod, displacement, buffer);
+}
+
+void
+x64_emit_address(Code_Buffer *buffer, X64_Op op, X64_Size size, Register reg, Register base)
+{
+	const X64_Encoding *encoding = &x64_encodings.entries[op][size];
+	u8 reg_bits = x64_emit_opcode(buffer, encoding, reg, base);
+	push_register_address(buffer, reg_bits, base);
+}
+
+u32
+x64_emit_rip(Code_Buffer *buffer, X64_Op op, X64_Size size, Register reg)
+{
+	const X64_Encoding *encoding = &x64_encodings.entries[op][size];
+	// rbp's number with no displacement is rip relative
+	u8 reg_bits = x64_emit_opcode(buffer, encoding, reg, reg_a);
+	push_byte(buffer, encode_postfix(MOD_displacement_0, reg_bits, 0b101));
+	u32 offset = buffer->count;
+	push_i32(buffer, 0);
+	return offset;
+}
+
+void
+x64_emit_immediate(Code_Buffer *buffer, X64_Op op, X64_Size size, Register rm, u64 value)
+{
+	const X64_Encoding *encoding = &x64_encodings.entries[op][size];
+	b32 high;
+	u8 rm_bits = x64_register_bits(rm, &high);
+	if(op == X64_MOV_R_IMM)
+	{
+		// the register is the low bits of the opcode
+		Assert(encoding->valid);
+		u8 rex = encoding->rex | (high ? REX_B : 0);
+		if(encoding->legacy)
+			push_byte(buffer, encoding->legacy);
+		if(rex)
+			push_byte(buffer, rex);
+		push_byte(buffer, encoding->opcode | rm_bits);
+	}
+	else
+	{
+		u8 reg_bits = x64_emit_opcode(buffer, encoding, reg_a, rm);
+		push_byte(buffer, encode_postfix(MOD_register, reg_bits, rm_bits));
+	}
+	for(u8 i = 0; i < encoding->immediate; ++i)
+		push_byte(buffer, (u8)(value >> (i * 8)));
+}
+
+void
+x64_count_encoded(u64 instructions, u64 bytes, u64 ns)
+{
+	platform_interlocked_add64(&encoder_stats.instructions, instructions);
+	platform_interlocked_add64(&encoder_stats.bytes, bytes);
+	platform_interlocked_add64(&encoder_stats.ns, ns);
+}
+
+void
+x64_print_encoder_report()
+{
+	f64 seconds = (f64)encoder_stats.ns / 1000000000.0;
+	f64 per_second = seconds > 0 ? (f64)encoder_stats.instructions / seconds : 0;
+	LG_INFO("x64 encoder: %llu instructions, %llu bytes, %f.3ms, %f.1M instructions/s", encoder_stats.instructions,
+			encoder_stats.bytes, (f64)encoder_stats.ns / 1000000.0, per_second / 1000000.0);
+}
@@ -0,0 +1,253 @@
+#ifndef _X64_ENCODING_H
+#define _X64_ENCODING_H
+#include <Basic.h>
+#include <Bytecode.h>
+#include <x64_Gen.h>
+
+// What the type of an instruction decides about its encoding, it's looked up
+// once per instruction instead of every helper inspecting the Type_Info again
+enum X64_Size {
+	X64_SIZE_8,
+	X64_SIZE_16,
+	X64_SIZE_32,
+	X64_SIZE_64,
+	X64_SIZE_F32,
+	X64_SIZE_F64,
+	X64_SIZE_F128, // f128 vectors, the ps forms
+	X64_SIZE_I128, // i128 vectors, the 66 prefixed p forms
+	// structs and anything else that doesn't fit in a register
+	X64_SIZE_NONE,
+
+	X64_SIZE_COUNT
+};
+
+// An instruction with its operand kinds, r is the reg field of ModRM,
+// rm the r/m field and /n an opcode extension in the reg field
+enum X64_Op {
+	X64_MOV_R_RM,
+	X64_MOV_RM_R,
+	X64_MOV_R_IMM,   // B8+r, the register is in the opcode
+	X64_ADD_RM_R,
+	X64_SUB_RM_R,
+	X64_XOR_R_RM,
+	X64_CMP_RM_R,
+	X64_ADD_RM_IMM,  // 81 /0
+	X64_SUB_RM_IMM,  // 81 /5
+	X64_NEG_RM,      // F7 /3
+	X64_MUL_RM,      // F7 /4
+	X64_IMUL_RM,     // F7 /5
+	X64_DIV_RM,      // F7 /6
+	X64_IDIV_RM,     // F7 /7
+	X64_SSE_MOV_R_RM,
+	X64_SSE_MOV_RM_R,
+	X64_SSE_ADD,
+	X64_SSE_SUB,
+	X64_SSE_MUL,
+	X64_SSE_DIV,
+	X64_SSE_AND,
+	X64_SSE_OR,
+	X64_SSE_XOR,
+	X64_UCOMIS,
+
+	X64_OP_COUNT
+};
+
+#define X64_NO_EXTENSION 0xFF
+
+// @NOTE: emitted in this order, a zero legacy prefix, rex or escape is left out
+struct X64_Encoding {
+	u8 legacy;    // 66, F2 or F3
+	u8 rex;       // REX.W when the size needs it, the register bits are added to it
+	u8 escape;    // 0F of the two byte opcodes
+	u8 opcode;
+	u8 extension; // the /n that goes in the reg field
+	u8 immediate; // bytes of immediate after ModRM
+	u8 valid;
+};
+
+// the integer ops the encoder emitted without an operand size prefix keep
+// their 32 bit forms for 8 and 16 bit values, only the low bits are used
+constexpr X64_Encoding
+x64_int_form(X64_Size size, u8 opcode8, u8 opcode, u8 extension, b32 operand_prefix)
+{
+	X64_Encoding result = {};
+	switch(size)
+	{
+		case X64_SIZE_8:
+		result.opcode = opcode8;
+		break;
+		case X64_SIZE_16:
+		result.legacy = operand_prefix ? 0x66 : 0;
+		result.opcode = opcode;
+		break;
+		case X64_SIZE_32:
+		result.opcode = opcode;
+		break;
+		case X64_SIZE_64:
+		result.rex = REX_W;
+		result.opcode = opcode;
+		break;
+		default:
+		return result;
+	}
+	result.extension = extension;
+	result.valid = true;
+	return result;
+}
+
+// ss and sd get F3 and F2, the packed f128 forms have no prefix and
+// the i128 ones use 66, a zero opcode means there's no such instruction
+constexpr X64_Encoding
+x64_sse_form(X64_Size size, u8 scalar, u8 packed, u8 packed_int)
+{
+	X64_Encoding result = {};
+	result.escape = 0x0F;
+	result.extension = X64_NO_EXTENSION;
+	switch(size)
+	{
+		case X64_SIZE_F32:
+		result.legacy = 0xF3;
+		result.opcode = scalar;
+		break;
+		case X64_SIZE_F64:
+		result.legacy = 0xF2;
+		result.opcode = scalar;
+		break;
+		case X64_SIZE_F128:
+		result.opcode = packed;
+		break;
+		case X64_SIZE_I128:
+		result.legacy = 0x66;
+		result.opcode = packed_int;
+		break;
+		default:
+		return result;
+	}
+	result.valid = result.opcode != 0;
+	return result;
+}
+
+constexpr X64_Encoding
+x64_make_encoding(X64_Op op, X64_Size size)
+{
+	switch(op)
+	{
+		case X64_MOV_R_RM:   return x64_int_form(size, 0x8A, 0x8B, X64_NO_EXTENSION, true);
+		case X64_MOV_RM_R:   return x64_int_form(size, 0x88, 0x89, X64_NO_EXTENSION, true);
+		case X64_MOV_R_IMM:
+		{
+			X64_Encoding result = x64_int_form(size, 0xB0, 0xB8, X64_NO_EXTENSION, true);
+			result.immediate = size == X64_SIZE_8 ? 1 : size == X64_SIZE_16 ? 2 : size == X64_SIZE_32 ? 4 : 8;
+			return result;
+		}
+		case X64_ADD_RM_R:   return x64_int_form(size, 0x01, 0x01, X64_NO_EXTENSION, false);
+		case X64_SUB_RM_R:   return x64_int_form(size, 0x29, 0x29, X64_NO_EXTENSION, false);
+		case X64_XOR_R_RM:   return x64_int_form(size, 0x33, 0x33, X64_NO_EXTENSION, false);
+		case X64_CMP_RM_R:   return x64_int_form(size, 0x38, 0x39, X64_NO_EXTENSION, true);
+		case X64_ADD_RM_IMM:
+		case X64_SUB_RM_IMM:
+		{
+			// there's no 64 bit immediate, imm32 is sign extended
+			X64_Encoding result = x64_int_form(size, 0x80, 0x81, op == X64_ADD_RM_IMM ? 0 : 5, true);
+			result.immediate = size == X64_SIZE_8 ? 1 : size == X64_SIZE_16 ? 2 : 4;
+			return result;
+		}
+		case X64_NEG_RM:     return x64_int_form(size, 0xF6, 0xF7, 3, true);
+		case X64_MUL_RM:     return x64_int_form(size, 0xF7, 0xF7, 4, false);
+		case X64_IMUL_RM:    return x64_int_form(size, 0xF7, 0xF7, 5, false);
+		case X64_DIV_RM:     return x64_int_form(size, 0xF7, 0xF7, 6, false);
+		case X64_IDIV_RM:    return x64_int_form(size, 0xF7, 0xF7, 7, false);
+		// movss/movsd, movaps and movdqa
+		case X64_SSE_MOV_R_RM: return x64_sse_form(size, 0x10, 0x28, 0x6F);
+		case X64_SSE_MOV_RM_R: return x64_sse_form(size, 0x11, 0x29, 0x7F);
+		case X64_SSE_ADD:    return x64_sse_form(size, 0x58, 0x58, 0xFE); // paddd
+		case X64_SSE_SUB:    return x64_sse_form(size, 0x5C, 0x5C, 0xFA); // psubd
+		case X64_SSE_MUL:    return x64_sse_form(size, 0x59, 0x59, 0);
+		case X64_SSE_DIV:    return x64_sse_form(size, 0x5E, 0x5E, 0);
+		case X64_SSE_AND:    return x64_sse_form(size, 0, 0x54, 0xDB);
+		case X64_SSE_OR:     return x64_sse_form(size, 0, 0x56, 0xEB);
+		case X64_SSE_XOR:    return x64_sse_form(size, 0, 0x57, 0xEF);
+		case X64_UCOMIS:
+		{
+			// ucomiss has no prefix and ucomisd 66
+			X64_Encoding result = x64_sse_form(size, 0x2E, 0, 0);
+			result.legacy = size == X64_SIZE_F64 ? 0x66 : 0;
+			return result;
+		}
+		default:
+		return X64_Encoding{};
+	}
+}
+
+struct X64_Encoding_Table {
+	X64_Encoding entries[X64_OP_COUNT][X64_SIZE_COUNT];
+
+	constexpr X64_Encoding_Table() : entries()
+	{
+		for(i32 op = 0; op < X64_OP_COUNT; ++op)
+		{
+			for(i32 size = 0; size < X64_SIZE_COUNT; ++size)
+				entries[op][size] = x64_make_encoding((X64_Op)op, (X64_Size)size);
+		}
+	}
+};
+
+// @NOTE: built by the compiler, nothing is computed at startup
+static constexpr X64_Encoding_Table x64_encodings = X64_Encoding_Table();
+
+static_assert(x64_encodings.entries[X64_MOV_R_RM][X64_SIZE_64].rex == REX_W, "mov r64, r/m64 is REX.W 8B");
+static_assert(x64_encodings.entries[X64_SSE_ADD][X64_SIZE_F64].legacy == 0xF2, "addsd is F2 0F 58");
+
+X64_Size
+x64_size_class(Type_Info *type);
+
+// the plain load and store of a scalar, movss and movsd for floats
+inline X64_Op
+x64_load_op(X64_Size size)
+{
+	return size == X64_SIZE_F32 || size == X64_SIZE_F64 ? X64_SSE_MOV_R_RM : X64_MOV_R_RM;
+}
+
+inline X64_Op
+x64_store_op(X64_Size size)
+{
+	return size == X64_SIZE_F32 || size == X64_SIZE_F64 ? X64_SSE_MOV_RM_R : X64_MOV_RM_R;
+}
+
+// reg, rm
+void
+x64_emit_rr(Code_Buffer *buffer, X64_Op op, X64_Size size, Register reg, Register rm);
+
+// reg, [rbp + displacement]
+void
+x64_emit_rbp(Code_Buffer *buffer, X64_Op op, X64_Size size, Register reg, i32 displacement);
+
+// reg, [base]
+void
+x64_emit_address(Code_Buffer *buffer, X64_Op op, X64_Size size, Register reg, Register base);
+
+// reg, [rip + rel32], returns the offset of the rel32 for its relocation
+u32
+x64_emit_rip(Code_Buffer *buffer, X64_Op op, X64_Size size, Register reg);
+
+// op rm, imm or the B8+r form
+void
+x64_emit_immediate(Code_Buffer *buffer, X64_Op op, X64_Size size, Register rm, u64 value);
+
+// @NOTE: only --time-passes counts what the encoder does,
+// reading the clock around every block isn't free
+void
+x64_set_encoder_stats(b32 enable);
+
+b32
+x64_encoder_stats_enabled();
+
+// @NOTE: functions are encoded on the thread pool, the time is the sum
+// over every thread so the rate is how fast a single thread encodes
+void
+x64_count_encoded(u64 instructions, u64 bytes, u64 ns);
+
+void
+x64_print_encoder_report();
+
+#endif
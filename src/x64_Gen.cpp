@@ -2,6 +2,7 @@
 #include <platform/platform.h>
 #include <Type.h>
 #include <Threading.h>
+#include <Profiler.h>
 
 //const int IMAGE_REL_AMD64_ADDR64 = 0x0001;
 const int IMAGE_REL_AMD64_REL32  = 0x0004;
@@ -42,130 +43,163 @@ push_symbol(Symbol_Descriptor to_push)
 	unlock_mutex();
 }
 
+// @NOTE: rodata shared by every function we've generated, only touched
+// on the main thread when the pools are merged
+static struct { Literal_Key key; i32 value; } *rodata_constants;
+static struct { char *key; i32 value; } *rodata_strings;
+static int rodata_size;
+static int rodata_constant_count;
+
 i32
-get_and_maybe_push_string(u8 *str)
+push_string(Relative_Relocation_Array *relocs, u8 *str)
 {
-	lock_mutex();
-
-	int last_ro = -1;
-	size_t sym_count = SDCount(obj_symbols);
-	for(size_t i = 0; i < sym_count; ++i)
-	{
-		if(obj_symbols[i].section == SEC_RO_DATA)
-		{
-			if(obj_symbols[i].type == OBJ_STRING && vstd_strcmp((char *)str, (char *)obj_symbols[i].name))
-				return i;
-			last_ro = i;
-		}
-	}
-	
-	// Same hack as above
-	Symbol_Descriptor new_str_symbol = {};
-	new_str_symbol.name = str;
-	new_str_symbol.size = vstd_strlen((char *)str) + 1;
-	if(last_ro != -1)
-	{
-		new_str_symbol.position = obj_symbols[last_ro].position + obj_symbols[last_ro].size;
-	}
-	else
+	Literal_Pool *pool = &relocs->literals;
+	ptrdiff_t idx = shgeti(pool->strings, (char *)str);
+	if(idx == -1)
 	{
-		new_str_symbol.position = 0;
+		shput(pool->strings, (char *)str, 0);
+		idx = shlen(pool->strings) - 1;
 	}
-	new_str_symbol.section = SEC_RO_DATA;
-	new_str_symbol.type = OBJ_STRING;
-	new_str_symbol.value = (u64)str;
-
-	push_symbol_no_lock_mutex(new_str_symbol);
-	unlock_mutex();
-	return sym_count;
+	return idx;
 }
 
 i32
-push_int(u64 _integer, Var_Size size)
+push_constant(Relative_Relocation_Array *relocs, u64 value, Var_Size size)
 {
-	lock_mutex();
-	static int integer_count = 0;
-
-	int last_ro = -1;
-	size_t sym_count = SDCount(obj_symbols);
-	for(size_t i = 0; i < sym_count; ++i)
+	Literal_Pool *pool = &relocs->literals;
+	Literal_Key key = {};
+	key.value = value;
+	key.size = primitive_size_to_alignment(size);
+	ptrdiff_t idx = hmgeti(pool->constants, key);
+	if(idx == -1)
 	{
-		if(obj_symbols[i].section == SEC_RO_DATA)
-		{
-			if(obj_symbols[i].type == OBJ_FLOAT && obj_symbols[i].value == _integer)
-				return i;
-			last_ro = i;
-		}
+		hmput(pool->constants, key, size);
+		idx = hmlen(pool->constants) - 1;
 	}
+	return idx;
+}
 
-	Symbol_Descriptor new_int_symbol = {};
-	u8 *symbol_name = (u8 *)AllocatePermanentMemory(16);
-	vstd_sprintf((char *)symbol_name, "__integer!@%d", integer_count++);
-	new_int_symbol.size = size;
+inline i32
+push_int(Relative_Relocation_Array *relocs, u64 _integer, Var_Size size)
+{
+	return push_constant(relocs, _integer, size);
+}
 
-	if(last_ro != -1)
-	{
-		new_int_symbol.position = obj_symbols[last_ro].position + obj_symbols[last_ro].size;
-	}
-	else
-	{
-		new_int_symbol.position = 0;
-	}
-	new_int_symbol.name = symbol_name;
-	new_int_symbol.section = SEC_RO_DATA;
-	new_int_symbol.value = _integer;
-	new_int_symbol.type = OBJ_FLOAT;
-	push_symbol_no_lock_mutex(new_int_symbol);
-	unlock_mutex();
-	return sym_count;
+inline i32
+push_float(Relative_Relocation_Array *relocs, u64 _float, Var_Size size)
+{
+	return push_constant(relocs, _float, size);
 }
 
-static volatile long float32_count = 0;
-static volatile long float64_count = 0;
-i32
-push_float(u64 _float, Var_Size size)
+// constants are aligned to their size, 16 for vectors, strings are packed
+static Symbol_Descriptor
+make_rodata_symbol(u8 *name, u64 value, int size, int alignment, Object_Symbol_Type type)
 {
-	lock_mutex();
-	int last_ro = -1;
-	size_t sym_count = SDCount(obj_symbols);
-	for(size_t i = 0; i < sym_count; ++i)
+	rodata_size = (rodata_size + alignment - 1) & ~(alignment - 1);
+	Symbol_Descriptor symbol = {};
+	symbol.name = name;
+	symbol.value = value;
+	symbol.size = size;
+	symbol.position = rodata_size;
+	symbol.section = SEC_RO_DATA;
+	symbol.type = type;
+	rodata_size += size;
+	return symbol;
+}
+
+void
+x64_merge_literals(Relative_Relocation_Array *relocs, int count)
+{
+	for(int i = 0; i < count; ++i)
 	{
-		if(obj_symbols[i].section == SEC_RO_DATA)
+		Literal_Pool *pool = &relocs[i].literals;
+		i32 constant_count = hmlen(pool->constants);
+		i32 string_count = shlen(pool->strings);
+		if(constant_count == 0 && string_count == 0)
+			continue;
+
+		i32 *constant_symbols = (i32 *)AllocateCompileMemory(constant_count * sizeof(i32) + 1);
+		for(i32 c = 0; c < constant_count; ++c)
+		{
+			Literal_Key key = pool->constants[c].key;
+			ptrdiff_t got = hmgeti(rodata_constants, key);
+			if(got != -1)
+			{
+				constant_symbols[c] = rodata_constants[got].value;
+				continue;
+			}
+
+			u8 *symbol_name = (u8 *)AllocatePermanentMemory(32);
+			Var_Size size = pool->constants[c].value;
+			if(size == real32)
+				vstd_sprintf((char *)symbol_name, "__real32!@%d", rodata_constant_count++);
+			else if(size == real64)
+				vstd_sprintf((char *)symbol_name, "__real64!@%d", rodata_constant_count++);
+			else
+				vstd_sprintf((char *)symbol_name, "__integer!@%d", rodata_constant_count++);
+
+			constant_symbols[c] = SDCount(obj_symbols);
+			push_symbol_no_lock_mutex(make_rodata_symbol(symbol_name, key.value, key.size, key.size, OBJ_FLOAT));
+			hmput(rodata_constants, key, constant_symbols[c]);
+		}
+
+		i32 *string_symbols = (i32 *)AllocateCompileMemory(string_count * sizeof(i32) + 1);
+		for(i32 s = 0; s < string_count; ++s)
 		{
-			if(obj_symbols[i].type == OBJ_FLOAT && obj_symbols[i].value == _float)
-				return i;
-			last_ro = i;
+			char *str = pool->strings[s].key;
+			ptrdiff_t got = shgeti(rodata_strings, str);
+			if(got != -1)
+			{
+				string_symbols[s] = rodata_strings[got].value;
+				continue;
+			}
+
+			string_symbols[s] = SDCount(obj_symbols);
+			push_symbol_no_lock_mutex(make_rodata_symbol((u8 *)str, (u64)str, vstd_strlen(str) + 1, 1, OBJ_STRING));
+			shput(rodata_strings, str, string_symbols[s]);
 		}
-	}
 
-	Symbol_Descriptor new_float_symbol = {};
-	u8 *symbol_name = (u8 *)AllocatePermanentMemory(16);
-	if(size == real32)
-	{
-		vstd_sprintf((char *)symbol_name, "__real32!@%d", platform_interlocked_increment(&float32_count));
-		new_float_symbol.size = 4;
-	}
-	else if(size == real64)
-	{
-		vstd_sprintf((char *)symbol_name, "__real64!@%d", platform_interlocked_increment(&float64_count));
-		new_float_symbol.size = 8;
-	}
+		for(u32 r = 0; r < relocs[i].count; ++r)
+		{
+			Relative_Relocation *reloc = &relocs[i].relocs[r];
+			if(reloc->literal == LITERAL_CONSTANT)
+				reloc->actual_relocation.symbol_index = constant_symbols[reloc->actual_relocation.symbol_index];
+			else if(reloc->literal == LITERAL_STRING)
+				reloc->actual_relocation.symbol_index = string_symbols[reloc->actual_relocation.symbol_index];
+			reloc->literal = LITERAL_NONE;
+		}
 
-	if(last_ro != -1)
-	{
-		new_float_symbol.position = obj_symbols[last_ro].position + obj_symbols[last_ro].size;
+		hmfree(pool->constants);
+		shfree(pool->strings);
 	}
-	else
+}
+
+static int data_section_size;
+static int bss_section_size;
+
+void
+push_global_symbol(u8 *name, Data_Segment *global)
+{
+	Symbol_Descriptor symbol = {};
+	symbol.name = name;
+	symbol.value = global->init_val;
+	symbol.size = global->size;
+	symbol.type = OBJ_DATA;
+
+	int *section_size = &bss_section_size;
+	symbol.section = SEC_BSS;
+	if(global->init_val)
 	{
-		new_float_symbol.position = 0;
+		section_size = &data_section_size;
+		symbol.section = SEC_DATA;
 	}
-	new_float_symbol.name = symbol_name;
-	new_float_symbol.section = SEC_RO_DATA;
-	new_float_symbol.value = _float;
-	new_float_symbol.type = OBJ_FLOAT;
-	push_symbol_no_lock_mutex(new_float_symbol);
-	unlock_mutex();
-	return sym_count;
+	int alignment = global->alignment > 0 ? global->alignment : 1;
+	*section_size = (*section_size + alignment - 1) & ~(alignment - 1);
+	symbol.position = *section_size;
+	*section_size += global->size;
+
+	global->symbol_index = SDCount(obj_symbols);
+	push_symbol(symbol);
 }
 
 void
@@ -178,15 +212,12 @@ push_intrinsic_function_symbols()
 	push_symbol(memcpy_sym);
 }
 
-Code_Buffer
-x64_generate_code(File_Contents **files, IR **ir_array, Relocation **relocations, u32 *out_relocation_count)
+void
+x64_initialize_types()
 {
-	int ir_count = SDCount(ir_array);
-	int file_count = SDCount(files);
-	Assert(ir_count == file_count);
-	obj_symbols = SDCreate(Symbol_Descriptor);
+	if(x64_type_64)
+		return;
 
-	// Set up some simple types to use whe needed
 	x64_type_64 = (Type_Info *)AllocateCompileMemory(sizeof(Type_Info));
 	x64_type_64->type = T_INTEGER;
 	x64_type_64->primitive.size = byte8;
@@ -206,6 +237,51 @@ x64_generate_code(File_Contents **files, IR **ir_array, Relocation **relocations
 	x64_str_type->type = T_POINTER;
 	x64_str_type->pointer.type = type_u8;
 	x64_str_type->identifier = (u8 *)"* u8";
+}
+
+Symbol_Descriptor *
+x64_get_symbols()
+{
+	return obj_symbols;
+}
+
+// @NOTE: is this enough ? is it too much?
+// inline copies are a load and a store of at most 10 bytes for every chunk
+size_t
+x64_code_size_estimate(IR *ir)
+{
+	size_t result = ir->bc_count * 12;
+	// functions without a body don't have blocks
+	size_t block_count = ir->blocks ? SDCount(ir->blocks) : 0;
+	for(size_t b = 0; b < block_count; ++b)
+	{
+		IR_Block *block = ir->blocks[b];
+		for(i32 i = 0; i < block->bc_count; ++i)
+		{
+			if(block->bc[i].op == BC_COPY_MEMORY)
+				result += (get_type_size(*block->bc[i].type) / 8 + 3) * 2 * 10;
+			else if(block->bc[i].op == BC_JUMP_TABLE)
+				result += ir->jump_tables[block->bc[i].right_idx].count * 8 + 32;
+		}
+	}
+	return result;
+}
+
+Code_Buffer
+x64_generate_code(File_Contents **files, IR **ir_array, Relocation **relocations, u32 *out_relocation_count)
+{
+	int ir_count = SDCount(ir_array);
+	int file_count = SDCount(files);
+	Assert(ir_count == file_count);
+	obj_symbols = SDCreate(Symbol_Descriptor);
+	hmfree(rodata_constants);
+	shfree(rodata_strings);
+	rodata_size = 0;
+	rodata_constant_count = 0;
+	data_section_size = 0;
+	bss_section_size = 0;
+
+	x64_initialize_types();
 
 	// Loop through functions and operator overloads and add them to the symbol table
 
@@ -218,6 +294,8 @@ x64_generate_code(File_Contents **files, IR **ir_array, Relocation **relocations
 	auto relative_relocations = (Relative_Relocation_Array *)AllocateCompileMemory(total_global_block_count * sizeof(Relative_Relocation_Array));
 	auto fixables = (Fixable_Array *)AllocateCompileMemory(total_global_block_count * sizeof(Fixable_Array));
 	auto code_buffers = (Code_Buffer *)AllocateCompileMemory(total_global_block_count * sizeof(Code_Buffer));
+	b32 debug_info = x64_debug_info_enabled();
+	char **function_files = (char **)AllocateCompileMemory(total_global_block_count * sizeof(char *));
 
 	int passed_global_blocks = 0;
 	for(size_t ir_i = 0; ir_i < ir_count; ++ir_i)
@@ -258,43 +336,26 @@ x64_generate_code(File_Contents **files, IR **ir_array, Relocation **relocations
 			push_symbol(func_sym);
 		}
 
-		// @TODO: Crashes for some reason, ir[0].allocated gets lost on 5th loop in the bytecode generator
-		size_t globals_count = SDCount(ir[0].allocated);
+		// globals are computed at compile time, the ones with a value go in .data
+		// and the zero initialized ones in .bss so they don't take space in the file
+		size_t globals_count = shlen(f->global_table);
 		for(size_t i = 0; i < globals_count; ++i)
 		{
-			u64 init_val = ir[0].allocated[i].init_val;
-			int size = ir[0].allocated[i].size;
-			// TODO: DO SOMETHING WITH THIS
-			// TODO: DO SOMETHING WITH THIS
-			// TODO: DO SOMETHING WITH THIS
-			// TODO: DO SOMETHING WITH THIS
-			// TODO: DO SOMETHING WITH THIS
-			// TODO: DO SOMETHING WITH THIS
-			// TODO: DO SOMETHING WITH THIS
-			// TODO: DO SOMETHING WITH THIS
-			// ALLOCATE THE GLOBAL VARIABLES (IDK HOW)
+			Data_Segment *global = &ir[0].allocated[f->global_table[i].value];
+			push_global_symbol(f->global_table[i].key, global);
 		}
 
 		for(size_t i = 1; i < global_block_count; ++i)
 		{
 			int i_total = i + passed_global_blocks;
 
-			Relative_Relocation_Array reloc_array;
-			reloc_array.relocs = (Relative_Relocation *)AllocateCompileMemory(ir[i].bc_count * sizeof(Relative_Relocation));
-			reloc_array.count = 0;
-
-			Fixable_Array fixable_arr;
-			fixable_arr.fixables = (Fixable *)AllocateCompileMemory(ir[i].bc_count * sizeof(Fixable));
-			fixable_arr.count = 0;
-
-			Code_Buffer code_buffer;
-			code_buffer.buffer = (u8 *)AllocateCompileMemory(ir[i].bc_count * 12); // @NOTE: is this enough ? is it too much?
-			code_buffer.count = 0;
-
-
-			relative_relocations[i_total] = reloc_array;
-			fixables[i_total] = fixable_arr;
-			code_buffers[i_total] = code_buffer;
+			// the arrays grow as they're pushed to, these are just where they start
+			relative_relocations[i_total] = {};
+			fixables[i_total] = {};
+			code_buffers[i_total] = make_code_buffer(x64_code_size_estimate(&ir[i]));
+			if(debug_info)
+				relative_relocations[i_total].debug = (Debug_Rows *)AllocateCompileMemory(sizeof(Debug_Rows));
+			function_files[i_total] = (char *)f->path;
 
 
 			Generate_Code_Args *args = (Generate_Code_Args *)AllocatePermanentMemory(sizeof(Generate_Code_Args));
@@ -311,72 +372,114 @@ x64_generate_code(File_Contents **files, IR **ir_array, Relocation **relocations
 
 	push_intrinsic_function_symbols();
 	wait_for_threads();
+	x64_merge_literals(relative_relocations, total_global_block_count);
 
-	u32 total_code_size = 0;
-	for(int i = 0; i < total_global_block_count; ++i)
-	{
-		total_code_size += code_buffers[i].count;
-	}
-
-	u32 buffer_offsets[total_global_block_count];
-	Code_Buffer program_code;
-	program_code.buffer = (u8 *)AllocateCompileMemory(total_code_size);
-	program_code.count = 0;
+	// every function's place in the program is the sum of the sizes before it,
+	// with that known the copies and relocation fixups don't depend on each other
+	u32 *buffer_offsets = (u32 *)AllocateCompileMemory((total_global_block_count + 1) * sizeof(u32));
+	u32 *relocation_offsets = (u32 *)AllocateCompileMemory((total_global_block_count + 1) * sizeof(u32));
 	for(int i = 0; i < total_global_block_count; ++i)
 	{
-		buffer_offsets[i] = program_code.count;
-		memcpy(program_code.buffer + program_code.count, code_buffers[i].buffer, code_buffers[i].count);
-		program_code.count += code_buffers[i].count;
+		buffer_offsets[i + 1] = buffer_offsets[i] + code_buffers[i].count;
+		relocation_offsets[i + 1] = relocation_offsets[i] + relative_relocations[i].count;
 	}
+	u32 total_code_size = buffer_offsets[total_global_block_count];
+	u32 total_relocation_count = relocation_offsets[total_global_block_count];
 
+	Code_Buffer program_code = make_code_buffer(total_code_size);
+	program_code.count = total_code_size;
+	Relocation *absolute_relocations = (Relocation *)AllocateCompileMemory(total_relocation_count * sizeof(Relocation) + 1);
 
-	size_t total_relocation_count = 0;
-	for(int i = 0; i < total_global_block_count; ++i)
+	const int functions_per_job = 64;
+	for(int start = 0; start < total_global_block_count; start += functions_per_job)
 	{
-		int relocation_count = relative_relocations[i].count;
-		auto relocations = relative_relocations[i].relocs;
-		total_relocation_count += relocation_count;
-		for(int j = 0; j < relocation_count; ++j)
-		{
-			relocations[j].actual_relocation.offset += buffer_offsets[relocations[j].buffer_index];
-		}
-	}
-	*out_relocation_count = total_relocation_count;
-
-	Relocation *absolute_relocations = (Relocation *)AllocateCompileMemory(total_relocation_count * sizeof(Relocation));
-	for(int i = 0; i < total_global_block_count; ++i)
-	{
-		int relocation_count = relative_relocations[i].count;
-		auto relocations = relative_relocations[i].relocs;
-		for(int j = 0; j < relocation_count; ++j)
-		{
-			absolute_relocations[--total_relocation_count] = relocations[j].actual_relocation;
-		}
+		Place_Code_Args *args = (Place_Code_Args *)AllocateCompileMemory(sizeof(Place_Code_Args));
+		args->buffers            = code_buffers;
+		args->relocs             = relative_relocations;
+		args->code_offsets       = buffer_offsets;
+		args->relocation_offsets = relocation_offsets;
+		args->program            = &program_code;
+		args->out_relocations    = absolute_relocations;
+		args->start              = start;
+		args->end                = start + functions_per_job < total_global_block_count ?
+			start + functions_per_job : total_global_block_count;
+		post_job_listing(JOB_PLACE_CODE, (void *)x64_place_functions, args);
 	}
+	wait_for_threads();
 
+	*out_relocation_count = total_relocation_count;
 	*relocations = absolute_relocations;
 
 	auto sym_count = SDCount(obj_symbols);
+	X64_Debug_Info *info = NULL;
+	if(debug_info)
+	{
+		info = (X64_Debug_Info *)AllocateCompileMemory(sizeof(X64_Debug_Info));
+		info->functions = (Debug_Function *)AllocateCompileMemory(sym_count * sizeof(Debug_Function) + 1);
+		info->code_size = total_code_size;
+	}
 	for(int i = 0; i < sym_count; ++i)
 	{
 		if(obj_symbols[i].type == OBJ_FUNCTION)
 		{
 			obj_symbols[i].position = buffer_offsets[obj_symbols[i].value];
+			if(info && obj_symbols[i].section == SEC_TEXT)
+			{
+				Debug_Function *function = &info->functions[info->function_count++];
+				u64 index = obj_symbols[i].value;
+				function->name  = obj_symbols[i].name;
+				function->file  = function_files[index];
+				function->start = buffer_offsets[index];
+				function->size  = code_buffers[index].count;
+				function->rows  = relative_relocations[index].debug;
+			}
 		}
 	}
+	if(info)
+		x64_build_dwarf(info, (char *)files[0]->path);
+	// block jumps never leave their function, x64_gen_ir already wrote their displacements
+	return program_code;
+}
 
-	for(int i = 0; i < total_global_block_count; ++i)
+void
+x64_place_functions(Code_Buffer *buffers, Relative_Relocation_Array *relocs, u32 *code_offsets, u32 *relocation_offsets,
+		Code_Buffer *program, Relocation *out_relocations, int start, int end)
+{
+	for(int i = start; i < end; ++i)
 	{
-		auto fix_array = fixables[i].fixables;
-		i32 fixable_count = fixables[i].count;
-		for(int j = 0; j < fixable_count; ++j)
+		memcpy(program->buffer + code_offsets[i], buffers[i].buffer, buffers[i].count);
+		Relocation *out = out_relocations + relocation_offsets[i];
+		for(u32 j = 0; j < relocs[i].count; ++j)
 		{
-			u32 absolute_destination = buffer_offsets[fix_array[j].buffer_index] + fix_array[j].block->start_address;
-			u32 absolute_address = buffer_offsets[fix_array[j].buffer_index] + fix_array[j].offset;
-			((u32 *)program_code.buffer)[absolute_address] = absolute_destination;
+			out[j] = relocs[i].relocs[j].actual_relocation;
+			out[j].offset += code_offsets[relocs[i].relocs[j].buffer_index];
 		}
 	}
-	return program_code;
+}
+
+Code_Buffer
+x64_generate_function(IR *ir, Relocation **out_relocations, u32 *out_relocation_count)
+{
+	x64_initialize_types();
+	if(!obj_symbols)
+		obj_symbols = SDCreate(Symbol_Descriptor);
+
+	Relative_Relocation_Array reloc_array = {};
+	Fixable_Array fixable_arr = {};
+	Code_Buffer code_buffer = make_code_buffer(x64_code_size_estimate(ir));
+
+	// block jumps are relaxed and resolved by x64_gen_ir
+	x64_gen_ir(ir, &code_buffer, &reloc_array, NULL, 0, &fixable_arr);
+	x64_merge_literals(&reloc_array, 1);
+
+	Relocation *relocations = (Relocation *)AllocateCompileMemory(reloc_array.count * sizeof(Relocation));
+	for(int i = 0; i < reloc_array.count; ++i)
+	{
+		relocations[i] = reloc_array.relocs[i].actual_relocation;
+	}
+	*out_relocations = relocations;
+	*out_relocation_count = reloc_array.count;
+	return code_buffer;
 }
 
 void
@@ -385,26 +488,250 @@ x64_gen_ir(IR *ir, Code_Buffer *buffer, Relative_Relocation_Array *relocs, Data_
 	if(!ir->blocks)
 		return;
 	size_t block_count = SDCount(ir->blocks);
+	u32 code_start = buffer->count;
+	u64 encode_ns = 0;
+	u64 encoded = 0;
+	b32 count_encoded = x64_encoder_stats_enabled();
+	Debug_Rows *debug = relocs->debug;
 	for(size_t block_idx = 0; block_idx < block_count; ++block_idx)
 	{
 		auto block = ir->blocks[block_idx];
+		IR_Block *fallthrough = block_idx + 1 < block_count ? ir->blocks[block_idx + 1] : NULL;
 		block->start_address = buffer->count;
+		x64_peephole_block(block);
+		// the peephole rewrites are timed with the rest of codegen, not the encoder
+		u64 block_start = count_encoded ? profiler_now() : 0;
 		for(size_t bytecode_idx = 0; bytecode_idx < block->bc_count; ++bytecode_idx)
 		{
-			x64_gen_from_bytecode(ir, block->bc[bytecode_idx], buffer, relocs, global_ds, buffer_idx, fixables);
+			Bytecode *bc = &block->bc[bytecode_idx];
+			if(count_encoded && bc->op != BC_NO_OP)
+				encoded++;
+			if(debug && bc->op != BC_NO_OP && bc->line)
+			{
+				Code_Line *last = debug->line_count ? &debug->lines[debug->line_count - 1] : NULL;
+				if(!last || last->line != bc->line || last->column != bc->column)
+					x64_push_line(debug, buffer->count, bc->line, bc->column);
+			}
+			if(bc->op == BC_COND_JUMP)
+			{
+				u8 condition = 0x5; // jne
+				if(bc->result == -1)
+				{
+					// cmp was just emitted without a setcc, jump on its flags
+					Bytecode *compare = get_flags_compare(block, bytecode_idx);
+					condition = x64_condition_code(compare->op);
+				}
+				else
+					push_compare_valuei8(buffer, bc, (Register)bc->result, 0);
+
+				IR_Block *target = (IR_Block *)bc->big_idx;
+				Bytecode *jump = x64_peephole_inverted_branch(block, bytecode_idx, fallthrough);
+				if(jump)
+				{
+					// the low bit of a condition code negates it
+					condition ^= 1;
+					target = (IR_Block *)jump->big_idx;
+					jump->op = BC_NO_OP;
+				}
+				push_jcc_to_block(buffer, condition, target, buffer_idx, fixables);
+				continue;
+			}
+			x64_gen_from_bytecode(ir, *bc, buffer, relocs, global_ds, buffer_idx, fixables);
 		}
+		if(count_encoded)
+			encode_ns += profiler_now() - block_start;
 	}
+	if(count_encoded)
+		x64_count_encoded(encoded, buffer->count - code_start, encode_ns);
+	x64_relax_jumps(ir, buffer, relocs, fixables);
+	x64_emit_jump_tables(ir, buffer, fixables);
+}
+
+// bytes removed by the relaxed jumps that start before old_address
+static u32
+x64_bytes_saved_before(u32 *starts, u32 *saved, u32 count, u32 old_address)
+{
+	u32 low = 0;
+	u32 high = count;
+	while(low < high)
+	{
+		u32 mid = (low + high) / 2;
+		if(starts[mid] < old_address)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	return saved[low];
+}
+
+void
+x64_relax_jumps(IR *ir, Code_Buffer *buffer, Relative_Relocation_Array *relocs, Fixable_Array *fixables)
+{
+	u32 count = fixables->count;
+	if(count == 0)
+		return;
+
+	Fixable *fix = fixables->fixables;
+	u32 *starts   = (u32 *)AllocateCompileMemory(count * sizeof(u32));
+	u8  *long_len = (u8 *)AllocateCompileMemory(count);
+	u8  *len      = (u8 *)AllocateCompileMemory(count);
+	// saved[i] is how many bytes the jumps before the i-th one gave up
+	u32 *saved    = (u32 *)AllocateCompileMemory((count + 1) * sizeof(u32));
+	for(u32 i = 0; i < count; ++i)
+	{
+		// a jump table's lea keeps its size, it only moves with the code
+		long_len[i] = fix[i].type == FIX_JCC_TO_BLOCK ? 6 : fix[i].type == FIX_JMP_TO_BLOCK ? 5 : 0;
+		starts[i] = fix[i].type == FIX_JUMP_TABLE ? fix[i].offset : fix[i].offset - (long_len[i] - 4);
+		len[i] = long_len[i];
+		Assert(i == 0 || starts[i] > starts[i - 1]);
+	}
+
+	// Shrinking a jump can only bring other jumps closer to their targets,
+	// so every pass keeps the earlier choices valid and this terminates
+	b32 changed = true;
+	while(changed)
+	{
+		changed = false;
+		saved[0] = 0;
+		for(u32 i = 0; i < count; ++i)
+			saved[i + 1] = saved[i] + (long_len[i] - len[i]);
+
+		for(u32 i = 0; i < count; ++i)
+		{
+			if(len[i] == 0)
+				continue;
+			u32 old_target = fix[i].block->start_address;
+			i64 start  = starts[i] - saved[i];
+			i64 target = old_target - x64_bytes_saved_before(starts, saved, count, old_target);
+			i64 displacement = target - (start + len[i]);
+			b32 is_forward = old_target > starts[i];
+			if(is_forward && displacement == 0)
+			{
+				// jump to the instruction right after it
+				len[i] = 0;
+				changed = true;
+				continue;
+			}
+			if(len[i] == 2)
+				continue;
+
+			// a forward target moves back with the end of the jump
+			i64 short_displacement = is_forward ? displacement : displacement + (len[i] - 2);
+			if(short_displacement >= -128 && short_displacement <= 127)
+			{
+				len[i] = 2;
+				changed = true;
+			}
+		}
+	}
+	saved[0] = 0;
+	for(u32 i = 0; i < count; ++i)
+		saved[i + 1] = saved[i] + (long_len[i] - len[i]);
+
+	// compact the buffer in place, the new code is never ahead of the old one
+	u32 read = 0;
+	u32 write = 0;
+	for(u32 i = 0; i < count; ++i)
+	{
+		u32 untouched = starts[i] - read;
+		memmove(buffer->buffer + write, buffer->buffer + read, untouched);
+		write += untouched;
+		read = starts[i] + long_len[i];
+		if(fix[i].type == FIX_JUMP_TABLE)
+		{
+			fix[i].offset = write;
+			continue;
+		}
+
+		u32 old_target = fix[i].block->start_address;
+		i32 target = old_target - x64_bytes_saved_before(starts, saved, count, old_target);
+		i32 displacement = target - (i32)(write + len[i]);
+		if(len[i] == 2)
+		{
+			buffer->buffer[write++] = fix[i].type == FIX_JCC_TO_BLOCK ? 0x70 | fix[i].condition : 0xEB;
+			buffer->buffer[write++] = (i8)displacement;
+		}
+		else if(len[i] != 0)
+		{
+			if(fix[i].type == FIX_JCC_TO_BLOCK)
+			{
+				buffer->buffer[write++] = 0x0F;
+				buffer->buffer[write++] = 0x80 | fix[i].condition;
+			}
+			else
+				buffer->buffer[write++] = 0xE9;
+			memcpy(buffer->buffer + write, &displacement, sizeof(i32));
+			write += 4;
+		}
+	}
+	memmove(buffer->buffer + write, buffer->buffer + read, buffer->count - read);
+	buffer->count -= saved[count];
+
+	size_t block_count = SDCount(ir->blocks);
+	for(size_t i = 0; i < block_count; ++i)
+	{
+		IR_Block *block = ir->blocks[i];
+		block->start_address -= x64_bytes_saved_before(starts, saved, count, block->start_address);
+	}
+	for(u32 i = 0; i < relocs->count; ++i)
+	{
+		u32 *offset = &relocs->relocs[i].actual_relocation.offset;
+		*offset -= x64_bytes_saved_before(starts, saved, count, *offset);
+	}
+	if(relocs->debug)
+	{
+		Debug_Rows *debug = relocs->debug;
+		for(u32 i = 0; i < debug->line_count; ++i)
+			debug->lines[i].offset -= x64_bytes_saved_before(starts, saved, count, debug->lines[i].offset);
+		for(u32 i = 0; i < debug->frame_count; ++i)
+			debug->frames[i].offset -= x64_bytes_saved_before(starts, saved, count, debug->frames[i].offset);
+	}
+
+	// every block displacement is written, only the jump tables are left
+	u32 kept = 0;
+	for(u32 i = 0; i < count; ++i)
+	{
+		if(fix[i].type == FIX_JUMP_TABLE)
+			fix[kept++] = fix[i];
+	}
+	fixables->count = kept;
+}
+
+Code_Buffer
+make_code_buffer(u32 capacity)
+{
+	Code_Buffer result;
+	result.buffer = (u8 *)AllocateCompileMemory(capacity);
+	result.count = 0;
+	result.capacity = capacity;
+	return result;
+}
+
+void
+grow_code_buffer(Code_Buffer *buffer, u32 needed)
+{
+	u32 capacity = buffer->capacity ? buffer->capacity * 2 : 64;
+	while(capacity < buffer->count + needed)
+		capacity *= 2;
+	u8 *grown = (u8 *)AllocateCompileMemory(capacity);
+	memcpy(grown, buffer->buffer, buffer->count);
+	buffer->buffer = grown;
+	buffer->capacity = capacity;
 }
 
 inline void
 push_i8(Code_Buffer *buffer, i8 byte)
 {
+	if(buffer->count == buffer->capacity)
+		grow_code_buffer(buffer, 1);
 	buffer->buffer[buffer->count++] = byte;
 }
 
 inline void
 push_byte(Code_Buffer *buffer, u8 byte)
 {
+	if(buffer->count == buffer->capacity)
+		grow_code_buffer(buffer, 1);
 	buffer->buffer[buffer->count++] = byte;
 }
 
@@ -417,36 +744,26 @@ push_i32(Code_Buffer *buffer, i32 bytes)
 }
 
 void
-push_any(Code_Buffer *buffer, void *any, Type_Info *type)
+x64_emit_jump_tables(IR *ir, Code_Buffer *buffer, Fixable_Array *fixables)
 {
-	Assert(type->type == T_INTEGER || type->type == T_UNTYPED_INTEGER);
-	switch(type->primitive.size)
+	for(u32 i = 0; i < fixables->count; ++i)
 	{
-		case byte1:
-		case ubyte1:
-		{
-			push_byte(buffer, *(u8 *)any);
-		} break;
-		case byte2:
-		case ubyte2:
-		{
-			push_byte(buffer, ((u8 *)any)[0]);
-			push_byte(buffer, ((u8 *)any)[1]);
-		} break;
-		case byte4:
-		case ubyte4:
-		{
-			push_i32(buffer, *(i32 *)any);
-		} break;
-		case byte8:
-		case ubyte8:
-		{
-			push_i32(buffer, ((i32 *)any)[0]);
-			push_i32(buffer, ((i32 *)any)[1]);
-		} break;
-		default: Assert(false);
+		Fixable *fix = &fixables->fixables[i];
+		Assert(fix->type == FIX_JUMP_TABLE);
+		BC_Jump_Table *table = &ir->jump_tables[fix->jump_table];
+		i32 table_displacement = buffer->count - (fix->offset + 4);
+		memcpy(buffer->buffer + fix->offset, &table_displacement, sizeof(i32));
+		for(i32 entry = 0; entry < table->count; ++entry)
+		{
+			i32 displacement = table->targets[entry]->start_address - (buffer->count + 5);
+			push_byte(buffer, 0xE9);
+			push_i32(buffer, displacement);
+			// int3 padding so an entry is indexed with a scale of 8
+			for(i32 pad = 0; pad < 3; ++pad)
+				push_byte(buffer, 0xCC);
+		}
 	}
-	
+	fixables->count = 0;
 }
 
 inline void
@@ -470,20 +787,6 @@ push_displacement(MOD mod, i32 displacement, Code_Buffer *buffer)
 		push_i32(buffer, displacement);
 }
 
-inline void
-push_generic_mov(MOD mod, u8 mov_opcode, i32 left_rm, i32 right_rm, i32 displacement, Code_Buffer *buffer)
-{
-	push_byte(buffer, mov_opcode);
-	u8 mod_reg_rm;
-	if(mod == MOD_displacement_0 || mod == MOD_register)
-		mod_reg_rm = encode_postfix(mod, left_rm, right_rm);
-	else 
-		mod_reg_rm = encode_postfix(mod, right_rm, left_rm);
-	push_byte(buffer, mod_reg_rm);
-	if(mod != MOD_displacement_0 && mod != MOD_register)
-			push_displacement(mod, displacement, buffer);
-}
-
 b32
 is_standard_type(Type_Info *type)
 {
@@ -506,42 +809,6 @@ is_standard_type(Type_Info *type)
 	return false;
 }
 
-u8
-get_rm_r_mov(Code_Buffer *buffer, Type_Info *type)
-{
-	u8 mov_opcode;
-	if(is_standard_type(type))
-	{
-		size_t size = get_type_size(*type);
-		switch(size)
-		{
-			case 1:
-			{
-				mov_opcode = 0x88;
-			} break;
-			case 2:
-			{
-				mov_opcode = 0x89;
-			} break;
-			case 4:
-			{
-				mov_opcode = 0x89;
-			} break;
-			case 8:
-			{
-				mov_opcode = 0x89;
-			} break;
-			default: Assert(false);
-		}
-	}
-	else 
-	{
-		Assert(false);
-		Assert(type->type == T_FLOAT);
-	}
-	return mov_opcode;
-}
-
 u8
 fix_register(Register &reg)
 {
@@ -583,8 +850,8 @@ prefix_type(Code_Buffer *buffer, Type_Info *type, u8 current_prefix)
 			} break;
 			case 2:
 			{
-				// @NOTE: no idea
-				current_prefix|= 0x66;
+				// operand size prefix, has to come before REX
+				push_byte(buffer, 0x66);
 			} break;
 			case 4:
 			{
@@ -605,82 +872,12 @@ prefix_type(Code_Buffer *buffer, Type_Info *type, u8 current_prefix)
 		push_byte(buffer, current_prefix);
 }
 
-u8
-get_r_i_mov(Code_Buffer *buffer, Type_Info *type)
-{
-	u8 mov_opcode;
-	if(type->type == T_INTEGER)
-	{
-		size_t size = get_type_size(*type);
-		switch(size)
-		{
-			case 1:
-			{
-				mov_opcode = 0xb4;
-			} break;
-			case 2:
-			{
-				mov_opcode = 0xb8;
-			} break;
-			case 4:
-			{
-				mov_opcode = 0xb8;
-			} break;
-			case 8:
-			{
-				mov_opcode = 0xb8;
-			} break;
-			default: Assert(false);
-		}
-	}
-	else
-	{
-		Assert(false);
-		Assert(type->type == T_FLOAT);
-	}
-	return mov_opcode;
-}
-
-u8
-get_r_rm_mov(Code_Buffer *buffer, Type_Info *type)
-{
-	u8 mov_opcode;
-	if(is_standard_type(type))
-	{
-		size_t size = get_type_size(*type);
-		switch(size)
-		{
-			case 1:
-			{
-				mov_opcode = 0x8a;
-			} break;
-			case 2:
-			{
-				// @NOTE: no idea
-				mov_opcode = 0x8b;
-			} break;
-			case 4:
-			{
-				mov_opcode = 0x8b;
-			} break;
-			case 8:
-			{
-				mov_opcode = 0x8b;
-			} break;
-			default: Assert(false);
-		}
-	}
-	else
-	{
-		Assert(false);
-		Assert(type->type == T_FLOAT);
-	}
-	return mov_opcode;
-}
-
 void
 push_compare_valuei8(Code_Buffer *buffer, Bytecode *bc, Register reg, u8 value)
 {
+	u8 prefix = fix_register(reg);
+	if(prefix != 0)
+		push_byte(buffer, prefix);
 	push_byte(buffer, 0x80);
 	u8 postfix = encode_postfix(MOD_register, 7, reg);
 	push_byte(buffer, postfix);
@@ -688,39 +885,16 @@ push_compare_valuei8(Code_Buffer *buffer, Bytecode *bc, Register reg, u8 value)
 }
 
 void
-push_compare(Code_Buffer *buffer, Bytecode *bc, Register left, Register right)
+push_compare(Code_Buffer *buffer, X64_Size size, Register left, Register right)
 {
-	u8 opcode;
-	prefix_type(buffer, bc->type, fix_registers(left, right));
-	if(get_type_size(*bc->type) == 1)
-	{
-		opcode = 0x38;
-	}
-	else
-	{
-		opcode = 0x39;
-	}
-	push_byte(buffer, opcode);
-	MOD mod = MOD_register;
-	u8 postfix = encode_postfix(mod, right, left);
-	push_byte(buffer, postfix);
+	x64_emit_rr(buffer, X64_CMP_RM_R, size, right, left);
 }
 
+// left is the destination, the table's r/m operand
 inline void
-encode_int_op(u8 opcode, Bytecode *bc, Code_Buffer *buffer, IR *ir)
+encode_int_op(X64_Op op, Bytecode *bc, X64_Size size, Code_Buffer *buffer)
 {
-	u8 prefix = 0;
-	if(bc->type->primitive.size == ubyte8 || bc->type->primitive.size == byte8)
-		prefix = REX_W;
-	Register left = (Register)bc->left_idx;
-	Register right = (Register)bc->right_idx;
-	prefix |= fix_registers(left, right);
-	if(prefix != 0)
-		push_byte(buffer, prefix);
-
-	push_byte(buffer, opcode);
-	u8 postfix = encode_postfix(MOD_register, right, left);
-	push_byte(buffer, postfix);
+	x64_emit_rr(buffer, op, size, (Register)bc->right_idx, (Register)bc->left_idx);
 }
 
 Register
@@ -772,149 +946,312 @@ prefix_float_op(Code_Buffer *buffer, Type_Info *type)
 	}
 	else if(type->primitive.size == real64)
 	{
-		push_byte(buffer, 0xF2);
+		push_byte(buffer, 0xF2);
+	}
+	// the packed forms, ps for f128 and the 66 prefixed integer ones for i128
+	else if(type->primitive.size == real128)
+	{
+	}
+	else if(type->primitive.size == byte128)
+	{
+		push_byte(buffer, 0x66);
+	}
+	else
+		Assert(false);
+}
+
+void
+push_literal_relocation(Relocation reloc, Literal_Kind literal, Relative_Relocation_Array *reloc_array, int buffer_index)
+{
+	if(reloc_array->count == reloc_array->capacity)
+	{
+		u32 capacity = reloc_array->capacity ? reloc_array->capacity * 2 : 16;
+		auto grown = (Relative_Relocation *)AllocateCompileMemory(capacity * sizeof(Relative_Relocation));
+		memcpy(grown, reloc_array->relocs, reloc_array->count * sizeof(Relative_Relocation));
+		reloc_array->relocs = grown;
+		reloc_array->capacity = capacity;
+	}
+	reloc_array->relocs[reloc_array->count++] = { reloc, buffer_index, literal };
+}
+
+void
+push_relocation(Relocation reloc, Relative_Relocation_Array *reloc_array, int buffer_index)
+{
+	push_literal_relocation(reloc, LITERAL_NONE, reloc_array, buffer_index);
+}
+
+void
+push_fixable(Fixable_Array *fixable_array, Fixable fixable)
+{
+	if(fixable_array->count == fixable_array->capacity)
+	{
+		u32 capacity = fixable_array->capacity ? fixable_array->capacity * 2 : 16;
+		Fixable *grown = (Fixable *)AllocateCompileMemory(capacity * sizeof(Fixable));
+		memcpy(grown, fixable_array->fixables, fixable_array->count * sizeof(Fixable));
+		fixable_array->fixables = grown;
+		fixable_array->capacity = capacity;
+	}
+	fixable_array->fixables[fixable_array->count++] = fixable;
+}
+
+void
+move_float_to_register(Code_Buffer *buffer, Register reg, u64 value, Type_Info *type, Relative_Relocation_Array *relocs, int buffer_index)
+{
+	Assert(is_float(*type));
+	Relocation relocation = {};
+	relocation.type = IMAGE_REL_AMD64_REL32;
+	relocation.symbol_index = push_float(relocs, value, type->primitive.size);
+	relocation.offset = x64_emit_rip(buffer, X64_SSE_MOV_R_RM, x64_size_class(type), reg);
+	push_literal_relocation(relocation, LITERAL_CONSTANT, relocs, buffer_index);
+}
+
+void 
+move_value_to_register(Register reg, u64 value, X64_Size size, Code_Buffer *buffer)
+{
+	x64_emit_immediate(buffer, X64_MOV_R_IMM, size, reg, value);
+}
+
+inline void
+set_2byte_opcode(Code_Buffer *buffer)
+{
+	push_byte(buffer, 0x0F);
+}
+
+void
+push_jcc_to_block(Code_Buffer *buffer, u8 condition, IR_Block *block, int buffer_index, Fixable_Array *fixable_array)
+{
+	set_2byte_opcode(buffer);
+	push_byte(buffer, 0x80 | condition);
+	Fixable fixable;
+	fixable.buffer_index = buffer_index;
+	fixable.type = FIX_JCC_TO_BLOCK;
+	fixable.offset = buffer->count;
+	fixable.block = block;
+	fixable.condition = condition;
+	push_fixable(fixable_array, fixable);
+	push_i32(buffer, 0);
+}
+
+void
+push_setcc(Code_Buffer *buffer, u8 op, Register reg)
+{
+	u8 prefix = fix_register(reg);
+	if(prefix != 0)
+		push_byte(buffer, prefix);
+	set_2byte_opcode(buffer);
+	push_byte(buffer, op);
+	push_byte(buffer, encode_postfix(MOD_register, 0, reg));
+}
+
+// [base] without a displacement, rsp and r12 need a SIB byte
+// and rbp and r13 can only be encoded with one
+void
+push_register_address(Code_Buffer *buffer, u8 reg, Register base)
+{
+	u8 rm = base & 0b111;
+	if(rm == reg_bp)
+	{
+		push_byte(buffer, encode_postfix(MOD_displacement_i8, reg, rm));
+		push_i8(buffer, 0);
 	}
 	else
-		Assert(false);
+	{
+		push_byte(buffer, encode_postfix(MOD_displacement_0, reg, rm));
+		if(rm == reg_sp)
+			push_byte(buffer, 0x24);
+	}
 }
 
+// [base + displacement], same rules as above when there is no displacement
 void
-push_relocation(Relocation reloc, Relative_Relocation_Array *reloc_array, int buffer_index)
+push_register_address_displaced(Code_Buffer *buffer, u8 reg, Register base, i32 displacement)
 {
-	reloc_array->relocs[reloc_array->count++] = { reloc, buffer_index };
+	if(displacement == 0)
+	{
+		push_register_address(buffer, reg, base);
+		return;
+	}
+	u8 rm = base & 0b111;
+	MOD mod = MOD_displacement_i32;
+	if(displacement > -129 && displacement < 128)
+		mod = MOD_displacement_i8;
+	push_byte(buffer, encode_postfix(mod, reg, rm));
+	if(rm == reg_sp)
+		push_byte(buffer, 0x24);
+	push_displacement(mod, displacement, buffer);
 }
 
+// moves size bytes at offset from [src] to [dst] through the scratch register
 void
-move_float_to_register(Code_Buffer *buffer, Register reg, u64 value, Type_Info *type, Relative_Relocation_Array *relocs, int buffer_index)
+push_copy_chunk(Code_Buffer *buffer, Register dst, Register src, Register scratch, i32 offset, i32 size)
 {
-	Assert(is_float(*type));
-	prefix_float_op(buffer, type);
-	if(reg >= reg_xmm8)
+	for(i32 is_store = 0; is_store < 2; ++is_store)
 	{
-		reg = (Register)(reg - (reg_r15 + 1));
-		push_byte(buffer, REX_R);
+		Register base = is_store ? dst : src;
+		Register reg = scratch;
+		u8 prefix = fix_registers(base, reg);
+		if(size == 8)
+			prefix |= REX_W;
+		// without a rex prefix the byte registers of rsi and rdi are dh and bh
+		else if(size == 1)
+			prefix |= REX_none;
+		else if(size == 2)
+			push_byte(buffer, 0x66);
+		if(prefix != 0)
+			push_byte(buffer, prefix);
+		if(size == 1)
+			push_byte(buffer, is_store ? 0x88 : 0x8a);
+		else
+			push_byte(buffer, is_store ? 0x89 : 0x8b);
+		push_register_address_displaced(buffer, reg, base, offset);
 	}
-	reg = get_float_register_encoding(reg);
-	push_byte(buffer, 0x0F);
-	push_byte(buffer, 0x10);
-	push_byte(buffer, encode_postfix(MOD_displacement_0, reg, 0b101));
-
-	Relocation relocation = {};
-	relocation.type = IMAGE_REL_AMD64_REL32;
-	relocation.symbol_index = push_float(value, type->primitive.size);
-	relocation.offset = buffer->count;
-	push_relocation(relocation, relocs, buffer_index);
-	push_i32(buffer, 0);
 }
 
-void 
-move_value_to_register(Register reg, u64 value, Type_Info *type, Code_Buffer *buffer)
+// The condition a compare tests as the low nibble of setcc and jcc,
+// float compares use the unsigned ones since ucomis sets CF and ZF
+u8
+x64_condition_code(BC_OP op)
 {
-	prefix_type(buffer, type, fix_register(reg));
-	u8 mov_opcode = get_r_i_mov(buffer, type);
-	mov_opcode |= reg & 0b111;
-	push_byte(buffer, mov_opcode);
-	push_any(buffer, &value, type);
+	switch(op)
+	{
+		case BC_CMP_I_EQ:
+		case BC_FCMP_EQ:
+		return 0x4; // e
+		case BC_CMP_I_NEQ:
+		case BC_FCMP_NEQ:
+		// @TODO: check parity flag
+		return 0x5; // ne
+		case BC_CMP_I_LESS_THAN:
+		return 0xC; // l
+		case BC_CMP_I_GREATER_THAN:
+		return 0xF; // g
+		case BC_CMP_I_LESS_EQ:
+		return 0xE; // le
+		case BC_CMP_I_GREATER_EQ:
+		return 0xD; // ge
+		case BC_CMP_U_LESS_THAN:
+		case BC_FCMP_LESS_THAN:
+		return 0x2; // b
+		case BC_CMP_U_GREATER_THAN:
+		case BC_FCMP_GREATER_THAN:
+		return 0x7; // a
+		case BC_CMP_U_LESS_EQ:
+		case BC_FCMP_LESS_EQ:
+		return 0x6; // be
+		case BC_CMP_U_GREATER_EQ:
+		case BC_FCMP_GREATER_EQ:
+		return 0x3; // ae
+		default:
+		Assert(false);
+		return 0;
+	}
 }
 
-inline void
-set_2byte_opcode(Code_Buffer *buffer)
+void
+push_cmp_op(Code_Buffer *buffer, Bytecode *bc, X64_Size size, u8 op)
 {
-	push_byte(buffer, 0x0F);
+	push_compare(buffer, size, (Register)bc->left_idx, (Register)bc->right_idx);
+	// without a result the flags are used by the jump after it
+	if(bc->result != -1)
+		push_setcc(buffer, op, (Register)bc->result);
 }
 
 void
-push_cmp_op(Code_Buffer *buffer, Bytecode *bc, u8 op)
+push_fcmp_op(Code_Buffer *buffer, Bytecode *bc, X64_Size size, u8 op)
 {
-	push_compare(buffer, bc, (Register)bc->left_idx, (Register)bc->right_idx);
-	set_2byte_opcode(buffer);
-	push_byte(buffer, op);
-	push_byte(buffer, encode_postfix(MOD_register, 0, bc->result));
+	x64_emit_rr(buffer, X64_UCOMIS, size, (Register)bc->left_idx, (Register)bc->right_idx);
+	if(bc->result != -1)
+		push_setcc(buffer, op, (Register)bc->result);
 }
 
 void
-push_fcmp(Code_Buffer *buffer, Bytecode *bc, Register left, Register right)
+float_move_reg_to_reg(Code_Buffer *buffer, Register left, Register right, X64_Size size)
 {
-	if(bc->type->primitive.size == real64)
-		push_byte(buffer, 0x66);
-	u8 prefix = float_fix_registers(left, right);
-	if(prefix != 0)
-		push_byte(buffer, prefix);
-	set_2byte_opcode(buffer);
-	push_byte(buffer, 0x2E); // ucomis(s/d)
-	push_byte(buffer, encode_postfix(MOD_register, left, right));
+	x64_emit_rr(buffer, X64_SSE_MOV_R_RM, size, left, right);
 }
 
+// f128 is moved with movaps and movups, i128 with movdqa and movdqu,
+// rex goes after the legacy prefix
 void
-push_fcmp_op(Code_Buffer *buffer, Bytecode *bc, u8 op)
+push_vector_move(Code_Buffer *buffer, Type_Info *type, u8 rex, b32 is_store, b32 is_aligned)
 {
-	push_fcmp(buffer, bc, (Register)bc->left_idx, (Register)bc->right_idx);
+	if(type->type == T_INTEGER)
+		push_byte(buffer, is_aligned ? 0x66 : 0xF3);
+	if(rex != 0)
+		push_byte(buffer, rex);
 	set_2byte_opcode(buffer);
-	push_byte(buffer, op);
-	push_byte(buffer, encode_postfix(MOD_register, 0, bc->result));
+	if(type->type == T_INTEGER)
+		push_byte(buffer, is_store ? 0x7F : 0x6F);
+	else if(is_aligned)
+		push_byte(buffer, is_store ? 0x29 : 0x28);
+	else
+		push_byte(buffer, is_store ? 0x11 : 0x10);
 }
 
 void
-store_float(Code_Buffer *buffer, Bytecode *bc, i32 displacement, MOD mod, Register reg)
+vector_move_reg_to_reg(Code_Buffer *buffer, Register left, Register right, X64_Size size)
 {
-	reg = get_float_register_encoding(reg);
-	push_byte(buffer, 0xF3);
-	if(reg >= reg_xmm8)
-	{
-		reg = (Register)(reg - (reg_r15 + 1));
-		push_byte(buffer, REX_R);
-	}
-	push_byte(buffer, 0x0F);
-	push_byte(buffer, 0x11);
-	push_byte(buffer, encode_postfix(mod, reg, reg_bp));
-	push_displacement(mod, displacement, buffer);
+	if(left == right)
+		return;
+	x64_emit_rr(buffer, X64_SSE_MOV_R_RM, size, left, right);
 }
 
+// [rbp - displacement], the frame is 16 byte aligned so slots at a multiple of 16 are too
 void
-float_move_reg_to_reg(Code_Buffer *buffer, Register left, Register right, Type_Info *type)
+vector_stack_move(Code_Buffer *buffer, Type_Info *type, Register reg, i32 displacement, b32 is_store)
 {
-	prefix_float_op(buffer, type);
-	u8 prefix = float_fix_registers(left, right);
-	left  = get_float_register_encoding(left);
-	right = get_float_register_encoding(right);
-	if(prefix != 0)
-		push_byte(buffer, prefix);
-	push_byte(buffer, 0x0F);
-	push_byte(buffer, 0x10);
-	push_byte(buffer, encode_postfix(MOD_register, left, right));
+	u8 prefix = float_fix_register(reg);
+	reg = get_float_register_encoding(reg);
+	push_vector_move(buffer, type, prefix, is_store, displacement % 16 == 0);
+	push_register_address_displaced(buffer, reg, reg_bp, displacement);
 }
 
+// nothing says where a pointer points so these don't assume alignment
 void
-encode_float_op(Code_Buffer *buffer, Register left, Register right, Type_Info *type, u8 opcode)
+vector_pointer_move(Code_Buffer *buffer, Type_Info *type, Register reg, Register address, b32 is_store)
 {
-	prefix_float_op(buffer, type);
-	u8 prefix = float_fix_registers(left, right);
-	if(prefix != 0)
-		push_byte(buffer, prefix);
-	left  = get_float_register_encoding(left);
-	right = get_float_register_encoding(right);
-	push_byte(buffer, 0x0F);
-	push_byte(buffer, opcode);
-	push_byte(buffer, encode_postfix(MOD_register, left, right));
+	u8 prefix = float_fix_register(reg) | fix_register(address);
+	reg = get_float_register_encoding(reg);
+	push_vector_move(buffer, type, prefix, is_store, false);
+	push_register_address(buffer, reg, address);
 }
 
 void
-move_reg_to_reg(Code_Buffer *buffer, Register left, Register right, Type_Info *type)
+move_reg_to_reg(Code_Buffer *buffer, Register left, Register right, X64_Size size)
 {
+	x64_emit_rr(buffer, X64_MOV_R_RM, size, left, right);
+}
 
-	MOD mod = MOD_register;
-
-	prefix_type(buffer, type, fix_registers(left, right));
+// scalar and lane wise ops, the size picks ss, sd, ps or the 66 prefixed p form
+#define F_OP(OP) x64_emit_rr(buffer, OP, size, (Register)bc.left_idx, (Register)bc.right_idx);
 
-	u8 mov_opcode = get_r_rm_mov(buffer, type);
-	push_generic_mov(mod, mov_opcode, left, right, 0, buffer);
+// Restore rsp from rbp instead of adding back stack_top,
+// functions that never subtract from rsp have stack_top
+// set to 16 too
+static void
+x64_leave_frame(IR *ir, Code_Buffer *buffer, Relative_Relocation_Array *relocs)
+{
+	if(ir->omit_frame)
+		return;
+	move_reg_to_reg(buffer, reg_sp, reg_bp, X64_SIZE_64);
+	// POP rbp
+	push_byte(buffer, 0x58 + reg_bp);
+	if(relocs->debug)
+		x64_push_frame_event(relocs->debug, buffer->count, FRAME_LEFT);
 }
 
-#define F_OP(OPCODE) encode_float_op(buffer, (Register)bc.left_idx, (Register)bc.right_idx, bc.type, OPCODE);
+// the ret or jmp ending an epilogue, the code after it still has the frame
+static void
+x64_frame_returned(IR *ir, Code_Buffer *buffer, Relative_Relocation_Array *relocs)
+{
+	if(!ir->omit_frame && relocs->debug)
+		x64_push_frame_event(relocs->debug, buffer->count, FRAME_RETURNED);
+}
 
 void
 x64_gen_from_bytecode(IR *ir, Bytecode bc, Code_Buffer *buffer, Relative_Relocation_Array *relocs, Data_Segment *global_ds, int buffer_index, Fixable_Array *fixable_array)
 {
+	X64_Size size = x64_size_class(bc.type);
 	switch(bc.op)
 	{
 		case BC_STORE_NON_REMOVABLE:
@@ -923,38 +1260,16 @@ x64_gen_from_bytecode(IR *ir, Bytecode bc, Code_Buffer *buffer, Relative_Relocat
 			Data_Segment seg = ir->allocated[bc.left_idx];
 			i32 displacement = seg.position + seg.size;
 			displacement = -displacement;
-			MOD mod = MOD_displacement_i32;
-			if(displacement > -129 && displacement < 128 )
-				mod = MOD_displacement_i8;
-
-			if(bc.type->type == T_FLOAT)
-			{
-				store_float(buffer, &bc, displacement, mod, (Register)bc.right_idx);
-			}
+			if(is_vector(*bc.type))
+				vector_stack_move(buffer, bc.type, (Register)bc.right_idx, displacement, true);
 			else
-			{
-				Register left = reg_bp;
-				Register right = (Register)bc.right_idx;
-				prefix_type(buffer, bc.type, fix_registers(left, right));
-
-				u8 mov_opcode = get_rm_r_mov(buffer, bc.type);
-				push_generic_mov(mod, mov_opcode, left, right, displacement, buffer);
-			}
+				x64_emit_rbp(buffer, x64_store_op(size), size, (Register)bc.right_idx, displacement);
 		} break;
 		case BC_PUSH_OFFSET:
 		{
 			Data_Segment seg = ir->allocated[bc.left_idx];
 			i32 displacement = seg.position + seg.size;
-			MOD mod = MOD_displacement_i32;
-			if(displacement > -129 && displacement < 128 )
-				mod = MOD_displacement_i8;
-
-			Register left = reg_bp;
-			Register right = (Register)bc.right_idx;
-			prefix_type(buffer, bc.type, fix_registers(left, right));
-
-			u8 mov_opcode = get_rm_r_mov(buffer, bc.type);
-			push_generic_mov(mod, mov_opcode, left, right, displacement, buffer);
+			x64_emit_rbp(buffer, X64_MOV_RM_R, size, (Register)bc.right_idx, displacement);
 		} break;
 		case BC_MOVE_FLOAT_TO_REG:
 		{
@@ -962,13 +1277,16 @@ x64_gen_from_bytecode(IR *ir, Bytecode bc, Code_Buffer *buffer, Relative_Relocat
 		} break;
 		case BC_MOVE_VALUE_TO_REG:
 		{
-			move_value_to_register((Register)bc.result, bc.big_idx, bc.type, buffer);
+			if(!x64_peephole_move_value(buffer, (Register)bc.result, bc.big_idx, bc.type))
+				move_value_to_register((Register)bc.result, bc.big_idx, size, buffer);
 		} break;
 		case BC_MOVE_FUNCTION_TO_REG:
 		{
-			prefix64(buffer);
+			Register rip = reg_bp;
+			Register result = (Register)bc.result;
+			push_byte(buffer, REX_W | fix_registers(rip, result));
 			push_byte(buffer, 0x8d);
-			push_byte(buffer, encode_postfix(MOD_displacement_0, bc.result, 5));
+			push_byte(buffer, encode_postfix(MOD_displacement_0, result, 5));
 			Relocation relocation = {};
 			relocation.type = IMAGE_REL_AMD64_REL32;
 			relocation.symbol_index = bc.right_idx;
@@ -977,63 +1295,77 @@ x64_gen_from_bytecode(IR *ir, Bytecode bc, Code_Buffer *buffer, Relative_Relocat
 
 			push_relocation(relocation, relocs, buffer_index);
 		} break;
-		case BC_LOAD_DATA_SEG:
-		case BC_LOAD_STACK:
+		case BC_GLOBAL_ADDRESS:
 		{
-			Data_Segment seg;
-			if(bc.op == BC_LOAD_DATA_SEG)
-				seg = global_ds[bc.right_idx];
-			else
-				seg = ir->allocated[bc.right_idx];
-			i32 displacement = seg.position + seg.size;
-			displacement = -displacement;
-			MOD mod = MOD_displacement_i32;
-			if( displacement > -129 && displacement < 128 )
-				mod = MOD_displacement_i8;
+			Register rip = reg_bp;
+			Register result = (Register)bc.result;
+			push_byte(buffer, REX_W | fix_registers(rip, result));
+			push_byte(buffer, 0x8d);
+			push_byte(buffer, encode_postfix(MOD_displacement_0, result, 5));
+			Relocation relocation = {};
+			relocation.type = IMAGE_REL_AMD64_REL32;
+			relocation.symbol_index = global_ds[bc.right_idx].symbol_index;
+			relocation.offset = buffer->count;
+			push_i32(buffer, 0);
 
-			Register left = reg_bp;
-			Register right = (Register)bc.result;
-			if(is_float(*bc.type))
+			push_relocation(relocation, relocs, buffer_index);
+		} break;
+		case BC_LOAD_DATA_SEG:
+		{
+			// [rip + rel32] of the global's symbol
+			Register result = (Register)bc.result;
+			Relocation relocation = {};
+			relocation.type = IMAGE_REL_AMD64_REL32;
+			relocation.symbol_index = global_ds[bc.right_idx].symbol_index;
+			if(is_vector(*bc.type))
 			{
-				prefix_float_op(buffer, bc.type);
-				if(right >= reg_xmm8)
-				{
-					right = (Register)(right - (reg_r15 + 1));
-					push_byte(buffer, REX_R);
-				}
-				right = get_float_register_encoding(right);
-				push_byte(buffer, 0x0F);
-				push_byte(buffer, 0x10);
-				push_byte(buffer, encode_postfix(mod, right, left));
-				push_displacement(mod, displacement, buffer);
+				u8 prefix = float_fix_register(result);
+				result = get_float_register_encoding(result);
+				push_vector_move(buffer, bc.type, prefix, false, false);
+				push_byte(buffer, encode_postfix(MOD_displacement_0, result, 5));
+				relocation.offset = buffer->count;
+				push_i32(buffer, 0);
 			}
 			else
-			{
-				prefix_type(buffer, bc.type, fix_registers(left, right));
+				relocation.offset = x64_emit_rip(buffer, x64_load_op(size), size, result);
 
-				u8 mov_opcode = get_r_rm_mov(buffer, bc.type);
-				push_generic_mov(mod, mov_opcode, left, right, displacement, buffer);
-			}
+			push_relocation(relocation, relocs, buffer_index);
+		} break;
+		case BC_LOAD_STACK:
+		{
+			Data_Segment seg = ir->allocated[bc.right_idx];
+			i32 displacement = seg.position + seg.size;
+			displacement = -displacement;
+			if(is_vector(*bc.type))
+				vector_stack_move(buffer, bc.type, (Register)bc.result, displacement, false);
+			else
+				x64_emit_rbp(buffer, x64_load_op(size), size, (Register)bc.result, displacement);
 		} break;
 		case BC_MOVE_REG_TO_REG:
 		{
-			if(is_float(*bc.type))
+			if(is_vector(*bc.type))
+			{
+				vector_move_reg_to_reg(buffer, (Register)bc.left_idx, (Register)bc.right_idx, size);
+			}
+			else if(is_float(*bc.type))
 			{
-				float_move_reg_to_reg(buffer, (Register)bc.left_idx, (Register)bc.right_idx, bc.type);
+				float_move_reg_to_reg(buffer, (Register)bc.left_idx, (Register)bc.right_idx, size);
 			}
 			else
 			{
 				if(bc.left_idx == bc.right_idx)
 					break;
 
-				Register left = (Register)bc.left_idx;
-				Register right = (Register)bc.right_idx;
-				move_reg_to_reg(buffer, left, right, bc.type);
+				move_reg_to_reg(buffer, (Register)bc.left_idx, (Register)bc.right_idx, size);
+				if(relocs->debug && bc.left_idx == reg_bp && bc.right_idx == reg_sp)
+					x64_push_frame_event(relocs->debug, buffer->count, FRAME_SET_BP);
 			}
 		} break;
 		case BC_PUSH_REG:
 		{
 			push_byte(buffer, 0x50 + bc.left_idx);
+			if(relocs->debug && bc.left_idx == reg_bp)
+				x64_push_frame_event(relocs->debug, buffer->count, FRAME_PUSHED_BP);
 		} break;
 		case BC_POP_REG:
 		{
@@ -1041,176 +1373,140 @@ x64_gen_from_bytecode(IR *ir, Bytecode bc, Code_Buffer *buffer, Relative_Relocat
 		} break;
 		case BC_RETURN:
 		{
-
-			// We add back the rsp
-			// that we have subtracted
-			Register operand = reg_sp;
-			prefix_type(buffer, x64_type_64, fix_register(operand));
-			u8 opcode = 0x81;
-			push_byte(buffer, opcode);
-
-			// /0 instruction
-			push_byte(buffer, encode_postfix(MOD_register, 0, operand));
-			push_i32(buffer, ir->stack_top);
-
-			if(bc.left_idx == -1)
-			{
-
-				// POP rbp
-				push_byte(buffer, 0x58 + reg_bp);
-				// RET
-				push_byte(buffer, 0xc3);
-			}
-			else
+			if(bc.left_idx != -1)
 			{
-				MOD mod = MOD_register;
 				i32 ret_register = bc.left_idx;
-				if(is_float(*bc.type))
+				if(is_vector(*bc.type))
+				{
+					vector_move_reg_to_reg(buffer, reg_xmm0, (Register)ret_register, size);
+				}
+				else if(is_float(*bc.type))
 				{
 					if(ret_register != reg_xmm0)
-					{
-						Register left = reg_xmm0;
-						Register right = (Register)ret_register;
-						float_move_reg_to_reg(buffer, left, right, bc.type);
-					}
+						float_move_reg_to_reg(buffer, reg_xmm0, (Register)ret_register, size);
 				}
 				else
 				{
 					if(ret_register != reg_a)
-					{
-						Register left = (Register)reg_a;
-						Register right = (Register)ret_register;
-						prefix_type(buffer, bc.type, fix_registers(left, right));
-
-						u8 mov_opcode = get_r_rm_mov(buffer, bc.type);
-						push_generic_mov(mod, mov_opcode, left, right, 0, buffer);
-					}
+						move_reg_to_reg(buffer, reg_a, (Register)ret_register, size);
 				}
-				// POP rbp
-				push_byte(buffer, 0x58 + reg_bp);
-				// RET
-				push_byte(buffer, 0xc3);
 			}
+			x64_leave_frame(ir, buffer, relocs);
+			// RET
+			push_byte(buffer, 0xc3);
+			x64_frame_returned(ir, buffer, relocs);
+		} break;
+		case BC_TAIL_CALL:
+		{
+			x64_leave_frame(ir, buffer, relocs);
+			// JMP rax
+			push_byte(buffer, 0xFF);
+			push_byte(buffer, encode_postfix(MOD_register, 4, reg_a));
+			x64_frame_returned(ir, buffer, relocs);
 		} break;
 		case BC_ADD_VALUE:
 		{
 			// This is use in special cases
 			// we usually don't do ops with values that aren't
-			// in registers
-			Register operand = (Register)bc.result;
-			prefix_type(buffer, bc.type, fix_register(operand));
-			u8 opcode = 0x81;
-			if(get_type_size(*bc.type) == 1)
-				opcode = 0x80;
-			push_byte(buffer, opcode);
-
-			// Make sure it's not bigger than 8 bytes
-			// since you can't directly add 8 bytes
-			Type_Info type = *bc.type;
-			Assert(is_integer(type));
-			if(type.primitive.size == byte8 || type.primitive.size == ubyte8)
-				type.primitive.size = ubyte4;
-			// /0 instruction
-			push_byte(buffer, encode_postfix(MOD_register, 0, operand));
-			push_any(buffer, &bc.big_idx, &type);
+			// in registers, a 64 bit add takes a sign extended imm32
+			Assert(is_integer(*bc.type));
+			x64_emit_immediate(buffer, X64_ADD_RM_IMM, size, (Register)bc.result, bc.big_idx);
 		} break;
 		case BC_SUB_VALUE:
 		{
-			// This is use in special cases
-			// we usually don't do ops with values that aren't
-			// in registers
-			Register operand = (Register)bc.result;
-			prefix_type(buffer, bc.type, fix_register(operand));
-			u8 opcode = 0x81;
-			if(get_type_size(*bc.type) == 1)
-				opcode = 0x80;
-			push_byte(buffer, opcode);
-
-			// Make sure it's not bigger than 8 bytes
-			// since you can't directly subtract 8 bytes
-			Type_Info type = *bc.type;
-			Assert(is_integer(type));
-			if(type.primitive.size == byte8 || type.primitive.size == ubyte8)
-				type.primitive.size = ubyte4;
-			// /5 instruction
-			push_byte(buffer, encode_postfix(MOD_register, 5, operand));
-			push_any(buffer, &bc.big_idx, &type);
+			// same as above
+			Assert(is_integer(*bc.type));
+			x64_emit_immediate(buffer, X64_SUB_RM_IMM, size, (Register)bc.result, bc.big_idx);
 		} break;
 		case BC_ADD:
 		{
-			encode_int_op(0x01, &bc, buffer, ir);
+			if(is_vector(*bc.type))
+				F_OP(X64_SSE_ADD) // paddd
+			else
+				encode_int_op(X64_ADD_RM_R, &bc, size, buffer);
 		} break;
 		case BC_F_ADD:
 		{
-			F_OP(0x58);
+			F_OP(X64_SSE_ADD);
 		} break;
 		case BC_SUB:
 		{
-			encode_int_op(0x29, &bc, buffer, ir);
+			if(is_vector(*bc.type))
+				F_OP(X64_SSE_SUB) // psubd
+			else
+				encode_int_op(X64_SUB_RM_R, &bc, size, buffer);
 		} break;
 		case BC_F_SUB:
 		{
-			F_OP(0x5C);
+			F_OP(X64_SSE_SUB);
 		} break;
+		// the one operand forms work on rax and rdx, the operand is in right
 		case BC_I_MUL:
 		{
-			bc.left_idx = bc.right_idx;
-			bc.right_idx = 5; // /5 instruction
-			encode_int_op(0xf7, &bc, buffer, ir);
+			x64_emit_rr(buffer, X64_IMUL_RM, size, reg_a, (Register)bc.right_idx);
 		} break;
 		case BC_U_MUL:
 		{
-			bc.left_idx = bc.right_idx;
-			bc.right_idx = 4; // /4 instruction
-			encode_int_op(0xf7, &bc, buffer, ir);
+			x64_emit_rr(buffer, X64_MUL_RM, size, reg_a, (Register)bc.right_idx);
 		} break;
 		case BC_F_MUL:
 		{
-			F_OP(0x59);
+			F_OP(X64_SSE_MUL);
 		} break;
 		case BC_U_DIV:
 		{
-			bc.left_idx = bc.right_idx;
-			bc.right_idx = 6; // /6 instruction
-			encode_int_op(0xf7, &bc, buffer, ir);
-
+			x64_emit_rr(buffer, X64_DIV_RM, size, reg_a, (Register)bc.right_idx);
 		} break;
 		case BC_I_DIV:
 		{
-			bc.left_idx = bc.right_idx;
-			bc.right_idx = 7; // /7 instruction
-			encode_int_op(0xf7, &bc, buffer, ir);
+			x64_emit_rr(buffer, X64_IDIV_RM, size, reg_a, (Register)bc.right_idx);
 		} break;
 		case BC_F_DIV:
 		{
-			F_OP(0x5E);
+			F_OP(X64_SSE_DIV);
 		} break;
 		case BC_BIT_XOR:
 		{
-			encode_int_op(0x33, &bc, buffer, ir);
+			if(is_vector(*bc.type))
+				F_OP(X64_SSE_XOR) // xorps, pxor
+			else
+				encode_int_op(X64_XOR_R_RM, &bc, size, buffer);
+		} break;
+		case BC_BIT_AND:
+		{
+			Assert(is_vector(*bc.type));
+			F_OP(X64_SSE_AND); // andps, pand
+		} break;
+		case BC_BIT_OR:
+		{
+			Assert(is_vector(*bc.type));
+			F_OP(X64_SSE_OR); // orps, por
 		} break;
 		case BC_LOAD_STRING:
 		{
-			prefix64(buffer);
+			Register rip = reg_bp;
+			Register result = (Register)bc.result;
+			push_byte(buffer, REX_W | fix_registers(rip, result));
 			push_byte(buffer, 0x8d);
-			push_byte(buffer, encode_postfix(MOD_displacement_0, bc.result, 5));
+			push_byte(buffer, encode_postfix(MOD_displacement_0, result, 5));
 			Relocation relocation = {};
 			relocation.type = IMAGE_REL_AMD64_REL32;
-			relocation.symbol_index = get_and_maybe_push_string((u8 *)bc.big_idx);
+			relocation.symbol_index = push_string(relocs, (u8 *)bc.big_idx);
 			relocation.offset = buffer->count;
 			push_i32(buffer, 0);
 
-			push_relocation(relocation, relocs, buffer_index);
+			push_literal_relocation(relocation, LITERAL_STRING, relocs, buffer_index);
 		} break;
 		case BC_OFFSET_POINTER:
 		{
-			bc.type = x64_type_64;
-			encode_int_op(0x01, &bc, buffer, ir);
+			encode_int_op(X64_ADD_RM_R, &bc, X64_SIZE_64, buffer);
 		} break;
 		case BC_LOAD_ADDRESS:
 		{
 			Assert(bc.type->type == T_POINTER || bc.type->type == T_STRUCT || bc.type->type == T_INTEGER);
-			prefix64(buffer);
+			Register base = reg_bp;
+			Register result = (Register)bc.result;
+			push_byte(buffer, REX_W | fix_registers(base, result));
 			push_byte(buffer, 0x8d);
 			Data_Segment seg = ir->allocated[bc.right_idx];
 			i32 displacement = seg.position + seg.size;
@@ -1218,49 +1514,71 @@ x64_gen_from_bytecode(IR *ir, Bytecode bc, Code_Buffer *buffer, Relative_Relocat
 			MOD mod = MOD_displacement_i32;
 			if(displacement > -129 && displacement < 128 )
 				mod = MOD_displacement_i8;
-			u8 postfix = encode_postfix(mod, bc.result, reg_bp);
+			u8 postfix = encode_postfix(mod, result, base);
 			push_byte(buffer, postfix);
 			push_displacement(mod, displacement, buffer);
 		} break;
 		case BC_STORE_REG:
 		{
-			if(is_float(*bc.type))
+			Register address = (Register)bc.left_idx;
+			Register value = (Register)bc.right_idx;
+			if(is_vector(*bc.type))
 			{
-				Register value = get_float_register_encoding((Register)bc.right_idx);
-				prefix_float_op(buffer, bc.type);
-				set_2byte_opcode(buffer);
-				push_byte(buffer, 0x11);
-				push_byte(buffer, encode_postfix(MOD_displacement_0, value, bc.left_idx));
+				vector_pointer_move(buffer, bc.type, value, address, true);
+			}
+			else
+			{
+				// only the value's size is written, vector lanes are stored next to each other,
+				// anything that isn't a scalar goes as a whole register
+				if(size == X64_SIZE_NONE)
+					size = X64_SIZE_64;
+				x64_emit_address(buffer, x64_store_op(size), size, value, address);
+			}
+		} break;
+		case BC_COPY_MEMORY:
+		{
+			Register dst = (Register)bc.left_idx;
+			Register src = (Register)bc.right_idx;
+			Register scratch = (Register)bc.result;
+			i32 size = get_type_size(*bc.type);
+			i32 offset = 0;
+			for(; offset + 8 <= size; offset += 8)
+				push_copy_chunk(buffer, dst, src, scratch, offset, 8);
+			if(offset < size && size >= 8)
+			{
+				// the last 8 bytes overlap the previous chunk instead of being split up
+				push_copy_chunk(buffer, dst, src, scratch, size - 8, 8);
 			}
 			else
 			{
-				MOD mod = MOD_displacement_0;
-				prefix64(buffer);
-				push_byte(buffer, 0x89); // MOV_RM_R
-							 // WHY ARE THEY THE OTHER WAY AROUND WHYYYY
-				u8 postfix = encode_postfix(mod, bc.right_idx, bc.left_idx);
-				push_byte(buffer, postfix);
+				for(i32 chunk = 4; chunk >= 1; chunk /= 2)
+				{
+					if(offset + chunk <= size)
+					{
+						push_copy_chunk(buffer, dst, src, scratch, offset, chunk);
+						offset += chunk;
+					}
+				}
 			}
 		} break;
 		case BC_DEREFRENCE:
 		{
-			if(is_float(*bc.type))
+			Register address = (Register)bc.left_idx;
+			Register result = (Register)bc.result;
+			if(is_vector(*bc.type))
 			{
-				Register result = (Register)bc.result;
-				prefix_float_op(buffer, bc.type->type == T_POINTER ? bc.type->pointer.type : bc.type);
-				float_fix_register(result);
-				result = get_float_register_encoding(result);
-				set_2byte_opcode(buffer);
-				push_byte(buffer, 0x10); // movss
-				push_byte(buffer, encode_postfix(MOD_displacement_0, result, bc.left_idx));
+				vector_pointer_move(buffer, bc.type, result, address, false);
+			}
+			else if(is_float(*bc.type))
+			{
+				if(bc.type->type == T_POINTER)
+					size = x64_size_class(bc.type->pointer.type);
+				x64_emit_address(buffer, X64_SSE_MOV_R_RM, size, result, address);
 			}
 			else
 			{
-				MOD mod = MOD_displacement_0;
-				prefix64(buffer);
-				push_byte(buffer, 0x8b); // MOV_R_RM
-				u8 postfix = encode_postfix(mod, bc.result, bc.left_idx);
-				push_byte(buffer, postfix);
+				// the whole register is loaded, the value's users only look at its size
+				x64_emit_address(buffer, X64_MOV_R_RM, X64_SIZE_64, result, address);
 			}
 		} break;
 		case BC_CALL:
@@ -1279,21 +1597,52 @@ x64_gen_from_bytecode(IR *ir, Bytecode bc, Code_Buffer *buffer, Relative_Relocat
 			fixable.type = FIX_JMP_TO_BLOCK;
 			fixable.offset = buffer->count;
 			fixable.block = (IR_Block *)bc.big_idx;
-			fixable_array->fixables[fixable_array->count++] = fixable;
+			fixable.condition = 0;
+			push_fixable(fixable_array, fixable);
 			push_i32(buffer, 0);
 		} break;
-		case BC_COND_JUMP:
+		case BC_JUMP_TABLE:
 		{
-			push_compare_valuei8(buffer, &bc, (Register)bc.result, 0);
-			set_2byte_opcode(buffer);
-			push_byte(buffer, 0x85); // jne
+			Register index = (Register)bc.left_idx;
+			Register scratch = (Register)bc.result;
+			u8 index_bits = index & 7;
+			u8 scratch_bits = scratch & 7;
+			b32 index_high = index >= reg_r8;
+			b32 scratch_high = scratch >= reg_r8;
+
+			// lea scratch, [rip + table]
+			push_byte(buffer, REX_W | (scratch_high ? REX_R : 0));
+			push_byte(buffer, 0x8D);
+			push_byte(buffer, encode_postfix(MOD_displacement_0, scratch_bits, 0b101));
 			Fixable fixable;
 			fixable.buffer_index = buffer_index;
-			fixable.type = FIX_JMP_TO_BLOCK;
+			fixable.type = FIX_JUMP_TABLE;
 			fixable.offset = buffer->count;
-			fixable.block = (IR_Block *)bc.big_idx;
-			fixable_array->fixables[fixable_array->count++] = fixable;
+			fixable.block = NULL;
+			fixable.condition = 0;
+			fixable.jump_table = bc.right_idx;
+			push_fixable(fixable_array, fixable);
 			push_i32(buffer, 0);
+
+			// lea scratch, [scratch + index * 8], rbp and r13 as a base need a displacement
+			MOD mod = scratch_bits == reg_bp ? MOD_displacement_i8 : MOD_displacement_0;
+			push_byte(buffer, REX_W | (scratch_high ? REX_R | REX_B : 0) | (index_high ? REX_X : 0));
+			push_byte(buffer, 0x8D);
+			push_byte(buffer, encode_postfix(mod, scratch_bits, 0b100));
+			push_byte(buffer, encode_postfix(MOD_register, index_bits, scratch_bits)); // SIB, scale 8
+			if(mod == MOD_displacement_i8)
+				push_byte(buffer, 0);
+
+			// jmp scratch
+			if(scratch_high)
+				push_byte(buffer, REX_B);
+			push_byte(buffer, 0xFF);
+			push_byte(buffer, encode_postfix(MOD_register, 4, scratch_bits));
+		} break;
+		case BC_COND_JUMP:
+		{
+			// emitted by x64_gen_ir, the flags form is fused with its compare
+			Assert(false);
 		} break;
 		case BC_CMP_LOGICAL_AND:
 		{
@@ -1307,7 +1656,7 @@ x64_gen_from_bytecode(IR *ir, Bytecode bc, Code_Buffer *buffer, Relative_Relocat
 
 			// when result is false
 			i32 false_position = buffer->count;
-			move_value_to_register((Register)bc.result, 0, bool_type, buffer);
+			move_value_to_register((Register)bc.result, 0, X64_SIZE_8, buffer);
 			// jump to the end
 			push_byte(buffer, 0xEB); // jmp
 			i32 insert_end_false = buffer->count; // jump to the end is put here after everything
@@ -1315,7 +1664,7 @@ x64_gen_from_bytecode(IR *ir, Bytecode bc, Code_Buffer *buffer, Relative_Relocat
 
 			// when result is true
 			i32 true_position = buffer->count;
-			move_value_to_register((Register)bc.result, 1, bool_type, buffer);
+			move_value_to_register((Register)bc.result, 1, X64_SIZE_8, buffer);
 			// jump to the end
 			push_byte(buffer, 0xEB); // jmp
 			i32 insert_end_true = buffer->count; // jump to the end is put here after everything
@@ -1349,7 +1698,7 @@ x64_gen_from_bytecode(IR *ir, Bytecode bc, Code_Buffer *buffer, Relative_Relocat
 			// same as above except it falls down to false
 
 			// when result is false
-			move_value_to_register((Register)bc.result, 0, bool_type, buffer);
+			move_value_to_register((Register)bc.result, 0, X64_SIZE_8, buffer);
 			// jump to the end
 			push_byte(buffer, 0xEB); // jmp
 			i32 insert_end_false = buffer->count; // jump to the end is put here after everything
@@ -1358,98 +1707,43 @@ x64_gen_from_bytecode(IR *ir, Bytecode bc, Code_Buffer *buffer, Relative_Relocat
 			// when result is true
 			buffer->buffer[true_insert] = calculate_jump_offset(true_insert, buffer->count);
 			buffer->buffer[true_insert_right] = calculate_jump_offset(true_insert, buffer->count);
-			move_value_to_register((Register)bc.result, 1, bool_type, buffer);
+			move_value_to_register((Register)bc.result, 1, X64_SIZE_8, buffer);
 
 			// END
 			buffer->buffer[insert_end_false] = calculate_jump_offset(insert_end_false, buffer->count - 1);
 		} break;
 		case BC_CMP_I_EQ:
-		{
-			push_cmp_op(buffer, &bc, 0x94);
-		} break;
-		case BC_FCMP_EQ:
-		{
-			push_fcmp_op(buffer, &bc, 0x94);
-		} break;
 		case BC_CMP_I_NEQ:
-		{
-			push_cmp_op(buffer, &bc, 0x95);
-
-		} break;
-		case BC_FCMP_NEQ:
-		{
-			// @TODO: check parity flag
-			push_fcmp_op(buffer, &bc, 0x95);
-		} break;
-		case BC_CMP_I_GREATER_EQ:
-		{
-			push_cmp_op(buffer, &bc, 0x9D); // set if >= (signed)
-		} break;
-		case BC_CMP_U_GREATER_EQ:
-		{
-			push_cmp_op(buffer, &bc, 0x93); // set if >= (unsigend)
-		} break;
-		case BC_FCMP_GREATER_EQ:
-		{
-			push_fcmp_op(buffer, &bc, 0x93);
-		} break;
+		case BC_CMP_I_LESS_THAN:
 		case BC_CMP_I_GREATER_THAN:
-		{
-			push_cmp_op(buffer, &bc, 0x9F); // set if > (signed)
-		} break;
-		case BC_CMP_U_GREATER_THAN:
-		{
-			push_cmp_op(buffer, &bc, 0x97); // set if > (unsigned)
-		} break;
-		case BC_FCMP_GREATER_THAN:
-		{
-			push_fcmp_op(buffer, &bc, 0x97);
-		} break;
 		case BC_CMP_I_LESS_EQ:
-		{
-			push_cmp_op(buffer, &bc, 0x9E);
-		} break;
-		case BC_CMP_U_LESS_EQ:
-		{
-			push_cmp_op(buffer, &bc, 0x96);
-		} break;
-		case BC_FCMP_LESS_EQ:
-		{
-			push_fcmp_op(buffer, &bc, 0x96);
-		} break;
-		case BC_CMP_I_LESS_THAN:
-		{
-			push_cmp_op(buffer, &bc, 0x9C);
-		} break;
+		case BC_CMP_I_GREATER_EQ:
 		case BC_CMP_U_LESS_THAN:
+		case BC_CMP_U_GREATER_THAN:
+		case BC_CMP_U_LESS_EQ:
+		case BC_CMP_U_GREATER_EQ:
 		{
-			push_cmp_op(buffer, &bc, 0x92);
+			push_cmp_op(buffer, &bc, size, 0x90 | x64_condition_code(bc.op));
 		} break;
+		case BC_FCMP_EQ:
+		case BC_FCMP_NEQ:
 		case BC_FCMP_LESS_THAN:
+		case BC_FCMP_GREATER_THAN:
+		case BC_FCMP_LESS_EQ:
+		case BC_FCMP_GREATER_EQ:
 		{
-			push_fcmp_op(buffer, &bc, 0x92);
+			push_fcmp_op(buffer, &bc, size, 0x90 | x64_condition_code(bc.op));
 		} break;
 		case BC_LOGICAL_NOT:
 		{
 			Assert(bc.type->type == T_BOOLEAN);
 
 			push_compare_valuei8(buffer, &bc, (Register)bc.left_idx, 0);
-			set_2byte_opcode(buffer);
-			push_byte(buffer, 0x95); // set if !=
-			push_byte(buffer, encode_postfix(MOD_register, 0, bc.result));
+			push_setcc(buffer, 0x95, (Register)bc.result); // set if !=
 		} break;
 		case BC_NEG:
 		{
-			Register operand = (Register)bc.left_idx;
-			prefix_type(buffer, bc.type, fix_register(operand));
-			u8 opcode;
-			if(get_type_size(*bc.type) == 1)
-				opcode = 0xF6;
-			else
-				opcode = 0xF7;
-			bc.left_idx = operand;
-			bc.right_idx = 3; // /3 instruction
-			encode_int_op(opcode, &bc, buffer, ir);
+			x64_emit_rr(buffer, X64_NEG_RM, size, reg_a, (Register)bc.left_idx);
 		} break;
 		case BC_FNEG:
 		{
@@ -1457,31 +1751,20 @@ x64_gen_from_bytecode(IR *ir, Bytecode bc, Code_Buffer *buffer, Relative_Relocat
 			// since there are neither negation neither xor instruction for scalars
 			// this the only way to do it without touching other registers which would complicate things
 			// so we don't do it
-			Register reg = (Register)bc.left_idx;
-			prefix_float_op(buffer, bc.type);
-			u8 prefix = float_fix_register(reg);
-			reg = get_float_register_encoding(reg);
-			if(prefix != 0)
-				push_byte(buffer, prefix);
-			push_byte(buffer, 0x0F);
-			push_byte(buffer, 0x59);
-			push_byte(buffer, encode_postfix(MOD_displacement_0, reg, 0b101));
-
 			Relocation relocation = {};
 			relocation.type = IMAGE_REL_AMD64_REL32;
 			if(bc.type->primitive.size == real64)
 			{
 				double the_val = -1.0;
-				relocation.symbol_index = push_float(*(u64 *)&the_val, bc.type->primitive.size);
+				relocation.symbol_index = push_float(relocs, *(u64 *)&the_val, bc.type->primitive.size);
 			}
 			else
 			{
 				float the_val = -1.0;
-				relocation.symbol_index = push_float(*(u32 *)&the_val, bc.type->primitive.size);
+				relocation.symbol_index = push_float(relocs, *(u32 *)&the_val, bc.type->primitive.size);
 			}
-			relocation.offset = buffer->count;
-			push_relocation(relocation, relocs, buffer_index);
-			push_i32(buffer, 0);
+			relocation.offset = x64_emit_rip(buffer, X64_SSE_MUL, size, (Register)bc.left_idx);
+			push_literal_relocation(relocation, LITERAL_CONSTANT, relocs, buffer_index);
 		} break;
 		// In the right register
 		// we store the offset between
@@ -1495,11 +1778,26 @@ x64_gen_from_bytecode(IR *ir, Bytecode bc, Code_Buffer *buffer, Relative_Relocat
 		case BC_CAST_ZEXT:
 		{
 			Type_Info *src_type = (Type_Info *)((u8 *)bc.type + bc.right_idx);
-			Type_Info *dst_type = bc.type;
 			Register left = (Register)bc.left_idx;
 			Register result = (Register)bc.result;
-			move_reg_to_reg(buffer, left, left, src_type);
-			move_reg_to_reg(buffer, result, left, dst_type);
+			auto src_size = get_type_size(*src_type);
+			if(src_size == 1 || src_size == 2)
+			{
+				// movzx, the REX byte also makes sil and dil reachable as bytes
+				push_byte(buffer, REX_W | fix_registers(left, result));
+				set_2byte_opcode(buffer);
+				push_byte(buffer, src_size == 1 ? 0xB6 : 0xB7);
+				push_byte(buffer, encode_postfix(MOD_register, result, left));
+			}
+			else
+			{
+				// writing the 32 bit register clears the upper half
+				u8 prefix = fix_registers(left, result);
+				if(prefix != 0)
+					push_byte(buffer, prefix);
+				push_byte(buffer, 0x8B);
+				push_byte(buffer, encode_postfix(MOD_register, result, left));
+			}
 		} break;
 		case BC_CAST_SEXT:
 		{
@@ -1524,7 +1822,7 @@ x64_gen_from_bytecode(IR *ir, Bytecode bc, Code_Buffer *buffer, Relative_Relocat
 		{
 			Register left = (Register)bc.left_idx;
 			Register result = (Register)bc.result;
-			move_reg_to_reg(buffer, result, left, bc.type);
+			move_reg_to_reg(buffer, result, left, size);
 		} break;
 		case BC_CAST_D_TO_I:
 		case BC_CAST_F_TO_I:
@@ -1560,11 +1858,11 @@ x64_gen_from_bytecode(IR *ir, Bytecode bc, Code_Buffer *buffer, Relative_Relocat
 				Relocation relocation = {};
 				relocation.type = IMAGE_REL_AMD64_REL32;
 				if(bc.op == BC_CAST_F_TO_I)
-					relocation.symbol_index = push_float(0x5F000000, real32);
+					relocation.symbol_index = push_float(relocs, 0x5F000000, real32);
 				else
-					relocation.symbol_index = push_float(0x43e0000000000000, real64);
+					relocation.symbol_index = push_float(relocs, 0x43e0000000000000, real64);
 				relocation.offset = buffer->count;
-				push_relocation(relocation, relocs, buffer_index);
+				push_literal_relocation(relocation, LITERAL_CONSTANT, relocs, buffer_index);
 				push_i32(buffer, 0);
 
 				// jump if not bellow
@@ -1590,7 +1888,7 @@ x64_gen_from_bytecode(IR *ir, Bytecode bc, Code_Buffer *buffer, Relative_Relocat
 				// Different relocation but has the same params
 				// so we reuse the variable
 				relocation.offset = buffer->count;
-				push_relocation(relocation, relocs, buffer_index);
+				push_literal_relocation(relocation, LITERAL_CONSTANT, relocs, buffer_index);
 				push_i32(buffer, 0);
 				// convert to signed
 				prefix_float_op(buffer, src_type);
@@ -1604,9 +1902,9 @@ x64_gen_from_bytecode(IR *ir, Bytecode bc, Code_Buffer *buffer, Relative_Relocat
 				push_byte(buffer, encode_postfix(MOD_displacement_0, right, 0b101));
 				Relocation int_bit_flip_reloc = {};
 				int_bit_flip_reloc.type = IMAGE_REL_AMD64_REL32;
-				int_bit_flip_reloc.symbol_index = push_int(0x8000000000000000, byte8);
+				int_bit_flip_reloc.symbol_index = push_int(relocs, 0x8000000000000000, byte8);
 				int_bit_flip_reloc.offset = buffer->count;
-				push_relocation(int_bit_flip_reloc, relocs, buffer_index);
+				push_literal_relocation(int_bit_flip_reloc, LITERAL_CONSTANT, relocs, buffer_index);
 				push_i32(buffer, 0);
 
 				buffer->buffer[insert_end] = calculate_jump_offset(insert_end, buffer->count);
@@ -4,35 +4,100 @@
 #include <Bytecode.h>
 #include <ObjDumper.h>
 
+// @NOTE: every buffer is only written by the job generating its function,
+// it starts at an estimate and grows when the code doesn't fit
 typedef struct _Code_Buffer {
 	u8 *buffer;
 	unsigned int count;
+	unsigned int capacity;
 } Code_Buffer;
 
+enum Literal_Kind {
+	LITERAL_NONE,     // the relocation already points at a symbol
+	LITERAL_CONSTANT,
+	LITERAL_STRING,
+};
+
 struct Relative_Relocation {
 	Relocation actual_relocation;
 	int buffer_index;
+	// @NOTE: for literals symbol_index is the index in the function's pool
+	// until x64_merge_literals gives the literal its rodata symbol
+	Literal_Kind literal;
+};
+
+// @NOTE: stored as bytes, size is the size of the constant not the padding
+struct Literal_Key {
+	u64 value;
+	u64 size;
+};
+
+// The rodata a single function references, the maps keep their insertion order
+// so an index into them stays valid. Only the job generating the function touches it
+struct Literal_Pool {
+	struct { Literal_Key key; Var_Size value; } *constants;
+	struct { char *key; i32 value; } *strings;
+};
+
+// A line table row, the code from offset up to the next row is at line and column
+struct Code_Line {
+	u32 offset;
+	u32 line;
+	u32 column;
+};
+
+// How the frame changes right after the instruction ending at offset
+enum Frame_Event_Kind {
+	FRAME_PUSHED_BP, // push rbp
+	FRAME_SET_BP,    // mov rbp, rsp
+	FRAME_LEFT,      // pop rbp of an epilogue, the return address is on top
+	FRAME_RETURNED,  // the ret or jmp after it, the code after has the frame again
+};
+
+struct Frame_Event {
+	u32 offset;
+	Frame_Event_Kind kind;
+};
+
+// @NOTE: only made when debug info is generated, the offsets are from the
+// start of the function and move with the code when jumps are relaxed
+struct Debug_Rows {
+	Code_Line *lines;
+	u32 line_count;
+	u32 line_capacity;
+	Frame_Event *frames;
+	u32 frame_count;
+	u32 frame_capacity;
 };
 
 struct Relative_Relocation_Array {
 	Relative_Relocation *relocs;
 	unsigned int count;
+	unsigned int capacity;
+	Literal_Pool literals;
+	Debug_Rows *debug;
 };
 
 enum Fixable_Type {
-	FIX_JMP_TO_BLOCK,
+	FIX_JMP_TO_BLOCK, // e9 rel32
+	FIX_JCC_TO_BLOCK, // 0f 8x rel32
+	FIX_JUMP_TABLE,   // lea reg, [rip + rel32] of a jump table put after the function
 };
 
+// @NOTE: offset points at the rel32 displacement, the opcode bytes are before it
 struct Fixable {
 	Fixable_Type type;
 	unsigned int buffer_index;
 	unsigned int offset;
 	IR_Block *block;
+	u8 condition;
+	i32 jump_table;
 };
 
 struct Fixable_Array {
 	Fixable *fixables;
 	unsigned int count;
+	unsigned int capacity;
 };
 
 enum MOD {
@@ -69,11 +134,63 @@ enum CMP_OP {
 Code_Buffer
 x64_generate_code(File_Contents **files, IR **ir, Relocation **out_relocations, u32 *out_relocation_count);
 
+void
+x64_initialize_types();
+
+Symbol_Descriptor *
+x64_get_symbols();
+
+// @NOTE: generates a single function for in process use,
+// relocations are relative to the start of the returned buffer
+size_t
+x64_code_size_estimate(IR *ir);
+
+Code_Buffer
+x64_generate_function(IR *ir, Relocation **out_relocations, u32 *out_relocation_count);
+
+Code_Buffer
+make_code_buffer(u32 capacity);
+
+// Makes room for at least needed more bytes, doubling so pushes stay amortized constant
+void
+grow_code_buffer(Code_Buffer *buffer, u32 needed);
+
+// Copies the functions [start, end) to their offset in the program and moves their
+// relocations to the final array, the ranges don't overlap so they run as jobs
+void
+x64_place_functions(Code_Buffer *buffers, Relative_Relocation_Array *relocs, u32 *code_offsets, u32 *relocation_offsets,
+		Code_Buffer *program, Relocation *out_relocations, int start, int end);
+
+// Gives every distinct literal of the pools one rodata symbol, assigns their
+// positions and points the relocations at them. Runs after the jobs are done
+void
+x64_merge_literals(Relative_Relocation_Array *relocs, int count);
+
 void
 x64_gen_ir(IR *ir, Code_Buffer *buffer, Relative_Relocation_Array *relocs, Data_Segment *global_ds, int buffer_idx, Fixable_Array *fixables);
 
+// Picks the rel8 form for block jumps that reach, drops jumps to the next
+// instruction and writes every displacement. Block start addresses, relocation
+// offsets and the jump table fixables left in the array are moved to the compacted code
+void
+x64_relax_jumps(IR *ir, Code_Buffer *buffer, Relative_Relocation_Array *relocs, Fixable_Array *fixables);
+
+// Writes the function's jump tables after its code, one padded jmp rel32 per entry
+void
+x64_emit_jump_tables(IR *ir, Code_Buffer *buffer, Fixable_Array *fixables);
+
 void
 x64_gen_from_bytecode(IR *ir, Bytecode bc, Code_Buffer *buffer, Relative_Relocation_Array *relocs, Data_Segment *global_ds, int buffer_index, Fixable_Array *fixables);
 
+u8
+x64_condition_code(BC_OP op);
+
+// jcc rel32 to the start of a block, condition is the low nibble of the opcode
+void
+push_jcc_to_block(Code_Buffer *buffer, u8 condition, IR_Block *block, int buffer_index, Fixable_Array *fixable_array);
+
+void
+push_compare_valuei8(Code_Buffer *buffer, Bytecode *bc, Register reg, u8 value);
+
 #endif
 
@@ -0,0 +1,521 @@
+#include <x64_Linker.h>
+#include <x64_Dwarf.h>
+#include <platform/platform.h>
+
+// @NOTE: a non PIE executable, every segment starts on its own page
+// so a file offset is also the offset from the base address
+#define LINK_BASE_ADDRESS 0x400000
+#define LINK_PAGE_SIZE    0x1000
+#define LINK_START_SIZE   48
+#define IMPORT_STUB_SIZE  8
+
+static const char *link_interpreter = "/lib64/ld-linux-x86-64.so.2";
+static const char *link_libc = "libc.so.6";
+
+const int ELF_ET_EXEC      = 2;
+const int ELF_PT_LOAD      = 1;
+const int ELF_PT_DYNAMIC   = 2;
+const int ELF_PT_INTERP    = 3;
+const int ELF_PT_GNU_STACK = 0x6474E551;
+const int ELF_PF_X = 0x1;
+const int ELF_PF_W = 0x2;
+const int ELF_PF_R = 0x4;
+const int ELF_DT_NULL     = 0;
+const int ELF_DT_NEEDED   = 1;
+const int ELF_DT_HASH     = 4;
+const int ELF_DT_STRTAB   = 5;
+const int ELF_DT_SYMTAB   = 6;
+const int ELF_DT_RELA     = 7;
+const int ELF_DT_RELASZ   = 8;
+const int ELF_DT_RELAENT  = 9;
+const int ELF_DT_STRSZ    = 10;
+const int ELF_DT_SYMENT   = 11;
+const int ELF_DT_DEBUG    = 21;
+const int ELF_DT_BIND_NOW = 24;
+const int ELF_R_X86_64_GLOB_DAT = 6;
+
+// @NOTE: only written with debug info, the loader doesn't look at sections
+enum Link_Section {
+	LINK_SEC_NULL,
+	LINK_SEC_TEXT,
+	LINK_SEC_SYMTAB,
+	LINK_SEC_STRTAB,
+	LINK_SEC_DEBUG, // one for every Dwarf_Section_Kind
+	LINK_SEC_SHSTRTAB = LINK_SEC_DEBUG + DWARF_SECTION_COUNT,
+	LINK_SEC_COUNT
+};
+
+enum Link_Program_Header {
+	LINK_PH_INTERP, // has to come before the loaded segments
+	LINK_PH_READ,
+	LINK_PH_CODE,
+	LINK_PH_DATA,
+	LINK_PH_DYNAMIC,
+	LINK_PH_STACK,
+	LINK_PH_COUNT
+};
+
+// xor ebp, ebp
+// mov rdi, [rsp]               ; argc
+// lea rsi, [rsp + 8]           ; argv
+// lea rdx, [rsi + rdi * 8 + 8] ; envp
+// and rsp, -16
+// call main
+// mov edi, eax
+// call exit
+// hlt
+static const u8 link_start_code[] = {
+	0x31, 0xED,
+	0x48, 0x8B, 0x3C, 0x24,
+	0x48, 0x8D, 0x74, 0x24, 0x08,
+	0x48, 0x8D, 0x54, 0xFE, 0x08,
+	0x48, 0x83, 0xE4, 0xF0,
+	0xE8, 0x00, 0x00, 0x00, 0x00,
+	0x89, 0xC7,
+	0xE8, 0x00, 0x00, 0x00, 0x00,
+	0xF4,
+};
+#define LINK_START_CALL_MAIN 21
+#define LINK_START_CALL_EXIT 28
+
+static inline void
+link_write_rel32(u8 *at, u64 from_address, u64 to_address)
+{
+	// the displacement is from the end of the 4 byte field
+	i32 displacement = (i32)((i64)to_address - (i64)(from_address + 4));
+	memcpy(at, &displacement, sizeof(i32));
+}
+
+// The loaded file followed by a .symtab naming the functions and the DWARF
+// sections, none of them are loaded so they go after everything else
+static b32
+link_write_with_debug_info(u8 *file, u64 file_size, X64_Debug_Info *debug, u64 text_offset, u64 text_end, u64 code_offset,
+		const char *out_path)
+{
+	u64 text_address = LINK_BASE_ADDRESS + text_offset;
+	u64 code_address = LINK_BASE_ADDRESS + code_offset;
+
+	String_Table strtab = {};
+	strtab.strings = SDCreate(u8 *);
+	strtab.size = 1;
+	String_Table shstrtab = {};
+	shstrtab.strings = SDCreate(u8 *);
+	shstrtab.size = 1;
+
+	// the null symbol, then _start as the only local
+	u32 symbol_count = debug->function_count + 2;
+	Elf_Symbol *symbols = (Elf_Symbol *)AllocateCompileMemory(symbol_count * sizeof(Elf_Symbol));
+	symbols[1].name = elf_put_string(&strtab, (u8 *)"_start");
+	symbols[1].info = (ELF_STB_LOCAL << 4) | ELF_STT_FUNC;
+	symbols[1].section_index = LINK_SEC_TEXT;
+	symbols[1].value = text_address;
+	symbols[1].size = sizeof(link_start_code);
+	for(u32 i = 0; i < debug->function_count; ++i)
+	{
+		Debug_Function *function = &debug->functions[i];
+		Elf_Symbol *sym = &symbols[i + 2];
+		sym->name = elf_put_string(&strtab, function->name);
+		sym->info = (ELF_STB_GLOBAL << 4) | ELF_STT_FUNC;
+		sym->section_index = LINK_SEC_TEXT;
+		sym->value = code_address + function->start;
+		sym->size = function->size;
+	}
+	u8 *strings = (u8 *)AllocateCompileMemory(strtab.size);
+	elf_write_string_table(strings, &strtab);
+
+	Elf_Section_Header sections[LINK_SEC_COUNT] = {};
+	void *contents[LINK_SEC_COUNT] = {};
+
+	sections[LINK_SEC_TEXT].name      = elf_put_string(&shstrtab, (u8 *)".text");
+	sections[LINK_SEC_TEXT].type      = ELF_SHT_PROGBITS;
+	sections[LINK_SEC_TEXT].flags     = ELF_SHF_ALLOC | ELF_SHF_EXECINSTR;
+	sections[LINK_SEC_TEXT].address   = text_address;
+	sections[LINK_SEC_TEXT].offset    = text_offset;
+	sections[LINK_SEC_TEXT].size      = text_end - text_offset;
+	sections[LINK_SEC_TEXT].alignment = 16;
+
+	sections[LINK_SEC_SYMTAB].name       = elf_put_string(&shstrtab, (u8 *)".symtab");
+	sections[LINK_SEC_SYMTAB].type       = ELF_SHT_SYMTAB;
+	sections[LINK_SEC_SYMTAB].size       = symbol_count * sizeof(Elf_Symbol);
+	sections[LINK_SEC_SYMTAB].link       = LINK_SEC_STRTAB;
+	sections[LINK_SEC_SYMTAB].info       = 2;
+	sections[LINK_SEC_SYMTAB].alignment  = 8;
+	sections[LINK_SEC_SYMTAB].entry_size = sizeof(Elf_Symbol);
+	contents[LINK_SEC_SYMTAB] = symbols;
+
+	sections[LINK_SEC_STRTAB].name      = elf_put_string(&shstrtab, (u8 *)".strtab");
+	sections[LINK_SEC_STRTAB].type      = ELF_SHT_STRTAB;
+	sections[LINK_SEC_STRTAB].size      = strtab.size;
+	sections[LINK_SEC_STRTAB].alignment = 1;
+	contents[LINK_SEC_STRTAB] = strings;
+
+	// there's one unit so offsets between the debug sections are already
+	// right, only the code addresses are moved to where the code is loaded
+	for(int i = 0; i < DWARF_SECTION_COUNT; ++i)
+	{
+		Dwarf_Section *dwarf = &debug->sections[i];
+		u8 *bytes = (u8 *)AllocateCompileMemory(dwarf->bytes.count + 1);
+		memcpy(bytes, dwarf->bytes.buffer, dwarf->bytes.count);
+		for(u32 j = 0; j < dwarf->fixup_count; ++j)
+		{
+			if(dwarf->fixups[j].target != DWARF_TEXT)
+				continue;
+			u64 address;
+			memcpy(&address, bytes + dwarf->fixups[j].offset, sizeof(u64));
+			address += code_address;
+			memcpy(bytes + dwarf->fixups[j].offset, &address, sizeof(u64));
+		}
+
+		Elf_Section_Header *section = &sections[LINK_SEC_DEBUG + i];
+		section->name      = elf_put_string(&shstrtab, (u8 *)dwarf_section_name((Dwarf_Section_Kind)i));
+		section->type      = ELF_SHT_PROGBITS;
+		section->size      = dwarf->bytes.count;
+		section->alignment = 1;
+		contents[LINK_SEC_DEBUG + i] = bytes;
+	}
+
+	sections[LINK_SEC_SHSTRTAB].name      = elf_put_string(&shstrtab, (u8 *)".shstrtab");
+	sections[LINK_SEC_SHSTRTAB].type      = ELF_SHT_STRTAB;
+	sections[LINK_SEC_SHSTRTAB].size      = shstrtab.size;
+	sections[LINK_SEC_SHSTRTAB].alignment = 1;
+	u8 *section_names = (u8 *)AllocateCompileMemory(shstrtab.size);
+	elf_write_string_table(section_names, &shstrtab);
+	contents[LINK_SEC_SHSTRTAB] = section_names;
+
+	u64 offset = file_size;
+	for(int i = LINK_SEC_SYMTAB; i < LINK_SEC_COUNT; ++i)
+	{
+		offset = elf_align(offset, sections[i].alignment);
+		sections[i].offset = offset;
+		offset += sections[i].size;
+	}
+	u64 section_header_offset = elf_align(offset, 8);
+
+	Elf_Header *header = (Elf_Header *)file;
+	header->section_header_offset    = section_header_offset;
+	header->number_of_sections       = LINK_SEC_COUNT;
+	header->section_name_table_index = LINK_SEC_SHSTRTAB;
+
+	Platform_Write_Chunk chunks[LINK_SEC_COUNT * 2 + 4];
+	u32 chunk_count = 0;
+	u64 at = 0;
+	push_file_chunk(chunks, &chunk_count, &at, 0, file, file_size);
+	for(int i = LINK_SEC_SYMTAB; i < LINK_SEC_COUNT; ++i)
+		push_file_chunk(chunks, &chunk_count, &at, sections[i].offset, contents[i], sections[i].size);
+	push_file_chunk(chunks, &chunk_count, &at, section_header_offset, sections, sizeof(sections));
+	return platform_write_file_chunks(chunks, chunk_count, out_path);
+}
+
+b32
+x64_link_executable(Code_Buffer code, Relocation *relocations, u32 relocation_count, Symbol_Descriptor *symbols,
+		const char *out_path)
+{
+	size_t symbol_count = SDCount(symbols);
+
+	i32 main_symbol = -1;
+	i32 exit_symbol = -1;
+	u64 rodata_size = 0;
+	u64 data_size = 0;
+	u64 bss_size = 0;
+	for(size_t i = 0; i < symbol_count; ++i)
+	{
+		u64 end = (u64)symbols[i].position + symbols[i].size;
+		switch(symbols[i].section)
+		{
+			case SEC_TEXT:
+			{
+				if(vstd_strcmp((char *)symbols[i].name, (char *)"main"))
+					main_symbol = i;
+			} break;
+			case SEC_UNDEFINED:
+			{
+				if(vstd_strcmp((char *)symbols[i].name, (char *)"exit"))
+					exit_symbol = i;
+			} break;
+			case SEC_RO_DATA: if(end > rodata_size) rodata_size = end; break;
+			case SEC_DATA:    if(end > data_size) data_size = end; break;
+			case SEC_BSS:     if(end > bss_size) bss_size = end; break;
+		}
+	}
+	if(main_symbol == -1)
+	{
+		LG_ERROR("There is no main function to link into an executable");
+		return false;
+	}
+
+	// @NOTE: only the functions that are referenced are imported, exit always is
+	// since _start calls it. import_of maps a symbol to its import
+	i32 *import_of = (i32 *)AllocateCompileMemory((symbol_count + 1) * sizeof(i32));
+	u8 **import_names = (u8 **)AllocateCompileMemory((symbol_count + 1) * sizeof(u8 *));
+	i32 import_count = 0;
+	for(size_t i = 0; i < symbol_count; ++i)
+		import_of[i] = -1;
+	for(u32 i = 0; i < relocation_count; ++i)
+	{
+		u32 idx = relocations[i].symbol_index;
+		Assert(idx < symbol_count);
+		if(symbols[idx].section == SEC_UNDEFINED && import_of[idx] == -1)
+		{
+			import_of[idx] = import_count;
+			import_names[import_count++] = symbols[idx].name;
+		}
+	}
+	i32 exit_import = exit_symbol != -1 ? import_of[exit_symbol] : -1;
+	if(exit_import == -1)
+	{
+		exit_import = import_count;
+		import_names[import_count++] = (u8 *)"exit";
+		if(exit_symbol != -1)
+			import_of[exit_symbol] = exit_import;
+	}
+
+	// report missing functions now instead of when the program is started
+	Platform_Dynamic_Lib libc = platform_load_dynamic_lib(link_libc);
+	if(libc)
+	{
+		b32 all_found = true;
+		for(i32 i = 0; i < import_count; ++i)
+		{
+			if(!platform_find_fn(libc, (char *)import_names[i]))
+			{
+				LG_ERROR("Undefined symbol %s, the builtin linker only imports from %s", import_names[i], link_libc);
+				all_found = false;
+			}
+		}
+		if(!all_found)
+			return false;
+	}
+
+	String_Table dynstr = {};
+	dynstr.strings = SDCreate(u8 *);
+	dynstr.size = 1;
+	u32 libc_name = elf_put_string(&dynstr, (u8 *)link_libc);
+	u32 *import_name_offsets = (u32 *)AllocateCompileMemory(import_count * sizeof(u32) + 1);
+	for(i32 i = 0; i < import_count; ++i)
+		import_name_offsets[i] = elf_put_string(&dynstr, import_names[i]);
+
+	// symbol 0 is the null symbol
+	u32 dynsym_count = import_count + 1;
+	u32 hash_size = (2 + 1 + dynsym_count) * sizeof(u32);
+	const u32 dynamic_count = 12;
+
+	// read only segment: headers, dynamic linking info and .rodata
+	u64 offset = sizeof(Elf_Header) + LINK_PH_COUNT * sizeof(Elf_Program_Header);
+	u64 interp_offset = offset;
+	u64 interp_size = vstd_strlen((char *)link_interpreter) + 1;
+	offset += interp_size;
+	offset = elf_align(offset, 8);
+	u64 hash_offset = offset;
+	offset += hash_size;
+	offset = elf_align(offset, 8);
+	u64 dynsym_offset = offset;
+	offset += dynsym_count * sizeof(Elf_Symbol);
+	u64 dynstr_offset = offset;
+	offset += dynstr.size;
+	offset = elf_align(offset, 8);
+	u64 rela_offset = offset;
+	offset += import_count * sizeof(Elf_Rela);
+	offset = elf_align(offset, 16);
+	u64 rodata_offset = offset;
+	offset += rodata_size;
+	u64 read_end = offset;
+
+	// code segment: _start, the program and a jmp [rip + got] for every import
+	u64 text_offset = elf_align(read_end, LINK_PAGE_SIZE);
+	u64 code_offset = text_offset + LINK_START_SIZE;
+	u64 stubs_offset = elf_align(code_offset + code.count, IMPORT_STUB_SIZE);
+	u64 text_end = stubs_offset + import_count * IMPORT_STUB_SIZE;
+
+	// writable segment: .dynamic, the GOT, .data and then .bss which isn't in the file
+	u64 rw_offset = elf_align(text_end, LINK_PAGE_SIZE);
+	u64 dynamic_offset = rw_offset;
+	u64 got_offset = dynamic_offset + dynamic_count * sizeof(Elf_Dynamic);
+	u64 data_offset = elf_align(got_offset + import_count * sizeof(u64), 16);
+	u64 file_size = data_offset + data_size;
+	u64 bss_offset = elf_align(file_size, 16);
+	u64 memory_end = bss_offset + bss_size;
+
+	u8 *file = (u8 *)AllocateCompileMemory(file_size);
+	memset(file, 0, file_size);
+
+	Elf_Header header = {};
+	header.ident[0] = 0x7F;
+	header.ident[1] = 'E';
+	header.ident[2] = 'L';
+	header.ident[3] = 'F';
+	header.ident[4] = 2; // 64 bit
+	header.ident[5] = 1; // little endian
+	header.ident[6] = 1; // current version
+	header.type                      = ELF_ET_EXEC;
+	header.machine                   = ELF_EM_X86_64;
+	header.version                   = 1;
+	header.entry                     = LINK_BASE_ADDRESS + text_offset;
+	header.program_header_offset     = sizeof(Elf_Header);
+	header.header_size               = sizeof(Elf_Header);
+	header.program_header_size       = sizeof(Elf_Program_Header);
+	header.number_of_program_headers = LINK_PH_COUNT;
+	header.section_header_size       = sizeof(Elf_Section_Header);
+	memcpy(file, &header, sizeof(Elf_Header));
+
+	Elf_Program_Header program_headers[LINK_PH_COUNT] = {};
+	program_headers[LINK_PH_INTERP].type      = ELF_PT_INTERP;
+	program_headers[LINK_PH_INTERP].flags     = ELF_PF_R;
+	program_headers[LINK_PH_INTERP].offset    = interp_offset;
+	program_headers[LINK_PH_INTERP].file_size = interp_size;
+	program_headers[LINK_PH_INTERP].alignment = 1;
+
+	program_headers[LINK_PH_READ].type      = ELF_PT_LOAD;
+	program_headers[LINK_PH_READ].flags     = ELF_PF_R;
+	program_headers[LINK_PH_READ].offset    = 0;
+	program_headers[LINK_PH_READ].file_size = read_end;
+
+	program_headers[LINK_PH_CODE].type      = ELF_PT_LOAD;
+	program_headers[LINK_PH_CODE].flags     = ELF_PF_R | ELF_PF_X;
+	program_headers[LINK_PH_CODE].offset    = text_offset;
+	program_headers[LINK_PH_CODE].file_size = text_end - text_offset;
+
+	program_headers[LINK_PH_DATA].type        = ELF_PT_LOAD;
+	program_headers[LINK_PH_DATA].flags       = ELF_PF_R | ELF_PF_W;
+	program_headers[LINK_PH_DATA].offset      = rw_offset;
+	program_headers[LINK_PH_DATA].file_size   = file_size - rw_offset;
+	program_headers[LINK_PH_DATA].memory_size = memory_end - rw_offset;
+
+	program_headers[LINK_PH_DYNAMIC].type      = ELF_PT_DYNAMIC;
+	program_headers[LINK_PH_DYNAMIC].flags     = ELF_PF_R | ELF_PF_W;
+	program_headers[LINK_PH_DYNAMIC].offset    = dynamic_offset;
+	program_headers[LINK_PH_DYNAMIC].file_size = dynamic_count * sizeof(Elf_Dynamic);
+	program_headers[LINK_PH_DYNAMIC].alignment = 8;
+
+	program_headers[LINK_PH_STACK].type  = ELF_PT_GNU_STACK;
+	program_headers[LINK_PH_STACK].flags = ELF_PF_R | ELF_PF_W;
+
+	for(int i = 0; i < LINK_PH_COUNT; ++i)
+	{
+		Elf_Program_Header *ph = &program_headers[i];
+		if(ph->type == ELF_PT_GNU_STACK)
+			continue;
+		ph->virtual_address = LINK_BASE_ADDRESS + ph->offset;
+		ph->physical_address = ph->virtual_address;
+		if(ph->memory_size == 0)
+			ph->memory_size = ph->file_size;
+		if(ph->type == ELF_PT_LOAD)
+			ph->alignment = LINK_PAGE_SIZE;
+	}
+	memcpy(file + sizeof(Elf_Header), program_headers, sizeof(program_headers));
+
+	memcpy(file + interp_offset, link_interpreter, interp_size);
+
+	// a single bucket, the chain walks every symbol down to the null one
+	u32 *hash = (u32 *)(file + hash_offset);
+	hash[0] = 1;
+	hash[1] = dynsym_count;
+	hash[2] = dynsym_count - 1;
+	for(u32 i = 1; i < dynsym_count; ++i)
+		hash[3 + i] = i - 1;
+
+	Elf_Symbol *dynsym = (Elf_Symbol *)(file + dynsym_offset);
+	for(i32 i = 0; i < import_count; ++i)
+	{
+		Elf_Symbol sym = {};
+		sym.name = import_name_offsets[i];
+		sym.info = (ELF_STB_GLOBAL << 4) | ELF_STT_FUNC;
+		memcpy(&dynsym[i + 1], &sym, sizeof(Elf_Symbol));
+	}
+	elf_write_string_table(file + dynstr_offset, &dynstr);
+
+	Elf_Rela *rela = (Elf_Rela *)(file + rela_offset);
+	for(i32 i = 0; i < import_count; ++i)
+	{
+		Elf_Rela entry = {};
+		entry.offset = LINK_BASE_ADDRESS + got_offset + i * sizeof(u64);
+		entry.info   = ((u64)(i + 1) << 32) | ELF_R_X86_64_GLOB_DAT;
+		memcpy(&rela[i], &entry, sizeof(Elf_Rela));
+	}
+
+	for(size_t i = 0; i < symbol_count; ++i)
+	{
+		Symbol_Descriptor *sym = &symbols[i];
+		if(sym->section == SEC_RO_DATA)
+		{
+			u8 *to = file + rodata_offset + sym->position;
+			if(sym->type == OBJ_STRING)
+				memcpy(to, (u8 *)sym->value, sym->size);
+			else
+				memcpy(to, &sym->value, sym->size);
+		}
+		else if(sym->section == SEC_DATA)
+		{
+			memcpy(file + data_offset + sym->position, (u8 *)sym->value, sym->size);
+		}
+	}
+
+	Elf_Dynamic dynamic[dynamic_count] = {
+		{ ELF_DT_NEEDED,   libc_name },
+		{ ELF_DT_HASH,     LINK_BASE_ADDRESS + hash_offset },
+		{ ELF_DT_STRTAB,   LINK_BASE_ADDRESS + dynstr_offset },
+		{ ELF_DT_SYMTAB,   LINK_BASE_ADDRESS + dynsym_offset },
+		{ ELF_DT_STRSZ,    dynstr.size },
+		{ ELF_DT_SYMENT,   sizeof(Elf_Symbol) },
+		{ ELF_DT_RELA,     LINK_BASE_ADDRESS + rela_offset },
+		{ ELF_DT_RELASZ,   import_count * sizeof(Elf_Rela) },
+		{ ELF_DT_RELAENT,  sizeof(Elf_Rela) },
+		{ ELF_DT_BIND_NOW, 0 },
+		{ ELF_DT_DEBUG,    0 },
+		{ ELF_DT_NULL,     0 },
+	};
+	memcpy(file + dynamic_offset, dynamic, sizeof(dynamic));
+
+	u64 code_address = LINK_BASE_ADDRESS + code_offset;
+	u64 stubs_address = LINK_BASE_ADDRESS + stubs_offset;
+	memcpy(file + code_offset, code.buffer, code.count);
+	for(u32 i = 0; i < relocation_count; ++i)
+	{
+		Relocation reloc = relocations[i];
+		Symbol_Descriptor *sym = &symbols[reloc.symbol_index];
+		u64 target = 0;
+		switch(sym->section)
+		{
+			case SEC_UNDEFINED: target = stubs_address + import_of[reloc.symbol_index] * IMPORT_STUB_SIZE; break;
+			case SEC_TEXT:      target = code_address + sym->position; break;
+			case SEC_RO_DATA:   target = LINK_BASE_ADDRESS + rodata_offset + sym->position; break;
+			case SEC_DATA:      target = LINK_BASE_ADDRESS + data_offset + sym->position; break;
+			case SEC_BSS:       target = LINK_BASE_ADDRESS + bss_offset + sym->position; break;
+		}
+		link_write_rel32(file + code_offset + reloc.offset, code_address + reloc.offset, target);
+	}
+
+	u8 *start = file + text_offset;
+	u64 start_address = LINK_BASE_ADDRESS + text_offset;
+	memcpy(start, link_start_code, sizeof(link_start_code));
+	memset(start + sizeof(link_start_code), 0xCC, LINK_START_SIZE - sizeof(link_start_code));
+	link_write_rel32(start + LINK_START_CALL_MAIN, start_address + LINK_START_CALL_MAIN,
+			code_address + symbols[main_symbol].position);
+	link_write_rel32(start + LINK_START_CALL_EXIT, start_address + LINK_START_CALL_EXIT,
+			stubs_address + exit_import * IMPORT_STUB_SIZE);
+
+	for(i32 i = 0; i < import_count; ++i)
+	{
+		u8 *stub = file + stubs_offset + i * IMPORT_STUB_SIZE;
+		u64 stub_address = stubs_address + i * IMPORT_STUB_SIZE;
+		stub[0] = 0xFF;
+		stub[1] = 0x25;
+		link_write_rel32(stub + 2, stub_address + 2, LINK_BASE_ADDRESS + got_offset + i * sizeof(u64));
+		stub[6] = 0xCC;
+		stub[7] = 0xCC;
+	}
+
+	X64_Debug_Info *debug = x64_get_debug_info();
+	b32 written = debug ? link_write_with_debug_info(file, file_size, debug, text_offset, text_end, code_offset, out_path) :
+		platform_write_file(file, file_size, out_path, true);
+	if(!written)
+	{
+		LG_ERROR("Couldn't write the executable %s", out_path);
+		return false;
+	}
+	if(!platform_mark_executable(out_path))
+	{
+		LG_ERROR("Couldn't make %s executable", out_path);
+		return false;
+	}
+	return true;
+}
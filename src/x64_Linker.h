@@ -0,0 +1,31 @@
+#ifndef _X64_LINKER_H
+#define _X64_LINKER_H
+#include <Basic.h>
+#include <x64_Gen.h>
+
+#pragma pack(push, 1)
+struct Elf_Program_Header {
+	u32 type;
+	u32 flags;
+	u64 offset;
+	u64 virtual_address;
+	u64 physical_address;
+	u64 file_size;
+	u64 memory_size;
+	u64 alignment;
+};
+
+struct Elf_Dynamic {
+	i64 tag;
+	u64 value;
+};
+#pragma pack(pop)
+
+// @NOTE: links the fast backend's output straight into a dynamically linked
+// ELF executable without writing an object file. Functions without a body are
+// imported from libc, a small _start calls main and then exit. Linux only
+b32
+x64_link_executable(Code_Buffer code, Relocation *relocations, u32 relocation_count, Symbol_Descriptor *symbols,
+		const char *out_path);
+
+#endif
@@ -0,0 +1,170 @@
+#include <x64_Loader.h>
+#include <platform/platform.h>
+
+// @NOTE: jmp [rip + 0] followed by the absolute address, padded to 16
+#define FAR_JUMP_STUB_SIZE 16
+
+static b32 perf_map_enabled = false;
+static char *perf_map_path;
+
+static inline u32
+align_to(u32 value, u32 alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+b32
+x64_load_code(Code_Buffer code, Relocation *relocations, u32 relocation_count, Symbol_Descriptor *symbols,
+		Symbol_Resolver resolve, Loaded_Code *out)
+{
+	size_t symbol_count = SDCount(symbols);
+	i64 *symbol_offsets = (i64 *)AllocateCompileMemory(symbol_count * sizeof(i64));
+	void **far_addresses = (void **)AllocateCompileMemory(symbol_count * sizeof(void *));
+	for(size_t i = 0; i < symbol_count; ++i)
+		symbol_offsets[i] = -1;
+
+	u32 data_start = align_to(code.count, 16);
+	u32 data_size = 0;
+	u32 stub_count = 0;
+
+	// @NOTE: only the symbols that are actually referenced get a place,
+	// the symbol array is shared by every function we've generated
+	for(u32 i = 0; i < relocation_count; ++i)
+	{
+		Relocation reloc = relocations[i];
+		if(reloc.type != IMAGE_REL_AMD64_REL32)
+		{
+			LG_ERROR("Unsupported relocation type %d in loaded code", reloc.type);
+			return false;
+		}
+		if(reloc.symbol_index >= symbol_count)
+		{
+			LG_ERROR("Relocation references an invalid symbol %d", reloc.symbol_index);
+			return false;
+		}
+
+		u32 idx = reloc.symbol_index;
+		if(symbol_offsets[idx] != -1 || far_addresses[idx])
+			continue;
+
+		Symbol_Descriptor *sym = &symbols[idx];
+		void *resolved = resolve ? resolve(sym) : NULL;
+		if(resolved)
+		{
+			far_addresses[idx] = resolved;
+			stub_count++;
+			continue;
+		}
+
+		switch(sym->section)
+		{
+			case SEC_TEXT:
+			{
+				symbol_offsets[idx] = sym->position;
+			} break;
+			case SEC_RO_DATA:
+			{
+				data_size = align_to(data_size, sym->size >= 16 ? 16 : 8);
+				symbol_offsets[idx] = data_start + data_size;
+				data_size += sym->size;
+			} break;
+			default:
+			{
+				LG_ERROR("Couldn't resolve symbol %s for loaded code", sym->name);
+				return false;
+			} break;
+		}
+	}
+
+	u32 stub_start = align_to(data_start + data_size, 16);
+	u32 total_size = stub_start + stub_count * FAR_JUMP_STUB_SIZE;
+	u8 *memory = (u8 *)platform_allocate_executable_memory(total_size);
+	if(!memory)
+		return false;
+
+	memcpy(memory, code.buffer, code.count);
+
+	u32 stub_at = stub_start;
+	for(size_t i = 0; i < symbol_count; ++i)
+	{
+		if(far_addresses[i])
+		{
+			u8 *stub = memory + stub_at;
+			stub[0] = 0xFF;
+			stub[1] = 0x25;
+			memset(stub + 2, 0, 4);
+			memcpy(stub + 6, &far_addresses[i], sizeof(void *));
+			symbol_offsets[i] = stub_at;
+			stub_at += FAR_JUMP_STUB_SIZE;
+		}
+		else if(symbol_offsets[i] != -1 && symbols[i].section == SEC_RO_DATA)
+		{
+			if(symbols[i].type == OBJ_STRING)
+				memcpy(memory + symbol_offsets[i], (u8 *)symbols[i].value, symbols[i].size);
+			else
+				memcpy(memory + symbol_offsets[i], &symbols[i].value, symbols[i].size);
+		}
+	}
+
+	// rel32 displacements are from the end of the 4 byte field
+	for(u32 i = 0; i < relocation_count; ++i)
+	{
+		Relocation reloc = relocations[i];
+		i64 displacement = symbol_offsets[reloc.symbol_index] - ((i64)reloc.offset + 4);
+		i32 displacement32 = (i32)displacement;
+		memcpy(memory + reloc.offset, &displacement32, sizeof(i32));
+	}
+
+	out->memory = memory;
+	out->size = total_size;
+	out->symbols = symbols;
+	return true;
+}
+
+void
+x64_set_perf_map(b32 enable)
+{
+	perf_map_enabled = enable;
+}
+
+static char *
+perf_map_hex(char *at, u64 value)
+{
+	char digits[16];
+	int count = 0;
+	do {
+		digits[count++] = "0123456789abcdef"[value & 0xF];
+		value >>= 4;
+	} while(value);
+	while(count)
+		*at++ = digits[--count];
+	return at;
+}
+
+void
+x64_perf_map_function(void *start, u32 size, u8 *name)
+{
+#if !defined(_WIN32)
+	if(!perf_map_enabled)
+		return;
+	// a map left by an earlier process with the same pid is replaced
+	b32 is_first = perf_map_path == NULL;
+	if(is_first)
+	{
+		perf_map_path = (char *)AllocatePermanentMemory(64);
+		vstd_sprintf(perf_map_path, "/tmp/perf-%d.map", (int)platform_get_process_id());
+	}
+
+	size_t name_len = vstd_strlen((char *)name);
+	char *line = (char *)AllocateCompileMemory(name_len + 64);
+	char *at = perf_map_hex(line, (u64)start);
+	*at++ = ' ';
+	at = perf_map_hex(at, size);
+	*at++ = ' ';
+	memcpy(at, name, name_len);
+	at += name_len;
+	*at++ = '\n';
+	if(!platform_write_file(line, at - line, perf_map_path, is_first))
+		LG_WARN("Couldn't write to %s", perf_map_path);
+#endif
+}
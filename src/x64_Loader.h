@@ -0,0 +1,32 @@
+
+#ifndef _X64_LOADER_H
+#define _X64_LOADER_H
+#include <Basic.h>
+#include <x64_Gen.h>
+
+// @NOTE: code, then the read only data it references, then jump stubs for
+// symbols outside of the loaded memory, all in one executable allocation
+struct Loaded_Code {
+	u8 *memory;
+	u32 size;
+	Symbol_Descriptor *symbols;
+};
+
+// @NOTE: returns the in process address of a symbol or NULL if the loader
+// should handle it itself
+typedef void *(*Symbol_Resolver)(Symbol_Descriptor *symbol);
+
+b32
+x64_load_code(Code_Buffer code, Relocation *relocations, u32 relocation_count, Symbol_Descriptor *symbols,
+		Symbol_Resolver resolve, Loaded_Code *out);
+
+void
+x64_set_perf_map(b32 enable);
+
+// @NOTE: perf names code in anonymous memory with /tmp/perf-<pid>.map,
+// one "start size name" line in hex per function. Nothing on windows
+void
+x64_perf_map_function(void *start, u32 size, u8 *name);
+
+#endif
+
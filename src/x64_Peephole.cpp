@@ -0,0 +1,303 @@
+#include <x64_Peephole.h>
+#include <Optimizer.h>
+#include <platform/platform.h>
+
+static Peephole_Rule_Info peephole_rules[PEEP_RULE_COUNT] = {
+	{"self move",           "mov a, a -> nothing"},
+	{"move back",           "mov a, b; mov b, a -> mov a, b"},
+	{"overwritten def",     "mov a, x; mov a, y -> mov a, y"},
+	{"store reload",        "mov [s], a; mov b, [s] -> mov [s], a; mov b, a"},
+	{"push pop",            "push a; pop b -> mov b, a"},
+	{"fold constant cast",  "mov a, imm; movzx/movsx/trunc a, a -> mov a, cast(imm)"},
+	{"narrow self trunc",   "mov al, al -> nothing"},
+	{"inverted branch",     "jcc next; jmp other; next: -> jncc other"},
+	{"zero idiom",          "mov a, 0 -> xor a32, a32"},
+	{"short immediate",     "mov r64, imm64 -> mov r32, imm32 / mov r64, simm32"},
+};
+
+static inline void
+peephole_hit(Peephole_Rule rule)
+{
+	// functions are generated on the thread pool
+	platform_interlocked_add64(&peephole_rules[rule].hits, 1);
+}
+
+b32
+x64_peephole_enabled()
+{
+	return get_bc_optimization() >= OPT_SOME;
+}
+
+// values that live in a general purpose register, the encoder's
+// hacks for strings and arrays are left alone
+static b32
+is_gpr_type(Type_Info *type)
+{
+	if(is_vector(*type))
+		return false;
+	switch(type->type)
+	{
+		case T_INTEGER:
+		case T_UNTYPED_INTEGER:
+		case T_POINTER:
+		case T_FUNC:
+		case T_BOOLEAN:
+		return true;
+		default:
+		return false;
+	}
+}
+
+static i32
+peephole_next(IR_Block *block, i32 bc_idx)
+{
+	for(i32 i = bc_idx + 1; i < block->bc_count; ++i)
+	{
+		if(block->bc[i].op != BC_NO_OP)
+			return i;
+	}
+	return -1;
+}
+
+static u64
+truncate_to_size(u64 value, i32 size)
+{
+	if(size >= 8)
+		return value;
+	return value & ((1ull << (size * 8)) - 1);
+}
+
+static u64
+sign_extend_from_size(u64 value, i32 size)
+{
+	if(size >= 8)
+		return value;
+	i32 shift = 64 - size * 8;
+	return (u64)((i64)(value << shift) >> shift);
+}
+
+// instructions that only write their result register
+static b32
+is_plain_def(Bytecode *bc)
+{
+	switch(bc->op)
+	{
+		case BC_MOVE_REG_TO_REG:
+		case BC_MOVE_VALUE_TO_REG:
+		case BC_MOVE_FUNCTION_TO_REG:
+		case BC_LOAD_STACK:
+		case BC_LOAD_ADDRESS:
+		case BC_GLOBAL_ADDRESS:
+		case BC_LOAD_DATA_SEG:
+		return is_gpr_type(bc->type);
+		default:
+		return false;
+	}
+}
+
+static b32
+peephole_single(Bytecode *bc)
+{
+	if(bc->op == BC_MOVE_REG_TO_REG && bc->left_idx == bc->right_idx)
+	{
+		bc->op = BC_NO_OP;
+		peephole_hit(PEEP_SELF_MOVE);
+		return true;
+	}
+	// an 8 or 16 bit move doesn't touch the rest of the register
+	if(bc->op == BC_CAST_TRUNC && bc->left_idx == bc->result && is_gpr_type(bc->type) &&
+			get_type_size(*bc->type) <= 2)
+	{
+		bc->op = BC_NO_OP;
+		peephole_hit(PEEP_NARROW_SELF_TRUNC);
+		return true;
+	}
+	return false;
+}
+
+static b32
+peephole_pair(Bytecode *a, Bytecode *b)
+{
+	if(a->op == BC_PUSH_REG && b->op == BC_POP_REG)
+	{
+		if(a->left_idx != b->left_idx)
+		{
+			Type_Info *type = a->type;
+			i32 from = a->left_idx;
+			i32 to = b->left_idx;
+			b->op = BC_MOVE_REG_TO_REG;
+			b->type = type;
+			b->left_idx = to;
+			b->right_idx = from;
+			b->result = to;
+		}
+		else
+			b->op = BC_NO_OP;
+		a->op = BC_NO_OP;
+		peephole_hit(PEEP_PUSH_POP);
+		return true;
+	}
+
+	if(a->op == BC_MOVE_REG_TO_REG && b->op == BC_MOVE_REG_TO_REG &&
+			a->left_idx == b->right_idx && a->right_idx == b->left_idx)
+	{
+		// a 32 bit move clears the upper half so moving it back isn't a no op
+		b32 same_class = is_gpr_type(a->type) ?
+			is_gpr_type(b->type) && get_type_size(*a->type) == 8 && get_type_size(*b->type) == 8 :
+			(is_float(*a->type) || is_vector(*a->type)) && a->type->type == b->type->type &&
+			get_type_size(*a->type) == get_type_size(*b->type);
+		if(same_class)
+		{
+			b->op = BC_NO_OP;
+			peephole_hit(PEEP_MOVE_BACK);
+			return true;
+		}
+	}
+
+	// the second write has to cover the whole register, 32 bit writes zero extend
+	if(is_plain_def(a) && is_plain_def(b) && a->result == b->result && get_type_size(*b->type) >= 4 &&
+			!(b->op == BC_MOVE_REG_TO_REG && b->right_idx == a->result))
+	{
+		a->op = BC_NO_OP;
+		peephole_hit(PEEP_OVERWRITTEN_DEF);
+		return true;
+	}
+
+	if((a->op == BC_STORE || a->op == BC_STORE_NON_REMOVABLE) && b->op == BC_LOAD_STACK &&
+			a->left_idx == b->right_idx && is_gpr_type(a->type) && is_gpr_type(b->type) &&
+			get_type_size(*a->type) == 8 && get_type_size(*b->type) == 8)
+	{
+		i32 stored = a->right_idx;
+		i32 loaded = b->result;
+		if(stored == loaded)
+			b->op = BC_NO_OP;
+		else
+		{
+			b->op = BC_MOVE_REG_TO_REG;
+			b->left_idx = loaded;
+			b->right_idx = stored;
+		}
+		peephole_hit(PEEP_STORE_RELOAD);
+		return true;
+	}
+
+	if(a->op == BC_MOVE_VALUE_TO_REG && is_gpr_type(a->type) &&
+			(b->op == BC_CAST_TRUNC || b->op == BC_CAST_ZEXT || b->op == BC_CAST_SEXT) &&
+			b->left_idx == a->result && b->result == a->result && b->type->type == T_INTEGER && !is_vector(*b->type))
+	{
+		i32 to_size = get_type_size(*b->type);
+		u64 value = a->big_idx;
+		if(b->op != BC_CAST_TRUNC)
+		{
+			Type_Info *src_type = (Type_Info *)((u8 *)b->type + b->right_idx);
+			i32 from_size = get_type_size(*src_type);
+			value = b->op == BC_CAST_SEXT ? sign_extend_from_size(value, from_size) : truncate_to_size(value, from_size);
+		}
+		a->big_idx = truncate_to_size(value, to_size);
+		a->type = b->type;
+		b->op = BC_NO_OP;
+		peephole_hit(PEEP_FOLD_CONSTANT_CAST);
+		return true;
+	}
+	return false;
+}
+
+void
+x64_peephole_block(IR_Block *block)
+{
+	if(!x64_peephole_enabled())
+		return;
+
+	// a rewrite can make a new pair with the instruction before it
+	b32 changed = true;
+	while(changed)
+	{
+		changed = false;
+		for(i32 i = 0; i < block->bc_count; ++i)
+		{
+			Bytecode *bc = &block->bc[i];
+			if(bc->op == BC_NO_OP)
+				continue;
+			if(peephole_single(bc))
+			{
+				changed = true;
+				continue;
+			}
+			i32 next = peephole_next(block, i);
+			if(next != -1 && peephole_pair(bc, &block->bc[next]))
+				changed = true;
+		}
+	}
+}
+
+Bytecode *
+x64_peephole_inverted_branch(IR_Block *block, i32 bc_idx, IR_Block *fallthrough)
+{
+	if(!x64_peephole_enabled() || !fallthrough)
+		return NULL;
+	Bytecode *cond_jump = &block->bc[bc_idx];
+	if((IR_Block *)cond_jump->big_idx != fallthrough)
+		return NULL;
+	i32 next = peephole_next(block, bc_idx);
+	if(next == -1 || block->bc[next].op != BC_JUMP)
+		return NULL;
+	peephole_hit(PEEP_INVERTED_BRANCH);
+	return &block->bc[next];
+}
+
+b32
+x64_peephole_move_value(Code_Buffer *buffer, Register reg, u64 value, Type_Info *type)
+{
+	if(!x64_peephole_enabled() || !is_gpr_type(type))
+		return false;
+
+	i32 size = get_type_size(*type);
+	value = truncate_to_size(value, size);
+	u8 prefix = fix_register(reg);
+	// mov r8, imm8 is as short as the xor already
+	if(value == 0 && size >= 2)
+	{
+		// xor r32, r32 doesn't read the register, the flags aren't live
+		// between instructions, a jump's compare is fused with it
+		if(prefix)
+			push_byte(buffer, REX_R | REX_B);
+		push_byte(buffer, 0x31);
+		push_byte(buffer, encode_postfix(MOD_register, reg, reg));
+		peephole_hit(PEEP_ZERO_IDIOM);
+		return true;
+	}
+	if(size != 8)
+		return false;
+
+	if(value <= 0xFFFFFFFF)
+	{
+		// writing the 32 bit register clears the upper half
+		if(prefix)
+			push_byte(buffer, prefix);
+		push_byte(buffer, 0xB8 | reg);
+		push_i32(buffer, (i32)value);
+		peephole_hit(PEEP_SHORT_IMMEDIATE);
+		return true;
+	}
+	if((i64)value == (i64)(i32)value)
+	{
+		// mov r/m64, imm32 sign extends
+		push_byte(buffer, REX_W | prefix);
+		push_byte(buffer, 0xC7);
+		push_byte(buffer, encode_postfix(MOD_register, 0, reg));
+		push_i32(buffer, (i32)value);
+		peephole_hit(PEEP_SHORT_IMMEDIATE);
+		return true;
+	}
+	return false;
+}
+
+void
+x64_print_peephole_report()
+{
+	for(i32 i = 0; i < PEEP_RULE_COUNT; ++i)
+	{
+		Peephole_Rule_Info *rule = &peephole_rules[i];
+		LG_INFO("%s: %llu hits (%s)", rule->name, rule->hits, rule->rewrite);
+	}
+}
@@ -0,0 +1,51 @@
+#ifndef _X64_PEEPHOLE_H
+#define _X64_PEEPHOLE_H
+#include <Basic.h>
+#include <Bytecode.h>
+#include <x64_Gen.h>
+
+enum Peephole_Rule {
+	PEEP_SELF_MOVE,
+	PEEP_MOVE_BACK,
+	PEEP_OVERWRITTEN_DEF,
+	PEEP_STORE_RELOAD,
+	PEEP_PUSH_POP,
+	PEEP_FOLD_CONSTANT_CAST,
+	PEEP_NARROW_SELF_TRUNC,
+	PEEP_INVERTED_BRANCH,
+	PEEP_ZERO_IDIOM,
+	PEEP_SHORT_IMMEDIATE,
+
+	PEEP_RULE_COUNT
+};
+
+struct Peephole_Rule_Info {
+	const char *name;
+	const char *rewrite;
+	u64 hits;
+};
+
+b32
+x64_peephole_enabled();
+
+// @NOTE: runs on a block after register allocation, right before it's encoded.
+// Instructions only ever get rewritten in place or turned into BC_NO_OP so the
+// block keeps its size and the flags compare of a jump stays where it is
+void
+x64_peephole_block(IR_Block *block);
+
+// Returns the jump that ends the block when the conditional jump at bc_idx goes
+// to the block right after it, the caller jumps to the other target on the
+// inverted condition instead and drops the returned jump
+Bytecode *
+x64_peephole_inverted_branch(IR_Block *block, i32 bc_idx, IR_Block *fallthrough);
+
+// Picks a shorter encoding than mov reg, imm64 when the value allows it,
+// returns false when the regular move has to be emitted
+b32
+x64_peephole_move_value(Code_Buffer *buffer, Register reg, u64 value, Type_Info *type);
+
+void
+x64_print_peephole_report();
+
+#endif